@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+/*
+ *region allocator for per-command memory. verify is the one user: its variable and
+ *update banks (new_secvar/alloc_secvar through arenaUseForSecvars) and the default
+ *variable paths of getCurrentVars come from one arena that is released at the end.
+ *The rest stays on the heap:
+ *	- printReadable and audit decode on worker threads, an arena is not thread safe
+ *	- x509 contexts are shared through the certificate cache and outlive a command
+ *	- the scratch of edk2_compat_process (certificate copies, error buffers) is freed
+ *	  as it goes, and verify_signature_parallel allocates it on worker threads
+ *	- mbedtls frees and reuses its temporaries many times per signature check, an
+ *	  arena would only grow where the heap reuses the memory
+ *	- read, write and validate create one secvar per variable and free it right away
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "err.h"
+#include "prlog.h"
+#include "arena.h"
+#include "external/skiboot/include/secvar.h" // for secvar_set_allocator
+
+#define ARENA_ALIGN 16
+
+struct arenaChunk {
+	struct arenaChunk *next;
+	size_t size, used;
+	// keep data aligned for any type
+	union {
+		long double ld;
+		void *ptr;
+		uint64_t u64;
+		unsigned char bytes[1];
+	} data[];
+};
+
+// the arena currently installed as allocator for secvars, if any
+static struct arena *secvarArena;
+
+static struct arenaChunk *newChunk(size_t size)
+{
+	struct arenaChunk *chunk;
+
+	chunk = calloc(1, sizeof(*chunk) + size);
+	if (!chunk)
+		return NULL;
+	chunk->size = size;
+
+	return chunk;
+}
+
+/**
+ *creates an arena
+ *@param chunkSize size of the blocks the arena hands out memory from, 0 for ARENA_DEFAULT_CHUNK
+ *@return new arena or NULL if allocation fails
+ */
+struct arena *arenaCreate(size_t chunkSize)
+{
+	struct arena *a;
+
+	a = calloc(1, sizeof(*a));
+	if (!a) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return NULL;
+	}
+	a->chunkSize = chunkSize ? chunkSize : ARENA_DEFAULT_CHUNK;
+
+	return a;
+}
+
+/**
+ *allocates zeroed memory from an arena, requests larger than the chunk size get
+ *their own chunk
+ *@param a arena
+ *@param size number of bytes
+ *@return pointer aligned to ARENA_ALIGN or NULL if allocation fails
+ */
+void *arenaAlloc(struct arena *a, size_t size)
+{
+	struct arenaChunk *chunk = a->chunks;
+	size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	void *ret;
+
+	if (need < size)
+		return NULL;
+	if (!chunk || chunk->size - chunk->used < need) {
+		chunk = newChunk(need > a->chunkSize ? need : a->chunkSize);
+		if (!chunk) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			return NULL;
+		}
+		// oversized chunks go behind the current one so its free space is not lost
+		if (a->chunks && need > a->chunkSize) {
+			chunk->next = a->chunks->next;
+			a->chunks->next = chunk;
+		}
+		else {
+			chunk->next = a->chunks;
+			a->chunks = chunk;
+		}
+	}
+	ret = chunk->data->bytes + chunk->used;
+	chunk->used += need;
+	a->allocated += need;
+
+	return ret;
+}
+
+/**
+ *calloc with memory from an arena
+ *@param a arena
+ *@param count number of elements
+ *@param size size of one element
+ *@return zeroed memory or NULL if allocation fails or count * size overflows
+ */
+void *arenaCalloc(struct arena *a, size_t count, size_t size)
+{
+	if (size && count > SIZE_MAX / size)
+		return NULL;
+
+	return arenaAlloc(a, count * size);
+}
+
+/**
+ *@param a arena
+ *@param str string to copy
+ *@return copy of str allocated from a or NULL if allocation fails
+ */
+char *arenaStrdup(struct arena *a, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ret;
+
+	ret = arenaAlloc(a, len);
+	if (ret)
+		memcpy(ret, str, len);
+
+	return ret;
+}
+
+/**
+ *releases everything allocated from an arena but keeps one chunk for reuse
+ *@param a arena
+ */
+void arenaReset(struct arena *a)
+{
+	struct arenaChunk *chunk, *next, *keep = NULL;
+
+	for (chunk = a->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		if (!keep && chunk->size == a->chunkSize) {
+			keep = chunk;
+			continue;
+		}
+		free(chunk);
+	}
+	if (keep) {
+		memset(keep->data, 0, keep->used);
+		keep->used = 0;
+		keep->next = NULL;
+	}
+	a->chunks = keep;
+	a->allocated = 0;
+}
+
+/**
+ *releases an arena and everything allocated from it, it must not be installed with
+ *arenaUseForSecvars anymore
+ *@param a arena, may be NULL
+ */
+void arenaDestroy(struct arena *a)
+{
+	struct arenaChunk *chunk, *next;
+
+	if (!a)
+		return;
+	for (chunk = a->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	free(a);
+}
+
+static void *secvarArenaZalloc(size_t size)
+{
+	return secvarArena ? arenaAlloc(secvarArena, size) : calloc(1, size);
+}
+
+// everything freed while the arena is installed was allocated from it, the arena
+// releases it, so nothing has to look up where ptr came from
+static void secvarArenaFree(void *ptr)
+{
+	(void)ptr;
+}
+
+/**
+ *makes new_secvar/alloc_secvar allocate from an arena, every bank built while it is
+ *installed must be cleared before it is uninstalled, and no secvar allocated before
+ *it is installed may be freed while it is
+ *@param a arena or NULL to go back to calloc/free
+ *@return SUCCESS or ALLOC_FAIL if another arena is already installed
+ */
+int arenaUseForSecvars(struct arena *a)
+{
+	if (a && secvarArena)
+		return ALLOC_FAIL;
+	secvarArena = a;
+	if (a)
+		secvar_set_allocator(secvarArenaZalloc, secvarArenaFree);
+	else
+		secvar_set_allocator(NULL, NULL);
+
+	return SUCCESS;
+}
@@ -22,8 +22,45 @@
  */
 int evfs_readFileFromSecVar(const char *path, const char *variable, int hrFlag)
 {
-	int rc, i;
+	int rc;
 	struct secvar *var = NULL;
+
+	rc = evfs_readSecVar(&var, path, variable);
+	if (rc) {
+		goto out;
+	}
+	if (hrFlag) {
+		if (var->data_size == 0) {
+			printf("%s is empty\n", var->key);
+			rc = SUCCESS;
+		}
+		else
+			rc = printReadable(var->data, var->data_size, var->key);
+
+		if (rc)
+			prlog(PR_WARNING, "ERROR: Could not parse file, continuing...\n");
+	}
+	else {
+		printRaw(var->data, var->data_size);
+		rc = SUCCESS;
+	}
+	
+out:
+	dealloc_secvar(var);
+	
+	return rc;
+}
+
+/**
+ *gets the secvar struct of a variable in efivarfs
+ *@param var , returned secvar, needs to be deallocated
+ *@param path , the path to the variables with ending '/'
+ *@param variable , variable name one of {db,dbx,KEK,PK}
+ *@return SUCCESS or error number
+ */
+int evfs_readSecVar(struct secvar **var, const char *path, const char *variable)
+{
+	int rc, i;
 	char *fullPath = NULL;
 	char *rename = NULL;
 
@@ -38,7 +75,7 @@ int evfs_readFileFromSecVar(const char *path, const char *variable, int hrFlag)
 		return INVALID_VAR_NAME;
 	}
 
-	fullPath = malloc(strlen(path) + strlen(rename));
+	fullPath = malloc(strlen(path) + strlen(rename) + 1);
 	if (!fullPath) { 
 		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
 		return ALLOC_FAIL;
@@ -47,32 +84,48 @@ int evfs_readFileFromSecVar(const char *path, const char *variable, int hrFlag)
 	strcpy(fullPath, path);
 	strcat(fullPath, rename);
 
-	rc = getEVFSSecVar(&var, variable, fullPath);
+	rc = getEVFSSecVar(var, variable, fullPath);
 	
 	free(fullPath);
 
-	if (rc) {
-		goto out;
-	}
-	if (hrFlag) {
-		if (var->data_size == 0) {
-			printf("%s is empty\n", var->key);
-			rc = SUCCESS;
-		}
-		else
-			rc = printReadable(var->data, var->data_size, var->key);
+	return rc;
+}
 
-		if (rc)
-			prlog(PR_WARNING, "ERROR: Could not parse file, continuing...\n");
+/**
+ *tells a variable that is not enrolled from one that can not be read
+ *@param path , the path to the variables with ending '/'
+ *@param variable , variable name one of {db,dbx,KEK,PK}
+ *@return 0 if the efivarfs file of variable does not exist, 1 otherwise
+ */
+int evfs_hasSecVar(const char *path, const char *variable)
+{
+	int rc, i;
+	char *fullPath = NULL;
+	char *rename = NULL;
+	struct stat fileInfo;
+
+	for (i = 0; i < ARRAY_SIZE(variable_renames); i++) {
+		if (strcmp(variable, variable_renames[i].from) == 0) {
+			rename = variable_renames[i].to;
+			break;
+		}
 	}
-	else {
-		printRaw(var->data, var->data_size);
-		rc = SUCCESS;
+	// let the read report the unknown name
+	if (!rename)
+		return 1;
+
+	fullPath = malloc(strlen(path) + strlen(rename) + 1);
+	if (!fullPath) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return 1;
 	}
-	
-out:
-	dealloc_secvar(var);
-	
+
+	strcpy(fullPath, path);
+	strcat(fullPath, rename);
+
+	rc = stat(fullPath, &fileInfo) && (errno == ENOENT || errno == ENOTDIR) ? 0 : 1;
+	free(fullPath);
+
 	return rc;
 }
 
@@ -184,7 +237,8 @@ void evfs_read_usage()
 	printf("USAGE:\n\t' $ secvarctl read [OPTIONS] [VARIABLES] '\nOPTIONS:"
 		"\n\t--usage/--help"
 		"\n\t-r\t\t\tprints raw data, default is human readable information"
-		"\n\t-f <filename>\t\tnavigates to ESL file from working directiory"
+		"\n\t--summary\t\tprints only sizes, hashes and entry counts, no certificate is parsed"
+		"\n\t-f <filename>\t\tnavigates to ESL file from working directiory, '-f -' reads stdin"
 		"\n\t-p <path to vars>\tlooks for key directories {'PK','KEK','db','dbx'} in <path>,\n"
 		"\t\t\t\tdefault is " SECVARPATH "\n"
 		"VARIABLES:\n\t{'PK','KEK','db','dbx'}\ttype one of the following to get info on that key,\n"
@@ -16,12 +16,15 @@
 void evfs_write_usage()
 {
 	printf("USAGE:\n\t' $ secvarctl write [OPTIONS] <variable> <authFile>'"
+		"\n\t' $ secvarctl write [OPTIONS] -b <bundleFile>'"
 		"\n\tOPTIONS:\n"
 		"\t\t--help/--usage\n"
 		"\t\t-v\t\tverbose, print process info"
 		"\n\t\t-f\t\tforce update, skips validation of file\n\t\t"
+		"-b <bundleFile>\twrite every update of an update bundle, see 'generate bundle'\n\t\t"
 		"-p <path>\tlooks for .../<var>-<UUID> file in <path>,\n"
 		"\t\t\t\tdefault is " SECVARPATH "\n"
+		"\tauthFile:\n\t\tpath to the auth file, '-' reads it from stdin\n"
 		"\tVariable:\n\t\tone of the following {PK, KEK, db, dbx}\n\n");
 }
 
@@ -78,6 +81,35 @@ int evfs_updateSecVar(const char *varName, const char *authFile, const char *pat
 	return rc;
 }
 
+/**
+ *writes every update of a bundle, in bundle order
+ *@param bundle, opened update bundle
+ *@param path string of path to directory containing the <varName>-<UUID> files
+ *@param force 1 for no validation of auths, 0 for validate
+ *@return error if a variable is unknown, or issue writing
+ */
+int evfs_updateSecVarBundle(const struct updateBundle *bundle, const char *path, int force)
+{
+	int rc;
+	const struct updateBundleEntry *entry;
+
+	if (!path) {
+		path = SECVARPATH;
+	}
+
+	// validation is not yet defined for efivarfs, see evfs_updateSecVar
+	for (int i = 0; i < bundle->count; i++) {
+		entry = &bundle->entries[i];
+		rc = evfs_updateVar(path, entry->name, entry->data, entry->size);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: issue writing update %d for %s: %s\n", i, entry->name, strerror(errno));
+			return rc;
+		}
+	}
+
+	return SUCCESS;
+}
+
 /*
  *updates a secure variable by writing data in buf to the <path>/<var>
  *@param path, path to sec vars
@@ -140,10 +172,13 @@ int evfs_updateVar(const char *path, const char *var, const unsigned char *buff,
 		rc =  FILE_WRITE_FAIL;
 	}
 	else if (rc != size) {
-		prlog(PR_WARNING,"End of file reached, not all of file was written to %s\n", fullPathWithCommand);	
+		prlog(PR_ERR,"ERROR: End of file reached, not all of file was written to %s\n", fullPathWithCommand);	
+		rc = FILE_WRITE_FAIL;
+	}
+	else {
+		prlog(PR_NOTICE,"%d/%zd bytes successfully written from file to %s\n", rc, size, fullPathWithCommand);
+		rc = SUCCESS;
 	}
-	else prlog(PR_NOTICE,"%d/%zd bytes successfully written from file to %s\n", rc, size, fullPathWithCommand);
-	rc = SUCCESS;
 	close(fptr);
 out_newbuf:
 	free(newbuff);
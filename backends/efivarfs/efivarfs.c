@@ -20,10 +20,13 @@ const struct secvarctl_backend efivarfs_backend = {
 
 	.readFileFromPath = evfs_readFileFromPath,
 	.readFileFromSecVar = evfs_readFileFromSecVar,
+	.readSecVar = evfs_readSecVar,
+	.hasSecVar = evfs_hasSecVar,
 	.read_help = evfs_read_help,
 	.read_usage = evfs_read_usage,
 
 	.updateSecVar = evfs_updateSecVar,
+	.updateSecVarBundle = evfs_updateSecVarBundle,
 	.write_help = evfs_write_help,
 	.write_usage = evfs_write_usage,
 };
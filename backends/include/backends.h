@@ -1,6 +1,11 @@
 #define QUIRK_TIME_MINUS_1900		0x1
 #define QUIRK_PKCS2_SIGNEDDATA_ONLY	0x2
 
+#include <stddef.h> // for size_t
+
+struct secvar;
+struct updateBundle;
+
 struct secvarctl_backend {
 	const char * name;
 	const char * default_secvar_path;
@@ -13,6 +18,12 @@ struct secvarctl_backend {
 	int (*readFileFromPath) (const char *file, int hrFlag);
 	// read name from var dir
 	int (*readFileFromSecVar) (const char *path, const char *variable, int hrFlag);
+	// get variable from var dir as a secvar, caller deallocs it
+	int (*readSecVar) (struct secvar **var, const char *path, const char *variable);
+	// 0 if variable does not exist in var dir, 1 if it does or that can not be told
+	int (*hasSecVar) (const char *path, const char *variable);
+	// largest size a variable in var dir may grow to, NULL if the backend can not tell
+	int (*getMaxVarSize) (size_t *size, const char *path, const char *variable);
 	// read usage
 	void (*read_usage) (void);
 	// read help
@@ -20,13 +31,16 @@ struct secvarctl_backend {
 
 	// write
 	int (*updateSecVar) (const char *varName, const char *authFile, const char *path, int force);
+	// write every update of a bundle in one pass
+	int (*updateSecVarBundle) (const struct updateBundle *bundle, const char *path, int force);
 	// write usage
 	void (*write_usage) (void);
 	// write help
 	void (*write_help) (void);
 
-	// verify
-	int (*verify) (char * currentVars[], int currCount, const char *updateVars[], int updateCount, const char *path, int writeFlag);
+	// verify, appendFlags has one entry per update or is NULL if none are appends,
+	// bundle replaces updateVars when it is not NULL
+	int (*verify) (char * currentVars[], int currCount, const char *updateVars[], int updateCount, const char *path, int writeFlag, const int *appendFlags, const struct updateBundle *bundle);
 	// verify usage
 	void (*verify_usage) (void);
 	// verify help
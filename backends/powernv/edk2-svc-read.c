@@ -26,24 +26,10 @@ static int readTS(const char *data, size_t size);
  */
 int edk2_readFileFromSecVar(const char *path, const char *variable, int hrFlag)
 {
-	int extra = 10, rc;
+	int rc;
 	struct secvar *var = NULL;
-	char *fullPath = NULL;
-	
-	fullPath = malloc(strlen(path) + strlen(variable) + extra);
-	if (!fullPath) { 
-		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-		return ALLOC_FAIL;
-	}
-
-	strcpy(fullPath, path);
-	strcat(fullPath, variable);
-	strcat(fullPath, "/data");
-
-	rc = getSecVar(&var, variable, fullPath);
-	
-	free(fullPath);
 
+	rc = edk2_readSecVar(&var, path, variable);
 	if (rc) {
 		goto out;
 	}
@@ -71,6 +57,96 @@ out:
 	return rc;
 }
 
+/**
+ *gets the secvar struct of a variable in a var dir
+ *@param var , returned secvar, needs to be deallocated
+ *@param path , the path to the variables with ending '/'
+ *@param variable , variable name one of {db,dbx,KEK,PK,TS}
+ *@return SUCCESS or error number
+ */
+int edk2_readSecVar(struct secvar **var, const char *path, const char *variable)
+{
+	int extra = 10, rc;
+	char *fullPath = NULL;
+
+	fullPath = malloc(strlen(path) + strlen(variable) + extra);
+	if (!fullPath) { 
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+
+	strcpy(fullPath, path);
+	strcat(fullPath, variable);
+	strcat(fullPath, "/data");
+
+	rc = getSecVar(var, variable, fullPath);
+
+	free(fullPath);
+
+	return rc;
+}
+
+/**
+ *tells a variable that is not there from one that can not be read
+ *@param path , the path to the variables with ending '/'
+ *@param variable , variable name one of {db,dbx,KEK,PK,TS}
+ *@return 0 if <path>/<variable>/data does not exist, 1 otherwise
+ */
+int edk2_hasSecVar(const char *path, const char *variable)
+{
+	int extra = 10, rc;
+	char *fullPath = NULL;
+	struct stat fileInfo;
+
+	fullPath = malloc(strlen(path) + strlen(variable) + extra);
+	if (!fullPath) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return 1;
+	}
+
+	strcpy(fullPath, path);
+	strcat(fullPath, variable);
+	strcat(fullPath, "/data");
+
+	rc = stat(fullPath, &fileInfo) && (errno == ENOENT || errno == ENOTDIR) ? 0 : 1;
+	free(fullPath);
+
+	return rc;
+}
+
+/**
+ *gets the largest size a variable can have, the kernel sizes the <var>/update file to it
+ *@param size , returned maximum size in bytes
+ *@param path , the path to the variables with ending '/'
+ *@param variable , variable name one of {db,dbx,KEK,PK,TS}
+ *@return SUCCESS or INVALID_FILE if the maximum is not known
+ */
+int edk2_getMaxVarSize(size_t *size, const char *path, const char *variable)
+{
+	int extra = 10, rc = INVALID_FILE;
+	char *fullPath = NULL;
+	struct stat fileInfo;
+
+	fullPath = malloc(strlen(path) + strlen(variable) + extra);
+	if (!fullPath) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+
+	strcpy(fullPath, path);
+	strcat(fullPath, variable);
+	strcat(fullPath, "/update");
+
+	// an update file of size zero tells nothing about the maximum
+	if (!stat(fullPath, &fileInfo) && fileInfo.st_size > 0) {
+		*size = fileInfo.st_size;
+		rc = SUCCESS;
+	}
+	free(fullPath);
+
+	return rc;
+}
+
 /**
  *Does the appropriate read command depending on hrFlag on the file 
  *@param file , the path to the file 
@@ -205,7 +281,8 @@ void edk2_read_usage()
 	printf("USAGE:\n\t' $ secvarctl read [OPTIONS] [VARIABLES] '\nOPTIONS:"
 		"\n\t--usage/--help"
 		"\n\t-r\t\t\tprints raw data, default is human readable information"
-		"\n\t-f <filename>\t\tnavigates to ESL file from working directiory"
+		"\n\t--summary\t\tprints only sizes, hashes and entry counts, no certificate is parsed"
+		"\n\t-f <filename>\t\tnavigates to ESL file from working directiory, '-f -' reads stdin"
 		"\n\t-p <path to vars>\tlooks for key directories {'PK','KEK','db','dbx', 'TS'} in <path>,\n"
 		"\t\t\t\tdefault is " SECVARPATH "\n"
 		"VARIABLES:\n\t{'PK','KEK','db','dbx', 'TS'}\ttype one of the following to get info on that key,\n"
@@ -7,26 +7,59 @@
 #include <unistd.h> // has read/open funcitons
 #include "external/skiboot/include/opal-api.h"
 #include "external/skiboot/include/secvar.h"
+#include "external/skiboot/include/edk2-compat-process.h" // for update_cache
 #include "backends/powernv/include/edk2-svc.h"
 #include "secvarctl.h"
+#include "arena.h"
 
 extern struct secvar_backend_driver edk2_compatible_v1;
 
 
 void edk2_verify_usage();
 void edk2_verify_help();
-int edk2_verify(char **currentVars, int currCount, const char **updateVars, int updateCount, const char *path, int writeFlag);
+int edk2_verify(char **currentVars, int currCount, const char **updateVars, int updateCount, const char *path, int writeFlag, const int *appendFlags, const struct updateBundle *bundle);
 
-static int getCurrentVars(char **newCurr, int *size, const char *path);
+static int getCurrentVars(struct arena *scratch, char **newCurr, int *size, const char *path);
 static char *opalErrToString(int rc);
-static int validateBanks(struct list_head *update_bank, struct list_head *variable_bank);
-static int setupBanks(struct list_head *variable_bank, struct list_head *update_bank, char *currentVars[], int currCount, const char *updateVars[], int updateCount, const char*path);
+/*
+ *everything validateBanks parsed, views point into the data of the banks
+ */
+struct parsedBanks {
+	int updateCount, currentCount;
+	const struct secvar **updateVars;
+	struct parsedAuth *updates;
+	struct parsedESL *current;
+};
+
+static int validateBanks(struct list_head *update_bank, struct list_head *variable_bank, struct parsedBanks *parsed);
+static int parseBankVar(const char *tag, const struct secvar *var, struct parsedAuth *auth, struct parsedESL *esl);
+static void freeParsedBanks(struct parsedBanks *parsed);
+static mbedtls_pkcs7 *getParsedPKCS7(const struct secvar *update);
+static int getParsedESLCount(const struct secvar *update);
+static mbedtls_x509_crt *getParsedCert(const char *cert, size_t size);
+static int setupBanks(struct arena *scratch, struct list_head *variable_bank, struct list_head *update_bank, char *currentVars[], int currCount, const char *updateVars[], int updateCount, const char*path, const int *appendFlags, const struct updateBundle *bundle);
 static void printBanks(struct list_head *variable_bank, struct list_head *update_bank);
 static int commitUpdateBank(struct list_head *update_bank, const char *path);
+static int validateTSWithKey(const unsigned char *data, size_t size, const char *key);
+static int lookupCachedUpdate(const struct secvar *update, const char *key_authority[], struct list_head *bank, const char *last_timestamp, unsigned char *digest);
+
+static const struct update_cache_ops verify_update_cache = {
+	.lookup = lookupCachedUpdate,
+	.store = verifyCacheStore,
+};
+
+// what validateBanks parsed, only set while edk2_compatible_v1.process runs
+static struct parsedBanks *activeParse;
+static const struct parsed_update_ops verify_parsed_updates = {
+	.get_pkcs7 = getParsedPKCS7,
+	.get_esl_count = getParsedESLCount,
+	.get_cert = getParsedCert,
+};
 
 void edk2_verify_usage()
 {
 	printf( "USAGE:\n\t$ secvarctl verify [OPTIONS] -u {UPDATE LIST}\n"
+		"\t$ secvarctl verify [OPTIONS] -b <bundleFile>\n"
 		"OPTIONS:\n"
 		"\t--help/--usage\n"
 		"\t-v\t\t\tverbose, give process progress\n"
@@ -36,6 +69,15 @@ void edk2_verify_usage()
 		"-p <path to vars>\tlooks for key directories {'PK','KEK','db','dbx', 'TS'} in <path>\n"
 		"\t\t\t\tdefault is " SECVARPATH "\n"
 		"\t\t\t\tcannot be used with '-c'\n"
+		"\t-a\t\t\tappend, the updates were signed as EFI_VARIABLE_APPEND_WRITE,\n"
+		"\t\t\t\ttheir ESL's are added to the variables, cannot be used with '-w'\n"
+		"\t-b <bundleFile>\t\ttake the updates from an update bundle, see 'generate bundle',\n"
+		"\t\t\t\treplaces '-u', appends are marked in the bundle\n"
+		"\t-j <threads>\t\tcheck the signers of an update against the signing\n"
+		"\t\t\t\tcertificates on up to <threads> threads\n"
+		"\t--cache <file>\t\tremember passed checks in <file> and skip them when\n"
+		"\t\t\t\tthe same update, signers and timestamp are seen again,\n"
+		"\t\t\t\t<file> must be protected like the keys themselves\n"
 		"CURRENT VAR LIST:\n\tOptional, only used when -c is used. Formatted as:"
 		"\n\t\t' -c <varName_1> <eslFileForVar_1> <varName_2> <eslFileForVar_2> ... '\n\t\t"
 		"Where <varName> is one of {'PK','KEK','db','dbx', 'TS'} and\n"
@@ -67,12 +109,16 @@ void edk2_verify_help()
  *@param updateCount length of updateVars
  *@param path holds path if -p option or null if no -p
  *@param writeFlag 0 if -w no given, 1 if given
+ *@param appendFlags 1 for each update that is an append, 0 if it replaces the variable, NULL if none are appends
+ *@param bundle if not NULL, the updates are the entries of this bundle instead of updateVars
  *@return SUCCESS or error value
  */
-int edk2_verify(char * currentVars[], int currCount, const char *updateVars[], int updateCount, const char *path, int writeFlag)
+int edk2_verify(char * currentVars[], int currCount, const char *updateVars[], int updateCount, const char *path, int writeFlag, const int *appendFlags, const struct updateBundle *bundle)
 {
-	int rc;
+	int rc, appends = 0;
 	struct list_head update_bank,variable_bank, update_bank_copy;
+	struct parsedBanks parsed = { 0 };
+	struct arena *scratch;
 	list_head_init(&variable_bank);
 	list_head_init(&update_bank);
 	list_head_init(&update_bank_copy);
@@ -80,12 +126,28 @@ int edk2_verify(char * currentVars[], int currCount, const char *updateVars[], i
 	if (!path) { 
 		path = SECVARPATH;
 	}
-	rc = setupBanks(&variable_bank,&update_bank,currentVars,currCount,updateVars,updateCount,path);
+	// the update files of this backend carry no attributes, firmware always replaces
+	for (int i = 0; appendFlags && i < updateCount / 2; i++)
+		appends |= appendFlags[i];
+	for (int i = 0; bundle && i < bundle->count; i++)
+		appends |= bundle->entries[i].flags & UPDATE_BUNDLE_APPEND;
+	if (writeFlag && appends) {
+		prlog(PR_ERR, "ERROR: Append updates cannot be submitted to %s, remove -w\n", path);
+		return ARG_PARSE_FAIL;
+	}
+	// the banks live in one arena that is released at the end, instead of one heap
+	// block per secvar. mbedtls keeps using the heap, it frees and reuses its
+	// temporaries many times during the signature checks
+	scratch = arenaCreate(0);
+	if (!scratch)
+		return ALLOC_FAIL;
+	arenaUseForSecvars(scratch);
+	rc = setupBanks(scratch, &variable_bank,&update_bank,currentVars,currCount,updateVars,updateCount,path,appendFlags,bundle);
 	if(rc){
 		prlog(PR_ERR, "ERROR:Could not initialize banks\n");
 		goto out;
 	}
-	rc = validateBanks(&update_bank,&variable_bank);
+	rc = validateBanks(&update_bank, &variable_bank, &parsed);
 	if(rc){
 		prlog(PR_ERR,"ERROR:Could not validate data in banks\n");
 		goto out;
@@ -102,8 +164,17 @@ int edk2_verify(char * currentVars[], int currCount, const char *updateVars[], i
 	}
 	// create copy of update_bank (it changes after process) and if we write, we are going to want to have original auth's
 	if (writeFlag) copy_bank_list(&update_bank_copy, &update_bank);
-	// run process
+	// run process, only consult the verification cache if one was loaded
+	// and let it reuse what validateBanks already parsed instead of parsing again
+	update_cache = isVerifyCacheOpen() ? &verify_update_cache : NULL;
+	activeParse = &parsed;
+	parsed_updates = &verify_parsed_updates;
+	verify_threads = verifyThreads;
 	rc = edk2_compatible_v1.process(&variable_bank, &update_bank);
+	verify_threads = 0;
+	parsed_updates = NULL;
+	activeParse = NULL;
+	update_cache = NULL;
 	if (rc) {
 		prlog(PR_ERR,"ERROR: Failed in processing OPAL ERR = %d = %s\n",rc, opalErrToString(rc));
 		goto out;
@@ -122,15 +193,20 @@ int edk2_verify(char * currentVars[], int currCount, const char *updateVars[], i
 	}
 
 out:
+	freeParsedBanks(&parsed);
 	clear_bank_list(&variable_bank);
 	clear_bank_list(&update_bank);
 	clear_bank_list(&update_bank_copy);
+	arenaUseForSecvars(NULL);
+	prlog(PR_INFO, "Verification used %zd bytes of scratch memory\n", scratch->allocated);
+	arenaDestroy(scratch);
 	return rc;
 }
 
 
 /**
  *parses arrays into banks with appropriate data
+ *@param scratch arena for the default variable paths, released by the caller
  *@param variable_bank will be filled with data depending on currentVars
  *@param update_bank will be filled with data dependent on updateVars
  *@param currentVars holds content of -c argument/or null if no -c
@@ -138,16 +214,19 @@ out:
  *@param updateVars holds content of -u argument
  *@param updateCount length of updateVars
  *@param path holds path to current vars
+ *@param appendFlags 1 for each update to mark as an append, may be NULL
+ *@param bundle if not NULL, fills the update bank from its entries instead of updateVars
  *@return SUCCESS or error value
  */
-static int setupBanks(struct list_head *variable_bank, struct list_head *update_bank, char * currentVars[], int currCount, const char *updateVars[], int updateCount, const char* path)
+static int setupBanks(struct arena *scratch, struct list_head *variable_bank, struct list_head *update_bank, char * currentVars[], int currCount, const char *updateVars[], int updateCount, const char* path, const int *appendFlags, const struct updateBundle *bundle)
 {
 	int defaultVarsFlag = 0;
 	size_t len;
 	struct secvar *tmp = NULL;
+	const struct updateBundleEntry *entry;
 	char * c;
 	// check that update string given
-	if (!updateVars || updateCount <= 1) {
+	if (!bundle && (!updateVars || updateCount <= 1)) {
 		fprintf(stderr,"ERROR: No update vars given\n");
 		edk2_verify_usage();
 		return ARG_PARSE_FAIL;
@@ -156,20 +235,24 @@ static int setupBanks(struct list_head *variable_bank, struct list_head *update_
 	if (!currentVars) { 
 		defaultVarsFlag = 1;
 		// max length of this array is #OfVars *2 b/c max contents= {Pk, path/pk/data, KEK, path/kek/data,etc}
-		currentVars = calloc(1, sizeof(char*) * ARRAY_SIZE(variables) * 2);
+		currentVars = arenaCalloc(scratch, ARRAY_SIZE(variables) * 2, sizeof(char*));
 		if (!currentVars) {
 			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
 			return ALLOC_FAIL;
 		}
-		getCurrentVars(currentVars, &currCount, path);	
+		getCurrentVars(scratch, currentVars, &currCount, path);	
 	}
 
 	// once here, strings should be ready, it is time to fill banks
-	// fill update bank with all updates
-	for (int i = 0;i < updateCount; i += 2) { 
+	// fill update bank with all updates, a bundle is copied straight from its mapping
+	for (int i = 0; bundle && i < bundle->count; i++) {
+		entry = &bundle->entries[i];
+		list_add_tail(update_bank, &new_secvar(entry->name, strlen(entry->name) + 1, (const char *)entry->data, entry->size, entry->flags & UPDATE_BUNDLE_APPEND ? SECVAR_FLAG_APPEND_WRITE : 0)->link);
+	}
+	for (int i = 0; !bundle && i < updateCount; i += 2) { 
 		c = getDataFromFile((char *)updateVars[i + 1], &len);
 		if (c) {
-			list_add_tail(update_bank, &new_secvar(updateVars[i], strlen(updateVars[i]) + 1, c, len, 0)->link);
+			list_add_tail(update_bank, &new_secvar(updateVars[i], strlen(updateVars[i]) + 1, c, len, appendFlags && appendFlags[i / 2] ? SECVAR_FLAG_APPEND_WRITE : 0)->link);
 			free(c);
 		}
 		else 
@@ -193,13 +276,6 @@ static int setupBanks(struct list_head *variable_bank, struct list_head *update_
 				prlog(PR_INFO, "Failed to open %s, not adding it to list\n", currentVars[i + 1]);
 		}
 	}
-	// cleanup because of dynamically allocated memory of default paths, need to cleanup pointer to array and pointer to strings
-	if (defaultVarsFlag) {	
-		for( int i = 0; i < currCount; i++)
-			free(currentVars[i]);
-		free(currentVars);
-		currentVars = NULL;
-	}
 
 	return SUCCESS;
 }
@@ -208,13 +284,28 @@ static int setupBanks(struct list_head *variable_bank, struct list_head *update_
  *runs validation function on data in banks, esl validation for variable bank and auth validation for update bank
  *@param variable_bank list of secvar's of current variables
  *@param update_bank list of secvar's of update variables
+ *@param parsed filled with everything that was parsed, for process_update to reuse, free with freeParsedBanks
  *@return SUCCESS or error value if any files fail
  */
-static int validateBanks(struct list_head *update_bank, struct list_head *variable_bank)
+static int validateBanks(struct list_head *update_bank, struct list_head *variable_bank, struct parsedBanks *parsed)
 {	
 	int rc = SUCCESS;
 	struct secvar *var = NULL;
 
+	memset(parsed, 0, sizeof(*parsed));
+	list_for_each(update_bank, var, link)
+		parsed->updateCount++;
+	list_for_each(variable_bank, var, link)
+		parsed->currentCount++;
+	parsed->updateVars = calloc(parsed->updateCount + 1, sizeof(*parsed->updateVars));
+	parsed->updates = calloc(parsed->updateCount + 1, sizeof(*parsed->updates));
+	parsed->current = calloc(parsed->currentCount + 1, sizeof(*parsed->current));
+	if (!parsed->updateVars || !parsed->updates || !parsed->current) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	parsed->updateCount = 0;
+	parsed->currentCount = 0;
 
 	// validate all data in both banks using efi-validate
 	list_for_each(update_bank, var,link){
@@ -225,7 +316,8 @@ static int validateBanks(struct list_head *update_bank, struct list_head *variab
 			prlog(PR_ERR, "ERROR: Invalid variable %s, cannot update Timestamp variable\n", var->key);
 			return rc;
 		}
-		rc = validateAuth((unsigned char *)var->data, var->data_size, var->key);
+		parsed->updateVars[parsed->updateCount] = var;
+		rc = parseBankVar("parseAuth", var, &parsed->updates[parsed->updateCount++], NULL);
 		if (rc) {
 			prlog(PR_ERR, "ERROR: failed to validate Auth file for %s, returned %d\n",var->key,rc);
 			return rc;
@@ -237,9 +329,9 @@ static int validateBanks(struct list_head *update_bank, struct list_head *variab
 		list_for_each(variable_bank, var, link) {
 			prlog(PR_INFO, "----VALIDATING CURRENT VAR: %s----\n", var->key);
 			if (strcmp(var->key, "TS") == 0) 
-				rc = validateTS((unsigned char *)var->data, var->data_size);
+				rc = cachedValidate("validateTS", var->key, (unsigned char *)var->data, var->data_size, validateTSWithKey);
 			else
-				rc = validateESL((unsigned char *)var->data, var->data_size, var->key);
+				rc = parseBankVar("validateESL", var, NULL, &parsed->current[parsed->currentCount++]);
 			if (rc) {
 				prlog(PR_ERR, "ERROR: failed to validate data file for %s,returned %d\n", var->key, rc);
 				return rc;
@@ -266,51 +358,192 @@ static int validateBanks(struct list_head *update_bank, struct list_head *variab
 	return rc;
 }
 
+/**
+ *validates one variable with parseAuth or parseESL and keeps the result, if the
+ *verification cache already has the check then nothing is parsed and the
+ *parsed struct stays empty
+ *@param tag name of the check for the verification cache
+ *@param var variable to validate
+ *@param auth if not NULL, var is an update and is parsed into auth
+ *@param esl if not NULL, var is a current variable and is parsed into esl
+ *@return SUCCESS or error value
+ */
+static int parseBankVar(const char *tag, const struct secvar *var, struct parsedAuth *auth, struct parsedESL *esl)
+{
+	int rc, cacheable;
+	unsigned char digest[VERIFY_CACHE_KEY_SIZE];
+
+	cacheable = isVerifyCacheOpen() && !getValidateCacheKey(tag, var->key, (unsigned char *)var->data, var->data_size, digest);
+	if (cacheable && !verifyCacheLookup(digest)) {
+		prlog(PR_INFO, "%s for %s found in verification cache\n", tag, var->key);
+		return SUCCESS;
+	}
+	if (auth)
+		// the keystore certs do the verifying, embedded signing certs are left undecoded
+		rc = parseAuth(auth, (unsigned char *)var->data, var->data_size, var->key, 0);
+	else
+		rc = parseESL(esl, (unsigned char *)var->data, var->data_size, var->key);
+	if (!rc && cacheable)
+		verifyCacheStore(digest);
+
+	return rc;
+}
+
+/**
+ *frees what validateBanks parsed
+ *@param parsed struct filled by validateBanks
+ */
+static void freeParsedBanks(struct parsedBanks *parsed)
+{
+	if (parsed->updates) {
+		for (int i = 0; i < parsed->updateCount; i++)
+			freeParsedAuth(&parsed->updates[i]);
+		free(parsed->updates);
+	}
+	if (parsed->current) {
+		for (int i = 0; i < parsed->currentCount; i++)
+			freeParsedESL(&parsed->current[i]);
+		free(parsed->current);
+	}
+	if (parsed->updateVars)
+		free(parsed->updateVars);
+	memset(parsed, 0, sizeof(*parsed));
+}
+
+/**
+ *@param update an update in the update bank
+ *@return what validateBanks parsed for update or NULL if it was not parsed
+ */
+static struct parsedAuth *getParsedUpdate(const struct secvar *update)
+{
+	for (int i = 0; activeParse && i < activeParse->updateCount; i++) {
+		if (activeParse->updateVars[i] == update)
+			return activeParse->updates[i].desc ? &activeParse->updates[i] : NULL;
+	}
+
+	return NULL;
+}
+
+static mbedtls_pkcs7 *getParsedPKCS7(const struct secvar *update)
+{
+	struct parsedAuth *auth = getParsedUpdate(update);
+
+	return auth ? auth->pkcs7 : NULL;
+}
+
+static int getParsedESLCount(const struct secvar *update)
+{
+	struct parsedAuth *auth = getParsedUpdate(update);
+
+	return auth ? auth->esl.count : -1;
+}
+
+/**
+ *finds a certificate validateBanks already parsed, the current variables and the updates
+ *hold a reference to each of their certificates in the certificate cache
+ *@param cert DER of certificate, as stored in an ESL
+ *@param size length of cert
+ *@return parsed certificate or NULL if it was never parsed
+ */
+static mbedtls_x509_crt *getParsedCert(const char *cert, size_t size)
+{
+	if (!activeParse)
+		return NULL;
+
+	return certCacheFind((const unsigned char *)cert, size);
+}
+
+/**
+ *validateTS with the signature expected by cachedValidate
+ *@param data TS variable data
+ *@param size length of data
+ *@param key unused, always "TS"
+ *@return SUCCESS or error number
+ */
+static int validateTSWithKey(const unsigned char *data, size_t size, const char *key)
+{
+	return validateTS(data, size);
+}
+
+/**
+ *builds the verification cache key for an update in process_update and checks
+ *if it is cached. The key covers everything the ESL and signature checks read:
+ *the update and whether it is an append, the setup mode, the current contents of every variable allowed to
+ *sign it and the timestamp slot for the variable
+ *@param update the update being processed
+ *@param key_authority NULL terminated list of variables that may sign the update
+ *@param bank bank the authorities are looked up in
+ *@param last_timestamp TS variable data
+ *@param digest filled with the key, VERIFY_CACHE_KEY_SIZE bytes
+ *@return 1 if cached, 0 if not cached or negative if the key could not be made
+ */
+static int lookupCachedUpdate(const struct secvar *update, const char *key_authority[], struct list_head *bank, const char *last_timestamp, unsigned char *digest)
+{
+	int rc, i;
+	unsigned char mode = setup_mode;
+	uint64_t flags = update->flags & SECVAR_FLAG_APPEND_WRITE;
+	struct secvar *avar;
+	struct cryptoHashCtx *ctx;
+
+	rc = verifyCacheKeyStart(&ctx, "process_update");
+	if (rc)
+		return -1;
+	rc = verifyCacheKeyAdd(ctx, update->key, update->key_len);
+	if (!rc)
+		rc = verifyCacheKeyAdd(ctx, update->data, update->data_size);
+	if (!rc)
+		rc = verifyCacheKeyAdd(ctx, &mode, sizeof(mode));
+	if (!rc)
+		rc = verifyCacheKeyAdd(ctx, &flags, sizeof(flags));
+	for (i = 0; !rc && key_authority[i]; i++) {
+		avar = find_secvar(key_authority[i], strlen(key_authority[i]) + 1, bank);
+		rc = verifyCacheKeyAdd(ctx, key_authority[i], strlen(key_authority[i]) + 1);
+		if (!rc)
+			rc = verifyCacheKeyAdd(ctx, avar ? avar->data : NULL, avar ? avar->data_size : 0);
+	}
+	// TS slots are in the same order as the variables array
+	for (i = 0; !rc && i < ARRAY_SIZE(variables) - 1; i++) {
+		if (!strcmp(update->key, variables[i])) {
+			rc = verifyCacheKeyAdd(ctx, last_timestamp ? last_timestamp + i * sizeof(struct efi_time) : NULL,
+					       last_timestamp ? sizeof(struct efi_time) : 0);
+			break;
+		}
+	}
+	if (rc) {
+		cryptoHashFree(ctx);
+		return -1;
+	}
+	if (verifyCacheKeyFinish(ctx, digest))
+		return -1;
+
+	return verifyCacheLookup(digest) ? 0 : 1;
+}
 
 /**
  *called if -c not used, tries to find the variables in the path/default path
+ *@param scratch arena the strings in newCurr are allocated from
  *@param newCurr , empty array of strings to be filled
  *@param size , pointer to integer to be filled with length of newCurr
  *@param path , path to the location of the subdirectories {"PK", "KEK", "db", "dbx", "TS"}
  *@return the return of the validation of newCurr, SUCCESS if everything is ordered and formated right
  */
-static int getCurrentVars(char *newCurr[], int *size, const char* path)
+static int getCurrentVars(struct arena *scratch, char *newCurr[], int *size, const char* path)
 {
-	int lenCtr = 0, i, offset = 0;
+	int lenCtr = 0, i;
 	char *ext = "/data";
 	char *fullPath = NULL;
 	for (i = 0; i < ARRAY_SIZE(variables); i++) {
-		fullPath = malloc(strlen(path) + strlen(variables[i]) + strlen(ext) + 1);
+		fullPath = arenaAlloc(scratch, strlen(path) + strlen(variables[i]) + strlen(ext) + 1);
 		if (!fullPath) { 
 			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
 			return ALLOC_FAIL;
 		}
-		strcpy(fullPath, path);
-		offset += strlen(path);
-		strncpy(fullPath + offset, variables[i], strlen(variables[i]));
-		offset += strlen(variables[i]);
-		strncpy(fullPath + offset, ext, strlen(ext) + 1);
+		sprintf(fullPath, "%s%s%s", path, variables[i], ext);
 		// if it is a file then add variable name and data file to newCurr
 		if (!isFile(fullPath)) {
-			newCurr[lenCtr] = malloc(strlen(variables[i]) + 1);
-			if (!newCurr[lenCtr]) {
-				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-				free(fullPath);
-				return ALLOC_FAIL;
-			}
-			strncpy(newCurr[lenCtr++], variables[i], strlen(variables[i]) + 1);
-			newCurr[lenCtr] = malloc(strlen(fullPath) + 1);
-			if (!newCurr[lenCtr]) {
-				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-				free(fullPath);
-				return ALLOC_FAIL;
-			}
-
-			strcpy(newCurr[lenCtr++],fullPath);
+			newCurr[lenCtr++] = variables[i];
+			newCurr[lenCtr++] = fullPath;
 		}
-		offset = 0;
-		free(fullPath);
-		fullPath = NULL;
 	}
 	*size = lenCtr;
 
@@ -12,13 +12,17 @@
 void edk2_write_usage()
 {
 	printf("USAGE:\n\t' $ secvarctl write [OPTIONS] <variable> <authFile>'"
+		"\n\t' $ secvarctl write [OPTIONS] -b <bundleFile>'"
 		"\n\tOPTIONS:\n"
 		"\t\t--help/--usage\n"
 		"\t\t-v\t\tverbose, print process info"
 		"\n\t\t-f\t\tforce update, skips validation of file\n\t\t"
+		"-b <bundleFile>\twrite every update of an update bundle, see 'generate bundle',\n"
+		"\t\t\t\tnothing is written unless all of them validate\n\t\t"
 		"-p <path>\tlooks for .../<var>/update file in <path>,\n"
 		"\t\t\t\tshould contain expected var subdirectories {'PK','KEK','db','dbx'},\n"
 		"\t\t\t\tdefault is " SECVARPATH "\n"
+		"\tauthFile:\n\t\tpath to the auth file, '-' reads it from stdin\n"
 		"\tVariable:\n\t\tone of the following {PK, KEK, db, dbx}\n\n");
 }
 
@@ -80,6 +84,55 @@ int edk2_updateSecVar(const char *varName, const char *authFile, const char *pat
 	return rc;
 }
 
+/**
+ *validates every update of a bundle and then writes them all, in bundle order
+ *@param bundle, opened update bundle
+ *@param path string of path to directory containing <varName>/update files
+ *@param force 1 for no validation of auths, 0 for validate
+ *@return error if a variable is unknown or an append, or issue validating or writing
+ */
+int edk2_updateSecVarBundle(const struct updateBundle *bundle, const char *path, int force)
+{
+	int rc;
+	const struct updateBundleEntry *entry;
+
+	if (!path) {
+		path = SECVARPATH;
+	}
+
+	// check everything before the first write so a bad entry leaves all variables alone
+	for (int i = 0; i < bundle->count; i++) {
+		entry = &bundle->entries[i];
+		if (strcmp(entry->name, "TS") == 0) {
+			prlog(PR_ERR, "ERROR: Cannot update TimeStamp (TS) variable\n");
+			return INVALID_VAR_NAME;
+		}
+		// the update files of this backend carry no attributes, firmware always replaces
+		if (entry->flags & UPDATE_BUNDLE_APPEND) {
+			prlog(PR_ERR, "ERROR: Append update for %s cannot be submitted to %s\n", entry->name, path);
+			return INVALID_VAR_NAME;
+		}
+		if (force)
+			continue;
+		rc = validateAuth(entry->data, entry->size, entry->name);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: validating update %d for %s (Signed Auth) failed, not updating\n", i, entry->name);
+			return rc;
+		}
+	}
+	for (int i = 0; i < bundle->count; i++) {
+		entry = &bundle->entries[i];
+		prlog(PR_INFO, "Writing new %s with %zd bytes of data to %s%s/update\n", entry->name, entry->size, path, entry->name);
+		rc = updateVar(path, entry->name, entry->data, entry->size);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: issue writing update %d for %s: %s\n", i, entry->name, strerror(errno));
+			return rc;
+		}
+	}
+
+	return SUCCESS;
+}
+
 /*
  *updates a secure variable by writing data in buf to the <path>/<var>/update
  *@param path, path to sec vars
@@ -8,14 +8,19 @@ const struct secvarctl_backend edk2_backend = {
 	.default_secvar_path = SECVARPATH,
 	.sb_variables = edk2_variables,
 	.sb_var_count = 5,
+	.default_attributes = SECVAR_ATTRIBUTES,
 	.read_help = edk2_read_help,
 	.read_usage = edk2_read_usage,
 	.readFileFromPath = edk2_readFileFromPath,
 	.readFileFromSecVar = edk2_readFileFromSecVar,
+	.readSecVar = edk2_readSecVar,
+	.hasSecVar = edk2_hasSecVar,
+	.getMaxVarSize = edk2_getMaxVarSize,
 	.write_help = edk2_write_help,
 	.write_usage = edk2_write_usage,
 	.updateSecVar = edk2_updateSecVar,
+	.updateSecVarBundle = edk2_updateSecVarBundle,
 	.verify_help = edk2_verify_help,
-	.verify_usage = edk2_write_usage,
+	.verify_usage = edk2_verify_usage,
 	.verify = edk2_verify,
 };
\ No newline at end of file
@@ -16,12 +16,16 @@ int updateVar(const char *path, const char *var, const unsigned char *buff, size
 void edk2_read_usage();
 void edk2_read_help();
 int edk2_readFileFromSecVar(const char * path, const char *variable, int hrFlag);
+int edk2_readSecVar(struct secvar **var, const char *path, const char *variable);
+int edk2_hasSecVar(const char *path, const char *variable);
 int edk2_readFileFromPath(const char *path, int hrFlag);
+int edk2_getMaxVarSize(size_t *size, const char *path, const char *variable);
 void edk2_write_usage();
 void edk2_write_help();
 int edk2_updateSecVar(const char *var, const char *authFile, const char *path, int force);
+int edk2_updateSecVarBundle(const struct updateBundle *bundle, const char *path, int force);
 void edk2_verify_usage();
 void edk2_verify_help();
-int edk2_verify(char **currentVars, int currCount, const char **updateVars, int updateCount, const char *path, int writeFlag);
+int edk2_verify(char **currentVars, int currCount, const char **updateVars, int updateCount, const char *path, int writeFlag, const int *appendFlags, const struct updateBundle *bundle);
 
 #endif
@@ -16,9 +16,12 @@
 #include "secvarctl.h"
 
 static int readFiles(const char* var, const char* file, int hrFlag, const  char* path);
+static int readSummary(const char *var, const char *file, const char *path);
+
+int verifyThreads = 1;
 
 struct readArguments {
-	int helpFlag, printRaw;
+	int helpFlag, printRaw, summary;
 	const char *pathToSecVars, *varName, *inFile;
 }; 
 static int parseReadArgs(int argc, char *argv[], struct readArguments *args);
@@ -34,7 +37,7 @@ int readCommand(int argc, char* argv[])
 {
 	int rc;
 	struct readArguments args = {	
-		.helpFlag = 0, .printRaw = 0, 
+		.helpFlag = 0, .printRaw = 0, .summary = 0,
 		.pathToSecVars = NULL, .inFile = NULL, .varName = NULL
 	};
 
@@ -42,6 +45,8 @@ int readCommand(int argc, char* argv[])
 	if (rc || args.helpFlag)
 		return rc;
 
+	if (args.summary)
+		return readSummary(args.varName, args.inFile, args.pathToSecVars);
 	rc = readFiles(args.varName, args.inFile, !args.printRaw, args.pathToSecVars);
 
 	return rc;	
@@ -75,6 +80,10 @@ static int parseReadArgs( int argc, char *argv[], struct readArguments *args) {
 			args->helpFlag = 1;
 			goto out;
 		}
+		else if (!strcmp(argv[i], "--summary")) {
+			args->summary = 1;
+			continue;
+		}
 		switch (argv[i][1]) {
 			case 'v':
 				verbose = PR_DEBUG;
@@ -93,7 +102,8 @@ static int parseReadArgs( int argc, char *argv[], struct readArguments *args) {
 				break;
 			//set file path
 			case 'f':
-				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+				// "-" reads the file from stdin
+				if (i + 1 >= argc || (argv[i + 1][0] == '-' && !isStdioFile(argv[i + 1]))) {
 					prlog(PR_ERR, "ERROR: Incorrect value for file flag, use '-f <file>', see usage...\n");
 					rc = ARG_PARSE_FAIL;
 					goto out;
@@ -113,6 +123,10 @@ static int parseReadArgs( int argc, char *argv[], struct readArguments *args) {
 		}
 		
 	}
+	if (args->summary && args->printRaw) {
+		prlog(PR_ERR, "ERROR: '-r' can not be used with '--summary'\n");
+		rc = ARG_PARSE_FAIL;
+	}
 		
 out:
 	if (rc) {
@@ -169,9 +183,73 @@ static int readFiles(const char* var, const char* file, int hrFlag, const char *
 	return SUCCESS;
 }
 
+/**
+ *prints the size, hash and entry counts of variables without decoding any certificate,
+ *meant for taking an inventory of many keystores often
+ *@param var  string to variable wanted if <variable> option is given, NULL if not
+ *@param file string to filename with path if -f option, NULL if not
+ *@param path string to path where {PK,KEK,db,dbx,TS} subdirectories are, default SECVARPATH if none given
+ *@return succcess if every variable was summarized
+ */
+static int readSummary(const char *var, const char *file, const char *path)
+{
+	int rc, successCount = 0, count = 0, maxKnown = 1;
+	size_t size = 0, maxSize, entries = 0, used = 0, unused = 0;
+	struct secvar *secvar = NULL;
+	char *c = NULL;
+
+	if (file) {
+		c = getDataFromFile(file, &size);
+		if (!c)
+			return INVALID_FILE;
+		rc = printSummary(c, size, NULL, 0, &entries);
+		free(c);
+		if (rc)
+			prlog(PR_WARNING, "ERROR: Could not parse file\n");
+		return rc;
+	}
+
+	if (!path)
+		path = secvarctl_backend->default_secvar_path;
+	for (int i = 0; i < secvarctl_backend->sb_var_count; i++) {
+		if (var && strcmp(var, secvarctl_backend->sb_variables[i]) != 0)
+			continue;
+		printf("READING %s :\n", secvarctl_backend->sb_variables[i]);
+		rc = secvarctl_backend->readSecVar(&secvar, path, secvarctl_backend->sb_variables[i]);
+		if (rc)
+			continue;
+		maxSize = 0;
+		if (!secvarctl_backend->getMaxVarSize
+		    || secvarctl_backend->getMaxVarSize(&maxSize, path, secvarctl_backend->sb_variables[i]))
+			maxKnown = 0;
+		rc = printSummary(secvar->data, secvar->data_size, secvar->key, maxSize, &entries);
+		if (rc)
+			prlog(PR_WARNING, "ERROR: Could not parse file, continuing...\n");
+		else
+			successCount++;
+		used += secvar->data_size;
+		if (maxSize > secvar->data_size)
+			unused += maxSize - secvar->data_size;
+		count++;
+		dealloc_secvar(secvar);
+		secvar = NULL;
+	}
+	if (maxKnown && count)
+		printf("TOTAL: %zd entries, %zd bytes in %d variables, %zd bytes free\n", entries, used, count, unused);
+	else
+		printf("TOTAL: %zd entries, %zd bytes in %d variables\n", entries, used, count);
+	// like read, a keystore is summarized if at least one variable was
+	if (successCount < 1) {
+		prlog(PR_ERR, "No valid files to summarize, returning failure\n");
+		return INVALID_FILE;
+	}
+
+	return SUCCESS;
+}
+
 struct writeArguments {
 	int helpFlag, inpValid;
-	const char *pathToSecVars, *varName, *inFile;
+	const char *pathToSecVars, *varName, *inFile, *bundleFile;
 }; 
 static int parseWriteArgs(int argc, char *argv[], struct writeArguments *args);
 
@@ -185,15 +263,36 @@ static int parseWriteArgs(int argc, char *argv[], struct writeArguments *args);
 int performWriteCommand(int argc, char* argv[])
 {
 	int rc;
+	struct updateBundle bundle;
 	struct writeArguments args = {	
 		.helpFlag = 0, .inpValid = 0, 
-		.pathToSecVars = NULL, .inFile = NULL, .varName = NULL
+		.pathToSecVars = NULL, .inFile = NULL, .varName = NULL, .bundleFile = NULL
 	};
 
 	rc = parseWriteArgs(argc, argv, &args);
 	if (rc || args.helpFlag)
 		goto out;
 
+	if (args.bundleFile) {
+		if (args.inFile || args.varName) {
+			prlog(PR_ERR, "ERROR: Give either '<var> <authFile>' or '-b <bundleFile>', not both\n");
+			secvarctl_backend->write_usage();
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		if (!secvarctl_backend->updateSecVarBundle) {
+			prlog(PR_ERR, "ERROR: The %s backend cannot write update bundles\n", secvarctl_backend->name);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		rc = openUpdateBundle(&bundle, args.bundleFile);
+		if (rc)
+			goto out;
+		rc = secvarctl_backend->updateSecVarBundle(&bundle, args.pathToSecVars, args.inpValid);
+		closeUpdateBundle(&bundle);
+		goto out;
+	}
+
 	if (!args.inFile || !args.varName ) {
 		secvarctl_backend->write_usage();
 		rc = ARG_PARSE_FAIL;
@@ -247,12 +346,25 @@ static int parseWriteArgs( int argc, char *argv[], struct writeArguments *args)
 					args->pathToSecVars= argv[i];
 				}
 			}
+			// set update bundle
+			else if (!strcmp(argv[i], "-b")) {
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '-b', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				else {
+					i++;
+					args->bundleFile = argv[i];
+				}
+			}
 			// set force flag
 			else if (!strcmp(argv[i], "-f"))
 				args->inpValid = 1;	
 		}
 		else {
-			if (i + 1 >= argc || argv[i + 1][0] == '-') {		
+			// "-" reads the auth from stdin
+			if (i + 1 >= argc || (argv[i + 1][0] == '-' && !isStdioFile(argv[i + 1]))) {
 				prlog(PR_ERR, "ERROR: Incorrect '<var> <authFile>', see usage\n");
 				rc = ARG_PARSE_FAIL;
 				goto out;
@@ -272,8 +384,8 @@ out:
 }
 
 struct verifyArguments {
-	int helpFlag, writeFlag, currVarCount, updateVarCount;
-	const char *pathToSecVars, **updateVars;
+	int helpFlag, writeFlag, appendFlag, currVarCount, updateVarCount;
+	const char *pathToSecVars, **updateVars, *cacheFile, *bundleFile;
 	char **currentVars;
 }; 
 
@@ -287,10 +399,11 @@ static int parseVerifyArgs(int argc, char *argv[], struct verifyArguments *args)
 */
 int performVerificationCommand(int argc, char* argv[])
 {
-	int rc;
+	int rc, *appendFlags = NULL;
+	struct updateBundle bundle = { 0 };
 	struct verifyArguments args = {	
-		.helpFlag = 0, .writeFlag = 0, .currVarCount = 0, .updateVarCount = 0,
-		.pathToSecVars = NULL, .updateVars = NULL, .currentVars = 0
+		.helpFlag = 0, .writeFlag = 0, .appendFlag = 0, .currVarCount = 0, .updateVarCount = 0,
+		.pathToSecVars = NULL, .updateVars = NULL, .currentVars = 0, .cacheFile = NULL, .bundleFile = NULL
 	};
 
 	rc = parseVerifyArgs(argc, argv, &args);
@@ -303,8 +416,42 @@ int performVerificationCommand(int argc, char* argv[])
 		rc = ARG_PARSE_FAIL;
 		goto out;
 	}
+	// a bundle carries its own variable names and append flags
+	if (args.bundleFile && (args.updateVars || args.appendFlag)) {
+		prlog(PR_ERR, "ERROR: Cannot use '-u' or '-a' with '-b <bundleFile>'\n");
+		secvarctl_backend->verify_usage();
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (args.bundleFile) {
+		rc = openUpdateBundle(&bundle, args.bundleFile);
+		if (rc)
+			goto out;
+	}
+
+	if (args.cacheFile) {
+		rc = openVerifyCache(args.cacheFile);
+		if (rc)
+			goto out;
+	}
+
+	// -a marks every update as an append
+	if (args.appendFlag && args.updateVarCount) {
+		appendFlags = malloc((args.updateVarCount + 1) / 2 * sizeof(*appendFlags));
+		if (!appendFlags) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		for (int i = 0; i < (args.updateVarCount + 1) / 2; i++)
+			appendFlags[i] = 1;
+	}
 
-	rc = secvarctl_backend->verify(args.currentVars, args.currVarCount, args.updateVars, args.updateVarCount, args.pathToSecVars, args.writeFlag);
+	rc = secvarctl_backend->verify(args.currentVars, args.currVarCount, args.updateVars, args.updateVarCount, args.pathToSecVars, args.writeFlag, appendFlags,
+				       args.bundleFile ? &bundle : NULL);
+	// results are only ever added after passing checks, so save them either way
+	if (args.cacheFile && closeVerifyCache() && !rc)
+		prlog(PR_WARNING, "WARNING: verification cache %s was not updated\n", args.cacheFile);
 	
 out:
 	if (rc) 
@@ -315,6 +462,9 @@ out:
 		free(args.currentVars);
 	if (args.updateVars) 
 		free(args.updateVars);
+	if (appendFlags)
+		free(appendFlags);
+	closeUpdateBundle(&bundle);
 	
 	return rc;
 }
@@ -420,8 +570,37 @@ static int parseVerifyArgs( int argc, char *argv[], struct verifyArguments *args
 					args->pathToSecVars= argv[i];
 				}
 			}
+			else if (!strcmp(argv[i], "--cache")) {
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '--cache', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				args->cacheFile = argv[i];
+			}
+			else if (!strcmp(argv[i], "-b")) {
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '-b', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				args->bundleFile = argv[i];
+			}
+			else if (!strcmp(argv[i], "-j")) {
+				if (i + 1 >= argc || argv[i + 1][0] == '-' || atoi(argv[i + 1]) <= 0) {
+					prlog(PR_ERR, "ERROR: Incorrect value for '-j', use '-j <threads>', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				verifyThreads = atoi(argv[i]);
+			}
 			else if (!strcmp(argv[i], "-w"))
 				args->writeFlag = 1;
+			else if (!strcmp(argv[i], "-a"))
+				args->appendFlag = 1;
 		}
 	}
 		
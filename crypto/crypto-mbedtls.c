@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/rsa.h>
+#include <mbedtls/x509_crt.h>
+#include "err.h"
+#include "prlog.h"
+#include "crypto/include/crypto.h"
+
+extern int verbose;
+
+const char *cryptoLibName = "mbedtls";
+
+struct cryptoHashCtx {
+	mbedtls_md_context_t md;
+};
+
+size_t cryptoHashSize(int hashFunct)
+{
+	const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(hashFunct);
+
+	return md_info ? mbedtls_md_get_size(md_info) : 0;
+}
+
+int cryptoHashInit(struct cryptoHashCtx **ctx, int hashFunct)
+{
+	int rc;
+	const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(hashFunct);
+
+	if (!md_info) {
+		prlog(PR_ERR, "ERROR: Invalid hash function %d\n", hashFunct);
+		return HASH_FAIL;
+	}
+	*ctx = malloc(sizeof(**ctx));
+	if (!*ctx) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	mbedtls_md_init(&(*ctx)->md);
+	rc = mbedtls_md_setup(&(*ctx)->md, md_info, 0);
+	if (!rc)
+		rc = mbedtls_md_starts(&(*ctx)->md);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Could not setup hashing environment mbedtls err #%d\n", rc);
+		cryptoHashFree(*ctx);
+		*ctx = NULL;
+		return HASH_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+int cryptoHashUpdate(struct cryptoHashCtx *ctx, const unsigned char *data, size_t size)
+{
+	int rc = mbedtls_md_update(&ctx->md, data, size);
+
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Failed to add %zd bytes of data to hashing context mbedtls err #%d\n", size, rc);
+		return HASH_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+int cryptoHashFinish(struct cryptoHashCtx *ctx, unsigned char *hash)
+{
+	int rc = mbedtls_md_finish(&ctx->md, hash);
+
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Generation hash failed mbedtls err #%d\n", rc);
+		return HASH_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+void cryptoHashFree(struct cryptoHashCtx *ctx)
+{
+	if (!ctx)
+		return;
+	mbedtls_md_free(&ctx->md);
+	free(ctx);
+}
+
+int cryptoHash(int hashFunct, const unsigned char *data, size_t size, unsigned char *hash)
+{
+	int rc;
+	const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(hashFunct);
+
+	if (!md_info) {
+		prlog(PR_ERR, "ERROR: Invalid hash function %d\n", hashFunct);
+		return HASH_FAIL;
+	}
+	rc = mbedtls_md(md_info, data, size, hash);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Generation hash failed mbedtls err #%d\n", rc);
+		return HASH_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+int cryptoVerifySignature(const mbedtls_x509_crt *cert, int hashFunct, const unsigned char *hash, size_t hashSize,
+			  const unsigned char *sig, size_t sigSize)
+{
+	int rc;
+	mbedtls_pk_context pubKey;
+
+	// mbedtls_rsa_public caches values in the key context, verifying with a private
+	// copy of the key keeps cert untouched so it can be shared between threads
+	mbedtls_pk_init(&pubKey);
+	rc = mbedtls_pk_parse_public_key(&pubKey, cert->pk_raw.p, cert->pk_raw.len);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Could not load public key of certificate, mbedtls err #%d\n", rc);
+		goto out;
+	}
+	rc = mbedtls_pk_verify(&pubKey, hashFunct, hash, hashSize, sig, sigSize);
+	if (rc)
+		prlog(PR_INFO, "Signature does not verify, mbedtls err #%d\n", rc);
+
+out:
+	mbedtls_pk_free(&pubKey);
+
+	return rc ? AUTH_FAIL : SUCCESS;
+}
+
+int cryptoRecoverDigest(const mbedtls_x509_crt *cert, const unsigned char *sig, size_t sigSize,
+			unsigned char **digestInfo, size_t *digestInfoSize)
+{
+	int rc;
+	size_t i, keySize;
+	unsigned char *block = NULL;
+	mbedtls_pk_context pubKey;
+	mbedtls_rsa_context *rsa;
+
+	*digestInfo = NULL;
+	// a private copy of the key like cryptoVerifySignature, so cert stays shareable
+	mbedtls_pk_init(&pubKey);
+	rc = mbedtls_pk_parse_public_key(&pubKey, cert->pk_raw.p, cert->pk_raw.len);
+	if (rc || mbedtls_pk_get_type(&pubKey) != MBEDTLS_PK_RSA) {
+		prlog(PR_ERR, "ERROR: Could not load RSA public key of certificate, mbedtls err #%d\n", rc);
+		rc = AUTH_FAIL;
+		goto out;
+	}
+	rsa = mbedtls_pk_rsa(pubKey);
+	keySize = mbedtls_rsa_get_len(rsa);
+	rc = AUTH_FAIL;
+	if (sigSize != keySize)
+		goto out;
+	block = malloc(keySize);
+	if (!block) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	if (mbedtls_rsa_public(rsa, sig, block))
+		goto out;
+	// the block is 00 01 FF..FF 00 DigestInfo with at least 8 bytes of padding
+	if (block[0] != 0x00 || block[1] != 0x01)
+		goto out;
+	for (i = 2; i < keySize && block[i] == 0xff; i++);
+	if (i < 10 || i >= keySize || block[i] != 0x00)
+		goto out;
+	i++;
+	*digestInfoSize = keySize - i;
+	*digestInfo = malloc(*digestInfoSize);
+	if (!*digestInfo) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	memcpy(*digestInfo, block + i, *digestInfoSize);
+	rc = SUCCESS;
+
+out:
+	if (block)
+		free(block);
+	mbedtls_pk_free(&pubKey);
+
+	return rc;
+}
+
+int cryptoSignHash(const unsigned char *key, size_t keySize, const mbedtls_x509_crt *cert, int hashFunct,
+		   const unsigned char *hash, size_t hashSize, unsigned char **sig, size_t *sigSize)
+{
+	int rc;
+	size_t sigSizeBits;
+	mbedtls_pk_context privKey;
+
+	*sig = NULL;
+	mbedtls_pk_init(&privKey);
+	// make sure private key parses into private key format
+	rc = mbedtls_pk_parse_key(&privKey, key, keySize, NULL, 0);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Failed to get context of private key, mbedtls error #%d\n", rc);
+		rc = CERT_FAIL;
+		goto out;
+	}
+	// make sure private key is matched with public key
+	rc = mbedtls_pk_check_pair(&cert->pk, &privKey);
+	if (rc) {
+		prlog(PR_ERR, "Public and private key are not matched, mbedtls err#%d\n", rc);
+		rc = CERT_FAIL;
+		goto out;
+	}
+	// make sure private key is RSA, otherwise quit
+	if (mbedtls_pk_get_type(&privKey) != MBEDTLS_PK_RSA) {
+		prlog(PR_ERR, "ERROR: Key is of type %s expected RSA\n", mbedtls_pk_get_name(&privKey));
+		rc = CERT_FAIL;
+		goto out;
+	}
+	// get size of RSA signature, ex 2048, 4096 ...
+	sigSizeBits = mbedtls_pk_get_bitlen(&privKey);
+	*sig = malloc(sigSizeBits / 8);
+	if (!*sig) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	if (verbose)
+		printf("Signing digest of %zd bytes with RSA into %zd bits \n", hashSize, sigSizeBits);
+	rc = mbedtls_pk_sign(&privKey, hashFunct, hash, 0, *sig, sigSize, 0, NULL);
+	if (rc) {
+		prlog(PR_ERR, "Failed to generate signature, mbedtls err #%d\n", rc);
+		free(*sig);
+		*sig = NULL;
+		rc = CERT_FAIL;
+	}
+
+out:
+	mbedtls_pk_free(&privKey);
+
+	return rc;
+}
@@ -0,0 +1,297 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include <mbedtls/md.h>
+#include <mbedtls/x509_crt.h>
+#include "err.h"
+#include "prlog.h"
+#include "crypto/include/crypto.h"
+
+extern int verbose;
+
+const char *cryptoLibName = "openssl";
+
+struct cryptoHashCtx {
+	EVP_MD_CTX *md;
+};
+
+/*
+ *hash types are the mbedtls ones, see crypto.h
+ */
+static const EVP_MD *getMD(int hashFunct)
+{
+	switch (hashFunct) {
+		case MBEDTLS_MD_SHA1:
+			return EVP_sha1();
+		case MBEDTLS_MD_SHA224:
+			return EVP_sha224();
+		case MBEDTLS_MD_SHA256:
+			return EVP_sha256();
+		case MBEDTLS_MD_SHA384:
+			return EVP_sha384();
+		case MBEDTLS_MD_SHA512:
+			return EVP_sha512();
+		default:
+			return NULL;
+	}
+}
+
+size_t cryptoHashSize(int hashFunct)
+{
+	const EVP_MD *md = getMD(hashFunct);
+
+	return md ? EVP_MD_size(md) : 0;
+}
+
+int cryptoHashInit(struct cryptoHashCtx **ctx, int hashFunct)
+{
+	const EVP_MD *md = getMD(hashFunct);
+
+	if (!md) {
+		prlog(PR_ERR, "ERROR: Invalid hash function %d\n", hashFunct);
+		return HASH_FAIL;
+	}
+	*ctx = malloc(sizeof(**ctx));
+	if (!*ctx) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	(*ctx)->md = EVP_MD_CTX_new();
+	if (!(*ctx)->md || EVP_DigestInit_ex((*ctx)->md, md, NULL) != 1) {
+		prlog(PR_ERR, "ERROR: Could not setup hashing environment openssl err #%lu\n", ERR_get_error());
+		cryptoHashFree(*ctx);
+		*ctx = NULL;
+		return HASH_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+int cryptoHashUpdate(struct cryptoHashCtx *ctx, const unsigned char *data, size_t size)
+{
+	if (EVP_DigestUpdate(ctx->md, data, size) != 1) {
+		prlog(PR_ERR, "ERROR: Failed to add %zd bytes of data to hashing context openssl err #%lu\n", size, ERR_get_error());
+		return HASH_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+int cryptoHashFinish(struct cryptoHashCtx *ctx, unsigned char *hash)
+{
+	if (EVP_DigestFinal_ex(ctx->md, hash, NULL) != 1) {
+		prlog(PR_ERR, "ERROR: Generation hash failed openssl err #%lu\n", ERR_get_error());
+		return HASH_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+void cryptoHashFree(struct cryptoHashCtx *ctx)
+{
+	if (!ctx)
+		return;
+	if (ctx->md)
+		EVP_MD_CTX_free(ctx->md);
+	free(ctx);
+}
+
+int cryptoHash(int hashFunct, const unsigned char *data, size_t size, unsigned char *hash)
+{
+	const EVP_MD *md = getMD(hashFunct);
+
+	if (!md) {
+		prlog(PR_ERR, "ERROR: Invalid hash function %d\n", hashFunct);
+		return HASH_FAIL;
+	}
+	if (EVP_Digest(data, size, hash, NULL, md, NULL) != 1) {
+		prlog(PR_ERR, "ERROR: Generation hash failed openssl err #%lu\n", ERR_get_error());
+		return HASH_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *@return the public key of a certificate parsed by mbedtls or NULL
+ */
+static EVP_PKEY *getPublicKey(const mbedtls_x509_crt *cert)
+{
+	const unsigned char *p = cert->pk_raw.p;
+
+	return d2i_PUBKEY(NULL, &p, cert->pk_raw.len);
+}
+
+/*
+ *@param key, PEM or DER private key, PEM's may include the trailing '\0'
+ *@return the private key or NULL
+ */
+static EVP_PKEY *getPrivateKey(const unsigned char *key, size_t keySize)
+{
+	EVP_PKEY *pkey = NULL;
+	const unsigned char *p = key;
+	BIO *bio;
+
+	bio = BIO_new_mem_buf(key, keySize);
+	if (bio) {
+		pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+		BIO_free(bio);
+	}
+	if (!pkey) {
+		// the failed PEM attempt leaves an error behind, DER is still worth a try
+		ERR_clear_error();
+		pkey = d2i_AutoPrivateKey(NULL, &p, keySize);
+	}
+
+	return pkey;
+}
+
+int cryptoVerifySignature(const mbedtls_x509_crt *cert, int hashFunct, const unsigned char *hash, size_t hashSize,
+			  const unsigned char *sig, size_t sigSize)
+{
+	int rc = AUTH_FAIL;
+	const EVP_MD *md = getMD(hashFunct);
+	EVP_PKEY *pkey;
+	EVP_PKEY_CTX *ctx = NULL;
+
+	pkey = getPublicKey(cert);
+	if (md && !hashSize)
+		hashSize = EVP_MD_size(md);
+	if (!md || !pkey) {
+		prlog(PR_ERR, "ERROR: Could not load public key of certificate, openssl err #%lu\n", ERR_get_error());
+		goto out;
+	}
+	ctx = EVP_PKEY_CTX_new(pkey, NULL);
+	if (!ctx || EVP_PKEY_verify_init(ctx) != 1 || EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) != 1
+	    || EVP_PKEY_CTX_set_signature_md(ctx, md) != 1) {
+		prlog(PR_ERR, "ERROR: Could not setup signature verification, openssl err #%lu\n", ERR_get_error());
+		goto out;
+	}
+	if (EVP_PKEY_verify(ctx, sig, sigSize, hash, hashSize) == 1)
+		rc = SUCCESS;
+	else
+		prlog(PR_INFO, "Signature does not verify, openssl err #%lu\n", ERR_get_error());
+
+out:
+	ERR_clear_error();
+	if (ctx)
+		EVP_PKEY_CTX_free(ctx);
+	if (pkey)
+		EVP_PKEY_free(pkey);
+
+	return rc;
+}
+
+int cryptoRecoverDigest(const mbedtls_x509_crt *cert, const unsigned char *sig, size_t sigSize,
+			unsigned char **digestInfo, size_t *digestInfoSize)
+{
+	int rc = AUTH_FAIL;
+	EVP_PKEY *pkey;
+	EVP_PKEY_CTX *ctx = NULL;
+
+	*digestInfo = NULL;
+	pkey = getPublicKey(cert);
+	if (!pkey || EVP_PKEY_base_id(pkey) != EVP_PKEY_RSA) {
+		prlog(PR_ERR, "ERROR: Could not load RSA public key of certificate, openssl err #%lu\n", ERR_get_error());
+		goto out;
+	}
+	// without a signature md openssl hands back the whole DigestInfo
+	ctx = EVP_PKEY_CTX_new(pkey, NULL);
+	if (!ctx || EVP_PKEY_verify_recover_init(ctx) != 1 || EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) != 1
+	    || EVP_PKEY_verify_recover(ctx, NULL, digestInfoSize, sig, sigSize) != 1) {
+		prlog(PR_ERR, "ERROR: Could not setup signature recovery, openssl err #%lu\n", ERR_get_error());
+		goto out;
+	}
+	*digestInfo = malloc(*digestInfoSize);
+	if (!*digestInfo) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	if (EVP_PKEY_verify_recover(ctx, *digestInfo, digestInfoSize, sig, sigSize) == 1)
+		rc = SUCCESS;
+	else {
+		free(*digestInfo);
+		*digestInfo = NULL;
+	}
+
+out:
+	ERR_clear_error();
+	if (ctx)
+		EVP_PKEY_CTX_free(ctx);
+	if (pkey)
+		EVP_PKEY_free(pkey);
+
+	return rc;
+}
+
+int cryptoSignHash(const unsigned char *key, size_t keySize, const mbedtls_x509_crt *cert, int hashFunct,
+		   const unsigned char *hash, size_t hashSize, unsigned char **sig, size_t *sigSize)
+{
+	int rc = CERT_FAIL;
+	const EVP_MD *md = getMD(hashFunct);
+	EVP_PKEY *privKey = NULL, *pubKey = NULL;
+	EVP_PKEY_CTX *ctx = NULL;
+
+	*sig = NULL;
+	privKey = getPrivateKey(key, keySize);
+	if (!privKey) {
+		prlog(PR_ERR, "ERROR: Failed to get context of private key, openssl err #%lu\n", ERR_get_error());
+		goto out;
+	}
+	// make sure private key is matched with public key
+	pubKey = getPublicKey(cert);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (!pubKey || EVP_PKEY_eq(pubKey, privKey) != 1) {
+#else
+	if (!pubKey || EVP_PKEY_cmp(pubKey, privKey) != 1) {
+#endif
+		prlog(PR_ERR, "Public and private key are not matched\n");
+		goto out;
+	}
+	// make sure private key is RSA, otherwise quit
+	if (EVP_PKEY_base_id(privKey) != EVP_PKEY_RSA) {
+		prlog(PR_ERR, "ERROR: Key is of type %s expected RSA\n", OBJ_nid2sn(EVP_PKEY_base_id(privKey)));
+		goto out;
+	}
+	ctx = EVP_PKEY_CTX_new(privKey, NULL);
+	if (!md || !ctx || EVP_PKEY_sign_init(ctx) != 1 || EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) != 1
+	    || EVP_PKEY_CTX_set_signature_md(ctx, md) != 1 || EVP_PKEY_sign(ctx, NULL, sigSize, hash, hashSize) != 1) {
+		prlog(PR_ERR, "ERROR: Could not setup signing, openssl err #%lu\n", ERR_get_error());
+		goto out;
+	}
+	*sig = malloc(*sigSize);
+	if (!*sig) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	if (verbose)
+		printf("Signing digest of %zd bytes with RSA into %zd bits \n", hashSize, *sigSize * 8);
+	if (EVP_PKEY_sign(ctx, *sig, sigSize, hash, hashSize) != 1) {
+		prlog(PR_ERR, "Failed to generate signature, openssl err #%lu\n", ERR_get_error());
+		free(*sig);
+		*sig = NULL;
+		goto out;
+	}
+	rc = SUCCESS;
+
+out:
+	ERR_clear_error();
+	if (ctx)
+		EVP_PKEY_CTX_free(ctx);
+	if (pubKey)
+		EVP_PKEY_free(pubKey);
+	if (privKey)
+		EVP_PKEY_free(privKey);
+
+	return rc;
+}
@@ -0,0 +1,532 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifdef PKCS11
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h> // for isxdigit
+#include <dlfcn.h> // for loading the PKCS#11 module
+#include <pthread.h>
+#include <p11-kit/pkcs11.h>
+#include <mbedtls/oid.h> // for the DigestInfo of a hash
+#include "err.h"
+#include "prlog.h"
+#include "crypto/include/crypto.h"
+
+/*
+ *Private keys on a PKCS#11 token are named with a 'pkcs11:' URI (RFC 7512), the
+ *path attributes 'token', 'object' and 'id' pick the key and the query attributes
+ *'module-path' and 'pin-value' the module and PIN, SECVARCTL_PKCS11_MODULE and
+ *SECVARCTL_PKCS11_PIN are used when the URI does not have them.
+ *The module is loaded and every key is found and logged into once per process,
+ *later signatures with the same URI reuse the session and key handle, so a run
+ *that signs many updates only pays for one login. The digest is computed here and
+ *only its DigestInfo goes to the token, one C_SignInit/C_Sign pair per signature.
+ */
+#define TOKEN_MAX_DIGEST_INFO 128
+
+struct tokenKey {
+	char *uri;
+	CK_SESSION_HANDLE session;
+	CK_OBJECT_HANDLE key;
+	CK_ULONG sigSize;
+	struct tokenKey *next;
+};
+
+struct tokenURI {
+	char *token, *object, *modulePath, *pin;
+	unsigned char *id;
+	size_t idSize;
+};
+
+static struct {
+	void *module;
+	char *modulePath;
+	CK_FUNCTION_LIST_PTR funcs;
+	struct tokenKey *keys;
+	pthread_mutex_t lock;
+} tokens = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int parseTokenURI(const char *uri, struct tokenURI *out);
+static void freeTokenURI(struct tokenURI *uri);
+static int loadModule(const char *path);
+static int openTokenKey(const char *uri, struct tokenKey **out);
+static int findSlot(const char *label, CK_SLOT_ID *slot, CK_FLAGS *flags);
+static int getDigestInfo(int hashFunct, const unsigned char *hash, size_t hashSize, unsigned char *out, size_t *outSize);
+
+/**
+ *@param key, a key argument, a key file or a PKCS#11 URI
+ *@param size, length of key
+ *@return 1 if key names a private key on a PKCS#11 token
+ */
+int isTokenKey(const char *key, size_t size)
+{
+	return size > strlen(TOKEN_KEY_PREFIX) && !memcmp(key, TOKEN_KEY_PREFIX, strlen(TOKEN_KEY_PREFIX));
+}
+
+/**
+ *signs a digest with an RSA private key on a PKCS#11 token and checks the signature
+ *against the certificate, so a key that does not belong to it is caught like with a key file
+ *@param uri, 'pkcs11:' URI of the key
+ *@param cert, certificate of the key
+ *@param sig, filled with the signature, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param sigSize, filled with length of sig
+ *@return SUCCESS or CERT_FAIL/ALLOC_FAIL
+ */
+int cryptoTokenSignHash(const char *uri, const mbedtls_x509_crt *cert, int hashFunct,
+			const unsigned char *hash, size_t hashSize, unsigned char **sig, size_t *sigSize)
+{
+	struct tokenKey *key;
+	CK_MECHANISM mech = { CKM_RSA_PKCS, NULL, 0 };
+	unsigned char digestInfo[TOKEN_MAX_DIGEST_INFO];
+	size_t digestInfoSize;
+	CK_ULONG len;
+	CK_RV rv;
+	int rc;
+
+	*sig = NULL;
+	rc = getDigestInfo(hashFunct, hash, hashSize, digestInfo, &digestInfoSize);
+	if (rc)
+		return rc;
+	pthread_mutex_lock(&tokens.lock);
+	rc = openTokenKey(uri, &key);
+	if (rc)
+		goto out;
+	*sig = malloc(key->sigSize);
+	if (!*sig) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	if (verbose)
+		printf("Signing digest of %zd bytes with RSA on a PKCS#11 token into %lu bits \n", hashSize, key->sigSize * 8);
+	len = key->sigSize;
+	rv = tokens.funcs->C_SignInit(key->session, &mech, key->key);
+	if (rv == CKR_OK)
+		rv = tokens.funcs->C_Sign(key->session, digestInfo, digestInfoSize, *sig, &len);
+	if (rv != CKR_OK) {
+		prlog(PR_ERR, "ERROR: Failed to generate signature on the PKCS#11 token, error %#lx\n", rv);
+		rc = CERT_FAIL;
+		goto out;
+	}
+	*sigSize = len;
+
+out:
+	pthread_mutex_unlock(&tokens.lock);
+	// make sure the token key is matched with the public key
+	if (!rc && cryptoVerifySignature(cert, hashFunct, hash, hashSize, *sig, *sigSize)) {
+		prlog(PR_ERR, "Public and private key are not matched\n");
+		rc = CERT_FAIL;
+	}
+	if (rc && *sig) {
+		free(*sig);
+		*sig = NULL;
+	}
+
+	return rc;
+}
+
+/**
+ *closes every session and unloads the PKCS#11 module, must be called before exiting
+ */
+void cryptoTokenClose(void)
+{
+	struct tokenKey *key;
+
+	pthread_mutex_lock(&tokens.lock);
+	while (tokens.keys) {
+		key = tokens.keys;
+		tokens.keys = key->next;
+		tokens.funcs->C_CloseSession(key->session);
+		free(key->uri);
+		free(key);
+	}
+	if (tokens.funcs)
+		tokens.funcs->C_Finalize(NULL);
+	if (tokens.module)
+		dlclose(tokens.module);
+	if (tokens.modulePath)
+		free(tokens.modulePath);
+	tokens.funcs = NULL;
+	tokens.module = NULL;
+	tokens.modulePath = NULL;
+	pthread_mutex_unlock(&tokens.lock);
+}
+
+/*
+ *finds the session of a key or opens one, must be called with tokens locked
+ *@param uri, 'pkcs11:' URI of the key
+ *@param out, the key's session
+ *@return SUCCESS or CERT_FAIL/ALLOC_FAIL/ARG_PARSE_FAIL
+ */
+static int openTokenKey(const char *uri, struct tokenKey **out)
+{
+	struct tokenURI parsed;
+	struct tokenKey *key;
+	CK_OBJECT_CLASS keyClass = CKO_PRIVATE_KEY;
+	CK_KEY_TYPE keyType = CKK_RSA;
+	CK_ATTRIBUTE find[4] = {
+		{ CKA_CLASS, &keyClass, sizeof(keyClass) },
+		{ CKA_KEY_TYPE, &keyType, sizeof(keyType) }
+	};
+	CK_ATTRIBUTE modulus = { CKA_MODULUS, NULL, 0 };
+	CK_OBJECT_HANDLE found[2];
+	CK_ULONG count = 0, findCount = 2;
+	CK_SLOT_ID slot;
+	CK_FLAGS flags;
+	CK_RV rv;
+	int rc;
+
+	for (key = tokens.keys; key; key = key->next) {
+		if (!strcmp(key->uri, uri)) {
+			*out = key;
+			return SUCCESS;
+		}
+	}
+	rc = parseTokenURI(uri, &parsed);
+	if (rc)
+		return rc;
+	rc = loadModule(parsed.modulePath);
+	if (rc)
+		goto out;
+	key = calloc(1, sizeof(*key));
+	if (!key || !(key->uri = strdup(uri))) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	rc = findSlot(parsed.token, &slot, &flags);
+	if (rc)
+		goto out;
+	rc = CERT_FAIL;
+	rv = tokens.funcs->C_OpenSession(slot, CKF_SERIAL_SESSION, NULL, NULL, &key->session);
+	if (rv != CKR_OK) {
+		prlog(PR_ERR, "ERROR: Could not open a session on PKCS#11 token, error %#lx\n", rv);
+		key->session = CK_INVALID_HANDLE;
+		goto out;
+	}
+	// the login is shared by every session of the token
+	if (flags & CKF_LOGIN_REQUIRED) {
+		if (!parsed.pin) {
+			prlog(PR_ERR, "ERROR: PKCS#11 token needs a PIN, use 'pin-value' or SECVARCTL_PKCS11_PIN\n");
+			goto out;
+		}
+		rv = tokens.funcs->C_Login(key->session, CKU_USER, (CK_UTF8CHAR_PTR)parsed.pin, strlen(parsed.pin));
+		if (rv != CKR_OK && rv != CKR_USER_ALREADY_LOGGED_IN) {
+			prlog(PR_ERR, "ERROR: Could not log into PKCS#11 token, error %#lx\n", rv);
+			goto out;
+		}
+	}
+	if (parsed.object) {
+		find[2 + count].type = CKA_LABEL;
+		find[2 + count].pValue = parsed.object;
+		find[2 + count++].ulValueLen = strlen(parsed.object);
+	}
+	if (parsed.id) {
+		find[2 + count].type = CKA_ID;
+		find[2 + count].pValue = parsed.id;
+		find[2 + count++].ulValueLen = parsed.idSize;
+	}
+	rv = tokens.funcs->C_FindObjectsInit(key->session, find, 2 + count);
+	if (rv == CKR_OK) {
+		rv = tokens.funcs->C_FindObjects(key->session, found, 2, &findCount);
+		tokens.funcs->C_FindObjectsFinal(key->session);
+	}
+	if (rv != CKR_OK || findCount != 1) {
+		if (rv != CKR_OK)
+			prlog(PR_ERR, "ERROR: Could not search PKCS#11 token, error %#lx\n", rv);
+		else
+			prlog(PR_ERR, "ERROR: %s private RSA keys on the PKCS#11 token match %s\n", findCount ? "Several" : "No", uri);
+		goto out;
+	}
+	key->key = found[0];
+	// signatures are as long as the modulus
+	rv = tokens.funcs->C_GetAttributeValue(key->session, key->key, &modulus, 1);
+	if (rv != CKR_OK || !modulus.ulValueLen || modulus.ulValueLen == CK_UNAVAILABLE_INFORMATION) {
+		prlog(PR_ERR, "ERROR: Could not get the modulus of %s, error %#lx\n", uri, rv);
+		goto out;
+	}
+	key->sigSize = modulus.ulValueLen;
+	prlog(PR_INFO, "Opened PKCS#11 key %s\n", uri);
+	key->next = tokens.keys;
+	tokens.keys = key;
+	*out = key;
+	rc = SUCCESS;
+
+out:
+	if (rc && key) {
+		if (key->session != CK_INVALID_HANDLE)
+			tokens.funcs->C_CloseSession(key->session);
+		if (key->uri)
+			free(key->uri);
+		free(key);
+	}
+	freeTokenURI(&parsed);
+
+	return rc;
+}
+
+/*
+ *loads and initializes the PKCS#11 module, only one module can be used per process
+ *@param path, file of the module
+ *@return SUCCESS or CERT_FAIL/ARG_PARSE_FAIL
+ */
+static int loadModule(const char *path)
+{
+	CK_C_GetFunctionList getFunctionList;
+	CK_C_INITIALIZE_ARGS initArgs;
+	CK_RV rv;
+
+	if (!path) {
+		prlog(PR_ERR, "ERROR: No PKCS#11 module given, use 'module-path' or SECVARCTL_PKCS11_MODULE\n");
+		return ARG_PARSE_FAIL;
+	}
+	if (tokens.module) {
+		if (strcmp(tokens.modulePath, path)) {
+			prlog(PR_ERR, "ERROR: Only one PKCS#11 module can be used, %s is already loaded\n", tokens.modulePath);
+			return ARG_PARSE_FAIL;
+		}
+		return SUCCESS;
+	}
+	tokens.module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!tokens.module) {
+		prlog(PR_ERR, "ERROR: Could not load PKCS#11 module %s: %s\n", path, dlerror());
+		return CERT_FAIL;
+	}
+	getFunctionList = (CK_C_GetFunctionList)dlsym(tokens.module, "C_GetFunctionList");
+	if (!getFunctionList || getFunctionList(&tokens.funcs) != CKR_OK) {
+		prlog(PR_ERR, "ERROR: %s is not a PKCS#11 module\n", path);
+		goto fail;
+	}
+	memset(&initArgs, 0, sizeof(initArgs));
+	initArgs.flags = CKF_OS_LOCKING_OK;
+	rv = tokens.funcs->C_Initialize(&initArgs);
+	if (rv != CKR_OK && rv != CKR_CRYPTOKI_ALREADY_INITIALIZED) {
+		prlog(PR_ERR, "ERROR: Could not initialize PKCS#11 module %s, error %#lx\n", path, rv);
+		goto fail;
+	}
+	tokens.modulePath = strdup(path);
+	if (!tokens.modulePath) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		tokens.funcs->C_Finalize(NULL);
+		goto fail;
+	}
+
+	return SUCCESS;
+fail:
+	tokens.funcs = NULL;
+	dlclose(tokens.module);
+	tokens.module = NULL;
+
+	return CERT_FAIL;
+}
+
+/*
+ *finds the slot of the token with a label or the first slot with a token
+ *@param label, token label or NULL
+ *@param slot, filled with the slot
+ *@param flags, filled with the flags of the token
+ *@return SUCCESS or CERT_FAIL/ALLOC_FAIL
+ */
+static int findSlot(const char *label, CK_SLOT_ID *slot, CK_FLAGS *flags)
+{
+	CK_SLOT_ID *slots = NULL;
+	CK_ULONG count = 0;
+	CK_TOKEN_INFO info;
+	size_t len;
+	int rc = CERT_FAIL;
+
+	if (tokens.funcs->C_GetSlotList(CK_TRUE, NULL, &count) != CKR_OK || !count) {
+		prlog(PR_ERR, "ERROR: No PKCS#11 tokens found\n");
+		return CERT_FAIL;
+	}
+	slots = calloc(count, sizeof(*slots));
+	if (!slots) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	if (tokens.funcs->C_GetSlotList(CK_TRUE, slots, &count) != CKR_OK)
+		count = 0;
+	for (CK_ULONG i = 0; i < count; i++) {
+		if (tokens.funcs->C_GetTokenInfo(slots[i], &info) != CKR_OK)
+			continue;
+		// labels are padded with blanks
+		for (len = sizeof(info.label); len && info.label[len - 1] == ' '; len--)
+			;
+		if (!label || (strlen(label) == len && !memcmp(info.label, label, len))) {
+			*slot = slots[i];
+			*flags = info.flags;
+			rc = SUCCESS;
+			break;
+		}
+	}
+	if (rc)
+		prlog(PR_ERR, "ERROR: PKCS#11 token %s not found\n", label ? label : "");
+	free(slots);
+
+	return rc;
+}
+
+/*
+ *decodes the percent encoding of a URI attribute
+ *@param value, start of the value
+ *@param size, length of the value
+ *@param outSize, filled with the decoded length, may be NULL
+ *@return decoded value with a NUL terminator or NULL, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ */
+static char *decodeURIValue(const char *value, size_t size, size_t *outSize)
+{
+	char *out, hex[3] = { 0 };
+	size_t len = 0;
+
+	out = malloc(size + 1);
+	if (!out)
+		return NULL;
+	for (size_t i = 0; i < size; i++) {
+		if (value[i] == '%') {
+			if (i + 2 >= size || !isxdigit(value[i + 1]) || !isxdigit(value[i + 2])) {
+				free(out);
+				return NULL;
+			}
+			hex[0] = value[i + 1];
+			hex[1] = value[i + 2];
+			out[len++] = strtol(hex, NULL, 16);
+			i += 2;
+		}
+		else
+			out[len++] = value[i];
+	}
+	out[len] = '\0';
+	if (outSize)
+		*outSize = len;
+
+	return out;
+}
+
+/*
+ *splits a 'pkcs11:' URI into the attributes that are used
+ *@param uri, the URI
+ *@param out, filled with the attributes, NOTE: REMEMBER TO freeTokenURI
+ *@return SUCCESS or ARG_PARSE_FAIL
+ */
+static int parseTokenURI(const char *uri, struct tokenURI *out)
+{
+	const char *attr, *end, *eq, *env;
+	char **value, *decoded;
+	size_t size, nameLen;
+	int query = 0;
+
+	memset(out, 0, sizeof(*out));
+	for (attr = uri + strlen(TOKEN_KEY_PREFIX); *attr; attr = *end ? end + 1 : end) {
+		end = attr + strcspn(attr, query ? "&" : ";?");
+		eq = memchr(attr, '=', end - attr);
+		if (!eq) {
+			if (end != attr)
+				goto fail;
+		}
+		else {
+			nameLen = eq - attr;
+			decoded = decodeURIValue(eq + 1, end - eq - 1, &size);
+			if (!decoded)
+				goto fail;
+			value = NULL;
+			if (!query && nameLen == 5 && !memcmp(attr, "token", 5))
+				value = &out->token;
+			else if (!query && nameLen == 6 && !memcmp(attr, "object", 6))
+				value = &out->object;
+			else if (!query && nameLen == 2 && !memcmp(attr, "id", 2))
+				value = (char **)&out->id;
+			else if (query && nameLen == 11 && !memcmp(attr, "module-path", 11))
+				value = &out->modulePath;
+			else if (query && nameLen == 9 && !memcmp(attr, "pin-value", 9))
+				value = &out->pin;
+			if (!value) {
+				prlog(PR_WARNING, "WARNING: Ignoring PKCS#11 URI attribute %.*s\n", (int)nameLen, attr);
+				free(decoded);
+			}
+			else {
+				if (*value)
+					free(*value);
+				*value = decoded;
+				if (value == (char **)&out->id)
+					out->idSize = size;
+			}
+		}
+		if (*end == '?')
+			query = 1;
+	}
+	env = getenv("SECVARCTL_PKCS11_MODULE");
+	if (!out->modulePath && env && !(out->modulePath = strdup(env)))
+		goto fail;
+	env = getenv("SECVARCTL_PKCS11_PIN");
+	if (!out->pin && env && !(out->pin = strdup(env)))
+		goto fail;
+	if (!out->object && !out->id) {
+		prlog(PR_ERR, "ERROR: PKCS#11 URI %s needs an 'object' or 'id' to find the key\n", uri);
+		freeTokenURI(out);
+		return ARG_PARSE_FAIL;
+	}
+
+	return SUCCESS;
+fail:
+	prlog(PR_ERR, "ERROR: Could not parse PKCS#11 URI %s\n", uri);
+	freeTokenURI(out);
+
+	return ARG_PARSE_FAIL;
+}
+
+static void freeTokenURI(struct tokenURI *uri)
+{
+	if (uri->token)
+		free(uri->token);
+	if (uri->object)
+		free(uri->object);
+	if (uri->id)
+		free(uri->id);
+	if (uri->modulePath)
+		free(uri->modulePath);
+	if (uri->pin) {
+		memset(uri->pin, 0, strlen(uri->pin));
+		free(uri->pin);
+	}
+	memset(uri, 0, sizeof(*uri));
+}
+
+/*
+ *builds the DER DigestInfo of a hash that RSA PKCS#1 v1.5 signs
+ *@param out, filled with the DigestInfo, at least TOKEN_MAX_DIGEST_INFO bytes
+ *@param outSize, filled with length of out
+ *@return SUCCESS or HASH_FAIL
+ */
+static int getDigestInfo(int hashFunct, const unsigned char *hash, size_t hashSize, unsigned char *out, size_t *outSize)
+{
+	const char *oid;
+	size_t oidSize;
+
+	if (!hashSize)
+		hashSize = cryptoHashSize(hashFunct);
+	if (mbedtls_oid_get_oid_by_md(hashFunct, &oid, &oidSize) || hashSize != cryptoHashSize(hashFunct)
+	    || 10 + oidSize + hashSize > TOKEN_MAX_DIGEST_INFO) {
+		prlog(PR_ERR, "ERROR: Invalid hash function %d for signing, see mbedtls_md_type_t\n", hashFunct);
+		return HASH_FAIL;
+	}
+	// SEQUENCE { SEQUENCE { OID, NULL }, OCTET STRING }, every length fits in one byte
+	*outSize = 0;
+	out[(*outSize)++] = 0x30;
+	out[(*outSize)++] = 8 + oidSize + hashSize;
+	out[(*outSize)++] = 0x30;
+	out[(*outSize)++] = 4 + oidSize;
+	out[(*outSize)++] = 0x06;
+	out[(*outSize)++] = oidSize;
+	memcpy(out + *outSize, oid, oidSize);
+	*outSize += oidSize;
+	out[(*outSize)++] = 0x05;
+	out[(*outSize)++] = 0x00;
+	out[(*outSize)++] = 0x04;
+	out[(*outSize)++] = hashSize;
+	memcpy(out + *outSize, hash, hashSize);
+	*outSize += hashSize;
+
+	return SUCCESS;
+}
+#endif
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef CRYPTO_H
+#define CRYPTO_H
+#include <stddef.h>
+#include <mbedtls/md.h>
+#include <mbedtls/x509_crt.h>
+
+/*
+ *hashing, RSA signing and signature verification go through one of the crypto
+ *libraries below, picked at build time (CRYPTO_LIB in the Makefile or CMake).
+ *Certificates and PKCS7's are always parsed by mbedtls, so hash types are the
+ *mbedtls_md_type_t values and keys are passed as mbedtls certificates.
+ */
+
+// opaque, each crypto library has its own context
+struct cryptoHashCtx;
+
+// name of the crypto library that was built in, "mbedtls" or "openssl"
+extern const char *cryptoLibName;
+
+/**
+ *@param hashFunct, mbedtls_md_type_t of the hash
+ *@return size of the digest in bytes or 0 if the hash is not supported
+ */
+size_t cryptoHashSize(int hashFunct);
+
+/**
+ *starts a hash, NOTE: REMEMBER TO cryptoHashFree THE CONTEXT
+ *@param ctx, filled with the new context
+ *@param hashFunct, mbedtls_md_type_t of the hash
+ *@return SUCCESS or HASH_FAIL/ALLOC_FAIL
+ */
+int cryptoHashInit(struct cryptoHashCtx **ctx, int hashFunct);
+int cryptoHashUpdate(struct cryptoHashCtx *ctx, const unsigned char *data, size_t size);
+/**
+ *@param hash, filled with cryptoHashSize() bytes of digest
+ *@return SUCCESS or HASH_FAIL
+ */
+int cryptoHashFinish(struct cryptoHashCtx *ctx, unsigned char *hash);
+void cryptoHashFree(struct cryptoHashCtx *ctx);
+
+/**
+ *hashes data in one call
+ *@param hash, filled with cryptoHashSize() bytes of digest
+ *@return SUCCESS or HASH_FAIL
+ */
+int cryptoHash(int hashFunct, const unsigned char *data, size_t size, unsigned char *hash);
+
+/**
+ *checks an RSA PKCS#1 v1.5 signature of a digest against the key of a certificate,
+ *cert is not modified so several threads may verify with the same certificate
+ *@param cert, parsed certificate of the signer
+ *@param hashFunct, mbedtls_md_type_t the digest was made with
+ *@param hashSize, length of hash, 0 means the digest size of hashFunct like mbedtls_pk_verify
+ *@return SUCCESS or AUTH_FAIL
+ */
+int cryptoVerifySignature(const mbedtls_x509_crt *cert, int hashFunct, const unsigned char *hash, size_t hashSize,
+			  const unsigned char *sig, size_t sigSize);
+
+/**
+ *recovers what an RSA PKCS#1 v1.5 signature was made over, the DER DigestInfo holding
+ *the hash algorithm and the digest, so signatures can be compared without the signed data
+ *@param cert, parsed certificate of the signer
+ *@param digestInfo, filled with the DigestInfo, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param digestInfoSize, filled with length of digestInfo
+ *@return SUCCESS or AUTH_FAIL if sig was not made with the key of cert
+ */
+int cryptoRecoverDigest(const mbedtls_x509_crt *cert, const unsigned char *sig, size_t sigSize,
+			unsigned char **digestInfo, size_t *digestInfoSize);
+
+/**
+ *signs a digest with an RSA private key after checking it belongs to the certificate
+ *@param key, private key (PEM or DER)
+ *@param cert, certificate of the key
+ *@param sig, filled with the signature, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param sigSize, filled with length of sig
+ *@return SUCCESS or CERT_FAIL/ALLOC_FAIL
+ */
+int cryptoSignHash(const unsigned char *key, size_t keySize, const mbedtls_x509_crt *cert, int hashFunct,
+		   const unsigned char *hash, size_t hashSize, unsigned char **sig, size_t *sigSize);
+
+/*
+ *private keys can also stay on a PKCS#11 token (HSM, smart card, SoftHSM), they are
+ *given as 'pkcs11:' URIs instead of key files. Only built with PKCS11 (PKCS11=1 in
+ *the Makefile or CMake), the module is loaded at runtime
+ */
+#define TOKEN_KEY_PREFIX "pkcs11:"
+#ifdef PKCS11
+int isTokenKey(const char *key, size_t size);
+
+/**
+ *signs a digest with an RSA private key on a PKCS#11 token, the session and key
+ *handle of a URI are opened on first use and reused until cryptoTokenClose
+ *@param uri, 'pkcs11:' URI of the private key
+ *@param cert, certificate of the key
+ *@param sig, filled with the signature, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param sigSize, filled with length of sig
+ *@return SUCCESS or CERT_FAIL/ALLOC_FAIL/ARG_PARSE_FAIL
+ */
+int cryptoTokenSignHash(const char *uri, const mbedtls_x509_crt *cert, int hashFunct,
+			const unsigned char *hash, size_t hashSize, unsigned char **sig, size_t *sigSize);
+void cryptoTokenClose(void);
+#endif
+#endif
@@ -17,6 +17,7 @@
 #include <mbedtls/pk_internal.h>
 #include <mbedtls/x509_crt.h>
 #include "generic.h"
+#include "crypto/include/crypto.h"
 
 #include "external/skiboot/include/edk2-compat-process.h" //  work on factoring this out
 #include "backends/include/backends.h" // likewise
@@ -149,44 +150,26 @@ out:
 int toHash(const unsigned char* data, size_t size, int hashFunct, unsigned char** outHash, size_t* outHashSize)
 {	
 	const mbedtls_md_info_t *md_info;
-	mbedtls_md_context_t ctx;
 	int rc;
 	
 	
 	md_info = mbedtls_md_info_from_type(hashFunct);
-
-	mbedtls_md_init(&ctx);
-
-	rc = mbedtls_md_setup(&ctx, md_info, 0);
-	if (rc) {
-		prlog(PR_ERR, "ERROR: Could not setup hashing environment mbedtls err #%d\n", rc);
-		goto out;
-	}
-
-	rc = mbedtls_md_starts(&ctx);
-	if (rc) {
-		prlog(PR_ERR, "ERROR: Starting hashing context failed mbedtls err #%d\n", rc);
-		goto out;
-	}
-	prlog(PR_INFO, "Creating %s hash of %zd bytes of data, result will be %d bytes\n", md_info->name, size, md_info->size);
-	rc = mbedtls_md_update(&ctx, data, size);
-	if (rc) {
-		prlog(PR_ERR, "ERROR: Failed to add %zd bytes of data to hashing context failed mbedtls err #%d\n", size, rc);
-		goto out;
+	if (!md_info) {
+		prlog(PR_ERR, "ERROR: Invalid hash function %d, see mbedtls_md_type_t\n", hashFunct);
+		return HASH_FAIL;
 	}
+	prlog(PR_INFO, "Creating %s hash of %zd bytes of data with %s, result will be %d bytes\n", md_info->name, size, cryptoLibName, md_info->size);
 
 	*outHash = calloc(1, md_info->size);
 	if (!*outHash){
 		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-		rc = ALLOC_FAIL;
-		goto out;
+		return ALLOC_FAIL;
 	}
-	rc = mbedtls_md_finish(&ctx, *outHash);
+	rc = cryptoHash(hashFunct, data, size, *outHash);
 	if (rc) {
-		prlog(PR_ERR, "ERROR: Generation hash failed mbedtls err #%d\n", rc);
 		free(*outHash);
 		*outHash = NULL;
-		goto out;
+		return rc;
 	}
 
 	*outHashSize = md_info->size;
@@ -194,11 +177,8 @@ int toHash(const unsigned char* data, size_t size, int hashFunct, unsigned char*
 		printf("Hash generation successful, %s: ", md_info->name);
 		printHex(*outHash, *outHashSize);
 	}
-	rc = SUCCESS;
 
-out:
-	mbedtls_md_free(&ctx);
-	return rc;
+	return SUCCESS;
 }
 
 static int allocateMoreMemory(unsigned char **start, size_t *size, unsigned char **ptr){
@@ -304,68 +284,30 @@ static int setPKCS7Data(unsigned char **start, size_t *size, unsigned char **ptr
 static int setSignature(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info, 
 			mbedtls_x509_crt *pub, unsigned char *priv, size_t privSize) {
 	int rc;
-	size_t sigSize, hashSize, sigSizeBits;
+	size_t sigSize, hashSize;
 	unsigned char *hash = NULL, *signature = NULL;
-	char *sigType = NULL;
-	mbedtls_pk_context *privKey;
-	
 
-	privKey = malloc(sizeof(*privKey));
-	if (!privKey){
-		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-		return ALLOC_FAIL;
-	}
-	mbedtls_pk_init(privKey);
-	// make sure private key parses into private key format
-	rc = mbedtls_pk_parse_key(privKey, priv, privSize, NULL, 0);
-	if (rc) {
-		prlog(PR_ERR, "ERROR: Failed to get context of private key, mbedtls error #%d\n", rc);
-		goto out;
-	}
-	// make sure private key is matched with public key
-	rc = mbedtls_pk_check_pair(&(pub->pk), privKey);
-	if (rc) {
-		prlog(PR_ERR, "Public and private key are not matched, mbedtls err#%d\n", rc);
-		goto out;
-	}
-	// make sure private key is RSA, otherwise quit
-	sigType = (char *) privKey->pk_info->name;
-	if (strcmp(sigType, "RSA")) {
-		rc = CERT_FAIL;
-		prlog(PR_ERR, "ERROR: Key is of type %s expected RSA\n", sigType);
-		goto out;
-	}
-	// get size of RSA signature, ex 2048, 4096 ...
-	sigSizeBits = privKey->pk_info->get_bitlen(privKey->pk_ctx);
-
-	// at this point we know pub and priv are valid, now we need the data to sign
+	// the data to sign
 	rc = toHash(pkcs7Info->newData, pkcs7Info->newDataSize, pkcs7Info->hashFunct, &hash, &hashSize);
 	if (rc) {
 		prlog(PR_ERR, "ERROR: Failed to generate hash of new data for signing\n");
 		goto out;
 	}
-	signature = malloc(sigSizeBits/8);
-	if (!signature){
-		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-		rc = ALLOC_FAIL;
-		goto out;
-	}
-
-	// sign
-	if (verbose)
-		printf("Signing digest of %zd bytes with %s into %zd bits \n", hashSize, sigType, sigSizeBits);
-	rc = mbedtls_pk_sign(privKey, pkcs7Info->hashFunct, hash, 0, signature, &sigSize, 0, NULL);
-	if (rc) {
-		prlog(PR_ERR, "Failed to generate signature, mbedtls err #%d\n", rc);
+#ifdef PKCS11
+	/* ADDED: keys on a PKCS#11 token are held as their URI */
+	if (isTokenKey((const char *)priv, privSize))
+		rc = cryptoTokenSignHash((const char *)priv, pub, pkcs7Info->hashFunct, hash, hashSize, &signature, &sigSize);
+	else
+#endif
+	// checks that priv is an RSA key matching pub before signing
+	rc = cryptoSignHash(priv, privSize, pub, pkcs7Info->hashFunct, hash, hashSize, &signature, &sigSize);
+	if (rc)
 		goto out;
-	}
 	rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_OCTET_STRING, signature, sigSize, 0);
 	if (rc) {
 		prlog(PR_ERR, "Failed to add signature to PKCS7 (signature generation was successful however)\n");
 	}
 out:
-	mbedtls_pk_free(privKey);
-	if (privKey) free(privKey);
 	if (hash) free(hash);
 	if (signature) free(signature);
 	return rc;
@@ -723,6 +665,23 @@ int to_pkcs7_generate_signature(unsigned char **pkcs7, size_t *pkcs7Size, const
 	}
 
 	for (int i = 0; i < keyPairs; i++) {
+		/* ADDED: a key on a PKCS#11 token stays there, only its URI is kept */
+		if (!strncmp(keyFiles[i], TOKEN_KEY_PREFIX, strlen(TOKEN_KEY_PREFIX))) {
+#ifdef PKCS11
+			keys[i] = (unsigned char *)strdup(keyFiles[i]);
+			if (!keys[i]) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				rc = ALLOC_FAIL;
+				goto out;
+			}
+			keySizes[i] = strlen(keyFiles[i]) + 1;
+			continue;
+#else
+			prlog(PR_ERR, "ERROR: %s is a PKCS#11 key but secvarctl was built without PKCS11\n", keyFiles[i]);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+#endif
+		}
 		// get data of private keys
 		keyPEM = (unsigned char *)getDataFromFile(keyFiles[i], &keySizePEM);
 
@@ -783,7 +742,6 @@ int to_pkcs7_already_signed_data(unsigned char **pkcs7, size_t *pkcs7Size, const
 	char **sigs = NULL;
 	size_t  *sig_sizes = NULL;
 	int rc;
-	PKCS7Info info;
 	// if no keys given
 	if (keyPairs == 0) {
 		prlog(PR_ERR, "ERROR: missing signature / certificate pairs... use -s <signedDataFile> -c <certificateFile>\n");
@@ -808,8 +766,40 @@ int to_pkcs7_already_signed_data(unsigned char **pkcs7, size_t *pkcs7Size, const
 		}
 	}
 	
+	rc = to_pkcs7_signatures(pkcs7, pkcs7Size, newData, newDataSize, crtFiles, (const unsigned char **)sigs, sig_sizes, keyPairs, hashFunct);
+out:
+	for (int i = 0; i < keyPairs; i++) {
+		if (sigs[i]) free(sigs[i]);
+	}
+	if (sigs) free (sigs);
+	if (sig_sizes) free(sig_sizes);
+	return rc;
+}
+
+/* ADDED: already signed data that is in memory instead of files
+ *@param pkcs7, the resulting PKCS7, newData not appended, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param pkcs7Size, the length of pkcs7
+ *@param newData, data to be added to be used in digest
+ *@param dataSize , length of newData
+ *@param crtFiles, array of file paths to public keys that were used in signing with(PEM)
+ *@param sigs, array of raw signed data, one per certificate
+ *@param sigSizes, array of the lengths of sigs
+ *@param keyPairs, array length of crt/signatures
+ *@param hashFunct, hash function to use in digest, see mbedtls_md_type_t for values in mbedtls/md.h
+ *@return SUCCESS or err number 
+ */
+int to_pkcs7_signatures(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData, size_t newDataSize,
+	const char** crtFiles, const unsigned char **sigs, const size_t *sigSizes, int keyPairs, int hashFunct)
+{
+	int rc;
+	PKCS7Info info;
+
+	if (keyPairs == 0) {
+		prlog(PR_ERR, "ERROR: missing signature / certificate pairs... use -s <signedDataFile> -c <certificateFile>\n");
+		return ARG_PARSE_FAIL;
+	}
 	info.keys = (unsigned char **)sigs;
-	info.keySizes = sig_sizes;
+	info.keySizes = (size_t *)sigSizes;
 	info.keyPairs = keyPairs;
 	info.newData = newData;
 	info.newDataSize = newDataSize;
@@ -817,17 +807,320 @@ int to_pkcs7_already_signed_data(unsigned char **pkcs7, size_t *pkcs7Size, const
 
 	rc = toPKCS7(pkcs7, pkcs7Size, crtFiles, keyPairs, hashFunct, &info);
 	if (rc)
-		goto out;
+		return rc;
 
 	if (verbose){
 		printf( "PKCS7 generation successful...\n");
 	}
+
+	return SUCCESS;
+}
+
+/* ADDED: combining single signer PKCS7's into one without signing again */
+typedef struct PKCS7Parts {
+	const unsigned char *head; // version, digest algorithms and content info in one
+	size_t headSize;
+	const unsigned char *certs, *signers; // contents of the certificate and signer info sets
+	size_t certsSize, signersSize;
+} PKCS7Parts;
+
+/*
+ *finds the parts of the SignedData of a PKCS7, with or without its ContentInfo wrapper
+ *@param pkcs7, DER of the PKCS7
+ *@param size, length of pkcs7
+ *@param parts, filled with views into pkcs7
+ *@return SUCCESS or PKCS7_FAIL
+ */
+static int splitPKCS7(const unsigned char *pkcs7, size_t size, PKCS7Parts *parts)
+{
+	unsigned char *p = (unsigned char *)pkcs7, *end = p + size;
+	size_t len;
+
+	memset(parts, 0, sizeof(*parts));
+	if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE))
+		return PKCS7_FAIL;
+	end = p + len;
+	// a ContentInfo starts with the SignedData OID, a bare SignedData with its version
+	if (p < end && *p == MBEDTLS_ASN1_OID) {
+		if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_OID) || len != strlen(MBEDTLS_OID_PKCS7_SIGNED_DATA)
+		    || memcmp(p, MBEDTLS_OID_PKCS7_SIGNED_DATA, len))
+			return PKCS7_FAIL;
+		p += len;
+		if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED))
+			return PKCS7_FAIL;
+		end = p + len;
+		if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE))
+			return PKCS7_FAIL;
+		end = p + len;
+	}
+	parts->head = p;
+	if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_INTEGER))
+		return PKCS7_FAIL;
+	p += len;
+	if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET))
+		return PKCS7_FAIL;
+	p += len;
+	if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE))
+		return PKCS7_FAIL;
+	p += len;
+	parts->headSize = p - parts->head;
+	if (p < end && *p == (MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED)) {
+		if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED))
+			return PKCS7_FAIL;
+		parts->certs = p;
+		parts->certsSize = len;
+		p += len;
+	}
+	if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET))
+		return PKCS7_FAIL;
+	parts->signers = p;
+	parts->signersSize = len;
+	p += len;
+	// CRLs are not generated here and would have to be merged too
+	if (p != end)
+		return PKCS7_FAIL;
+
+	return SUCCESS;
+}
+
+/*
+ *adds the elements of a certificate or signer info set to a list, leaving out the ones
+ *that are in the list already so a certificate or signer given twice is kept once
+ *@param set, contents of the set
+ *@param setSize, length of set
+ *@param elems, the list, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param elemSizes, lengths of the elements, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param count, number of elements in the list
+ *@return SUCCESS or err number
+ */
+static int addSetElements(const unsigned char *set, size_t setSize, const unsigned char ***elems, size_t **elemSizes, int *count)
+{
+	unsigned char *p = (unsigned char *)set, *end = p + setSize, *elem;
+	const unsigned char **tmpElems;
+	size_t len, *tmpSizes;
+	int seen;
+
+	while (p < end) {
+		elem = p;
+		if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE))
+			return PKCS7_FAIL;
+		p += len;
+		seen = 0;
+		for (int i = 0; i < *count && !seen; i++)
+			seen = (*elemSizes)[i] == p - elem && !memcmp((*elems)[i], elem, p - elem);
+		if (seen)
+			continue;
+		tmpElems = realloc(*elems, (*count + 1) * sizeof(**elems));
+		if (tmpElems)
+			*elems = tmpElems;
+		tmpSizes = realloc(*elemSizes, (*count + 1) * sizeof(**elemSizes));
+		if (tmpSizes)
+			*elemSizes = tmpSizes;
+		if (!tmpElems || !tmpSizes) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			return ALLOC_FAIL;
+		}
+		(*elems)[*count] = elem;
+		(*elemSizes)[*count] = p - elem;
+		(*count)++;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *writes a list of elements from addSetElements as a set with the given tag
+ *for start, size and ptr see setPKCS7Data
+ *@return SUCCESS or err number
+ */
+static int setMergedSet(unsigned char **start, size_t *size, unsigned char **ptr, const unsigned char **elems,
+			const size_t *elemSizes, int count, int tag)
+{
+	int rc;
+	size_t currentlyUsedBytes = *size - (*ptr - *start);
+
+	// written from the end, so the last element goes first
+	for (int i = count - 1; i >= 0; i--) {
+		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_BIT_STRING, elems[i], elemSizes[i], 0);
+		if (rc)
+			return rc;
+	}
+
+	return setPKCS7Data(start, size, ptr, tag, NULL, *size - (*ptr - *start) - currentlyUsedBytes, 0);
+}
+
+/*
+ *finds the DigestInfo every signer of a PKCS7 signed and checks it is the same as digestInfo,
+ *a signer's certificate is the one of the PKCS7 whose key recovers its signature
+ *@param pkcs7, DER of the PKCS7
+ *@param size, length of pkcs7
+ *@param digestInfo, DigestInfo all signers must have signed, NULL to take it from the first
+ *signer, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param digestInfoSize, length of digestInfo
+ *@param index, number of the PKCS7 for errors
+ *@return SUCCESS or err number
+ */
+static int checkSignedDigest(const unsigned char *pkcs7, size_t size, unsigned char **digestInfo, size_t *digestInfoSize, int index)
+{
+	int rc, signer = 0;
+	unsigned char *recovered = NULL;
+	size_t recoveredSize = 0;
+	mbedtls_pkcs7 parsed;
+	mbedtls_pkcs7_signer_info *info;
+	mbedtls_x509_crt *certs, *crt;
+
+	mbedtls_pkcs7_init(&parsed);
+	rc = mbedtls_pkcs7_parse_der_ext(pkcs7, size, &parsed, MBEDTLS_PKCS7_PARSE_LAZY_CERTS);
+	if (rc != MBEDTLS_PKCS7_SIGNED_DATA) {
+		prlog(PR_ERR, "ERROR: Parsing PKCS7 %d failed mbedtls error #%04x\n", index, rc);
+		rc = PKCS7_FAIL;
+		goto out;
+	}
+	rc = mbedtls_pkcs7_get_certificates(&parsed, &certs);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: PKCS7 %d has no signing certificates, mbedtls error #%04x\n", index, rc);
+		rc = PKCS7_FAIL;
+		goto out;
+	}
+	for (info = parsed.signed_data.signers; info; info = info->next) {
+		signer++;
+		rc = AUTH_FAIL;
+		for (crt = certs; crt && rc; crt = crt->next)
+			rc = cryptoRecoverDigest(crt, info->sig.p, info->sig.len, &recovered, &recoveredSize);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: No certificate of PKCS7 %d made the signature of its signer %d\n", index, signer);
+			goto out;
+		}
+		if (!*digestInfo) {
+			*digestInfo = recovered;
+			*digestInfoSize = recoveredSize;
+			recovered = NULL;
+			continue;
+		}
+		if (recoveredSize != *digestInfoSize || memcmp(recovered, *digestInfo, recoveredSize)) {
+			prlog(PR_ERR, "ERROR: Signer %d of PKCS7 %d signed a different digest than the first signer\n", signer, index);
+			rc = AUTH_FAIL;
+			goto out;
+		}
+		free(recovered);
+		recovered = NULL;
+	}
+	if (!signer) {
+		prlog(PR_ERR, "ERROR: PKCS7 %d has no signers\n", index);
+		rc = PKCS7_FAIL;
+	}
+
 out:
-	for (int i = 0; i < keyPairs; i++) {
-		if (sigs[i]) free(sigs[i]);
+	if (recovered)
+		free(recovered);
+	mbedtls_pkcs7_free(&parsed);
+
+	return rc;
+}
+
+/*
+ *combines the signers of several PKCS7's over the same data into one PKCS7, nothing is
+ *signed again so the signers can sign on their own. The version, digest algorithms and
+ *content of every PKCS7 must be equal and every signer must have signed the same digest
+ *@param pkcs7, the resulting PKCS7, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param pkcs7Size, the length of pkcs7
+ *@param inputs, DER of the PKCS7's to merge
+ *@param inputSizes, lengths of inputs
+ *@param count, number of inputs
+ *@return SUCCESS or err number
+ */
+int merge_pkcs7(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char **inputs, const size_t *inputSizes, int count)
+{
+	int rc = SUCCESS, certCount = 0, signerCount = 0;
+	unsigned char *pkcs7Buff = NULL, *ptr, *digestInfo = NULL;
+	const unsigned char **certs = NULL, **signers = NULL;
+	size_t pkcs7BuffSize = 0, currentlyUsedBytes, digestInfoSize = 0, *certSizes = NULL, *signerSizes = NULL;
+	PKCS7Parts *parts = NULL;
+
+	*pkcs7 = NULL;
+	if (count < 1) {
+		prlog(PR_ERR, "ERROR: No PKCS7's given to merge\n");
+		return ARG_PARSE_FAIL;
 	}
-	if (sigs) free (sigs);
-	if (sig_sizes) free(sig_sizes);
+	parts = calloc(count, sizeof(*parts));
+	if (!parts) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (int i = 0; i < count; i++) {
+		rc = splitPKCS7(inputs[i], inputSizes[i], &parts[i]);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: PKCS7 %d is not a SignedData that can be merged\n", i + 1);
+			goto out;
+		}
+		if (parts[i].headSize != parts[0].headSize || memcmp(parts[i].head, parts[0].head, parts[0].headSize)) {
+			prlog(PR_ERR, "ERROR: PKCS7 %d has another version, digest algorithm or content than PKCS7 1\n", i + 1);
+			rc = PKCS7_FAIL;
+			goto out;
+		}
+		rc = checkSignedDigest(inputs[i], inputSizes[i], &digestInfo, &digestInfoSize, i + 1);
+		if (rc)
+			goto out;
+		rc = addSetElements(parts[i].certs, parts[i].certsSize, &certs, &certSizes, &certCount);
+		if (!rc)
+			rc = addSetElements(parts[i].signers, parts[i].signersSize, &signers, &signerSizes, &signerCount);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Invalid certificates or signers in PKCS7 %d\n", i + 1);
+			goto out;
+		}
+		pkcs7BuffSize += inputSizes[i];
+	}
+	prlog(PR_INFO, "Merging %d PKCS7's into %d signer(s) with %d certificate(s)...\n", count, signerCount, certCount);
+
+	// the merged PKCS7 is never larger than its inputs together
+	pkcs7Buff = malloc(pkcs7BuffSize);
+	if (!pkcs7Buff) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	ptr = pkcs7Buff + pkcs7BuffSize;
+	rc = setMergedSet(&pkcs7Buff, &pkcs7BuffSize, &ptr, signers, signerSizes, signerCount, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET);
+	if (!rc)
+		rc = setMergedSet(&pkcs7Buff, &pkcs7BuffSize, &ptr, certs, certSizes, certCount,
+				  MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED);
+	if (!rc)
+		rc = setPKCS7Data(&pkcs7Buff, &pkcs7BuffSize, &ptr, MBEDTLS_ASN1_BIT_STRING, parts[0].head, parts[0].headSize, 0);
+	if (!rc) {
+		currentlyUsedBytes = pkcs7BuffSize - (ptr - pkcs7Buff);
+		rc = setPKCS7Data(&pkcs7Buff, &pkcs7BuffSize, &ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE, NULL, currentlyUsedBytes, 0);
+	}
+	// same outer format as a generated PKCS7, see setPKCS7OID
+	if (!rc && !(secvarctl_backend->quirks & QUIRK_PKCS2_SIGNEDDATA_ONLY)) {
+		currentlyUsedBytes = pkcs7BuffSize - (ptr - pkcs7Buff);
+		rc = setPKCS7Data(&pkcs7Buff, &pkcs7BuffSize, &ptr, MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED, NULL, currentlyUsedBytes, 0);
+		if (!rc) {
+			currentlyUsedBytes = pkcs7BuffSize - (ptr - pkcs7Buff);
+			rc = setPKCS7Data(&pkcs7Buff, &pkcs7BuffSize, &ptr, MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC, (void *) MBEDTLS_OID_PKCS7_SIGNED_DATA, strlen(MBEDTLS_OID_PKCS7_SIGNED_DATA), currentlyUsedBytes);
+		}
+	}
+	if (rc) {
+		prlog(PR_ERR, "Failed to generate merged PKCS7\n");
+		goto out;
+	}
+	*pkcs7Size = pkcs7BuffSize - (ptr - pkcs7Buff);
+	*pkcs7 = malloc(*pkcs7Size);
+	if (!*pkcs7) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	memcpy(*pkcs7, ptr, *pkcs7Size);
+
+out:
+	if (parts) free(parts);
+	if (certs) free(certs);
+	if (certSizes) free(certSizes);
+	if (signers) free(signers);
+	if (signerSizes) free(signerSizes);
+	if (digestInfo) free(digestInfo);
+	if (pkcs7Buff) free(pkcs7Buff);
+
 	return rc;
 }
 #endif
@@ -3,8 +3,11 @@
 #include "pkcs7.h"
 int to_pkcs7_already_signed_data(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData, size_t newDataSize, 
     const char** crtFiles, const char** sigFiles,  int keyPairs, int hashFunct);
+int to_pkcs7_signatures(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData, size_t newDataSize,
+    const char** crtFiles, const unsigned char **sigs, const size_t *sigSizes, int keyPairs, int hashFunct);
 int to_pkcs7_generate_signature(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData, size_t newDataSize, 
     const char** crtFiles, const char** keyFiles,  int keyPairs, int hashFunct);
+int merge_pkcs7(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char **inputs, const size_t *inputSizes, int count);
 int convert_pem_to_der( const unsigned char *input, size_t ilen, unsigned char **output, size_t *olen );
 int toHash(const unsigned char* data, size_t size, int hashFunct, unsigned char** outHash, size_t* outHashSize);
 #endif
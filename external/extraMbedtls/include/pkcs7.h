@@ -49,6 +49,7 @@
 #define MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA                   -0x8400  /**< Input invalid. */
 #define MBEDTLS_ERR_PKCS7_ALLOC_FAILED                     -0x8480  /**< Allocation of memory failed. */
 #define MBEDTLS_ERR_PKCS7_FILE_IO_ERROR                    -0x8500  /**< File Read/Write Error */
+#define MBEDTLS_ERR_PKCS7_VERIFY_CANCELLED                 -0x8580  /**< ADDED: Pair was not tried, another one already verified */
 /* \} name */
 
 /**
@@ -58,6 +59,15 @@
 #define MBEDTLS_PKCS7_SUPPORTED_VERSION                           0x01
 /* \} name */
 
+/**
+ * \name PKCS7 Parse Flags (ADDED)
+ * \{
+ */
+/* only record where the embedded certificates are, decode them with
+ * mbedtls_pkcs7_get_certificates when they are needed */
+#define MBEDTLS_PKCS7_PARSE_LAZY_CERTS                            0x01
+/* \} name */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -127,6 +137,8 @@ typedef struct mbedtls_pkcs7_signed_data
     mbedtls_pkcs7_buf digest_alg_identifiers;
     struct mbedtls_pkcs7_data content;
     mbedtls_x509_crt certs;
+    mbedtls_pkcs7_buf certs_raw; /* ADDED: DER of the certificate set */
+    int certs_parsed; /* ADDED: certs holds the decoded certs_raw */
     mbedtls_x509_crl crl;
     struct mbedtls_pkcs7_signer_info *signers;
 }
@@ -147,6 +159,15 @@ void mbedtls_pkcs7_init( mbedtls_pkcs7 *pkcs7 );
 int mbedtls_pkcs7_parse_der(const unsigned char *buf, const int buflen,
                             mbedtls_pkcs7 *pkcs7);
 
+/* ADDED: parse with MBEDTLS_PKCS7_PARSE_* flags */
+int mbedtls_pkcs7_parse_der_ext(const unsigned char *buf, const int buflen,
+                                mbedtls_pkcs7 *pkcs7, int flags);
+
+/* ADDED: decodes the embedded certificates if that has not happened yet,
+ * certs points into pkcs7 and is freed with it */
+int mbedtls_pkcs7_get_certificates(mbedtls_pkcs7 *pkcs7,
+                                   mbedtls_x509_crt **certs);
+
 int mbedtls_pkcs7_signed_data_verify(mbedtls_pkcs7 *pkcs7,
                                      mbedtls_x509_crt *cert,
                                      const unsigned char *data,
@@ -156,6 +177,19 @@ int mbedtls_pkcs7_signed_hash_verify( mbedtls_pkcs7 *pkcs7,
                                       mbedtls_x509_crt *cert,
                                       const unsigned char *hash, int hashlen);
 
+/* ADDED: number of SignerInfos */
+int mbedtls_pkcs7_signer_count( const mbedtls_pkcs7 *pkcs7 );
+
+/* ADDED: verifies hash for every (signer, certs[i]) pair on up to threads
+ * workers. Without results it returns 0 as soon as any pair verifies and the
+ * pairs that have not started are cancelled, *matched is set to the index of
+ * the certificate that verified. With results every pair is evaluated and
+ * results[signer * ncerts + cert] is set to the result of that pair */
+int mbedtls_pkcs7_signed_hash_verify_multi( mbedtls_pkcs7 *pkcs7,
+                                            mbedtls_x509_crt **certs, int ncerts,
+                                            const unsigned char *hash, int hashlen,
+                                            int threads, int *results, int *matched );
+
 int mbedtls_pkcs7_load_file( const char *path, unsigned char **buf, size_t *n );
 
 void mbedtls_pkcs7_free(  mbedtls_pkcs7 *pkcs7 );
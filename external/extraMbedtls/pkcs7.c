@@ -36,6 +36,7 @@
 #include <sys/stat.h>
 #endif
 #include <unistd.h>
+#include <pthread.h> //ADDED: for mbedtls_pkcs7_signed_hash_verify_multi
 
 #if defined(MBEDTLS_PLATFORM_C)
 #include <mbedtls/platform.h>
@@ -59,6 +60,7 @@
 /* Prototypes */
 //ADDED BY NICK
 #include "prlog.h"
+#include "crypto/include/crypto.h" //ADDED: hashing and RSA go through the selected crypto library
 static void pkcs7_free_signer_info( mbedtls_pkcs7_signer_info *si );
 
 
@@ -423,7 +425,7 @@ cleanup:
  *      signerInfos SignerInfos }
  */
 static int pkcs7_get_signed_data( unsigned char *buf, size_t buflen,
-        mbedtls_pkcs7_signed_data *signed_data )
+        mbedtls_pkcs7_signed_data *signed_data, int flags ) //ADDED flags
 {
     unsigned char *p = buf;
     unsigned char *end = buf + buflen;
@@ -472,9 +474,16 @@ static int pkcs7_get_signed_data( unsigned char *buf, size_t buflen,
     ret = pkcs7_get_next_content_len( &p, end, &len );
     if( ret == 0 ) {
         mbedtls_x509_crt_init( &signed_data->certs );
-        ret = pkcs7_get_certificates( &p, len, &signed_data->certs );
-        if( ret != 0 )
-            return( ret ) ;
+        /* ADDED: remember the set so the certs can be decoded later */
+        signed_data->certs_raw.tag = MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_CONTEXT_SPECIFIC;
+        signed_data->certs_raw.p = p;
+        signed_data->certs_raw.len = len;
+        if( !( flags & MBEDTLS_PKCS7_PARSE_LAZY_CERTS ) ) {
+            ret = pkcs7_get_certificates( &p, len, &signed_data->certs );
+            if( ret != 0 )
+                return( ret ) ;
+            signed_data->certs_parsed = 1;
+        }
 
       p = p + len;
     }
@@ -491,6 +500,13 @@ static int pkcs7_get_signed_data( unsigned char *buf, size_t buflen,
 
 int mbedtls_pkcs7_parse_der( const unsigned char *buf, const int buflen,
         mbedtls_pkcs7 *pkcs7 )
+{
+    return( mbedtls_pkcs7_parse_der_ext( buf, buflen, pkcs7, 0 ) );
+}
+
+/* ADDED: mbedtls_pkcs7_parse_der with MBEDTLS_PKCS7_PARSE_* flags */
+int mbedtls_pkcs7_parse_der_ext( const unsigned char *buf, const int buflen,
+        mbedtls_pkcs7 *pkcs7, int flags )
 {
     unsigned char *start;
     unsigned char *end;
@@ -534,7 +550,7 @@ try_data:
     if( ret != 0 )
         goto out;
 
-    ret = pkcs7_get_signed_data( start, len, &pkcs7->signed_data );
+    ret = pkcs7_get_signed_data( start, len, &pkcs7->signed_data, flags );
     if (ret != 0)
         goto out;
 
@@ -548,6 +564,35 @@ out:
     return( ret );
 }
 
+/* ADDED: decodes the certificates a lazy parse skipped, the raw set
+ * points into the parsed buffer which must still be around */
+int mbedtls_pkcs7_get_certificates( mbedtls_pkcs7 *pkcs7,
+                                    mbedtls_x509_crt **certs )
+{
+    int ret;
+    unsigned char *p;
+
+    if( pkcs7 == NULL || certs == NULL )
+        return( MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA );
+    if( pkcs7->signed_data.certs_raw.p == NULL )
+        return( MBEDTLS_ERR_PKCS7_INVALID_FORMAT );
+    if( !pkcs7->signed_data.certs_parsed ) {
+        p = pkcs7->signed_data.certs_raw.p;
+        ret = pkcs7_get_certificates( &p, pkcs7->signed_data.certs_raw.len,
+                                      &pkcs7->signed_data.certs );
+        if( ret != 0 ) {
+            /* leave it decodable again rather than half filled */
+            mbedtls_x509_crt_free( &pkcs7->signed_data.certs );
+            mbedtls_x509_crt_init( &pkcs7->signed_data.certs );
+            return( ret );
+        }
+        pkcs7->signed_data.certs_parsed = 1;
+    }
+    *certs = &pkcs7->signed_data.certs;
+
+    return( 0 );
+}
+
 int mbedtls_pkcs7_signed_data_verify( mbedtls_pkcs7 *pkcs7,
                                       mbedtls_x509_crt *cert,
                                       const unsigned char *data,
@@ -570,10 +615,11 @@ int mbedtls_pkcs7_signed_data_verify( mbedtls_pkcs7 *pkcs7,
         return( MBEDTLS_ERR_PKCS7_ALLOC_FAILED );
     }
 
-    mbedtls_md( md_info, data, datalen, hash );
-
-    ret = mbedtls_pkcs7_signed_hash_verify( pkcs7, cert,
-                                            hash, sizeof( hash ) );
+    /* ADDED: hash with the selected crypto library and pass the digest length, not the pointer size */
+    ret = cryptoHash( md_alg, data, datalen, hash );
+    if( ret == 0 )
+        ret = mbedtls_pkcs7_signed_hash_verify( pkcs7, cert,
+                                                hash, mbedtls_md_get_size( md_info ) );
 
     mbedtls_free( hash );
 
@@ -586,15 +632,12 @@ int mbedtls_pkcs7_signed_hash_verify( mbedtls_pkcs7 *pkcs7,
 {
     int ret;
     mbedtls_md_type_t md_alg;
-    mbedtls_pk_context pk_cxt;
     mbedtls_pkcs7_signer_info *signer;
 
     ret = mbedtls_oid_get_md_alg( &pkcs7->signed_data.digest_alg_identifiers, &md_alg );
     if( ret != 0 )
         return( MBEDTLS_ERR_PKCS7_INVALID_ALG + ret );
 
-    pk_cxt = cert->pk;
-
     /*
      * Potential TODO
      * Currently we iterate over all signers and return success if any of them
@@ -609,9 +652,10 @@ int mbedtls_pkcs7_signed_hash_verify( mbedtls_pkcs7 *pkcs7,
     signer = pkcs7->signed_data.signers;
     while( signer != NULL )
     {
-        ret = mbedtls_pk_verify( &pk_cxt, md_alg, hash, hashlen,
-                                 signer->sig.p,
-                                 signer->sig.len );
+        /* ADDED: verify with the selected crypto library */
+        ret = cryptoVerifySignature( cert, md_alg, hash, hashlen,
+                                     signer->sig.p,
+                                     signer->sig.len );
         if( ret == 0 )
             return( ret );
         signer = signer->next;
@@ -619,6 +663,134 @@ int mbedtls_pkcs7_signed_hash_verify( mbedtls_pkcs7 *pkcs7,
     return ( ret );
 }
 
+/* ADDED: number of SignerInfos */
+int mbedtls_pkcs7_signer_count( const mbedtls_pkcs7 *pkcs7 )
+{
+    int count = 0;
+    const mbedtls_pkcs7_signer_info *signer;
+
+    for( signer = pkcs7->signed_data.signers; signer != NULL; signer = signer->next )
+        count++;
+
+    return( count );
+}
+
+/* ADDED: shared state of the workers of mbedtls_pkcs7_signed_hash_verify_multi,
+ * pair i is signer i % nsigners with certificate i / nsigners so the pairs
+ * of the first certificate are handed out first like the sequential loop */
+struct pkcs7_verify_pool
+{
+    mbedtls_pkcs7_signer_info **signers;
+    int nsigners;
+    mbedtls_x509_crt **certs;
+    mbedtls_md_type_t md_alg;
+    const unsigned char *hash;
+    int hashlen;
+    int *results;
+    int npairs, next, matched, ret;
+    pthread_mutex_t lock;
+};
+
+static void *pkcs7_verify_worker( void *arg )
+{
+    struct pkcs7_verify_pool *pool = arg;
+    mbedtls_pkcs7_signer_info *signer;
+    int pair, ret;
+
+    for( ;; )
+    {
+        pthread_mutex_lock( &pool->lock );
+        /* once a pair verified only a full result matrix needs the rest */
+        if( pool->next >= pool->npairs ||
+            ( pool->results == NULL && pool->matched >= 0 ) )
+        {
+            pthread_mutex_unlock( &pool->lock );
+            break;
+        }
+        pair = pool->next++;
+        pthread_mutex_unlock( &pool->lock );
+
+        signer = pool->signers[pair % pool->nsigners];
+        ret = cryptoVerifySignature( pool->certs[pair / pool->nsigners],
+                                     pool->md_alg, pool->hash, pool->hashlen,
+                                     signer->sig.p, signer->sig.len );
+
+        pthread_mutex_lock( &pool->lock );
+        if( pool->results != NULL )
+            pool->results[( pair % pool->nsigners ) * ( pool->npairs / pool->nsigners )
+                          + pair / pool->nsigners] = ret;
+        if( ret == 0 && ( pool->matched < 0 || pair / pool->nsigners < pool->matched ) )
+            pool->matched = pair / pool->nsigners;
+        if( pool->matched < 0 )
+            pool->ret = ret;
+        pthread_mutex_unlock( &pool->lock );
+    }
+
+    return( NULL );
+}
+
+int mbedtls_pkcs7_signed_hash_verify_multi( mbedtls_pkcs7 *pkcs7,
+                                            mbedtls_x509_crt **certs, int ncerts,
+                                            const unsigned char *hash, int hashlen,
+                                            int threads, int *results, int *matched )
+{
+    int ret, i, created = 0;
+    pthread_t *workers = NULL;
+    mbedtls_pkcs7_signer_info *signer;
+    struct pkcs7_verify_pool pool;
+
+    memset( &pool, 0, sizeof( pool ) );
+    pool.matched = -1;
+    pool.ret = MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA;
+    if( pkcs7 == NULL || certs == NULL || ncerts <= 0 )
+        return( pool.ret );
+
+    ret = mbedtls_oid_get_md_alg( &pkcs7->signed_data.digest_alg_identifiers, &pool.md_alg );
+    if( ret != 0 )
+        return( MBEDTLS_ERR_PKCS7_INVALID_ALG + ret );
+
+    pool.nsigners = mbedtls_pkcs7_signer_count( pkcs7 );
+    if( pool.nsigners == 0 )
+        return( MBEDTLS_ERR_PKCS7_INVALID_SIGNER_INFO );
+    pool.signers = mbedtls_calloc( pool.nsigners, sizeof( *pool.signers ) );
+    if( pool.signers == NULL )
+        return( MBEDTLS_ERR_PKCS7_ALLOC_FAILED );
+    for( i = 0, signer = pkcs7->signed_data.signers; signer != NULL; signer = signer->next )
+        pool.signers[i++] = signer;
+    pool.certs = certs;
+    pool.hash = hash;
+    pool.hashlen = hashlen;
+    pool.results = results;
+    pool.npairs = pool.nsigners * ncerts;
+    if( results != NULL )
+        for( i = 0; i < pool.npairs; i++ )
+            results[i] = MBEDTLS_ERR_PKCS7_VERIFY_CANCELLED;
+    pthread_mutex_init( &pool.lock, NULL );
+
+    if( threads > pool.npairs )
+        threads = pool.npairs;
+    if( threads > 1 )
+        workers = mbedtls_calloc( threads, sizeof( *workers ) );
+    for( ; workers != NULL && created < threads; created++ )
+        if( pthread_create( &workers[created], NULL, pkcs7_verify_worker, &pool ) != 0 )
+            break;
+    /* if no workers could be started then do the work here */
+    if( created == 0 )
+        pkcs7_verify_worker( &pool );
+    for( i = 0; i < created; i++ )
+        pthread_join( workers[i], NULL );
+
+    if( pool.matched >= 0 )
+        pool.ret = 0;
+    if( matched != NULL )
+        *matched = pool.matched;
+    pthread_mutex_destroy( &pool.lock );
+    mbedtls_free( workers );
+    mbedtls_free( pool.signers );
+
+    return( pool.ret );
+}
+
 /*
  * Deallocate the contents of a pkcs7 signer_info
  */
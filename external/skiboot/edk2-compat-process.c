@@ -23,24 +23,35 @@
 #include <stdlib.h>
 #include "external/skiboot/include/edk2.h"
 #include "prlog.h"
+#include "crypto/include/crypto.h" //ADDED
 
 
 
 bool setup_mode;
+const struct update_cache_ops *update_cache; //ADDED
+const struct parsed_update_ops *parsed_updates; //ADDED
+int verify_threads; //ADDED
 
 int update_variable_in_bank(struct secvar *update_var, const char *data,
 			    const uint64_t dsize, struct list_head *bank)
 {
 	struct secvar *var;
+	char *tmp;
 
 	var = find_secvar(update_var->key, update_var->key_len, bank);
 	if (!var)
 		return OPAL_EMPTY;
 
         /* Reallocate the data memory, if there is change in data size */
-	if (var->data_size < dsize)
-		if (realloc_secvar(var, dsize))
+	/* ADDED: the old contents are overwritten, so do not copy them over,
+	 * bank data comes from the secvar allocator */
+	if (var->data_size < dsize) {
+		tmp = secvar_zalloc(dsize);
+		if (!tmp)
 			return OPAL_NO_MEM;
+		secvar_free(var->data);
+		var->data = tmp;
+	}
 
 	if (dsize && data)
 		memcpy(var->data, data, dsize);
@@ -58,6 +69,102 @@ int update_variable_in_bank(struct secvar *update_var, const char *data,
 	return 0;
 }
 
+/* ADDED: true if the ESLs in esl already hold the signature sig of the
+ * type and size described by list, like edk2 the owner is compared too */
+static bool esl_has_signature(const char *esl, size_t size,
+			      const EFI_SIGNATURE_LIST *list, const char *sig)
+{
+	const EFI_SIGNATURE_LIST *cur;
+	size_t offset = 0, lsize, hsize, ssize = le32_to_cpu(list->SignatureSize);
+	const char *data;
+
+	while (size - offset >= sizeof(EFI_SIGNATURE_LIST)) {
+		cur = (const EFI_SIGNATURE_LIST *)(esl + offset);
+		lsize = le32_to_cpu(cur->SignatureListSize);
+		hsize = le32_to_cpu(cur->SignatureHeaderSize);
+		if (lsize > size - offset || lsize < sizeof(EFI_SIGNATURE_LIST) + hsize
+		    || !cur->SignatureSize)
+			break;
+		if (uuid_equals(&cur->SignatureType, &list->SignatureType)
+		    && le32_to_cpu(cur->SignatureSize) == ssize) {
+			data = esl + offset + sizeof(EFI_SIGNATURE_LIST) + hsize;
+			for (; data + ssize <= esl + offset + lsize; data += ssize) {
+				if (!memcmp(data, sig, ssize))
+					return true;
+			}
+		}
+		offset += lsize;
+	}
+
+	return false;
+}
+
+/* ADDED: EFI_VARIABLE_APPEND_WRITE, the new ESLs are added after the
+ * current ones leaving out any signature the variable already has */
+int append_variable_in_bank(struct secvar *update_var, const char *data,
+			    const uint64_t dsize, struct list_head *bank)
+{
+	struct secvar *var;
+	const EFI_SIGNATURE_LIST *list;
+	EFI_SIGNATURE_LIST *out;
+	size_t offset = 0, size, lsize, hsize, ssize, kept;
+	const char *sig;
+	char *tmp;
+
+	var = find_secvar(update_var->key, update_var->key_len, bank);
+	if (!var)
+		return OPAL_EMPTY;
+
+	/* Appending nothing leaves the variable as it is */
+	if (!dsize)
+		return 0;
+
+	tmp = secvar_zalloc(var->data_size + dsize);
+	if (!tmp)
+		return OPAL_NO_MEM;
+	memcpy(tmp, var->data, var->data_size);
+	size = var->data_size;
+
+	while (dsize - offset >= sizeof(EFI_SIGNATURE_LIST)) {
+		list = (const EFI_SIGNATURE_LIST *)(data + offset);
+		lsize = le32_to_cpu(list->SignatureListSize);
+		hsize = le32_to_cpu(list->SignatureHeaderSize);
+		ssize = le32_to_cpu(list->SignatureSize);
+		if (lsize > dsize - offset || lsize < sizeof(EFI_SIGNATURE_LIST) + hsize
+		    || !ssize) {
+			secvar_free(tmp);
+			return OPAL_PARAMETER;
+		}
+		/* Copy the list and its header, then only the new signatures */
+		out = (EFI_SIGNATURE_LIST *)(tmp + size);
+		memcpy(out, list, sizeof(EFI_SIGNATURE_LIST) + hsize);
+		kept = 0;
+		for (sig = data + offset + sizeof(EFI_SIGNATURE_LIST) + hsize;
+		     sig + ssize <= data + offset + lsize; sig += ssize) {
+			if (esl_has_signature(var->data, var->data_size, list, sig))
+				continue;
+			memcpy((char *)out + sizeof(EFI_SIGNATURE_LIST) + hsize
+			       + kept * ssize, sig, ssize);
+			kept++;
+		}
+		if (kept) {
+			out->SignatureListSize = cpu_to_le32(sizeof(EFI_SIGNATURE_LIST)
+							     + hsize + kept * ssize);
+			size += le32_to_cpu(out->SignatureListSize);
+		}
+		offset += lsize;
+	}
+
+	secvar_free(var->data);
+	var->data = tmp;
+	var->data_size = size;
+
+	if (size)
+		var->flags &= ~SECVAR_FLAG_VOLATILE;
+
+	return 0;
+}
+
 /* Expand char to wide character size */
 static char *char_to_wchar(const char *key, const size_t keylen)
 {
@@ -180,7 +287,7 @@ static size_t get_pkcs7_len(const struct efi_variable_authentication_2 *auth)
 	return size;
 }
 
-int get_auth_descriptor2(const void *buf, const size_t buflen, void **auth_buffer)
+int get_auth_descriptor2(const void *buf, const size_t buflen, const void **auth_buffer)
 {
 	const struct efi_variable_authentication_2 *auth = buf;
 	int auth_buffer_size;
@@ -199,15 +306,11 @@ int get_auth_descriptor2(const void *buf, const size_t buflen, void **auth_buffe
 	auth_buffer_size = sizeof(auth->timestamp) + sizeof(auth->auth_info.hdr)
 			   + sizeof(auth->auth_info.cert_type) + len;
 
-	*auth_buffer = zalloc(auth_buffer_size);
-	if (!(*auth_buffer))
-		return OPAL_NO_MEM;
-
 	/*
 	 * Data = auth descriptor + new ESL data.
-	 * Extracts only the auth descriptor from data.
+	 * ADDED: the auth descriptor is returned as a view into buf, not a copy.
 	 */
-	memcpy(*auth_buffer, buf, auth_buffer_size);
+	*auth_buffer = buf;
 
 	return auth_buffer_size;
 }
@@ -218,6 +321,10 @@ static bool validate_cert(char *signing_cert, int signing_cert_size)
 	char *x509_buf = NULL;
 	int rc;
 
+	/* ADDED: a certificate the caller already parsed is known to be good */
+	if (parsed_updates && parsed_updates->get_cert(signing_cert, signing_cert_size))
+		return true;
+
 	mbedtls_x509_crt_init(&x509);
 	rc = mbedtls_x509_crt_parse(&x509, (unsigned char *)signing_cert, signing_cert_size);
 
@@ -271,6 +378,7 @@ int validate_esl_list(const char *key, const char *esl, const size_t size)
 	int rc = OPAL_SUCCESS;
 	int offset = 0;
 	EFI_SIGNATURE_LIST *list = NULL;
+	bool valid = false; //ADDED
 
 	while (eslvarsize > 0) {
 		prlog(PR_DEBUG, "esl var size size is %d offset is %d\n", eslvarsize, offset);
@@ -309,13 +417,17 @@ int validate_esl_list(const char *key, const char *esl, const size_t size)
 				rc = OPAL_PARAMETER;
 				break;
 			}
-		} else {
+		} else if (!valid) {
+		       /* ADDED: every pass reads the list at the start of esl, not
+			* at offset, so once it checked out there is no need to
+			* parse the same certificate again for each following list */
 		       if (!uuid_equals(&list->SignatureType, &EFI_CERT_X509_GUID)
 			   || !validate_cert(data, dsize)) {
 				prlog(PR_ERR, "No valid cert is found\n");
 				rc = OPAL_PARAMETER;
 				break;
 		       }
+		       valid = true; //ADDED
 		}
 
 		count++;
@@ -429,6 +541,7 @@ static mbedtls_pkcs7* get_pkcs7(const struct efi_variable_authentication_2 *auth
 	char *checkpkcs7cert = NULL;
 	size_t len;
 	mbedtls_pkcs7 *pkcs7 = NULL;
+	mbedtls_x509_crt *certs = NULL; //ADDED
 	int rc;
 
 	len = get_pkcs7_len(auth);
@@ -438,25 +551,35 @@ static mbedtls_pkcs7* get_pkcs7(const struct efi_variable_authentication_2 *auth
 		return NULL;
 
 	mbedtls_pkcs7_init(pkcs7);
-	rc = mbedtls_pkcs7_parse_der( auth->auth_info.cert_data, len, pkcs7);
+	/* ADDED: verification uses the keystore certs, the embedded ones are
+	 * only decoded when they are going to be printed. Printing them must
+	 * not change the result, so a failure to decode them is only a warning */
+	rc = mbedtls_pkcs7_parse_der_ext( auth->auth_info.cert_data, len, pkcs7,
+					  MBEDTLS_PKCS7_PARSE_LAZY_CERTS);
 	if (rc <= 0) {
 		prlog(PR_ERR, "Parsing pkcs7 failed %04x\n", rc);
 		goto out;
 	}
 
+	if (verbose < PR_DEBUG)
+		return pkcs7;
+
+	rc = mbedtls_pkcs7_get_certificates(pkcs7, &certs);
+	if (rc) {
+		prlog(PR_WARNING, "WARNING: Failed to parse the certificate in PKCS7 structure\n");
+		return pkcs7;
+	}
+
 	checkpkcs7cert = zalloc(CERT_BUFFER_SIZE);
 	if (!checkpkcs7cert)
-		goto out;
+		return pkcs7;
 
 	rc = mbedtls_x509_crt_info(checkpkcs7cert, CERT_BUFFER_SIZE, "CRT:",
-				   &(pkcs7->signed_data.certs));
-	if (rc < 0) {
-		prlog(PR_ERR, "Failed to parse the certificate in PKCS7 structure\n");
-		free(checkpkcs7cert);
-		goto out;
-	}
-
-	prlog(PR_DEBUG, "%s \n", checkpkcs7cert);
+				   certs);
+	if (rc < 0)
+		prlog(PR_WARNING, "WARNING: Failed to parse the certificate in PKCS7 structure\n");
+	else
+		prlog(PR_DEBUG, "%s \n", checkpkcs7cert);
 	free(checkpkcs7cert);
 	return pkcs7;
 
@@ -466,13 +589,119 @@ out:
 	return pkcs7;
 }
 
+/* ADDED: verify_signature checking every (signer, keystore certificate) pair
+ * on verify_threads workers instead of one certificate after the other */
+static int verify_signature_parallel(mbedtls_pkcs7 *pkcs7, const char *newcert,
+				     const size_t new_data_size,
+				     const struct secvar *avar)
+{
+	mbedtls_x509_crt *x509 = NULL, **certs = NULL;
+	char *signing_cert = NULL;
+	char *errbuf;
+	int signing_cert_size, eslsize, eslvarsize;
+	int offset = 0, count = 0, ncerts = 0, nsigners, matched = -1;
+	int *results = NULL;
+	int rc = 0;
+
+	/* Count the ESLs, each of them holds one certificate */
+	for (eslvarsize = avar->data_size;
+	     eslvarsize >= (int)sizeof(EFI_SIGNATURE_LIST);
+	     eslvarsize -= eslsize, offset += eslsize, count++) {
+		eslsize = get_esl_signature_list_size(avar->data + offset,
+						      eslvarsize);
+		if (eslsize <= 0)
+			return OPAL_PARAMETER;
+	}
+	if (!count)
+		return rc;
+
+	x509 = zalloc(sizeof(*x509) * count);
+	certs = zalloc(sizeof(*certs) * count);
+	if (!x509 || !certs) {
+		rc = OPAL_NO_MEM;
+		goto out;
+	}
+	for (int i = 0; i < count; i++)
+		mbedtls_x509_crt_init(&x509[i]);
+
+	prlog(PR_INFO, "Load the signing certificates from the keystore\n");
+	for (offset = 0, eslvarsize = avar->data_size; ncerts < count;
+	     offset += eslsize, eslvarsize -= eslsize) {
+		eslsize = get_esl_signature_list_size(avar->data + offset,
+						      eslvarsize);
+		signing_cert_size = get_esl_cert(avar->data + offset,
+						 eslvarsize, &signing_cert);
+		if (signing_cert_size < 0) {
+			rc = signing_cert_size;
+			goto out;
+		}
+		certs[ncerts] = parsed_updates ?
+			parsed_updates->get_cert(signing_cert, signing_cert_size) : NULL;
+		if (!certs[ncerts]) {
+			certs[ncerts] = &x509[ncerts];
+			rc = mbedtls_x509_crt_parse(&x509[ncerts],
+						    (unsigned char *)signing_cert,
+						    signing_cert_size);
+			/* This should not happen, unless something corrupted in PNOR */
+			if (rc) {
+				prlog(PR_ERR, "X509 certificate parsing failed %04x\n", rc);
+				rc = OPAL_INTERNAL_ERROR;
+				goto out;
+			}
+		}
+		ncerts++;
+		free(signing_cert);
+		signing_cert = NULL;
+	}
+
+	/* Only ask for every result if they are going to be printed */
+	nsigners = mbedtls_pkcs7_signer_count(pkcs7);
+	if (verbose >= PR_INFO)
+		results = zalloc(sizeof(*results) * nsigners * ncerts);
+
+	prlog(PR_INFO, "Checking %d signers against %d certificates with %d threads\n",
+	      nsigners, ncerts, verify_threads);
+	rc = mbedtls_pkcs7_signed_hash_verify_multi(pkcs7, certs, ncerts,
+						    (unsigned char *)newcert,
+						    new_data_size, verify_threads,
+						    results, &matched);
+	for (int s = 0; results && s < nsigners; s++)
+		for (int c = 0; c < ncerts; c++)
+			prlog(PR_INFO, "\tSigner %d with certificate %d: %s\n", s, c,
+			      results[s * ncerts + c] ? "failed" : "passed");
+
+	if (rc == 0) {
+		prlog(PR_INFO, "Signature Verification passed with certificate %d\n",
+		      matched);
+	} else {
+		errbuf = zalloc(MBEDTLS_ERR_BUFFER_SIZE);
+		if (errbuf)
+			mbedtls_strerror(rc, errbuf, MBEDTLS_ERR_BUFFER_SIZE);
+		prlog(PR_NOTICE, "Signature Verification failed %02x %s\n",
+		      rc, errbuf ? errbuf : "");
+		free(errbuf);
+		rc = OPAL_PERMISSION;
+	}
+
+out:
+	free(signing_cert);
+	free(results);
+	for (int i = 0; x509 && i < count; i++)
+		mbedtls_x509_crt_free(&x509[i]);
+	free(x509);
+	free(certs);
+
+	return rc;
+}
+
 /* Verify the PKCS7 signature on the signed data. */
 static int verify_signature(const struct efi_variable_authentication_2 *auth,
 			    const char *newcert, const size_t new_data_size,
-			    const struct secvar *avar)
+			    const struct secvar *avar, mbedtls_pkcs7 *parsed_pkcs7)
 {
 	mbedtls_pkcs7 *pkcs7 = NULL;
 	mbedtls_x509_crt x509;
+	mbedtls_x509_crt *signer; //ADDED
 	char *signing_cert = NULL;
 	char *x509_buf = NULL;
 	int signing_cert_size;
@@ -486,11 +715,18 @@ static int verify_signature(const struct efi_variable_authentication_2 *auth,
 		return OPAL_PARAMETER;
 
 	/* Extract the pkcs7 from the auth structure */
-	pkcs7 = get_pkcs7(auth);
+	/* ADDED: unless the caller already parsed it */
+	pkcs7 = parsed_pkcs7 ? parsed_pkcs7 : get_pkcs7(auth);
 	/* Failure to parse pkcs7 implies bad input. */
 	if (!pkcs7)
 			return OPAL_PARAMETER;	
 
+	/* ADDED: let the signers be checked in parallel if more threads are allowed */
+	if (verify_threads > 1) {
+		rc = verify_signature_parallel(pkcs7, newcert, new_data_size, avar);
+		goto out;
+	}
+
 	prlog(PR_INFO, "Load the signing certificate from the keystore\n");
 
 	eslvarsize = avar->data_size;
@@ -518,9 +754,16 @@ static int verify_signature(const struct efi_variable_authentication_2 *auth,
 		}
 
 		mbedtls_x509_crt_init(&x509);
-		rc = mbedtls_x509_crt_parse(&x509,
-					    (unsigned char *)signing_cert,
-					    signing_cert_size);
+		/* ADDED: reuse the certificate if the caller already parsed it */
+		signer = parsed_updates ? parsed_updates->get_cert(signing_cert,
+							signing_cert_size) : NULL;
+		if (!signer) {
+			signer = &x509;
+			rc = mbedtls_x509_crt_parse(&x509,
+						    (unsigned char *)signing_cert,
+						    signing_cert_size);
+		} else
+			rc = 0;
 
 		/* This should not happen, unless something corrupted in PNOR */
 		if(rc) {
@@ -533,7 +776,7 @@ static int verify_signature(const struct efi_variable_authentication_2 *auth,
 		rc = mbedtls_x509_crt_info(x509_buf,
 					   CERT_BUFFER_SIZE,
 					   "\tCRT:",
-					   &x509);	//NICK ADDED \t
+					   signer);	//NICK ADDED \t
 
 		/* This should not happen, unless something corrupted in PNOR */
 		if (rc < 0) {
@@ -546,7 +789,7 @@ static int verify_signature(const struct efi_variable_authentication_2 *auth,
 		free(x509_buf);
 		x509_buf = NULL;
 
-		rc = mbedtls_pkcs7_signed_hash_verify(pkcs7, &x509, (unsigned char *)newcert, new_data_size);
+		rc = mbedtls_pkcs7_signed_hash_verify(pkcs7, signer, (unsigned char *)newcert, new_data_size);
 
 		/* If you find a signing certificate, you are done */
 		if (rc == 0) {
@@ -573,9 +816,12 @@ static int verify_signature(const struct efi_variable_authentication_2 *auth,
 
 	}
 
+out: //ADDED
 	free(signing_cert);
-	mbedtls_pkcs7_free(pkcs7);
-	free(pkcs7);
+	if (pkcs7 != parsed_pkcs7) { //ADDED
+		mbedtls_pkcs7_free(pkcs7);
+		free(pkcs7);
+	}
 
 	return rc;
 }
@@ -588,25 +834,20 @@ static int verify_signature(const struct efi_variable_authentication_2 *auth,
  */
 static char *get_hash_to_verify(const char *key, const char *new_data,
 				const size_t new_data_size,
-				const struct efi_time *timestamp)
+				const struct efi_time *timestamp,
+				bool append) //ADDED
 {
-	le32 attr = cpu_to_le32(SECVAR_ATTRIBUTES);
+	/* ADDED: appends are signed with the append attribute set */
+	le32 attr = cpu_to_le32(SECVAR_ATTRIBUTES
+				| (append ? EFI_VARIABLE_APPEND_WRITE : 0));
 	size_t varlen;
 	char *wkey;
 	uuid_t guid;
 	unsigned char *hash = NULL;
-	const mbedtls_md_info_t *md_info;
-	mbedtls_md_context_t ctx;
+	struct cryptoHashCtx *ctx = NULL; //ADDED: hashed by the selected crypto library
 	int rc;
 
-	md_info = mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 );
-	mbedtls_md_init(&ctx);
-
-	rc = mbedtls_md_setup(&ctx, md_info, 0);
-	if (rc)
-		goto out;
-
-	rc = mbedtls_md_starts(&ctx);
+	rc = cryptoHashInit(&ctx, MBEDTLS_MD_SHA256);
 	if (rc)
 		goto out;
 
@@ -617,44 +858,44 @@ static char *get_hash_to_verify(const char *key, const char *new_data,
 	    || key_equals(key, "dbx"))
 		guid = EFI_IMAGE_SECURITY_DATABASE_GUID;
 	else
-		return NULL;
+		goto out; //ADDED: the context is allocated, free it
 
 	/* Expand char name to wide character width */
 	varlen = strlen(key) * 2;
 	wkey = char_to_wchar(key, strlen(key));
-	rc = mbedtls_md_update(&ctx, (const unsigned char *)wkey, varlen);
+	rc = cryptoHashUpdate(ctx, (const unsigned char *)wkey, varlen);
 	free(wkey);
 	if (rc) 
 		goto out;
 	
-	rc = mbedtls_md_update(&ctx, (const unsigned char *)&guid, sizeof(guid));
+	rc = cryptoHashUpdate(ctx, (const unsigned char *)&guid, sizeof(guid));
 	if (rc)
 		goto out;
 
-	rc = mbedtls_md_update(&ctx, (const unsigned char *)&attr, sizeof(attr));
+	rc = cryptoHashUpdate(ctx, (const unsigned char *)&attr, sizeof(attr));
 	if (rc)
 		goto out;
 
-	rc = mbedtls_md_update(&ctx, (const unsigned char *)timestamp,
+	rc = cryptoHashUpdate(ctx, (const unsigned char *)timestamp,
 			       sizeof(struct efi_time));
 	if (rc)
 		goto out;
 
-	rc = mbedtls_md_update(&ctx, (const unsigned char *)new_data, new_data_size);
+	rc = cryptoHashUpdate(ctx, (const unsigned char *)new_data, new_data_size);
 	if (rc)
 		goto out;
 
 	hash = zalloc(32);
 	if (!hash)
-		return NULL;
-	rc = mbedtls_md_finish(&ctx, hash);
+		goto out; //ADDED
+	rc = cryptoHashFinish(ctx, hash);
 	if (rc) {
 		free(hash);
 		hash = NULL;
 	}
 
 out:
-	mbedtls_md_free(&ctx);
+	cryptoHashFree(ctx);
 	return (char *)hash;
 }
 
@@ -666,12 +907,12 @@ bool is_pkcs7_sig_format(const void *data)
 	return !memcmp(&auth->auth_info.cert_type, &pkcs7_guid, 16);
 }
 
-int process_update(const struct secvar *update, char **newesl,
+int process_update(const struct secvar *update, const char **newesl,
 		   int *new_data_size, struct efi_time *timestamp,
 		   struct list_head *bank, char *last_timestamp)
 {
-	struct efi_variable_authentication_2 *auth = NULL;
-	void *auth_buffer = NULL;
+	const struct efi_variable_authentication_2 *auth = NULL;
+	const void *auth_buffer = NULL;
 	int auth_buffer_size = 0;
 	const char *key_authority[3];
 	char *tbhbuffer = NULL;
@@ -679,6 +920,9 @@ int process_update(const struct secvar *update, char **newesl,
 	struct secvar *avar = NULL;
 	int rc = 0;
 	int i;
+	unsigned char cache_key[UPDATE_CACHE_KEY_SIZE]; //ADDED
+	int cached = -1; //ADDED
+	bool append = update->flags & SECVAR_FLAG_APPEND_WRITE; //ADDED
 
 	/* We need to split data into authentication descriptor and new ESL */
 	auth_buffer_size = get_auth_descriptor2(update->data,
@@ -700,7 +944,16 @@ int process_update(const struct secvar *update, char **newesl,
 
 	memcpy(timestamp, auth_buffer, sizeof(struct efi_time));
 
-	rc = check_timestamp(update->key, timestamp, last_timestamp);
+	/* ADDED: the PK can only ever hold one certificate */
+	if (append && key_equals(update->key, "PK")) {
+		prlog(PR_ERR, "PK can not be appended to\n");
+		rc = OPAL_PARAMETER;
+		goto out;
+	}
+
+	/* ADDED: like edk2, appends may carry an older timestamp */
+	rc = append ? OPAL_SUCCESS
+		    : check_timestamp(update->key, timestamp, last_timestamp);
 	/* Failure implies probably an older command being resubmitted */
 	if (rc != OPAL_SUCCESS) {
 		prlog(PR_ERR, "Timestamp verification failed for key %s\n", update->key);
@@ -714,15 +967,32 @@ int process_update(const struct secvar *update, char **newesl,
 		rc = OPAL_PARAMETER;
 		goto out;
 	}
-	*newesl = zalloc(*new_data_size);
-	if (!(*newesl)) {
-		rc = OPAL_NO_MEM;
-		goto out;
+	/* ADDED: the new ESL is a view into the update, it is only copied
+	 * once the update is applied to the bank */
+	*newesl = update->data + auth_buffer_size;
+
+	/* Get the authority to verify the signature */
+	get_key_authority(key_authority, update->key);
+
+	/* ADDED: skip ESL and signature checks if these inputs passed before */
+	if (update_cache) {
+		cached = update_cache->lookup(update, key_authority, bank,
+					      last_timestamp, cache_key);
+		if (cached > 0) {
+			prlog(PR_INFO, "Update for %s found in verification cache\n", update->key);
+			rc = OPAL_SUCCESS;
+			goto out;
+		}
 	}
-	memcpy(*newesl, update->data + auth_buffer_size, *new_data_size);
 
 	/* Validate the new ESL is in right format */
-	rc = validate_esl_list(update->key, *newesl, *new_data_size);
+	/* ADDED: the caller may already have validated it */
+	rc = parsed_updates ? parsed_updates->get_esl_count(update) : -1;
+	if (rc > 1 && key_equals(update->key, "PK")) {
+		prlog(PR_ERR, "PK can only be one\n");
+		rc = OPAL_PARAMETER;
+	} else if (rc < 0)
+		rc = validate_esl_list(update->key, *newesl, *new_data_size);
 	if (rc < 0) {
 		prlog(PR_ERR, "ESL validation failed for key %s with error %04x\n",
 		      update->key, rc);
@@ -736,15 +1006,12 @@ int process_update(const struct secvar *update, char **newesl,
 
 	/* Prepare the data to be verified */
 	tbhbuffer = get_hash_to_verify(update->key, *newesl, *new_data_size,
-				timestamp);
+				timestamp, append);
 	if (!tbhbuffer) {
 		rc = OPAL_INTERNAL_ERROR;
 		goto out;
 	}
 
-	/* Get the authority to verify the signature */
-	get_key_authority(key_authority, update->key);
-
 	/*
 	 * Try for all the authorities that are allowed to sign.
 	 * For eg. db/dbx can be signed by both PK or KEK
@@ -760,7 +1027,8 @@ int process_update(const struct secvar *update, char **newesl,
 
 		/* Verify the signature */
 		rc = verify_signature(auth, tbhbuffer, tbhbuffersize,
-				      avar);
+				      avar, parsed_updates ?
+				      parsed_updates->get_pkcs7(update) : NULL);
 
 		/* Break if signature verification is successful */
 		if (rc == OPAL_SUCCESS) {
@@ -770,7 +1038,9 @@ int process_update(const struct secvar *update, char **newesl,
 	}
 
 out:
-	free(auth_buffer);
+	//ADDED
+	if (update_cache && cached == 0 && rc == OPAL_SUCCESS)
+		update_cache->store(cache_key);
 	free(tbhbuffer);
 
 	return rc;
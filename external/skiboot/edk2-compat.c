@@ -111,7 +111,7 @@ static int edk2_compat_process(struct list_head *variable_bank,
 	struct secvar *var = NULL;
 	struct secvar *tsvar = NULL;
 	struct efi_time timestamp;
-	char *newesl = NULL;
+	const char *newesl = NULL; //ADDED: view into the update, not owned
 	int neweslsize;
 	int rc = 0;
 
@@ -179,21 +179,28 @@ static int edk2_compat_process(struct list_head *variable_bank,
 		 * If reached here means, signature is verified so update the
 		 * value in the variable bank
 		 */
-		rc = update_variable_in_bank(var,
-					     newesl,
-					     neweslsize,
-					     &staging_bank);
+		/* ADDED: apply appends as appends */
+		if (var->flags & SECVAR_FLAG_APPEND_WRITE)
+			rc = append_variable_in_bank(var, newesl, neweslsize,
+						     &staging_bank);
+		else
+			rc = update_variable_in_bank(var,
+						     newesl,
+						     neweslsize,
+						     &staging_bank);
 		if (rc) {
 			prlog(PR_ERR, "Updating the variable data failed %04x\n", rc);
 			break;
 		}
 
-		free(newesl);
 		newesl = NULL;
 		/* Update the TS variable with the new timestamp */
-		rc = update_timestamp(var->key,
-				      &timestamp,
-				      tsvar->data);
+		/* ADDED: an append only ever moves it forward */
+		if (!(var->flags & SECVAR_FLAG_APPEND_WRITE)
+		    || check_timestamp(var->key, &timestamp, tsvar->data) == OPAL_SUCCESS)
+			rc = update_timestamp(var->key,
+					      &timestamp,
+					      tsvar->data);
 		if (rc) {
 			prlog (PR_ERR, "Variable updated, but timestamp updated failed %04x\n", rc);
 			break;
@@ -222,11 +229,11 @@ static int edk2_compat_process(struct list_head *variable_bank,
 
 	if (rc == 0) {
 		/* Update the variable bank with updated working copy */
+		/* ADDED: hand the working copy over instead of copying it */
 		clear_bank_list(variable_bank);
-		copy_bank_list(variable_bank, &staging_bank);
+		move_bank_list(variable_bank, &staging_bank);
 	}
 
-	free(newesl);
 	clear_bank_list(&staging_bank);
 
 	/* Set the global variable setup_mode as per final contents in variable_bank */
@@ -50,16 +50,51 @@
 extern bool setup_mode;
 extern struct list_head staging_bank;
 
+/* ADDED: optional hooks so a caller can remember updates that already passed
+ * process_update. lookup fills digest with a key for the inputs of the check
+ * and returns 1 if that key was stored before, 0 if not or negative if no key
+ * could be made. store is only called with keys of successful checks */
+struct update_cache_ops {
+	int (*lookup)(const struct secvar *update, const char *key_authority[],
+		      struct list_head *bank, const char *last_timestamp,
+		      unsigned char *digest);
+	void (*store)(const unsigned char *digest);
+};
+#define UPDATE_CACHE_KEY_SIZE 32
+extern const struct update_cache_ops *update_cache;
+
+/* ADDED: optional access to data the caller already validated and parsed, so
+ * process_update does not parse the same DER again. Returning NULL or a
+ * negative count falls back to parsing. Returned objects stay owned by the
+ * caller */
+struct parsed_update_ops {
+	/* parsed PKCS7 of the update's auth descriptor */
+	mbedtls_pkcs7 *(*get_pkcs7)(const struct secvar *update);
+	/* number of valid ESLs appended to the update */
+	int (*get_esl_count)(const struct secvar *update);
+	/* parsed certificate with exactly this DER */
+	mbedtls_x509_crt *(*get_cert)(const char *cert, size_t size);
+};
+extern const struct parsed_update_ops *parsed_updates;
+
+/* ADDED: number of threads that may check the (signer, certificate) pairs of
+ * one update at once, 0 or 1 keeps the sequential loop */
+extern int verify_threads;
+
 /* Update the variable in the variable bank with the new value. */
 int update_variable_in_bank(struct secvar *update_var, const char *data,
 			    uint64_t dsize, struct list_head *bank);
 
+/* ADDED: Append the signatures the variable does not have yet */
+int append_variable_in_bank(struct secvar *update_var, const char *data,
+			    uint64_t dsize, struct list_head *bank);
+
 /* This function outputs the Authentication 2 Descriptor in the
  * auth_buffer and returns the size of the buffer. Please refer to
  * edk2.h for details on Authentication 2 Descriptor
  */
 int get_auth_descriptor2(const void *buf, const size_t buflen,
-			 void **auth_buffer);
+			 const void **auth_buffer);
 
 /* Check the format of the ESL */
 int validate_esl_list(const char *key, const char *esl, const size_t size);
@@ -74,7 +109,7 @@ int check_timestamp(const char *key, const struct efi_time *timestamp, char *las
 bool is_pkcs7_sig_format(const void *data);
 
 /* Process the update */
-int process_update(const struct secvar *update, char **newesl,
+int process_update(const struct secvar *update, const char **newesl,
 		   int *neweslsize, struct efi_time *timestamp,
 		   struct list_head *bank, char *last_timestamp);
 
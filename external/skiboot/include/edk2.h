@@ -140,7 +140,7 @@ struct efi_time {
 ///
 /// The format of a signature database.
 ///
-#pragma pack(1)
+#pragma pack(push, 1)
 
 typedef struct {
   ///
@@ -250,4 +250,6 @@ struct efi_variable_authentication_2 {
   struct win_certificate_uefi_guid auth_info;
 };
 
+#pragma pack(pop)
+
 #endif
\ No newline at end of file
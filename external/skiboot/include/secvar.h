@@ -64,6 +64,7 @@ enum {
 
 #define SECVAR_FLAG_VOLATILE	0x1 /* Instructs storage driver to ignore variable on writes */
 #define SECVAR_FLAG_PROTECTED	0x2 /* Instructs storage driver to store in lockable flash */
+#define SECVAR_FLAG_APPEND_WRITE	0x4 /* ADDED: update was signed with EFI_VARIABLE_APPEND_WRITE */
 
 struct secvar {
 	struct list_node link;
@@ -84,6 +85,10 @@ extern struct secvar_backend_driver secvar_backend;
 // Helper functions
 void clear_bank_list(struct list_head *bank);
 int copy_bank_list(struct list_head *dst, struct list_head *src);
+void move_bank_list(struct list_head *dst, struct list_head *src); //ADDED
+void secvar_set_allocator(void *(*zalloc_fn)(size_t), void (*free_fn)(void *)); //ADDED
+void *secvar_zalloc(size_t size); //ADDED
+void secvar_free(void *ptr); //ADDED
 struct secvar *alloc_secvar(uint64_t key_len, uint64_t data_size);
 struct secvar *new_secvar(const char *key, uint64_t key_len,
 			       const char *data, uint64_t data_size,
@@ -12,7 +12,30 @@
 #include "external/skiboot/include/secvar.h"
 //ADDED BY NICK
 #include "external/skiboot/include/opal-api.h"
-#define zalloc(...) calloc(1,__VA_ARGS__)
+
+/* ADDED: pluggable allocator so callers can place banks in their own memory */
+static void *(*secvar_zalloc_fn)(size_t size);
+static void (*secvar_free_fn)(void *ptr);
+
+void secvar_set_allocator(void *(*zalloc_fn)(size_t), void (*free_fn)(void *))
+{
+	secvar_zalloc_fn = zalloc_fn;
+	secvar_free_fn = free_fn;
+}
+
+void *secvar_zalloc(size_t size)
+{
+	return secvar_zalloc_fn ? secvar_zalloc_fn(size) : calloc(1, size);
+}
+
+void secvar_free(void *ptr)
+{
+	if (secvar_free_fn)
+		secvar_free_fn(ptr);
+	else
+		free(ptr);
+}
+#define zalloc(...) secvar_zalloc(__VA_ARGS__)
 
 void clear_bank_list(struct list_head *bank)
 {
@@ -42,6 +65,17 @@ int copy_bank_list(struct list_head *dst, struct list_head *src)
 	return OPAL_SUCCESS;
 }
 
+//ADDED: moves every secvar from src to the end of dst without copying data
+void move_bank_list(struct list_head *dst, struct list_head *src)
+{
+	struct secvar *var, *next;
+
+	list_for_each_safe(src, var, next, link) {
+		list_del(&var->link);
+		list_add_tail(dst, &var->link);
+	}
+}
+
 struct secvar *alloc_secvar(uint64_t key_len, uint64_t data_size)
 {
 	struct secvar *ret;
@@ -52,14 +86,14 @@ struct secvar *alloc_secvar(uint64_t key_len, uint64_t data_size)
 
 	ret->key = zalloc(key_len);
 	if (!ret->key) {
-		free(ret->key);
+		secvar_free(ret->key);
 		return NULL;
 	}
 
 	ret->data = zalloc(data_size);
 	if (!ret->data) {
-		free(ret->key);
-		free(ret);
+		secvar_free(ret->key);
+		secvar_free(ret);
 		return NULL;
 	}
 
@@ -107,7 +141,7 @@ int realloc_secvar(struct secvar *var, uint64_t size)
 		return -1;
 
 	memcpy(tmp, var->data, var->data_size);
-	free(var->data);
+	secvar_free(var->data);
 	var->data = tmp;
 
 	return 0;
@@ -118,9 +152,9 @@ void dealloc_secvar(struct secvar *var)
 	if (!var)
 		return;
 
-	free(var->key);
-	free(var->data);
-	free(var);
+	secvar_free(var->key);
+	secvar_free(var->data);
+	secvar_free(var);
 }
 
 struct secvar *find_secvar(const char *key, uint64_t key_len, struct list_head *bank)
@@ -1,15 +1,76 @@
 // SPDX-License-Identifier: Apache-2.0
 /* Copyright 2021 IBM Corp.*/
+#define _GNU_SOURCE // for syncfs
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <errno.h>	//strerror
 #include <stdlib.h>
+#include <limits.h> // PATH_MAX
 #include <fcntl.h> // O_WRONLY
 #include <unistd.h> // has read/open funcitons
 #include <sys/stat.h> // needed for stat struct for file info
 #include <sys/types.h>
 #include "err.h"
 #include "prlog.h"
+#include "generic.h"
+
+// same limit as the kernel puts on a chain of symlinks
+#define MAX_LINK_DEPTH 40
+
+/*
+ *output held back by a capture, consecutive writes to the same stream share one segment
+ */
+struct captureSegment {
+	FILE *stream;
+	char *text;
+	size_t len, allocated;
+};
+
+struct outputCapture {
+	struct captureSegment *segments;
+	size_t count, allocated;
+};
+
+__thread struct outputCapture *prlogCapture;
+
+// where data written to "-" goes, see reserveStdout
+static int dataOutFd = STDOUT_FILENO;
+
+#define READ_CHUNK_SIZE 65536
+
+/**
+ *@param file, file name from the command line
+ *@return 1 if file is "-", which stands for stdin or stdout, 0 otherwise
+ */
+int isStdioFile(const char *file)
+{
+	return file && !strcmp(file, "-");
+}
+
+/**
+ *keeps stdout for the data written to "-" and sends everything printed to stderr,
+ *so the data can be piped into another command
+ *@return SUCCESS or FILE_WRITE_FAIL
+ */
+int reserveStdout(void)
+{
+	int fd;
+
+	if (dataOutFd != STDOUT_FILENO)
+		return SUCCESS;
+	fflush(stdout);
+	fd = dup(STDOUT_FILENO);
+	if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+		prlog(PR_ERR, "ERROR: Could not keep stdout for data: %s\n", strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return FILE_WRITE_FAIL;
+	}
+	dataOutFd = fd;
+
+	return SUCCESS;
+}
 
 /**
  *determines if given file currently exists
@@ -20,6 +81,8 @@ int isFile(const char* path)
 {
 	int fptr;
 
+	if (isStdioFile(path))
+		return SUCCESS;
 	fptr = open(path, O_RDONLY);
 	if (fptr < 0) {
 		return INVALID_FILE;
@@ -41,8 +104,8 @@ size_t getLeadingWhitespace(unsigned char* data, size_t dataSize)
 void printHex(unsigned char* data, size_t length)
 {
 	for (int i = 0; i < length; i++) 
-		printf("/%02x", data[i]);
-	printf("\n");
+		prout("/%02x", data[i]);
+	prout("\n");
 }
 
 /**
@@ -58,9 +121,53 @@ void printRaw(const char* c, size_t size)
 }
 
 
+/*
+ *reads fd until end of file in chunks, for pipes and other files without a known size
+ *@param fd, file to read
+ *@param file, name of the file for errors
+ *@param size, returned length of the data
+ *@return allocated data or NULL, NOTE:REMEMBER TO UNALLOCATE RETURNED DATA
+ */
+static char *readStream(int fd, const char *file, size_t *size)
+{
+	char *c = NULL, *tmp;
+	size_t len = 0, allocated = 0;
+	ssize_t read_size;
+
+	for (;;) {
+		if (len == allocated) {
+			allocated = allocated ? allocated * 2 : READ_CHUNK_SIZE;
+			tmp = realloc(c, allocated);
+			if (!tmp) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				free(c);
+				return NULL;
+			}
+			c = tmp;
+		}
+		read_size = read(fd, c + len, allocated - len);
+		if (read_size < 0 && errno == EINTR)
+			continue;
+		if (read_size < 0) {
+			prlog(PR_ERR, "ERROR: failed to read %s: %s\n", file, strerror(errno));
+			free(c);
+			return NULL;
+		}
+		if (read_size == 0)
+			break;
+		len += read_size;
+	}
+	if (!len)
+		prlog(PR_WARNING, "WARNING: file %s is empty\n", file);
+	prlog(PR_NOTICE, "----read %zd bytes from %s----\n", len, file);
+	*size = len;
+
+	return c;
+}
+
 /**
  *This Function returns a pointer to allocated memory that holds the data from the file 
- *@param fullPath string of file with path
+ *@param fullPath string of file with path, "-" for stdin
  *@param size address of unitialized int memory that will be filled with length of returned char*
  *@return NULL if cannot open file or read file
  *@return char* to allocted data of file with one extra '\0' for good measure
@@ -72,6 +179,10 @@ char* getDataFromFile(const char* fullPath, size_t *size)
 	char *c = NULL;
 	struct stat fileInfo;
 	ssize_t read_size;
+	size_t len = 0;
+
+	if (isStdioFile(fullPath))
+		return readStream(STDIN_FILENO, "stdin", size);
 	fptr = open(fullPath, O_RDONLY);			
 	if (fptr < 0) {
 		prlog(PR_WARNING,"----opening %s failed : %s----\n", fullPath, strerror(errno));
@@ -80,21 +191,31 @@ char* getDataFromFile(const char* fullPath, size_t *size)
 	if (fstat(fptr, &fileInfo) < 0) {
 		goto out;
 	}
+	// pipes and devices have no size to go by
+	if (!S_ISREG(fileInfo.st_mode)) {
+		c = readStream(fptr, fullPath, size);
+		goto out;
+	}
 	if(fileInfo.st_size <= 0){
 		prlog(PR_WARNING, "WARNING: file %s is empty\n", fullPath);
 	}
 	prlog(PR_NOTICE,"----opening %s is success: reading %ld bytes----\n", fullPath, fileInfo.st_size);
-	c = malloc(fileInfo.st_size); 
+	c = malloc(fileInfo.st_size ? fileInfo.st_size : 1); 
 	if (!c){
 		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
 		goto out;
 	}
-	read_size = read(fptr, c, fileInfo.st_size);
-	if (read_size != fileInfo.st_size) {
-		prlog(PR_ERR, "ERROR: failed to read whole contents of %s in one go\n", fullPath);
-		free(c);
-		c = NULL;
-		goto out;
+	while (len < fileInfo.st_size) {
+		read_size = read(fptr, c + len, fileInfo.st_size - len);
+		if (read_size < 0 && errno == EINTR)
+			continue;
+		if (read_size <= 0) {
+			prlog(PR_ERR, "ERROR: failed to read whole contents of %s\n", fullPath);
+			free(c);
+			c = NULL;
+			goto out;
+		}
+		len += read_size;
 	}
 	*size = fileInfo.st_size;
 out:	
@@ -103,6 +224,36 @@ out:
 	return c;
 }
 
+/*
+ *writes all of buff to fd, a short write is continued where it stopped
+ *@param fd, open file
+ *@param file, name of the file for errors
+ *@return SUCCESS or FILE_WRITE_FAIL
+ */
+static int writeAll(int fd, const char *file, const char *buff, size_t size)
+{
+	ssize_t rc;
+	size_t written = 0;
+
+	while (written < size) {
+		rc = write(fd, buff + written, size - written);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0) {
+			prlog(PR_ERR, "ERROR: Writing data to %s failed: %s\n", file, strerror(errno));
+			return FILE_WRITE_FAIL;
+		}
+		if (rc == 0) {
+			prlog(PR_ERR, "ERROR: End of file reached, only %zd/%zd bytes were written to %s\n", written, size, file);
+			return FILE_WRITE_FAIL;
+		}
+		written += rc;
+	}
+	prlog(PR_NOTICE, "%zd/%zd bytes successfully written from file to %s\n", written, size, file);
+
+	return SUCCESS;
+}
+
 /*
  *writes size bytes of buff to 
  *@param file string to file
@@ -113,54 +264,466 @@ out:
  */
 int writeData(const char * file, const char * buff, size_t size)
 {
-
 	int rc, fptr = open(file, O_WRONLY|O_TRUNC);
 	if (fptr == -1) {
 		prlog(PR_ERR, "ERROR: Opening %s failed: %s\n", file, strerror(errno));
 		return INVALID_FILE;
 	}
-	rc = write(fptr, buff, size);
-	if (rc < 0) {
-		prlog(PR_ERR,"ERROR: Writing data to %s failed\n", file);
-		return FILE_WRITE_FAIL;
+	rc = writeAll(fptr, file, buff, size);
+	close(fptr);
+
+	return rc;
+}
+
+/*
+ *while a batch is open, createFile leaves every file under a temporary name and
+ *outputBatchFinish makes all of them durable at once before renaming them
+ */
+struct pendingOutput {
+	char *tmpFile, *file;
+};
+
+static struct {
+	int depth;
+	struct pendingOutput *pending;
+	size_t count, allocated;
+} outputBatch;
+
+/*
+ *@param file, path of a file
+ *@return newly allocated name of the directory file is in, NULL if out of memory
+ */
+static char *getParentDir(const char *file)
+{
+	const char *slash = strrchr(file, '/');
+
+	if (!slash)
+		return strdup(".");
+	if (slash == file)
+		return strdup("/");
+
+	return strndup(file, slash - file);
+}
+
+/*
+ *fsyncs the directory of file so a rename in it survives a crash
+ *@return SUCCESS or FILE_WRITE_FAIL
+ */
+static int syncParentDir(const char *file)
+{
+	int fd, rc = SUCCESS;
+	char *dir = getParentDir(file);
+
+	if (!dir) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
 	}
-	else if (rc == 0) {
-		prlog(PR_WARNING,"End of file reached, not all of file was written to %s\n", file);	
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0 || fsync(fd)) {
+		prlog(PR_ERR, "ERROR: Syncing directory %s failed: %s\n", dir, strerror(errno));
+		rc = FILE_WRITE_FAIL;
 	}
-	else prlog(PR_NOTICE,"%d/%zd bytes successfully written from file to %s\n", rc, size, file);
-	close(fptr);
+	if (fd >= 0)
+		close(fd);
+	free(dir);
+
+	return rc;
+}
+
+/**
+ *starts a batch of createFile calls that are made durable together by outputBatchFinish,
+ *until then the new files keep temporary names, batches may nest
+ */
+void outputBatchStart(void)
+{
+	outputBatch.depth++;
+}
+
+/**
+ *ends a batch from outputBatchStart, every file system written to is synced once,
+ *then every file is renamed to its name and every directory is synced once
+ *@return SUCCESS or FILE_WRITE_FAIL, files that were not renamed yet keep their old contents
+ */
+int outputBatchFinish(void)
+{
+	int rc = SUCCESS, fd, done;
+	size_t i, j;
+	char *dir;
+	struct stat *devices = NULL;
+
+	if (outputBatch.depth > 0 && --outputBatch.depth)
+		return SUCCESS;
+	if (!outputBatch.count)
+		goto out;
+	devices = calloc(outputBatch.count, sizeof(*devices));
+	if (!devices) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	// one syncfs per file system flushes the data of every temporary file on it
+	for (i = 0; i < outputBatch.count && !rc; i++) {
+		fd = open(outputBatch.pending[i].tmpFile, O_RDONLY);
+		if (fd < 0 || fstat(fd, &devices[i])) {
+			prlog(PR_ERR, "ERROR: Opening %s failed: %s\n", outputBatch.pending[i].tmpFile, strerror(errno));
+			rc = FILE_WRITE_FAIL;
+		}
+		for (j = 0, done = 0; !rc && j < i && !done; j++)
+			done = devices[j].st_dev == devices[i].st_dev;
+		if (!rc && !done && syncfs(fd)) {
+			prlog(PR_ERR, "ERROR: Syncing the file system of %s failed: %s\n", outputBatch.pending[i].file, strerror(errno));
+			rc = FILE_WRITE_FAIL;
+		}
+		if (fd >= 0)
+			close(fd);
+	}
+	for (i = 0; i < outputBatch.count && !rc; i++) {
+		if (rename(outputBatch.pending[i].tmpFile, outputBatch.pending[i].file)) {
+			prlog(PR_ERR, "ERROR: Renaming %s to %s failed: %s\n", outputBatch.pending[i].tmpFile,
+			      outputBatch.pending[i].file, strerror(errno));
+			rc = FILE_WRITE_FAIL;
+		}
+	}
+	// then the renames, once per directory
+	for (i = 0; i < outputBatch.count && !rc; i++) {
+		dir = getParentDir(outputBatch.pending[i].file);
+		if (!dir) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = FILE_WRITE_FAIL;
+			break;
+		}
+		if (stat(dir, &devices[i])) {
+			prlog(PR_ERR, "ERROR: Syncing directory %s failed: %s\n", dir, strerror(errno));
+			free(dir);
+			rc = FILE_WRITE_FAIL;
+			break;
+		}
+		free(dir);
+		for (j = 0, done = 0; j < i && !done; j++)
+			done = devices[j].st_dev == devices[i].st_dev && devices[j].st_ino == devices[i].st_ino;
+		if (!done)
+			rc = syncParentDir(outputBatch.pending[i].file);
+	}
+	prlog(PR_INFO, "Committed a batch of %zd files\n", outputBatch.count);
+
+out:
+	for (i = 0; i < outputBatch.count; i++) {
+		// left over if the batch failed
+		unlink(outputBatch.pending[i].tmpFile);
+		free(outputBatch.pending[i].tmpFile);
+		free(outputBatch.pending[i].file);
+	}
+	if (outputBatch.pending)
+		free(outputBatch.pending);
+	if (devices)
+		free(devices);
+	memset(&outputBatch, 0, sizeof(outputBatch));
+
+	return rc;
+}
+
+/*
+ *remembers a written temporary file until outputBatchFinish
+ *@return SUCCESS or ALLOC_FAIL
+ */
+static int addPendingOutput(const char *tmpFile, const char *file)
+{
+	struct pendingOutput *tmp;
+	size_t allocated;
+
+	if (outputBatch.count == outputBatch.allocated) {
+		allocated = outputBatch.allocated * 2 + 16;
+		tmp = realloc(outputBatch.pending, sizeof(*tmp) * allocated);
+		if (!tmp)
+			return ALLOC_FAIL;
+		outputBatch.pending = tmp;
+		outputBatch.allocated = allocated;
+	}
+	tmp = &outputBatch.pending[outputBatch.count];
+	tmp->tmpFile = strdup(tmpFile);
+	tmp->file = strdup(file);
+	if (!tmp->tmpFile || !tmp->file) {
+		free(tmp->tmpFile);
+		free(tmp->file);
+		return ALLOC_FAIL;
+	}
+	outputBatch.count++;
 
 	return SUCCESS;
 }
 
 /*
- *writes size bytes of buff to new file
- *@param file string to file
+ *follows a chain of symlinks whose last target does not exist yet, realpath only
+ *resolves links to existing files
+ *@param file, path of a symlink
+ *@return newly allocated path the chain ends at or NULL with errno set
+ */
+static char *followLink(const char *file)
+{
+	char *path, *dir, *next, target[PATH_MAX];
+	struct stat fileInfo;
+	ssize_t len;
+	int depth = 0;
+
+	path = strdup(file);
+	while (path && !lstat(path, &fileInfo) && S_ISLNK(fileInfo.st_mode)) {
+		len = readlink(path, target, sizeof(target) - 1);
+		if (len < 0 || ++depth > MAX_LINK_DEPTH) {
+			if (len >= 0)
+				errno = ELOOP;
+			free(path);
+			return NULL;
+		}
+		target[len] = '\0';
+		dir = target[0] == '/' ? NULL : getParentDir(path);
+		if (target[0] != '/' && !dir) {
+			free(path);
+			return NULL;
+		}
+		next = malloc((dir ? strlen(dir) + 1 : 0) + len + 1);
+		if (next)
+			sprintf(next, "%s%s%s", dir ? dir : "", dir ? "/" : "", target);
+		free(dir);
+		free(path);
+		path = next;
+	}
+
+	return path;
+}
+
+/*
+ *createFile for a path that is not a symlink
+ *@return 0 for success or error number
+ */
+static int replaceFile(const char *file, const char *buff, size_t size)
+{
+	int rc, fptr;
+	char *tmpFile = NULL;
+	struct stat fileInfo;
+	mode_t mode, mask;
+
+	// devices and pipes can not be replaced, write to them directly
+	if (!stat(file, &fileInfo) && !S_ISREG(fileInfo.st_mode)) {
+		fptr = open(file, O_WRONLY|O_TRUNC);
+		if (fptr == -1) {
+			prlog(PR_ERR, "ERROR: Opening %s failed: %s\n", file, strerror(errno));
+			return INVALID_FILE;
+		}
+		rc = writeAll(fptr, file, buff, size);
+		close(fptr);
+		return rc;
+	}
+	// a replaced file keeps its permissions, a new one gets them as if it was opened with O_CREAT
+	if (!stat(file, &fileInfo))
+		mode = fileInfo.st_mode & 07777;
+	else {
+		mask = umask(0);
+		umask(mask);
+		mode = (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) & ~mask;
+	}
+	tmpFile = malloc(strlen(file) + sizeof(".XXXXXX"));
+	if (!tmpFile) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	strcpy(tmpFile, file);
+	strcat(tmpFile, ".XXXXXX");
+	fptr = mkstemp(tmpFile);
+	if (fptr == -1) {
+		prlog(PR_ERR, "ERROR: Opening %s failed: %s\n", file, strerror(errno));
+		free(tmpFile);
+		return INVALID_FILE;
+	}
+	rc = writeAll(fptr, file, buff, size);
+	if (!rc && fchmod(fptr, mode)) {
+		prlog(PR_ERR, "ERROR: Setting permissions of %s failed: %s\n", file, strerror(errno));
+		rc = FILE_WRITE_FAIL;
+	}
+	if (!rc && !outputBatch.depth && fsync(fptr)) {
+		prlog(PR_ERR, "ERROR: Syncing %s failed: %s\n", file, strerror(errno));
+		rc = FILE_WRITE_FAIL;
+	}
+	close(fptr);
+	if (rc)
+		goto out;
+	if (outputBatch.depth) {
+		rc = addPendingOutput(tmpFile, file);
+		if (rc)
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		else
+			tmpFile[0] = '\0';
+		goto out;
+	}
+	if (rename(tmpFile, file)) {
+		prlog(PR_ERR, "ERROR: Renaming %s to %s failed: %s\n", tmpFile, file, strerror(errno));
+		rc = FILE_WRITE_FAIL;
+		goto out;
+	}
+	tmpFile[0] = '\0';
+	rc = syncParentDir(file);
+
+out:
+	if (tmpFile[0])
+		unlink(tmpFile);
+	free(tmpFile);
+
+	return rc;
+}
+
+/*
+ *writes size bytes of buff to new file, the data goes to a temporary file next to it
+ *that replaces file once it is complete, so after a crash file has either its old or
+ *its new contents. Outside of a batch the data and the rename are synced before returning
+ *@param file string to file, "-" for stdout, a symlink is followed and its target replaced
  *@param authBuf pointer to auth data
  *@param size length of data
- *@return negative int, error if opening/writing to .../update file
  *@return 0 for success or error number
  */
 int createFile(const char * file, const char * buff, size_t size)
 {
 	int rc;
-	// create and set permissions
-	int fptr = open(file, O_WRONLY|O_TRUNC|O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH); 
-	if (fptr == -1) {
-		prlog(PR_ERR, "ERROR: Opening %s failed: %s\n", file, strerror(errno));
+	char *target;
+	struct stat fileInfo;
+
+	if (isStdioFile(file)) {
+		fflush(stdout);
+		return writeAll(dataOutFd, "stdout", buff, size);
+	}
+	// renaming over a symlink would replace the link itself with a regular file
+	if (lstat(file, &fileInfo) || !S_ISLNK(fileInfo.st_mode))
+		return replaceFile(file, buff, size);
+	target = realpath(file, NULL);
+	// a dangling link gets its target created
+	if (!target && errno == ENOENT)
+		target = followLink(file);
+	if (!target) {
+		prlog(PR_ERR, "ERROR: Resolving %s failed: %s\n", file, strerror(errno));
 		return INVALID_FILE;
 	}
-	rc = write(fptr, buff, size);
-	if (rc < 0) {
-		prlog(PR_ERR,"ERROR: Writing data to %s failed: %s\n", file, strerror(errno));
-		return FILE_WRITE_FAIL;
+	rc = replaceFile(target, buff, size);
+	free(target);
+
+	return rc;
+}
+
+
+/*
+ *appends text to the last segment of capture if it goes to the same stream
+ *@return SUCCESS or ALLOC_FAIL
+ */
+static int captureAppend(struct outputCapture *capture, FILE *stream, const char *text, size_t len)
+{
+	struct captureSegment *seg = NULL, *tmp;
+	char *buf;
+	size_t allocated;
+
+	if (capture->count && capture->segments[capture->count - 1].stream == stream)
+		seg = &capture->segments[capture->count - 1];
+	if (!seg) {
+		if (capture->count == capture->allocated) {
+			allocated = capture->allocated * 2 + 4;
+			tmp = realloc(capture->segments, sizeof(*tmp) * allocated);
+			if (!tmp)
+				return ALLOC_FAIL;
+			capture->segments = tmp;
+			capture->allocated = allocated;
+		}
+		seg = &capture->segments[capture->count++];
+		memset(seg, 0, sizeof(*seg));
+		seg->stream = stream;
 	}
-	else if (rc == 0) {
-		prlog(PR_WARNING,"End of file reached, not all of file was written to %s\n", file);	
+	if (seg->len + len > seg->allocated) {
+		allocated = (seg->len + len) * 2;
+		buf = realloc(seg->text, allocated);
+		if (!buf)
+			return ALLOC_FAIL;
+		seg->text = buf;
+		seg->allocated = allocated;
 	}
-	else prlog(PR_NOTICE,"%d/%zd bytes successfully written from file to %s\n", rc, size, file);
-	close(fptr);
+	memcpy(seg->text + seg->len, text, len);
+	seg->len += len;
 
 	return SUCCESS;
 }
 
+/**
+ *fprintf that keeps the text in prlogCapture if the calling thread set one,
+ *if the capture can not grow the text is printed right away
+ *@param stream, stdout or stderr
+ */
+void prlogPrintf(FILE *stream, const char *fmt, ...)
+{
+	va_list args, copy;
+	char *text;
+	int len;
+
+	va_start(args, fmt);
+	if (!prlogCapture) {
+		vfprintf(stream, fmt, args);
+		va_end(args);
+		return;
+	}
+	va_copy(copy, args);
+	len = vsnprintf(NULL, 0, fmt, copy);
+	va_end(copy);
+	text = len < 0 ? NULL : malloc(len + 1);
+	if (text)
+		vsnprintf(text, len + 1, fmt, args);
+	va_end(args);
+	if (!text)
+		return;
+	if (captureAppend(prlogCapture, stream, text, len))
+		fwrite(text, 1, len, stream);
+	free(text);
+}
+
+/**
+ *holds back everything the calling thread prints until captureStop
+ *@return the new capture or NULL if it could not be allocated, output is then printed as usual
+ */
+struct outputCapture *captureStart(void)
+{
+	prlogCapture = calloc(1, sizeof(*prlogCapture));
+
+	return prlogCapture;
+}
+
+/**
+ *@return the capture of the calling thread, it is not capturing anymore
+ */
+struct outputCapture *captureStop(void)
+{
+	struct outputCapture *capture = prlogCapture;
+
+	prlogCapture = NULL;
+
+	return capture;
+}
+
+/**
+ *prints captured output to the streams it was written to and frees the capture
+ *@param capture, from captureStop, may be NULL
+ */
+void capturePrint(struct outputCapture *capture)
+{
+	if (!capture)
+		return;
+	for (size_t i = 0; i < capture->count; i++)
+		fwrite(capture->segments[i].text, 1, capture->segments[i].len, capture->segments[i].stream);
+	captureFree(capture);
+}
+
+/**
+ *frees captured output without printing it
+ *@param capture, from captureStop, may be NULL
+ */
+void captureFree(struct outputCapture *capture)
+{
+	if (!capture)
+		return;
+	for (size_t i = 0; i < capture->count; i++)
+		free(capture->segments[i].text);
+	if (capture->segments)
+		free(capture->segments);
+	free(capture);
+}
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+#define ARENA_DEFAULT_CHUNK (64 * 1024)
+
+struct arenaChunk;
+
+/*
+ *region allocator, everything allocated from an arena is released at once by
+ *arenaReset or arenaDestroy, individual allocations are never freed
+ */
+struct arena {
+	struct arenaChunk *chunks;
+	size_t chunkSize, allocated;
+};
+
+struct arena *arenaCreate(size_t chunkSize);
+void *arenaAlloc(struct arena *a, size_t size);
+void *arenaCalloc(struct arena *a, size_t count, size_t size);
+char *arenaStrdup(struct arena *a, const char *str);
+void arenaReset(struct arena *a);
+void arenaDestroy(struct arena *a);
+
+int arenaUseForSecvars(struct arena *a);
+#endif
@@ -11,8 +11,16 @@ struct command {
 char * getDataFromFile(const char *file, size_t* size);
 int writeData(const char * file, const char * buff, size_t size);
 int createFile(const char * file, const char * buff, size_t size);
+void outputBatchStart(void);
+int outputBatchFinish(void);
 void printRaw(const char* c, size_t size) ;
 int isFile(const char* path);
+int isStdioFile(const char *file);
+int reserveStdout(void);
 size_t getLeadingWhitespace(unsigned char* data, size_t dataSize);
 void printHex(unsigned char* data, size_t length);
+struct outputCapture *captureStart(void);
+struct outputCapture *captureStop(void);
+void capturePrint(struct outputCapture *capture);
+void captureFree(struct outputCapture *capture);
 #endif
\ No newline at end of file
@@ -14,5 +14,15 @@ extern int verbose;
 #define PR_PRINTF	PR_NOTICE
 #define PR_INFO		6
 #define PR_DEBUG	7
- #define prlog(l,...) do { if(l<=MAXLEVEL)fprintf((l <= PR_ERR) ? stderr : stdout, ##__VA_ARGS__); } while(0)
+
+/*
+ *a thread with prlogCapture set keeps what it prints in memory instead, so the
+ *output of worker threads can be printed in order, see captureStart in generic.c
+ */
+struct outputCapture;
+extern __thread struct outputCapture *prlogCapture;
+void prlogPrintf(FILE *stream, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+ #define prlog(l,...) do { if(l<=MAXLEVEL)prlogPrintf((l <= PR_ERR) ? stderr : stdout, ##__VA_ARGS__); } while(0)
+// printf to stdout that follows prlogCapture, for output that does not depend on verbose
+#define prout(...) prlogPrintf(stdout, __VA_ARGS__)
 #endif
\ No newline at end of file
@@ -16,6 +16,8 @@ enum backends {
 };
 
 extern int verbose;
+// number of threads verify may use per update, set by 'verify -j'
+extern int verifyThreads;
 
 int readCommand(int argc, char* argv[]);
 int performWriteCommand(int argc, char* argv[]);
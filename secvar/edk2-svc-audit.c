@@ -0,0 +1,571 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h> // for sysconf
+#include <dirent.h> // for listing host directories
+#include <pthread.h>
+#include <sys/stat.h>
+#include <mbedtls/md.h> // for content hashes and fingerprints
+#include "secvar/include/edk2-svc.h"// import last!!
+
+#define AUDIT_HASH_SIZE 32
+#define AUDIT_CACHE_BUCKETS 1024
+#define AUDIT_MAX_THREADS 256
+
+struct auditArguments {
+	int helpFlag, threads;
+	const char *root;
+};
+
+/*
+ *result of examining one unique variable blob, shared by every host whose
+ *variable has the same name and contents
+ */
+struct blobResult {
+	unsigned char hash[AUDIT_HASH_SIZE];
+	int done, rc, entries, hasFingerprint;
+	unsigned char fingerprint[AUDIT_HASH_SIZE];
+	struct blobResult *next;
+};
+
+struct hostResult {
+	char *name;
+	int rc;
+	// bit i is set if variables[i] could not be read or is invalid
+	unsigned int failedVars;
+	struct blobResult *vars[ARRAY_SIZE(variables)];
+};
+
+struct auditContext {
+	const char *root;
+	struct hostResult *hosts;
+	size_t hostCount, nextHost, uniqueBlobs, cacheHits;
+	pthread_mutex_t lock;
+	pthread_cond_t blobDone;
+	struct blobResult *cache[AUDIT_CACHE_BUCKETS];
+};
+
+static void usage();
+static void help();
+static int parseArgs(int argc, char *argv[], struct auditArguments *args);
+static int getHosts(const char *root, struct hostResult **hosts, size_t *count);
+static void *auditWorker(void *arg);
+static void auditHost(struct auditContext *ctx, struct hostResult *host);
+static struct blobResult *getBlobResult(struct auditContext *ctx, const char *var, const unsigned char *data, size_t size);
+static void examineBlob(struct blobResult *blob, const char *var, const unsigned char *data, size_t size);
+static int hashBlob(const char *var, const unsigned char *data, size_t size, unsigned char *out);
+static int countESLEntries(const unsigned char *esl, size_t size);
+static void printHostResult(struct hostResult *host);
+
+/*
+ *called from main()
+ *audits every host keystore directory found under a root directory
+ *@param argc, number of argument
+ *@param arv, array of params
+ *@return SUCCESS if every host keystore is valid, err number otherwise
+ */
+int performAuditCommand(int argc, char* argv[])
+{
+	int rc, threadCount, created = 0, valid = 0, invalid = 0, setup = 0;
+	size_t i;
+	pthread_t *threads = NULL;
+	struct blobResult *blob, *tmp;
+	struct auditContext ctx;
+	struct auditArguments args = {
+		.helpFlag = 0, .threads = 0, .root = NULL
+	};
+
+	memset(&ctx, 0, sizeof(ctx));
+	pthread_mutex_init(&ctx.lock, NULL);
+	pthread_cond_init(&ctx.blobDone, NULL);
+
+	rc = parseArgs(argc, argv, &args);
+	if (rc || args.helpFlag)
+		goto out;
+
+	if (!args.root) {
+		usage();
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	ctx.root = args.root;
+
+	rc = getHosts(args.root, &ctx.hosts, &ctx.hostCount);
+	if (rc)
+		goto out;
+	if (!ctx.hostCount) {
+		prlog(PR_ERR, "ERROR: No host directories found in %s\n", args.root);
+		rc = INVALID_FILE;
+		goto out;
+	}
+
+	threadCount = args.threads;
+	if (threadCount <= 0)
+		threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threadCount <= 0)
+		threadCount = 1;
+	if (threadCount > AUDIT_MAX_THREADS)
+		threadCount = AUDIT_MAX_THREADS;
+	if (threadCount > ctx.hostCount)
+		threadCount = ctx.hostCount;
+	prlog(PR_NOTICE, "Auditing %zd hosts in %s with %d worker threads\n", ctx.hostCount, args.root, threadCount);
+
+	threads = malloc(sizeof(*threads) * threadCount);
+	if (!threads) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	for (; created < threadCount; created++) {
+		if (pthread_create(&threads[created], NULL, auditWorker, &ctx)) {
+			prlog(PR_WARNING, "WARNING: Could only start %d of %d worker threads\n", created, threadCount);
+			break;
+		}
+	}
+	// if no workers could be started then do the work here
+	if (!created)
+		auditWorker(&ctx);
+	for (int j = 0; j < created; j++)
+		pthread_join(threads[j], NULL);
+
+	// print results in directory order so output is stable regardless of scheduling
+	for (i = 0; i < ctx.hostCount; i++) {
+		printHostResult(&ctx.hosts[i]);
+		if (ctx.hosts[i].rc)
+			invalid++;
+		else if (!ctx.hosts[i].vars[0])
+			setup++;
+		else
+			valid++;
+	}
+	printf("Audited %zd hosts: %d valid, %d invalid, %d in setup mode. "
+		"Parsed %zd unique variables, reused %zd cached results\n",
+		ctx.hostCount, valid, invalid, setup, ctx.uniqueBlobs, ctx.cacheHits);
+
+	rc = invalid ? ESL_FAIL : SUCCESS;
+
+out:
+	if (rc)
+		printf("RESULT: FAILURE\n");
+	else
+		printf("RESULT: SUCCESS\n");
+	if (threads)
+		free(threads);
+	for (i = 0; i < ctx.hostCount; i++)
+		free(ctx.hosts[i].name);
+	if (ctx.hosts)
+		free(ctx.hosts);
+	for (i = 0; i < AUDIT_CACHE_BUCKETS; i++) {
+		for (blob = ctx.cache[i]; blob; blob = tmp) {
+			tmp = blob->next;
+			free(blob);
+		}
+	}
+	pthread_cond_destroy(&ctx.blobDone);
+	pthread_mutex_destroy(&ctx.lock);
+
+	return rc;
+}
+
+static void usage()
+{
+	printf("USAGE:\n\t $ secvarctl audit [OPTIONS] <rootDirectory>"
+		"\n\tOPTIONS:"
+		"\n\t\t--help/--usage"
+		"\n\t\t-v\t\tverbose, print process info"
+		"\n\t\t-j <threads>\tnumber of worker threads, default is number of online CPUs\n");
+}
+
+static void help()
+{
+	printf("HELP:\n\t"
+		"The purpose of this command is to audit the keystores of many hosts at once.\n\t"
+		"<rootDirectory> is expected to contain one directory per host, each laid out as\n\t"
+		"<host>/{'PK','KEK','db','dbx','TS'}/data. One line is printed per host with its\n\t"
+		"validity, the SHA256 fingerprint of the first PK and KEK certificate and the number\n\t"
+		"of entries in the db and dbx. Variables with identical contents across hosts are\n\t"
+		"only validated once. NOTE: This command does not verify any signatures\n");
+	usage();
+}
+
+/**
+ *@param argv , array of command line arguments
+ *@param argc, length of argv
+ *@param args, struct that will be filled with data from argv
+ *@return success or errno
+ */
+static int parseArgs(int argc, char *argv[], struct auditArguments *args)
+{
+	int rc = SUCCESS;
+	for (int i = 0; i < argc; i++) {
+		if (argv[i][0] != '-') {
+			args->root = argv[i];
+			continue;
+		}
+		if (!strcmp(argv[i], "--usage")) {
+			usage();
+			args->helpFlag = 1;
+			goto out;
+		}
+		else if (!strcmp(argv[i], "--help")) {
+			help();
+			args->helpFlag = 1;
+			goto out;
+		}
+		switch (argv[i][1]) {
+			case 'v':
+				verbose = PR_DEBUG;
+				break;
+			case 'j':
+				if (i + 1 >= argc || argv[i + 1][0] == '-' || atoi(argv[i + 1]) <= 0) {
+					prlog(PR_ERR, "ERROR: Incorrect value for '-j', use '-j <threads>', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				args->threads = atoi(argv[i]);
+				break;
+			default:
+				prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+				rc = ARG_PARSE_FAIL;
+				goto out;
+		}
+	}
+
+out:
+	if (rc) {
+		prlog(PR_ERR, "Failed during argument parsing\n");
+		usage();
+	}
+
+	return rc;
+}
+
+static int compareHosts(const void *a, const void *b)
+{
+	return strcmp(((const struct hostResult *)a)->name, ((const struct hostResult *)b)->name);
+}
+
+/**
+ *finds every subdirectory of root, each one is treated as a host keystore
+ *@param root, directory containing the host directories
+ *@param hosts, will be allocated and filled with one entry per host, sorted by name
+ *@param count, will be filled with the length of hosts
+ *@return SUCCESS or error number
+ */
+static int getHosts(const char *root, struct hostResult **hosts, size_t *count)
+{
+	DIR *dir;
+	struct dirent *entry;
+	struct stat statbuf;
+	struct hostResult *tmp;
+	size_t allocated = 0;
+	char *fullPath;
+	int rc = SUCCESS;
+
+	*hosts = NULL;
+	*count = 0;
+	dir = opendir(root);
+	if (!dir) {
+		prlog(PR_ERR, "ERROR: Could not open directory %s\n", root);
+		return INVALID_FILE;
+	}
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.')
+			continue;
+		fullPath = malloc(strlen(root) + strlen(entry->d_name) + 2);
+		if (!fullPath) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		sprintf(fullPath, "%s/%s", root, entry->d_name);
+		rc = stat(fullPath, &statbuf);
+		free(fullPath);
+		if (rc || (statbuf.st_mode & S_IFMT) != S_IFDIR) {
+			rc = SUCCESS;
+			continue;
+		}
+		if (*count == allocated) {
+			allocated = allocated ? allocated * 2 : 64;
+			tmp = realloc(*hosts, sizeof(**hosts) * allocated);
+			if (!tmp) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				rc = ALLOC_FAIL;
+				goto out;
+			}
+			*hosts = tmp;
+		}
+		memset(&(*hosts)[*count], 0, sizeof(**hosts));
+		(*hosts)[*count].name = strdup(entry->d_name);
+		if (!(*hosts)[*count].name) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		(*count)++;
+	}
+	if (*count)
+		qsort(*hosts, *count, sizeof(**hosts), compareHosts);
+out:
+	closedir(dir);
+
+	return rc;
+}
+
+/*
+ *worker thread, takes hosts from the context until there are none left
+ *@param arg, pointer to the shared audit context
+ */
+static void *auditWorker(void *arg)
+{
+	struct auditContext *ctx = arg;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&ctx->lock);
+		i = ctx->nextHost++;
+		pthread_mutex_unlock(&ctx->lock);
+		if (i >= ctx->hostCount)
+			break;
+		auditHost(ctx, &ctx->hosts[i]);
+	}
+
+	return NULL;
+}
+
+/**
+ *reads and examines every variable of one host keystore
+ *@param ctx, shared audit context
+ *@param host, host to audit, rc and vars will be filled
+ */
+static void auditHost(struct auditContext *ctx, struct hostResult *host)
+{
+	char *fullPath, *data;
+	size_t size;
+
+	host->rc = SUCCESS;
+	for (int i = 0; i < ARRAY_SIZE(variables); i++) {
+		fullPath = malloc(strlen(ctx->root) + strlen(host->name) + strlen(variables[i]) + strlen("//" "/data") + 1);
+		if (!fullPath) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			host->rc = ALLOC_FAIL;
+			return;
+		}
+		sprintf(fullPath, "%s/%s/%s/data", ctx->root, host->name, variables[i]);
+		// a missing variable is not an error, the keystore could be in setup mode
+		if (isFile(fullPath)) {
+			free(fullPath);
+			continue;
+		}
+		data = getDataFromFile(fullPath, &size);
+		if (!data) {
+			prlog(PR_ERR, "ERROR: %s: failed to get data from %s\n", host->name, fullPath);
+			free(fullPath);
+			host->rc = INVALID_FILE;
+			host->failedVars |= 1 << i;
+			continue;
+		}
+		free(fullPath);
+		// an empty variable is treated the same as a missing one
+		if (size) {
+			host->vars[i] = getBlobResult(ctx, variables[i], (unsigned char *)data, size);
+			if (!host->vars[i] || host->vars[i]->rc) {
+				host->failedVars |= 1 << i;
+				if (!host->rc)
+					host->rc = host->vars[i] ? host->vars[i]->rc : ALLOC_FAIL;
+			}
+		}
+		free(data);
+	}
+}
+
+/**
+ *finds the result for a variable blob, examining it if it has not been seen before.
+ *if another thread is examining the same blob, waits for its result instead
+ *@param ctx, shared audit context
+ *@param var, variable name, part of the cache key since validation depends on it
+ *@param data, variable contents
+ *@param size, length of data
+ *@return pointer to cached result or NULL on failure
+ */
+static struct blobResult *getBlobResult(struct auditContext *ctx, const char *var, const unsigned char *data, size_t size)
+{
+	unsigned char hash[AUDIT_HASH_SIZE];
+	struct blobResult *blob;
+	size_t bucket;
+
+	if (hashBlob(var, data, size, hash))
+		return NULL;
+	bucket = (hash[0] | hash[1] << 8) % AUDIT_CACHE_BUCKETS;
+
+	pthread_mutex_lock(&ctx->lock);
+	for (blob = ctx->cache[bucket]; blob; blob = blob->next) {
+		if (!memcmp(blob->hash, hash, AUDIT_HASH_SIZE))
+			break;
+	}
+	if (blob) {
+		ctx->cacheHits++;
+		while (!blob->done)
+			pthread_cond_wait(&ctx->blobDone, &ctx->lock);
+		pthread_mutex_unlock(&ctx->lock);
+		return blob;
+	}
+	blob = calloc(1, sizeof(*blob));
+	if (!blob) {
+		pthread_mutex_unlock(&ctx->lock);
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return NULL;
+	}
+	memcpy(blob->hash, hash, AUDIT_HASH_SIZE);
+	blob->next = ctx->cache[bucket];
+	ctx->cache[bucket] = blob;
+	ctx->uniqueBlobs++;
+	pthread_mutex_unlock(&ctx->lock);
+
+	// blob is published but not done, other threads wanting it will wait
+	examineBlob(blob, var, data, size);
+
+	pthread_mutex_lock(&ctx->lock);
+	blob->done = 1;
+	pthread_cond_broadcast(&ctx->blobDone);
+	pthread_mutex_unlock(&ctx->lock);
+
+	return blob;
+}
+
+/**
+ *validates a variable and collects the summary info for it
+ *@param blob, result to fill
+ *@param var, variable name {"PK", "KEK", "db", "dbx", "TS"}
+ *@param data, variable contents
+ *@param size, length of data
+ */
+static void examineBlob(struct blobResult *blob, const char *var, const unsigned char *data, size_t size)
+{
+	EFI_SIGNATURE_LIST *sigList;
+	size_t offset;
+
+	if (!strcmp(var, "TS")) {
+		blob->rc = validateTS(data, size);
+		return;
+	}
+	blob->rc = validateESL(data, size, var);
+	if (blob->rc)
+		return;
+	blob->entries = countESLEntries(data, size);
+	if (strcmp(var, "PK") && strcmp(var, "KEK"))
+		return;
+	// fingerprint is the hash of the DER of the first certificate, skipping the owner guid
+	sigList = get_esl_signature_list((const char *)data, size);
+	offset = sizeof(EFI_SIGNATURE_LIST) + sigList->SignatureHeaderSize + sizeof(uuid_t);
+	if (sigList->SignatureSize > sizeof(uuid_t) && offset + sigList->SignatureSize - sizeof(uuid_t) <= size
+		&& !cryptoHash(MBEDTLS_MD_SHA256, data + offset,
+			       sigList->SignatureSize - sizeof(uuid_t), blob->fingerprint))
+		blob->hasFingerprint = 1;
+}
+
+/**
+ *hashes a variable name and its contents into a cache key
+ *@param var, variable name
+ *@param data, variable contents
+ *@param size, length of data
+ *@param out, AUDIT_HASH_SIZE buffer for the resulting SHA256
+ *@return SUCCESS or error number
+ */
+static int hashBlob(const char *var, const unsigned char *data, size_t size, unsigned char *out)
+{
+	struct cryptoHashCtx *ctx;
+	int rc;
+
+	rc = cryptoHashInit(&ctx, MBEDTLS_MD_SHA256);
+	if (rc)
+		return rc;
+	rc = cryptoHashUpdate(ctx, (const unsigned char *)var, strlen(var) + 1);
+	if (!rc)
+		rc = cryptoHashUpdate(ctx, data, size);
+	if (!rc)
+		rc = cryptoHashFinish(ctx, out);
+	cryptoHashFree(ctx);
+	if (rc)
+		prlog(PR_ERR, "ERROR: Failed to hash %s data\n", var);
+
+	return rc;
+}
+
+/**
+ *counts the signature entries in every ESL of a buffer, stops at the first malformed ESL
+ *@param esl, buffer of appended ESL's
+ *@param size, length of esl
+ *@return number of entries
+ */
+static int countESLEntries(const unsigned char *esl, size_t size)
+{
+	EFI_SIGNATURE_LIST *sigList;
+	size_t offset = 0, dataSize;
+	int count = 0;
+
+	while (size - offset >= sizeof(EFI_SIGNATURE_LIST)) {
+		sigList = (EFI_SIGNATURE_LIST *)(esl + offset);
+		if (sigList->SignatureListSize > size - offset || !sigList->SignatureSize
+			|| sigList->SignatureListSize < sizeof(EFI_SIGNATURE_LIST) + sigList->SignatureHeaderSize)
+			break;
+		dataSize = sigList->SignatureListSize - sizeof(EFI_SIGNATURE_LIST) - sigList->SignatureHeaderSize;
+		count += dataSize / sigList->SignatureSize;
+		offset += sigList->SignatureListSize;
+	}
+
+	return count;
+}
+
+static void printFingerprint(const char *var, struct blobResult *blob)
+{
+	printf(" %s:", var);
+	if (!blob || !blob->hasFingerprint) {
+		printf("-");
+		return;
+	}
+	for (int i = 0; i < AUDIT_HASH_SIZE; i++)
+		printf("%02x", blob->fingerprint[i]);
+	if (blob->entries > 1)
+		printf("(+%d)", blob->entries - 1);
+}
+
+static void printCount(const char *var, struct blobResult *blob)
+{
+	printf(" %s:", var);
+	if (!blob || blob->rc)
+		printf("-");
+	else
+		printf("%d", blob->entries);
+}
+
+/**
+ *prints the one line summary of a host
+ *@param host, audited host
+ */
+static void printHostResult(struct hostResult *host)
+{
+	printf("%s: ", host->name);
+	if (host->rc) {
+		printf("INVALID(");
+		for (int i = 0, first = 1; i < ARRAY_SIZE(variables); i++) {
+			if (host->failedVars & (1 << i)) {
+				printf("%s%s", first ? "" : ",", variables[i]);
+				first = 0;
+			}
+		}
+		printf(")");
+	}
+	else if (!host->vars[0])
+		printf("SETUP");
+	else
+		printf("VALID");
+	printFingerprint("PK", host->vars[0]);
+	printFingerprint("KEK", host->vars[1]);
+	printCount("db", host->vars[2]);
+	printCount("dbx", host->vars[3]);
+	printf("\n");
+}
@@ -0,0 +1,445 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h> // for strcasecmp
+#include <unistd.h> // for sysconf
+#include <dirent.h> // for scandir
+#include <pthread.h>
+#include <sys/stat.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/md.h>
+#include "secvar/include/edk2-svc.h"// import last!!
+
+#define BUNDLE_HASH_SIZE 32
+#define BUNDLE_MAX_THREADS 256
+#define PEM_CERT_BEGIN "-----BEGIN CERTIFICATE-----"
+#define PEM_CERT_END "-----END CERTIFICATE-----"
+
+/*
+ *one certificate of the input, index is its position in the input so that
+ *results can be reported in input order
+ */
+struct bundleCert {
+	unsigned char *der;
+	size_t size, index;
+	const char *file;
+	int rc, duplicate;
+	unsigned char fingerprint[BUNDLE_HASH_SIZE];
+};
+
+struct bundleContext {
+	struct bundleCert *certs;
+	size_t count, allocated, next;
+	const char *varName;
+	int skipValidation;
+	pthread_mutex_t lock;
+};
+
+static int isDirectory(const char *path);
+static int isCertFileName(const char *name);
+static int addCertFile(struct bundleContext *ctx, const char *file);
+static int addCert(struct bundleContext *ctx, const char *file, unsigned char *der, size_t size);
+static int readCertDirectory(struct bundleContext *ctx, const char *path);
+static void *bundleWorker(void *arg);
+static void checkCerts(struct bundleContext *ctx, int threads);
+static int compareCerts(const void *a, const void *b);
+static int buildBundleESL(struct bundleContext *ctx, unsigned char **out, size_t *outSize);
+static size_t countPEMCerts(const unsigned char *data, size_t size);
+
+/**
+ *@param path, input file or directory given to generate
+ *@return 1 if path is a directory or a PEM file with more than one certificate, 0 otherwise
+ */
+int isCertBundle(const char *path)
+{
+	char *data;
+	size_t size, count;
+
+	if (isDirectory(path))
+		return 1;
+	data = getDataFromFile(path, &size);
+	if (!data)
+		return 0;
+	count = countPEMCerts((unsigned char *)data, size);
+	free(data);
+
+	return count > 1;
+}
+
+/**
+ *reads every certificate of a PEM bundle or of the .crt/.der/.pem/.cer files of a directory,
+ *checks them with validateCert on worker threads and packs them into one ESL. Certificates
+ *are deduplicated and ordered by their SHA256 fingerprint, so the result only depends on the
+ *set of certificates. Every certificate gets its own X509 signature list, laid out like the
+ *ESL 'generate c:e' writes for it, since firmware only reads the first certificate of a list
+ *@param path, PEM/DER file or directory
+ *@param varName, variable the certificates are for, see validateCert, may be NULL
+ *@param threads, number of worker threads, 0 for the number of online CPUs
+ *@param skipValidation, if set certificates are only parsed for their DER, not validated
+ *@param out, the resulting ESL, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outSize, length of out
+ *@return SUCCESS or err number of the first invalid certificate
+ */
+int certBundleToESL(const char *path, const char *varName, int threads, int skipValidation,
+		    unsigned char **out, size_t *outSize)
+{
+	int rc;
+	size_t i;
+	struct bundleContext ctx;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.varName = varName;
+	ctx.skipValidation = skipValidation;
+	pthread_mutex_init(&ctx.lock, NULL);
+	*out = NULL;
+	*outSize = 0;
+
+	if (isDirectory(path))
+		rc = readCertDirectory(&ctx, path);
+	else
+		rc = addCertFile(&ctx, path);
+	if (rc)
+		goto out;
+	if (!ctx.count) {
+		prlog(PR_ERR, "ERROR: No certificates found in %s\n", path);
+		rc = INVALID_FILE;
+		goto out;
+	}
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads <= 0)
+		threads = 1;
+	if (threads > BUNDLE_MAX_THREADS)
+		threads = BUNDLE_MAX_THREADS;
+	if (threads > ctx.count)
+		threads = ctx.count;
+	prlog(PR_INFO, "Checking %zd certificates from %s with %d worker threads\n", ctx.count, path, threads);
+	checkCerts(&ctx, threads);
+
+	// report the first failure in input order, not in the order the workers finished
+	for (i = 0; i < ctx.count; i++) {
+		if (ctx.certs[i].rc) {
+			prlog(PR_ERR, "ERROR: Certificate #%zd of %s is invalid\n", ctx.certs[i].index, ctx.certs[i].file);
+			rc = ctx.certs[i].rc;
+			goto out;
+		}
+	}
+
+	rc = buildBundleESL(&ctx, out, outSize);
+
+out:
+	for (i = 0; i < ctx.count; i++) {
+		free(ctx.certs[i].der);
+		// the file name is shared by the certificates of one file, it is owned by the first
+		if (!ctx.certs[i].index)
+			free((char *)ctx.certs[i].file);
+	}
+	if (ctx.certs)
+		free(ctx.certs);
+	pthread_mutex_destroy(&ctx.lock);
+
+	return rc;
+}
+
+static int isDirectory(const char *path)
+{
+	struct stat statbuf;
+
+	return !stat(path, &statbuf) && (statbuf.st_mode & S_IFMT) == S_IFDIR;
+}
+
+static int isCertFileName(const char *name)
+{
+	const char *ext = strrchr(name, '.');
+
+	if (!ext || name[0] == '.')
+		return 0;
+
+	return !strcasecmp(ext, ".crt") || !strcasecmp(ext, ".der") || !strcasecmp(ext, ".pem")
+		|| !strcasecmp(ext, ".cer");
+}
+
+static int selectCertFile(const struct dirent *entry)
+{
+	return isCertFileName(entry->d_name);
+}
+
+/**
+ *adds the certificate files of a directory in name order, subdirectories are not searched
+ *@param ctx, context to add the certificates to
+ *@param path, directory
+ *@return SUCCESS or err number
+ */
+static int readCertDirectory(struct bundleContext *ctx, const char *path)
+{
+	struct dirent **entries = NULL;
+	char *fullPath;
+	int count, i, rc = SUCCESS;
+
+	count = scandir(path, &entries, selectCertFile, alphasort);
+	if (count < 0) {
+		prlog(PR_ERR, "ERROR: Could not open directory %s\n", path);
+		return INVALID_FILE;
+	}
+	for (i = 0; i < count; i++) {
+		if (!rc) {
+			fullPath = malloc(strlen(path) + strlen(entries[i]->d_name) + 2);
+			if (!fullPath) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				rc = ALLOC_FAIL;
+			} else {
+				sprintf(fullPath, "%s/%s", path, entries[i]->d_name);
+				if (!isDirectory(fullPath))
+					rc = addCertFile(ctx, fullPath);
+				free(fullPath);
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+
+	return rc;
+}
+
+/**
+ *splits a file into the DER of its certificates, a file without PEM certificates is one DER certificate
+ *@param ctx, context to add the certificates to
+ *@param file, path of the file
+ *@return SUCCESS or err number
+ */
+static int addCertFile(struct bundleContext *ctx, const char *file)
+{
+	int rc = SUCCESS;
+	char *data = NULL, *pem = NULL, *name;
+	const char *begin, *end;
+	unsigned char *der;
+	size_t size, derSize, first = ctx->count;
+
+	// every certificate keeps the name of its file for error messages
+	name = strdup(file);
+	if (!name) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	data = getDataFromFile(file, &size);
+	if (!data) {
+		prlog(PR_ERR, "ERROR: Could not read certificates from %s\n", file);
+		rc = INVALID_FILE;
+		goto out;
+	}
+
+	if (!countPEMCerts((unsigned char *)data, size)) {
+		der = malloc(size);
+		if (!der) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		memcpy(der, data, size);
+		rc = addCert(ctx, name, der, size);
+		goto out;
+	}
+
+	// copy with a trailing '\0' so the PEM can be searched as a string
+	pem = calloc(1, size + 1);
+	if (!pem) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	memcpy(pem, data, size);
+	for (begin = strstr(pem, PEM_CERT_BEGIN); begin; begin = strstr(end, PEM_CERT_BEGIN)) {
+		begin += strlen(PEM_CERT_BEGIN);
+		end = strstr(begin, PEM_CERT_END);
+		if (!end) {
+			prlog(PR_ERR, "ERROR: PEM certificate #%zd of %s has no end line\n", ctx->count - first, file);
+			rc = CERT_FAIL;
+			goto out;
+		}
+		derSize = 0;
+		mbedtls_base64_decode(NULL, 0, &derSize, (const unsigned char *)begin, end - begin);
+		der = malloc(derSize ? derSize : 1);
+		if (!der) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		rc = mbedtls_base64_decode(der, derSize, &derSize, (const unsigned char *)begin, end - begin);
+		if (rc || !derSize) {
+			prlog(PR_ERR, "ERROR: Could not decode PEM certificate #%zd of %s, mbedtls err #%d\n", ctx->count - first, file, rc);
+			free(der);
+			rc = CERT_FAIL;
+			goto out;
+		}
+		rc = addCert(ctx, name, der, derSize);
+		if (rc)
+			goto out;
+	}
+
+out:
+	if (data)
+		free(data);
+	if (pem)
+		free(pem);
+	if (ctx->count == first)
+		free(name);
+
+	return rc;
+}
+
+/**
+ *@param der, DER of the certificate, taken over by ctx even on failure
+ *@return SUCCESS or ALLOC_FAIL
+ */
+static int addCert(struct bundleContext *ctx, const char *file, unsigned char *der, size_t size)
+{
+	struct bundleCert *tmp;
+	size_t index = 0;
+
+	if (ctx->count && ctx->certs[ctx->count - 1].file == file)
+		index = ctx->certs[ctx->count - 1].index + 1;
+	if (ctx->count == ctx->allocated) {
+		ctx->allocated = ctx->allocated ? ctx->allocated * 2 : 64;
+		tmp = realloc(ctx->certs, sizeof(*ctx->certs) * ctx->allocated);
+		if (!tmp) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			free(der);
+			return ALLOC_FAIL;
+		}
+		ctx->certs = tmp;
+	}
+	memset(&ctx->certs[ctx->count], 0, sizeof(*ctx->certs));
+	ctx->certs[ctx->count].der = der;
+	ctx->certs[ctx->count].size = size;
+	ctx->certs[ctx->count].file = file;
+	ctx->certs[ctx->count].index = index;
+	ctx->count++;
+
+	return SUCCESS;
+}
+
+/*
+ *worker thread, takes certificates from the context until there are none left,
+ *every result is stored with its certificate so the order of completion does not matter
+ *@param arg, pointer to the shared bundle context
+ */
+static void *bundleWorker(void *arg)
+{
+	struct bundleContext *ctx = arg;
+	struct bundleCert *cert;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&ctx->lock);
+		i = ctx->next++;
+		pthread_mutex_unlock(&ctx->lock);
+		if (i >= ctx->count)
+			break;
+		cert = &ctx->certs[i];
+		if (!ctx->skipValidation)
+			cert->rc = validateCert(cert->der, cert->size, ctx->varName);
+		if (!cert->rc)
+			cert->rc = cryptoHash(MBEDTLS_MD_SHA256, cert->der, cert->size, cert->fingerprint);
+	}
+
+	return NULL;
+}
+
+/**
+ *runs bundleWorker on threads workers, falls back to the calling thread if none can be started
+ */
+static void checkCerts(struct bundleContext *ctx, int threads)
+{
+	pthread_t *workers;
+	int created = 0;
+
+	workers = malloc(sizeof(*workers) * threads);
+	for (; workers && threads > 1 && created < threads; created++) {
+		if (pthread_create(&workers[created], NULL, bundleWorker, ctx)) {
+			prlog(PR_WARNING, "WARNING: Could only start %d of %d worker threads\n", created, threads);
+			break;
+		}
+	}
+	// if no workers could be started then do the work here
+	if (!created)
+		bundleWorker(ctx);
+	for (int j = 0; j < created; j++)
+		pthread_join(workers[j], NULL);
+	if (workers)
+		free(workers);
+}
+
+/*
+ *orders certificates by fingerprint so the ESL only depends on the set of certificates
+ */
+static int compareCerts(const void *a, const void *b)
+{
+	const struct bundleCert *x = a, *y = b;
+
+	return memcmp(x->fingerprint, y->fingerprint, BUNDLE_HASH_SIZE);
+}
+
+/**
+ *sorts and deduplicates the checked certificates and writes each into its own X509
+ *signature list, firmware and verify only read the first certificate of a list
+ *@return SUCCESS or ALLOC_FAIL
+ */
+static int buildBundleESL(struct bundleContext *ctx, unsigned char **out, size_t *outSize)
+{
+	EFI_SIGNATURE_LIST list;
+	size_t i, unique = 0, offset = 0;
+
+	qsort(ctx->certs, ctx->count, sizeof(*ctx->certs), compareCerts);
+	for (i = 0; i < ctx->count; i++) {
+		if (i && !compareCerts(&ctx->certs[i - 1], &ctx->certs[i])) {
+			ctx->certs[i].duplicate = 1;
+			prlog(PR_INFO, "Certificate #%zd of %s is a duplicate, skipping it\n", ctx->certs[i].index, ctx->certs[i].file);
+			continue;
+		}
+		unique++;
+		*outSize += sizeof(list) + sizeof(uuid_t) + ctx->certs[i].size;
+	}
+	*out = calloc(1, *outSize);
+	if (!*out) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		*outSize = 0;
+		return ALLOC_FAIL;
+	}
+
+	for (i = 0; i < ctx->count; i++) {
+		if (ctx->certs[i].duplicate)
+			continue;
+		// same layout as the ESL made from one certificate, header size is zero
+		memset(&list, 0, sizeof(list));
+		list.SignatureType = EFI_CERT_X509_GUID;
+		list.SignatureHeaderSize = 0;
+		list.SignatureSize = sizeof(uuid_t) + ctx->certs[i].size;
+		list.SignatureListSize = sizeof(list) + list.SignatureSize;
+		memcpy(*out + offset, &list, sizeof(list));
+		offset += sizeof(list);
+		// owner guid is left blank
+		offset += sizeof(uuid_t);
+		memcpy(*out + offset, ctx->certs[i].der, ctx->certs[i].size);
+		offset += ctx->certs[i].size;
+	}
+	prlog(PR_NOTICE, "Packed %zd unique certificates of %zd into %zd bytes of ESL data\n", unique, ctx->count, *outSize);
+
+	return SUCCESS;
+}
+
+static size_t countPEMCerts(const unsigned char *data, size_t size)
+{
+	size_t count = 0, len = strlen(PEM_CERT_BEGIN);
+
+	for (size_t i = 0; i + len <= size; i++) {
+		if (data[i] == '-' && !memcmp(data + i, PEM_CERT_BEGIN, len)) {
+			count++;
+			i += len - 1;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,324 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <mbedtls/md.h> // for cache keys
+#include "secvar/include/edk2-svc.h"// import last!!
+
+/*
+ *The verification cache remembers which inputs have already passed a check so
+ *repeated 'verify' runs over the same files can skip the x509/PKCS7 work.
+ *Each record is the SHA256 digest of everything the check depended on (see
+ *verifyCacheKeyStart/verifyCacheKeyAdd), so any change to an input yields a
+ *new key and the check is simply run again. Only successes are recorded.
+ *The keys are kept sorted and unique so a lookup is a binary search.
+ *File format: VERIFY_CACHE_MAGIC followed by VERIFY_CACHE_KEY_SIZE byte keys
+ */
+#define VERIFY_CACHE_MAGIC "secvarctl-vcache1"
+#define VERIFY_CACHE_MAGIC_LEN (sizeof(VERIFY_CACHE_MAGIC) - 1)
+
+static struct {
+	const char *file;
+	unsigned char *keys;
+	size_t count, capacity, hits;
+	int dirty;
+} cache;
+// certificates may be looked up and stored by worker threads
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int compareKeys(const void *a, const void *b)
+{
+	return memcmp(a, b, VERIFY_CACHE_KEY_SIZE);
+}
+
+/*
+ *finds where key is or would be inserted in the sorted keys, cacheLock must be held
+ *@param key digest to look for
+ *@param found set to 1 if key is stored at the returned index
+ *@return index of key or of the first key greater than it
+ */
+static size_t findKey(const unsigned char *key, int *found)
+{
+	size_t low = 0, high = cache.count, mid;
+	int cmp;
+
+	*found = 0;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		cmp = compareKeys(cache.keys + mid * VERIFY_CACHE_KEY_SIZE, key);
+		if (!cmp) {
+			*found = 1;
+			return mid;
+		}
+		if (cmp < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+/**
+ *loads verification results from a cache file, a missing or unreadable file
+ *is treated as an empty cache and is (re)written by closeVerifyCache
+ *@param file path to cache file
+ *@return SUCCESS or error number
+ */
+int openVerifyCache(const char *file)
+{
+	char *c = NULL;
+	size_t size = 0, unique = 0;
+
+	memset(&cache, 0, sizeof(cache));
+	cache.file = file;
+	if (isFile(file))
+		return SUCCESS;
+
+	c = getDataFromFile(file, &size);
+	if (!c || size < VERIFY_CACHE_MAGIC_LEN || memcmp(c, VERIFY_CACHE_MAGIC, VERIFY_CACHE_MAGIC_LEN)
+		|| (size - VERIFY_CACHE_MAGIC_LEN) % VERIFY_CACHE_KEY_SIZE) {
+		prlog(PR_WARNING, "WARNING: %s is not a verification cache, it will be overwritten\n", file);
+		cache.dirty = 1;
+		goto out;
+	}
+	cache.count = (size - VERIFY_CACHE_MAGIC_LEN) / VERIFY_CACHE_KEY_SIZE;
+	cache.capacity = cache.count;
+	if (cache.count) {
+		cache.keys = malloc(cache.count * VERIFY_CACHE_KEY_SIZE);
+		if (!cache.keys) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			free(c);
+			cache.file = NULL;
+			return ALLOC_FAIL;
+		}
+		memcpy(cache.keys, c + VERIFY_CACHE_MAGIC_LEN, cache.count * VERIFY_CACHE_KEY_SIZE);
+		// files written by closeVerifyCache are sorted already, others are sorted once here
+		qsort(cache.keys, cache.count, VERIFY_CACHE_KEY_SIZE, compareKeys);
+		for (size_t i = 0; i < cache.count; i++) {
+			if (unique && !compareKeys(cache.keys + (unique - 1) * VERIFY_CACHE_KEY_SIZE, cache.keys + i * VERIFY_CACHE_KEY_SIZE))
+				continue;
+			if (unique != i)
+				memcpy(cache.keys + unique * VERIFY_CACHE_KEY_SIZE, cache.keys + i * VERIFY_CACHE_KEY_SIZE, VERIFY_CACHE_KEY_SIZE);
+			unique++;
+		}
+		if (unique != cache.count)
+			cache.dirty = 1;
+		cache.count = unique;
+	}
+	prlog(PR_INFO, "Loaded %zd cached verification results from %s\n", cache.count, file);
+out:
+	if (c)
+		free(c);
+
+	return SUCCESS;
+}
+
+/**
+ *writes any new results to the cache file and releases the cache
+ *@return SUCCESS or error number
+ */
+int closeVerifyCache(void)
+{
+	int rc = SUCCESS;
+	char *buff = NULL;
+	size_t size;
+
+	if (!cache.file)
+		return SUCCESS;
+	prlog(PR_INFO, "Verification cache: %zd hits, %zd entries\n", cache.hits, cache.count);
+	if (cache.dirty) {
+		size = VERIFY_CACHE_MAGIC_LEN + cache.count * VERIFY_CACHE_KEY_SIZE;
+		buff = malloc(size);
+		if (!buff) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		memcpy(buff, VERIFY_CACHE_MAGIC, VERIFY_CACHE_MAGIC_LEN);
+		if (cache.count)
+			memcpy(buff + VERIFY_CACHE_MAGIC_LEN, cache.keys, cache.count * VERIFY_CACHE_KEY_SIZE);
+		rc = createFile(cache.file, buff, size);
+		if (rc)
+			prlog(PR_ERR, "ERROR: failed to update verification cache %s\n", cache.file);
+	}
+out:
+	if (buff)
+		free(buff);
+	if (cache.keys)
+		free(cache.keys);
+	memset(&cache, 0, sizeof(cache));
+
+	return rc;
+}
+
+/**
+ *@return 1 if a verification cache is loaded, 0 otherwise
+ */
+int isVerifyCacheOpen(void)
+{
+	return cache.file != NULL;
+}
+
+/**
+ *starts a cache key, the tag names the check being cached so that results
+ *of different checks on the same data never collide
+ *@param ctx filled with a hash context, freed by verifyCacheKeyFinish or cryptoHashFree
+ *@param tag name of check
+ *@return SUCCESS or HASH_FAIL
+ */
+int verifyCacheKeyStart(struct cryptoHashCtx **ctx, const char *tag)
+{
+	if (cryptoHashInit(ctx, MBEDTLS_MD_SHA256))
+		return HASH_FAIL;
+
+	return verifyCacheKeyAdd(*ctx, tag, strlen(tag));
+}
+
+/**
+ *adds one input to a cache key, inputs are length prefixed so the
+ *concatenation of two inputs can not be mistaken for another pair
+ *@param ctx context from verifyCacheKeyStart
+ *@param data input data, may be NULL if len is 0
+ *@param len length of data
+ *@return SUCCESS or HASH_FAIL
+ */
+int verifyCacheKeyAdd(struct cryptoHashCtx *ctx, const void *data, size_t len)
+{
+	uint64_t prefix = len;
+
+	if (cryptoHashUpdate(ctx, (const unsigned char *)&prefix, sizeof(prefix)))
+		return HASH_FAIL;
+	if (len && cryptoHashUpdate(ctx, data, len))
+		return HASH_FAIL;
+
+	return SUCCESS;
+}
+
+/**
+ *finishes a cache key and frees the context
+ *@param ctx context from verifyCacheKeyStart
+ *@param key buffer of VERIFY_CACHE_KEY_SIZE bytes
+ *@return SUCCESS or HASH_FAIL
+ */
+int verifyCacheKeyFinish(struct cryptoHashCtx *ctx, unsigned char *key)
+{
+	int rc;
+
+	rc = cryptoHashFinish(ctx, key);
+	cryptoHashFree(ctx);
+
+	return rc ? HASH_FAIL : SUCCESS;
+}
+
+/**
+ *@param key digest from verifyCacheKeyFinish
+ *@return SUCCESS if the check described by key has already passed, error otherwise
+ */
+int verifyCacheLookup(const unsigned char *key)
+{
+	int rc = INVALID_FILE, found;
+
+	pthread_mutex_lock(&cacheLock);
+	findKey(key, &found);
+	if (found) {
+		cache.hits++;
+		rc = SUCCESS;
+	}
+	pthread_mutex_unlock(&cacheLock);
+
+	return rc;
+}
+
+/**
+ *records that the check described by key passed, failures to store are not
+ *fatal since the check is simply run again next time
+ *@param key digest from verifyCacheKeyFinish
+ */
+void verifyCacheStore(const unsigned char *key)
+{
+	unsigned char *tmp;
+	size_t index;
+	int found;
+
+	if (!cache.file)
+		return;
+	pthread_mutex_lock(&cacheLock);
+	// two threads may have passed the same check
+	index = findKey(key, &found);
+	if (found)
+		goto out;
+	if (cache.count == cache.capacity) {
+		tmp = realloc(cache.keys, (cache.capacity * 2 + 16) * VERIFY_CACHE_KEY_SIZE);
+		if (!tmp)
+			goto out;
+		cache.keys = tmp;
+		cache.capacity = cache.capacity * 2 + 16;
+	}
+	memmove(cache.keys + (index + 1) * VERIFY_CACHE_KEY_SIZE, cache.keys + index * VERIFY_CACHE_KEY_SIZE,
+		(cache.count - index) * VERIFY_CACHE_KEY_SIZE);
+	memcpy(cache.keys + index * VERIFY_CACHE_KEY_SIZE, key, VERIFY_CACHE_KEY_SIZE);
+	cache.count++;
+	cache.dirty = 1;
+out:
+	pthread_mutex_unlock(&cacheLock);
+}
+
+/**
+ *makes the cache key for one of the validate functions run on a variable
+ *@param tag name of check
+ *@param key variable name
+ *@param data variable data
+ *@param size length of data
+ *@param digest filled with the key, VERIFY_CACHE_KEY_SIZE bytes
+ *@return SUCCESS or HASH_FAIL
+ */
+int getValidateCacheKey(const char *tag, const char *key, const unsigned char *data, size_t size, unsigned char *digest)
+{
+	int rc;
+	struct cryptoHashCtx *ctx;
+
+	rc = verifyCacheKeyStart(&ctx, tag);
+	if (rc)
+		return rc;
+	rc = verifyCacheKeyAdd(ctx, key, strlen(key) + 1);
+	if (!rc)
+		rc = verifyCacheKeyAdd(ctx, data, size);
+	if (rc) {
+		cryptoHashFree(ctx);
+		return rc;
+	}
+
+	return verifyCacheKeyFinish(ctx, digest);
+}
+
+/**
+ *runs one of the validate functions unless it has already passed for the same
+ *variable name and data
+ *@param tag name of check
+ *@param key variable name
+ *@param data variable data
+ *@param size length of data
+ *@param validate validation function, key is passed through to it
+ *@return SUCCESS or error number from validate
+ */
+int cachedValidate(const char *tag, const char *key, const unsigned char *data, size_t size,
+		   int (*validate)(const unsigned char *, size_t, const char *))
+{
+	int rc;
+	unsigned char digest[VERIFY_CACHE_KEY_SIZE];
+
+	if (!cache.file || getValidateCacheKey(tag, key, data, size, digest))
+		return validate(data, size, key);
+	if (!verifyCacheLookup(digest)) {
+		prlog(PR_INFO, "%s for %s found in verification cache\n", tag, key);
+		return SUCCESS;
+	}
+	rc = validate(data, size, key);
+	if (!rc)
+		verifyCacheStore(digest);
+
+	return rc;
+}
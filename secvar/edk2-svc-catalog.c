@@ -0,0 +1,811 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <dirent.h> // for scanning the update repository
+#include <sys/stat.h>
+#include <mbedtls/md.h> // for payload digests and signer ids
+#include "backends/include/backends.h"
+#include "secvar/include/edk2-svc.h"// import last!!
+
+/*
+ *The catalog is an index of a repository of auth files that is built without
+ *any x509 or signature work, only the auth header, the issuer and serial of the
+ *PKCS7 SignerInfos and the ESL headers are decoded. Queries pick the newest
+ *update per variable from the index and only the chosen file is verified.
+ *File format: CATALOG_MAGIC line, then one line per auth file with tab separated
+ *<var> <timestamp> <SHA256 of ESL> <ESL size> <entries> <signers> <file>,
+ *signers are comma separated <issuer>:<serial> ids, see signerId
+ */
+#define CATALOG_MAGIC "secvarctl-catalog1"
+#define CATALOG_HASH_SIZE 32
+// bytes of the SHA256 of the issuer name in a signer id
+#define CATALOG_ISSUER_ID 8
+#define CATALOG_VAR_COUNT (ARRAY_SIZE(variables) - 1)
+
+struct catalogArguments {
+	int helpFlag, varMask;
+	const char *dir, *outFile, *inFile, *signerCert, *pathToSecVars;
+};
+
+/*
+ *growing text buffer the index is written into
+ */
+struct catalogBuffer {
+	char *data;
+	size_t len, capacity;
+};
+
+struct catalogEntry {
+	int var;
+	struct efi_time time;
+	size_t size, entries;
+	char *signers, *file;
+};
+
+struct fileList {
+	char **names;
+	size_t count, capacity;
+};
+
+static void usage();
+static void help();
+static int parseArgs(int argc, char *argv[], struct catalogArguments *args);
+static int buildCatalog(const char *dir, const char *outFile);
+static int listAuthFiles(const char *dir, struct fileList *files);
+static int addName(struct fileList *list, char *name);
+static int catalogFile(const char *file, struct catalogBuffer *buf);
+static int getVarIndex(const char *file);
+static char *signerId(const mbedtls_x509_buf *issuer, const mbedtls_x509_buf *serial);
+static int bufferPrintf(struct catalogBuffer *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static int queryCatalog(const struct catalogArguments *args);
+static int loadCatalog(const char *file, struct catalogEntry **entries, size_t *count);
+static void freeCatalog(struct catalogEntry *entries, size_t count);
+static int compareTime(const struct efi_time *a, const struct efi_time *b);
+static int hasSigner(const char *signers, const char *id);
+
+/*
+ *called from main()
+ *builds an index of a directory of auth files or picks updates from one
+ *@param argc, number of argument
+ *@param arv, array of params
+ *@return SUCCESS or err number
+ */
+int performCatalogCommand(int argc, char* argv[])
+{
+	int rc;
+	struct catalogArguments args = {
+		.helpFlag = 0, .varMask = 0, .dir = NULL, .outFile = NULL, .inFile = NULL,
+		.signerCert = NULL, .pathToSecVars = NULL
+	};
+
+	rc = parseArgs(argc, argv, &args);
+	if (rc || args.helpFlag)
+		return rc;
+
+	if (args.inFile)
+		rc = queryCatalog(&args);
+	else
+		rc = buildCatalog(args.dir, args.outFile);
+
+	printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
+
+	return rc;
+}
+
+static void usage()
+{
+	printf("USAGE:\n\t $ secvarctl catalog [OPTIONS] {<directory> -o <indexFile> | -i <indexFile>}"
+		"\n\tOPTIONS:"
+		"\n\t\t--help/--usage"
+		"\n\t\t-v\t\tverbose, print process info"
+		"\n\t\t-o <indexFile>\tindex every .auth file under <directory> into <indexFile>"
+		"\n\t\t-i <indexFile>\tprint the newest update per variable found in <indexFile>"
+		"\n\t\t-n <varName>\twith -i, only pick updates for <varName>, can be given several times"
+		"\n\t\t-s <certFile>\twith -i, only pick updates signed by the x509 certificate in <certFile>"
+		"\n\t\t-p <path>\twith -i, only pick updates newer than the timestamps in <path>/TS,"
+		"\n\t\t\t\tthe chosen update is verified against the variables in <path>,"
+		"\n\t\t\t\tif it fails the next newest one is tried\n");
+}
+
+static void help()
+{
+	printf("HELP:\n\t"
+		"The purpose of this command is to find the right update in a large repository of\n\t"
+		"auth files without validating each of them. Building the index decodes only the\n\t"
+		"auth header, the issuer and serial of every PKCS7 signer and the ESL headers, no\n\t"
+		"certificate is parsed and no signature is checked. The variable of a file is taken\n\t"
+		"from the name of its directory or the start of its name, ex. 'dbx/update1.auth'\n\t"
+		"or 'dbx_by_KEK.auth'. Each line of the index holds the variable, timestamp,\n\t"
+		"SHA256 and size of the ESL, number of entries, signers and path of one file.\n\t"
+		"A query picks the newest update of each variable from the index, signers are\n\t"
+		"matched by the issuer and serial of the certificate given with '-s'. With '-p'\n\t"
+		"only the chosen update is fully verified against the current variables.\n");
+	usage();
+}
+
+/**
+ *@param argv , array of command line arguments
+ *@param argc, length of argv
+ *@param args, struct that will be filled with data from argv
+ *@return success or errno
+ */
+static int parseArgs(int argc, char *argv[], struct catalogArguments *args)
+{
+	int rc = SUCCESS, var;
+
+	for (int i = 0; i < argc; i++) {
+		if (argv[i][0] != '-') {
+			if (args->dir) {
+				prlog(PR_ERR, "ERROR: Only one directory can be cataloged at a time, found %s and %s\n", args->dir, argv[i]);
+				rc = ARG_PARSE_FAIL;
+				goto out;
+			}
+			args->dir = argv[i];
+			continue;
+		}
+		if (!strcmp(argv[i], "--usage")) {
+			usage();
+			args->helpFlag = 1;
+			goto out;
+		}
+		else if (!strcmp(argv[i], "--help")) {
+			help();
+			args->helpFlag = 1;
+			goto out;
+		}
+		switch (argv[i][1]) {
+			case 'v':
+				verbose = PR_DEBUG;
+				break;
+			case 'o':
+			case 'i':
+			case 's':
+			case 'p':
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '%s', see usage...\n", argv[i]);
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				if (argv[i - 1][1] == 'o')
+					args->outFile = argv[i];
+				else if (argv[i - 1][1] == 'i')
+					args->inFile = argv[i];
+				else if (argv[i - 1][1] == 's')
+					args->signerCert = argv[i];
+				else
+					args->pathToSecVars = argv[i];
+				break;
+			case 'n':
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '-n', use '-n <varName>', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				for (var = 0; var < CATALOG_VAR_COUNT && strcmp(argv[i], variables[var]); var++)
+					;
+				if (var == CATALOG_VAR_COUNT) {
+					prlog(PR_ERR, "ERROR: Invalid variable name %s\n", argv[i]);
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				args->varMask |= 1 << var;
+				break;
+			default:
+				prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+				rc = ARG_PARSE_FAIL;
+				goto out;
+		}
+	}
+
+	if (!args->inFile == !args->outFile) {
+		prlog(PR_ERR, "ERROR: Give either '-o <indexFile>' to build an index or '-i <indexFile>' to query one\n");
+		rc = ARG_PARSE_FAIL;
+	}
+	else if (args->outFile && !args->dir) {
+		prlog(PR_ERR, "ERROR: No directory to catalog\n");
+		rc = ARG_PARSE_FAIL;
+	}
+	else if (args->inFile && args->dir) {
+		prlog(PR_ERR, "ERROR: A directory can not be given with '-i'\n");
+		rc = ARG_PARSE_FAIL;
+	}
+	else if (args->outFile && (args->varMask || args->signerCert || args->pathToSecVars)) {
+		prlog(PR_ERR, "ERROR: '-n', '-s' and '-p' are only used with '-i'\n");
+		rc = ARG_PARSE_FAIL;
+	}
+
+out:
+	if (rc) {
+		prlog(PR_ERR, "Failed during argument parsing\n");
+		usage();
+	}
+
+	return rc;
+}
+
+/**
+ *indexes every auth file under a directory
+ *@param dir, directory to scan, subdirectories included
+ *@param outFile, index file to write
+ *@return SUCCESS or error number, files that do not decode are skipped with a warning
+ */
+static int buildCatalog(const char *dir, const char *outFile)
+{
+	int rc;
+	size_t indexed = 0, skipped = 0, i;
+	struct fileList files = { 0 };
+	struct catalogBuffer buf = { 0 };
+
+	rc = listAuthFiles(dir, &files);
+	if (rc)
+		goto out;
+	rc = bufferPrintf(&buf, "%s\n", CATALOG_MAGIC);
+	if (rc)
+		goto out;
+	for (i = 0; i < files.count; i++) {
+		rc = catalogFile(files.names[i], &buf);
+		if (rc == ALLOC_FAIL)
+			goto out;
+		if (rc) {
+			prlog(PR_WARNING, "WARNING: Skipping %s\n", files.names[i]);
+			skipped++;
+		}
+		else
+			indexed++;
+	}
+	rc = createFile(outFile, buf.data, buf.len);
+	if (rc)
+		goto out;
+	printf("Cataloged %zd auth files from %s into %s, skipped %zd\n", indexed, dir, outFile, skipped);
+
+out:
+	for (i = 0; i < files.count; i++)
+		free(files.names[i]);
+	if (files.names)
+		free(files.names);
+	if (buf.data)
+		free(buf.data);
+
+	return rc;
+}
+
+static int compareNames(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+ *finds every file ending in .auth under dir, sorted so the index is the same on every run
+ *@param dir, directory to scan, subdirectories included
+ *@param files, filled with the paths of the files
+ *@return SUCCESS or error number
+ */
+static int listAuthFiles(const char *dir, struct fileList *files)
+{
+	struct fileList dirs = { 0 };
+	struct dirent *entry;
+	struct stat statbuf;
+	char *fullPath;
+	const char *current;
+	size_t len;
+	DIR *d;
+	int rc = SUCCESS;
+
+	// dirs is a stack of directories still to be read, dir itself is not freed
+	for (current = dir; current; current = dirs.count ? dirs.names[--dirs.count] : NULL) {
+		d = opendir(current);
+		if (!d) {
+			prlog(PR_ERR, "ERROR: Could not open directory %s\n", current);
+			rc = INVALID_FILE;
+		}
+		while (d && (entry = readdir(d))) {
+			if (entry->d_name[0] == '.')
+				continue;
+			fullPath = malloc(strlen(current) + strlen(entry->d_name) + 2);
+			if (!fullPath) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				rc = ALLOC_FAIL;
+				break;
+			}
+			sprintf(fullPath, "%s/%s", current, entry->d_name);
+			len = strlen(entry->d_name);
+			if (stat(fullPath, &statbuf))
+				free(fullPath);
+			else if ((statbuf.st_mode & S_IFMT) == S_IFDIR)
+				rc = addName(&dirs, fullPath);
+			// tabs and newlines separate the fields and lines of the index
+			else if (len > strlen(".auth") && !strcmp(entry->d_name + len - strlen(".auth"), ".auth")
+				 && !strpbrk(fullPath, "\t\n"))
+				rc = addName(files, fullPath);
+			else
+				free(fullPath);
+			if (rc == ALLOC_FAIL)
+				break;
+		}
+		if (d)
+			closedir(d);
+		if (current != dir)
+			free((char *)current);
+		if (rc == ALLOC_FAIL)
+			break;
+	}
+	for (size_t i = 0; i < dirs.count; i++)
+		free(dirs.names[i]);
+	if (dirs.names)
+		free(dirs.names);
+	if (files->count)
+		qsort(files->names, files->count, sizeof(*files->names), compareNames);
+
+	return rc;
+}
+
+/**
+ *adds a path to a list, the list takes ownership of it
+ *@return SUCCESS or ALLOC_FAIL, name is freed on failure
+ */
+static int addName(struct fileList *list, char *name)
+{
+	char **tmp;
+
+	if (list->count == list->capacity) {
+		tmp = realloc(list->names, sizeof(*tmp) * (list->capacity * 2 + 64));
+		if (!tmp) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			free(name);
+			return ALLOC_FAIL;
+		}
+		list->names = tmp;
+		list->capacity = list->capacity * 2 + 64;
+	}
+	list->names[list->count++] = name;
+
+	return SUCCESS;
+}
+
+static int countEntry(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data)
+{
+	if (sig)
+		(*(size_t *)data)++;
+
+	return SUCCESS;
+}
+
+/**
+ *decodes the headers of one auth file and adds its line to the index
+ *@param file, path to the auth file
+ *@param buf, index being built
+ *@return SUCCESS, ALLOC_FAIL or another error number if the file does not decode
+ */
+static int catalogFile(const char *file, struct catalogBuffer *buf)
+{
+	int rc, var;
+	size_t size = 0, authSize, pkcs7Size, entries = 0;
+	unsigned char digest[CATALOG_HASH_SIZE];
+	const struct efi_variable_authentication_2 *desc;
+	const struct efi_time *t;
+	mbedtls_pkcs7 *pkcs7 = NULL;
+	mbedtls_pkcs7_signer_info *signer;
+	char *data = NULL, *id;
+
+	var = getVarIndex(file);
+	if (var < 0) {
+		prlog(PR_ERR, "ERROR: Could not tell the variable of %s from its name or directory\n", file);
+		return INVALID_VAR_NAME;
+	}
+	data = getDataFromFile(file, &size);
+	if (!data)
+		return INVALID_FILE;
+
+	rc = AUTH_FAIL;
+	desc = (const struct efi_variable_authentication_2 *)data;
+	if (size < sizeof(*desc)) {
+		prlog(PR_ERR, "ERROR: %s is too small to be valid auth file\n", file);
+		goto out;
+	}
+	authSize = desc->auth_info.hdr.dw_length + sizeof(desc->timestamp);
+	if ((ssize_t)authSize <= 0 || authSize > size) {
+		prlog(PR_ERR, "ERROR: Invalid auth size, expected %zd found %zd\n", authSize, size);
+		goto out;
+	}
+	if (strcmp(getSigType(desc->auth_info.cert_type), "PKCS7")) {
+		prlog(PR_ERR, "ERROR: Auth file does not contain PKCS7 guid\n");
+		goto out;
+	}
+	pkcs7Size = get_pkcs7_len(desc);
+	if ((ssize_t)pkcs7Size <= 0 || pkcs7Size > authSize) {
+		prlog(PR_ERR, "ERROR: Invalid pkcs7 size %zd\n", pkcs7Size);
+		goto out;
+	}
+	// the certificates are left encoded, only the SignerInfos are needed
+	rc = parsePKCS7(&pkcs7, desc->auth_info.cert_data, pkcs7Size, 0);
+	if (rc)
+		goto out;
+	rc = walkESL((const unsigned char *)data + authSize, size - authSize, countEntry, &entries);
+	if (rc)
+		goto out;
+	rc = cryptoHash(MBEDTLS_MD_SHA256, (const unsigned char *)data + authSize, size - authSize, digest);
+	if (rc)
+		goto out;
+
+	t = &desc->timestamp;
+	rc = bufferPrintf(buf, "%s\t%04d-%02d-%02dT%02d:%02d:%02d\t", variables[var],
+			  t->year, t->month, t->day, t->hour, t->minute, t->second);
+	for (int i = 0; !rc && i < CATALOG_HASH_SIZE; i++)
+		rc = bufferPrintf(buf, "%02x", digest[i]);
+	if (!rc)
+		rc = bufferPrintf(buf, "\t%zd\t%zd\t", size - authSize, entries);
+	for (signer = pkcs7->signed_data.signers; !rc && signer; signer = signer->next) {
+		id = signerId(&signer->issuer_raw, &signer->serial);
+		if (!id) {
+			rc = ALLOC_FAIL;
+			break;
+		}
+		rc = bufferPrintf(buf, "%s%s", signer == pkcs7->signed_data.signers ? "" : ",", id);
+		free(id);
+	}
+	if (!rc)
+		rc = bufferPrintf(buf, "\t%s\n", file);
+
+out:
+	if (pkcs7) {
+		mbedtls_pkcs7_free(pkcs7);
+		free(pkcs7);
+	}
+	free(data);
+
+	return rc;
+}
+
+/**
+ *finds the variable an auth file updates from the name of its directory or from
+ *the start of its name, the longest matching name wins so 'dbx_1.auth' is a dbx update
+ *@param file, path to the auth file
+ *@return index into variables or -1 if no name matches
+ */
+static int getVarIndex(const char *file)
+{
+	const char *base, *parent;
+	size_t parentLen, len;
+	int var = -1;
+
+	base = strrchr(file, '/');
+	base = base ? base + 1 : file;
+	// directory the file is in, if any
+	for (parent = base - 1; parent > file && parent[-1] != '/'; parent--)
+		;
+	parentLen = base - 1 - parent;
+	for (int i = 0; base != file && i < CATALOG_VAR_COUNT; i++) {
+		if (parentLen == strlen(variables[i]) && !strncmp(parent, variables[i], parentLen))
+			return i;
+	}
+	for (int i = 0; i < CATALOG_VAR_COUNT; i++) {
+		len = strlen(variables[i]);
+		if (!strncmp(base, variables[i], len) && !isalnum((unsigned char)base[len])
+		    && (var < 0 || len > strlen(variables[var])))
+			var = i;
+	}
+
+	return var;
+}
+
+/**
+ *makes the id a signer is matched by, <issuer>:<serial> where issuer is the start of the
+ *SHA256 of the issuer name DER in hex and serial is the serial number in hex
+ *@param issuer, DER of the issuer name, as in a SignerInfo or an x509 certificate
+ *@param serial, serial number
+ *@return id, NOTE: REMEMBER TO UNALLOC THIS MEMORY, or NULL on failure
+ */
+static char *signerId(const mbedtls_x509_buf *issuer, const mbedtls_x509_buf *serial)
+{
+	unsigned char hash[CATALOG_HASH_SIZE];
+	char *id, *p;
+
+	if (cryptoHash(MBEDTLS_MD_SHA256, issuer->p, issuer->len, hash))
+		return NULL;
+	id = malloc(CATALOG_ISSUER_ID * 2 + 1 + serial->len * 2 + 1);
+	if (!id) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return NULL;
+	}
+	p = id;
+	for (int i = 0; i < CATALOG_ISSUER_ID; i++)
+		p += sprintf(p, "%02x", hash[i]);
+	*p++ = ':';
+	for (size_t i = 0; i < serial->len; i++)
+		p += sprintf(p, "%02x", serial->p[i]);
+	*p = '\0';
+
+	return id;
+}
+
+/**
+ *appends formatted text to the index
+ *@return SUCCESS or ALLOC_FAIL
+ */
+static int bufferPrintf(struct catalogBuffer *buf, const char *fmt, ...)
+{
+	va_list args;
+	char *tmp;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+	if (len < 0)
+		return ALLOC_FAIL;
+	if (buf->len + len + 1 > buf->capacity) {
+		tmp = realloc(buf->data, (buf->len + len + 1) * 2);
+		if (!tmp) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			return ALLOC_FAIL;
+		}
+		buf->data = tmp;
+		buf->capacity = (buf->len + len + 1) * 2;
+	}
+	va_start(args, fmt);
+	vsnprintf(buf->data + buf->len, len + 1, fmt, args);
+	va_end(args);
+	buf->len += len;
+
+	return SUCCESS;
+}
+
+/*
+ *sorts entries by variable, newest first, ties go by path so the pick is stable
+ */
+static int compareEntries(const void *a, const void *b)
+{
+	const struct catalogEntry *x = a, *y = b;
+	int rc;
+
+	if (x->var != y->var)
+		return x->var - y->var;
+	rc = compareTime(&y->time, &x->time);
+
+	return rc ? rc : strcmp(x->file, y->file);
+}
+
+/**
+ *prints the newest update of every variable that passes the filters of args
+ *@param args, parsed arguments, inFile is the index
+ *@return SUCCESS if an update was picked for at least one variable, error number otherwise
+ */
+static int queryCatalog(const struct catalogArguments *args)
+{
+	int rc, picked = 0, haveTS = 0;
+	size_t count = 0, i, tsSize = 0;
+	struct catalogEntry *entries = NULL;
+	mbedtls_x509_crt signerCert;
+	char *id = NULL, *certData = NULL, *ts = NULL;
+	const char *updateVars[2];
+	struct efi_time current[CATALOG_VAR_COUNT];
+
+	mbedtls_x509_crt_init(&signerCert);
+	rc = loadCatalog(args->inFile, &entries, &count);
+	if (rc)
+		goto out;
+
+	if (args->signerCert) {
+		certData = getDataFromFile(args->signerCert, &tsSize);
+		if (!certData) {
+			rc = INVALID_FILE;
+			goto out;
+		}
+		rc = parseX509(&signerCert, (unsigned char *)certData, tsSize);
+		if (rc)
+			goto out;
+		id = signerId(&signerCert.issuer_raw, &signerCert.serial);
+		if (!id) {
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		prlog(PR_INFO, "Picking updates signed by %s\n", id);
+	}
+
+	// an update is only applicable if it is newer than the variable's current timestamp
+	if (args->pathToSecVars && !getSecVarData(args->pathToSecVars, "TS", &ts, &tsSize)) {
+		if (tsSize == sizeof(current)) {
+			memcpy(current, ts, sizeof(current));
+			haveTS = 1;
+		}
+		else
+			prlog(PR_WARNING, "WARNING: TS in %s has %zd bytes, expected %zd, timestamps are not compared\n",
+			      args->pathToSecVars, tsSize, sizeof(current));
+	}
+	if (args->pathToSecVars && !secvarctl_backend->verify)
+		prlog(PR_WARNING, "WARNING: %s backend can not verify updates, picked updates are not verified\n", secvarctl_backend->name);
+
+	qsort(entries, count, sizeof(*entries), compareEntries);
+	for (int var = 0; var < CATALOG_VAR_COUNT; var++) {
+		if (args->varMask && !(args->varMask & 1 << var))
+			continue;
+		for (i = 0; i < count; i++) {
+			if (entries[i].var != var || (id && !hasSigner(entries[i].signers, id)))
+				continue;
+			if (haveTS && compareTime(&entries[i].time, &current[var]) <= 0) {
+				prlog(PR_INFO, "%s is not newer than the current %s\n", entries[i].file, variables[var]);
+				continue;
+			}
+			if (args->pathToSecVars && secvarctl_backend->verify) {
+				updateVars[0] = variables[var];
+				updateVars[1] = entries[i].file;
+				if (secvarctl_backend->verify(NULL, 0, updateVars, 2, args->pathToSecVars, 0, NULL, NULL)) {
+					prlog(PR_WARNING, "WARNING: %s does not verify, trying an older update\n", entries[i].file);
+					continue;
+				}
+			}
+			break;
+		}
+		if (i == count) {
+			printf("%s: no applicable update\n", variables[var]);
+			continue;
+		}
+		printf("%s: %04d-%02d-%02dT%02d:%02d:%02d %s (%zd entries, %zd bytes)\n", variables[var],
+		       entries[i].time.year, entries[i].time.month, entries[i].time.day, entries[i].time.hour,
+		       entries[i].time.minute, entries[i].time.second, entries[i].file, entries[i].entries, entries[i].size);
+		picked++;
+	}
+	if (!picked) {
+		prlog(PR_ERR, "ERROR: No applicable update found in %s\n", args->inFile);
+		rc = INVALID_FILE;
+	}
+
+out:
+	freeCatalog(entries, count);
+	mbedtls_x509_crt_free(&signerCert);
+	if (certData)
+		free(certData);
+	if (ts)
+		free(ts);
+	if (id)
+		free(id);
+
+	return rc;
+}
+
+/**
+ *reads an index written by buildCatalog
+ *@param file, index file
+ *@param entries, filled with one entry per indexed auth file, NOTE: REMEMBER TO freeCatalog
+ *@param count, filled with the length of entries
+ *@return SUCCESS or error number
+ */
+static int loadCatalog(const char *file, struct catalogEntry **entries, size_t *count)
+{
+	char *data = NULL, *tmp, *line, *next, *fields[7];
+	size_t size = 0, lines = 0, lineNum = 1;
+	struct catalogEntry *entry;
+	int rc = SUCCESS, var, year, month, day, hour, minute, second, f;
+
+	*entries = NULL;
+	*count = 0;
+	data = getDataFromFile(file, &size);
+	if (!data)
+		return INVALID_FILE;
+	if (size < strlen(CATALOG_MAGIC) + 1 || memcmp(data, CATALOG_MAGIC "\n", strlen(CATALOG_MAGIC) + 1)) {
+		prlog(PR_ERR, "ERROR: %s is not a catalog index\n", file);
+		free(data);
+		return INVALID_FILE;
+	}
+	// terminate the text so lines can be split with the str functions
+	tmp = realloc(data, size + 1);
+	if (!tmp) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		free(data);
+		return ALLOC_FAIL;
+	}
+	data = tmp;
+	data[size] = '\0';
+	for (size_t i = 0; i < size; i++) {
+		if (data[i] == '\n')
+			lines++;
+	}
+	*entries = calloc(lines ? lines : 1, sizeof(**entries));
+	if (!*entries) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		free(data);
+		return ALLOC_FAIL;
+	}
+
+	for (line = data + strlen(CATALOG_MAGIC) + 1; *line; line = next) {
+		lineNum++;
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+		for (f = 0, fields[0] = line; f < 6 && (fields[f + 1] = strchr(fields[f], '\t')); f++)
+			*fields[f + 1]++ = '\0';
+		for (var = 0; var < CATALOG_VAR_COUNT && strcmp(fields[0], variables[var]); var++)
+			;
+		if (f != 6 || var == CATALOG_VAR_COUNT
+		    || sscanf(fields[1], "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second) != 6) {
+			prlog(PR_ERR, "ERROR: Line %zd of %s is not a catalog entry\n", lineNum, file);
+			rc = INVALID_FILE;
+			goto out;
+		}
+		entry = &(*entries)[(*count)++];
+		entry->var = var;
+		entry->time.year = year;
+		entry->time.month = month;
+		entry->time.day = day;
+		entry->time.hour = hour;
+		entry->time.minute = minute;
+		entry->time.second = second;
+		entry->size = strtoul(fields[3], NULL, 10);
+		entry->entries = strtoul(fields[4], NULL, 10);
+		entry->signers = strdup(fields[5]);
+		entry->file = strdup(fields[6]);
+		if (!entry->signers || !entry->file) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+	}
+	prlog(PR_NOTICE, "Loaded %zd entries from %s\n", *count, file);
+
+out:
+	free(data);
+	if (rc) {
+		freeCatalog(*entries, *count);
+		*entries = NULL;
+		*count = 0;
+	}
+
+	return rc;
+}
+
+static void freeCatalog(struct catalogEntry *entries, size_t count)
+{
+	if (!entries)
+		return;
+	for (size_t i = 0; i < count; i++) {
+		if (entries[i].signers)
+			free(entries[i].signers);
+		if (entries[i].file)
+			free(entries[i].file);
+	}
+	free(entries);
+}
+
+/**
+ *@return <0 if a is older than b, 0 if they are the same second, >0 if a is newer
+ */
+static int compareTime(const struct efi_time *a, const struct efi_time *b)
+{
+	if (a->year != b->year)
+		return a->year - b->year;
+	if (a->month != b->month)
+		return a->month - b->month;
+	if (a->day != b->day)
+		return a->day - b->day;
+	if (a->hour != b->hour)
+		return a->hour - b->hour;
+	if (a->minute != b->minute)
+		return a->minute - b->minute;
+
+	return a->second - b->second;
+}
+
+/**
+ *@param signers, comma separated signer ids of an entry
+ *@param id, signer id to look for
+ *@return 1 if id is one of signers, 0 if not
+ */
+static int hasSigner(const char *signers, const char *id)
+{
+	size_t len = strlen(id);
+
+	for (const char *p = signers; (p = strstr(p, id)); p += len) {
+		if ((p == signers || p[-1] == ',') && (p[len] == ',' || p[len] == '\0'))
+			return 1;
+	}
+
+	return 0;
+}
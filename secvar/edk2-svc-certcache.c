@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h> // for offsetof
+#include <pthread.h>
+#include <mbedtls/md.h> // for cache keys
+#include "secvar/include/edk2-svc.h"// import last!!
+
+/*
+ *The certificate cache hands out parsed certificates keyed by the SHA256 of
+ *the bytes they were parsed from, so a certificate that is printed, validated
+ *and then used to verify a signature is only decoded once per process.
+ *Certificates are reference counted, certCacheRelease drops a reference and
+ *certCacheFlush frees every certificate that is not referenced anymore.
+ *Failed parses are not cached, their errors are printed every time.
+ */
+#define CERT_CACHE_HASH_SIZE 32
+#define CERT_CACHE_BUCKETS 256
+
+struct certCacheEntry {
+	mbedtls_x509_crt x509; // first, certCacheRelease finds the entry from it
+	unsigned char hash[CERT_CACHE_HASH_SIZE];
+	int refs;
+	struct certCacheEntry *next;
+};
+
+static struct {
+	struct certCacheEntry *buckets[CERT_CACHE_BUCKETS];
+	size_t count, parsed, reused;
+	pthread_mutex_t lock;
+} certCache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static struct certCacheEntry *findEntry(const unsigned char *hash);
+
+/**
+ *parses a certificate (DER or PEM) or takes it from the cache, NOTE: REMEMBER TO certCacheRelease
+ *the certificate is shared, it may be read by several threads but must not be changed or freed
+ *@param cert, certificate data
+ *@param size, length of cert
+ *@return parsed certificate or NULL if cert does not parse
+ */
+mbedtls_x509_crt *certCacheGet(const unsigned char *cert, size_t size)
+{
+	unsigned char hash[CERT_CACHE_HASH_SIZE];
+	struct certCacheEntry *entry, *other;
+	size_t bucket;
+
+	if (cryptoHash(MBEDTLS_MD_SHA256, cert, size, hash))
+		return NULL;
+	pthread_mutex_lock(&certCache.lock);
+	entry = findEntry(hash);
+	if (entry) {
+		entry->refs++;
+		certCache.reused++;
+	}
+	pthread_mutex_unlock(&certCache.lock);
+	if (entry)
+		return &entry->x509;
+
+	// parsing is the slow part, do it without holding the cache
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return NULL;
+	}
+	if (parseX509(&entry->x509, cert, size)) {
+		mbedtls_x509_crt_free(&entry->x509);
+		free(entry);
+		return NULL;
+	}
+	memcpy(entry->hash, hash, CERT_CACHE_HASH_SIZE);
+	entry->refs = 1;
+
+	pthread_mutex_lock(&certCache.lock);
+	// another thread may have parsed the same certificate in the meantime
+	other = findEntry(hash);
+	if (other) {
+		other->refs++;
+		certCache.reused++;
+	}
+	else {
+		bucket = (hash[0] | hash[1] << 8) % CERT_CACHE_BUCKETS;
+		entry->next = certCache.buckets[bucket];
+		certCache.buckets[bucket] = entry;
+		certCache.count++;
+		certCache.parsed++;
+	}
+	pthread_mutex_unlock(&certCache.lock);
+	if (other) {
+		mbedtls_x509_crt_free(&entry->x509);
+		free(entry);
+		return &other->x509;
+	}
+
+	return &entry->x509;
+}
+
+/**
+ *looks up a certificate that is already cached without parsing or referencing it
+ *@param cert, certificate data
+ *@param size, length of cert
+ *@return parsed certificate, valid until the next certCacheFlush, or NULL if it is not cached
+ */
+mbedtls_x509_crt *certCacheFind(const unsigned char *cert, size_t size)
+{
+	unsigned char hash[CERT_CACHE_HASH_SIZE];
+	struct certCacheEntry *entry;
+
+	if (cryptoHash(MBEDTLS_MD_SHA256, cert, size, hash))
+		return NULL;
+	pthread_mutex_lock(&certCache.lock);
+	entry = findEntry(hash);
+	if (entry)
+		certCache.reused++;
+	pthread_mutex_unlock(&certCache.lock);
+
+	return entry ? &entry->x509 : NULL;
+}
+
+/**
+ *drops a reference taken by certCacheGet, the certificate stays cached until certCacheFlush
+ *@param x509, certificate from certCacheGet, may be NULL
+ */
+void certCacheRelease(mbedtls_x509_crt *x509)
+{
+	struct certCacheEntry *entry;
+
+	if (!x509)
+		return;
+	entry = (struct certCacheEntry *)((char *)x509 - offsetof(struct certCacheEntry, x509));
+	pthread_mutex_lock(&certCache.lock);
+	if (entry->refs > 0)
+		entry->refs--;
+	pthread_mutex_unlock(&certCache.lock);
+}
+
+/**
+ *frees every cached certificate without references, must be called before exiting
+ */
+void certCacheFlush(void)
+{
+	struct certCacheEntry **link, *entry;
+
+	pthread_mutex_lock(&certCache.lock);
+	if (certCache.parsed || certCache.reused)
+		prlog(PR_INFO, "Certificate cache: parsed %zd certificates, reused them %zd times\n",
+		      certCache.parsed, certCache.reused);
+	for (int i = 0; i < CERT_CACHE_BUCKETS; i++) {
+		for (link = &certCache.buckets[i]; *link;) {
+			entry = *link;
+			if (entry->refs) {
+				link = &entry->next;
+				continue;
+			}
+			*link = entry->next;
+			mbedtls_x509_crt_free(&entry->x509);
+			free(entry);
+			certCache.count--;
+		}
+	}
+	certCache.parsed = certCache.reused = 0;
+	pthread_mutex_unlock(&certCache.lock);
+}
+
+/*
+ *must be called with the cache locked
+ *@param hash, SHA256 of the certificate data
+ *@return entry with that hash or NULL
+ */
+static struct certCacheEntry *findEntry(const unsigned char *hash)
+{
+	struct certCacheEntry *entry;
+
+	entry = certCache.buckets[(hash[0] | hash[1] << 8) % CERT_CACHE_BUCKETS];
+	for (; entry; entry = entry->next) {
+		if (!memcmp(entry->hash, hash, CERT_CACHE_HASH_SIZE))
+			return entry;
+	}
+
+	return NULL;
+}
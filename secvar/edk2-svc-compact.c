@@ -0,0 +1,486 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "backends/include/backends.h"
+#include "secvar/include/edk2-svc.h"// import last!!
+
+// signature owner GUID at the start of every EFI_SIGNATURE_DATA
+#define SIG_OWNER_SIZE sizeof(uuid_t)
+
+struct compactArguments {
+	int helpFlag, signKeyCount, signCertCount;
+	const char *pathToSecVars, *eslFile, *outFile, *varName;
+	const char **signKeys, **signCerts;
+};
+
+/*
+ *one signature of the input, group is the output list it belongs to
+ */
+struct compactEntry {
+	const unsigned char *sig;
+	size_t group, seq;
+	int duplicate;
+};
+
+/*
+ *a list of the output, every entry with the same type and size is merged into it
+ */
+struct compactGroup {
+	EFI_SIGNATURE_LIST header;
+	// the first list of the group in the input
+	const unsigned char *listData;
+	size_t kept;
+};
+
+struct compactResult {
+	struct compactEntry *entries;
+	struct compactGroup *groups;
+	size_t entryCount, groupCount, listCount, duplicates;
+};
+
+static void usage();
+static void help();
+static int parseArgs(int argc, char *argv[], struct compactArguments *args);
+static int collectEntries(struct compactResult *res, const unsigned char *esl, size_t size);
+static void markDuplicates(struct compactResult *res);
+static int buildCompactESL(const struct compactResult *res, unsigned char **out, size_t *outSize);
+static void freeResult(struct compactResult *res);
+
+/*
+ *called from main()
+ *removes duplicate signatures of an ESL or variable and packs hashes of the same
+ *type and size into one signature list
+ *@param argc, number of argument
+ *@param arv, array of params
+ *@return SUCCESS or err number
+ */
+int performCompactCommand(int argc, char* argv[])
+{
+	int rc;
+	char *in = NULL;
+	unsigned char *esl = NULL, *out = NULL;
+	size_t inSize = 0, eslSize = 0, outSize = 0;
+	struct compactResult res;
+	struct compactArguments args = {
+		.helpFlag = 0, .signKeyCount = 0, .signCertCount = 0,
+		.pathToSecVars = NULL, .eslFile = NULL, .outFile = NULL, .varName = NULL,
+		.signKeys = NULL, .signCerts = NULL
+	};
+
+	memset(&res, 0, sizeof(res));
+
+	rc = parseArgs(argc, argv, &args);
+	if (rc || args.helpFlag)
+		goto out;
+
+	if (args.varName && isVariable(args.varName)) {
+		prlog(PR_ERR, "ERROR: %s is not a valid variable name\n", args.varName);
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (!args.eslFile && !args.varName) {
+		prlog(PR_ERR, "ERROR: Nothing to compact, give '-e <eslFile>' or '-n <varName>'\n");
+		usage();
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (args.signCertCount != args.signKeyCount) {
+		prlog(PR_ERR, "ERROR: Number of certificates does not equal number of keys, %d != %d\n", args.signCertCount, args.signKeyCount);
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (args.signKeyCount && !args.varName) {
+		prlog(PR_ERR, "ERROR: Signing a replacement auth file needs the variable name, use '-n <varName>'\n");
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+#ifdef NO_CRYPTO
+	if (args.signKeyCount) {
+		prlog(PR_ERR, "ERROR: Signing is not supported in this build, remove '-k' and '-c'\n");
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+#endif
+
+	if (args.eslFile) {
+		in = getDataFromFile(args.eslFile, &inSize);
+		if (!in) {
+			prlog(PR_ERR, "ERROR: Could not read ESL's from %s\n", args.eslFile);
+			rc = INVALID_FILE;
+			goto out;
+		}
+	}
+	else {
+		rc = getSecVarData(args.pathToSecVars, args.varName, &in, &inSize);
+		if (rc)
+			goto out;
+	}
+
+	rc = collectEntries(&res, (unsigned char *)in, inSize);
+	if (rc)
+		goto out;
+	markDuplicates(&res);
+	rc = buildCompactESL(&res, &esl, &eslSize);
+	if (rc)
+		goto out;
+
+	printf("Signatures: %zd -> %zd (%zd duplicates removed)\n", res.entryCount, res.entryCount - res.duplicates, res.duplicates);
+	printf("Signature lists: %zd -> %zd\n", res.listCount, res.groupCount);
+	printf("Size: %zd -> %zd bytes, %zd bytes (%.1f%%) saved\n", inSize, eslSize, inSize - eslSize,
+	       inSize ? 100.0 * (inSize - eslSize) / inSize : 0.0);
+	if (!args.outFile)
+		goto out;
+
+	if (args.signKeyCount) {
+#ifndef NO_CRYPTO
+		rc = generateAuthFromESL(esl, eslSize, args.varName, args.signKeys, args.signCerts, args.signKeyCount, 0, &out, &outSize);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Failed to sign the compacted %s\n", args.varName);
+			goto out;
+		}
+		prlog(PR_NOTICE, "Replacement auth file for %s is %zd bytes\n", args.varName, outSize);
+#endif
+	}
+	rc = createFile(args.outFile, (char *)(out ? out : esl), out ? outSize : eslSize);
+	if (rc)
+		prlog(PR_ERR, "ERROR: Could not write compacted data to %s\n", args.outFile);
+
+out:
+	freeResult(&res);
+	if (in)
+		free(in);
+	if (esl)
+		free(esl);
+	if (out)
+		free(out);
+	if (args.signKeys)
+		free(args.signKeys);
+	if (args.signCerts)
+		free(args.signCerts);
+	if (!args.helpFlag)
+		printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
+
+	return rc;
+}
+
+static void usage()
+{
+	printf("USAGE:\n\t $ secvarctl compact [OPTIONS] {-e <eslFile> | -n <varName>}"
+		"\n\tOPTIONS:"
+		"\n\t\t--help/--usage"
+		"\n\t\t-v\t\tverbose, print process info"
+		"\n\t\t-e <eslFile>\tcompact the ESL's in <eslFile>"
+		"\n\t\t-n <varName>\tcompact the current <varName>, also the variable a signed file is for"
+		"\n\t\t-p <path>\tlooks for <varName> in path, default is ");
+	printf("%s", secvarctl_backend ? secvarctl_backend->default_secvar_path : "the backend's var path");
+	printf("\n\t\t-o <outFile>\twrite the compacted ESL, or auth file if signing, to <outFile>"
+		"\n\t\t-k <keyFile>\tprivate RSA key (PEM) to sign a replacement auth file with,"
+		"\n\t\t\t\tmust have a corresponding '-c <crtFile>'"
+		"\n\t\t-c <crtFile>\tx509 certificate (PEM) of the signer\n");
+}
+
+static void help()
+{
+	printf("HELP:\n\t"
+		"The purpose of this command is to shrink a variable that grew over many updates.\n\t"
+		"Signatures with the same type and data are kept once, the first owner GUID wins.\n\t"
+		"Every hash of the same type and size is then packed into a single signature\n\t"
+		"list so only one list header is stored for them. Certificate lists and lists with\n\t"
+		"a signature header are never merged, firmware only reads the first certificate of\n\t"
+		"a list. The order of the remaining signatures does not change.\n\t"
+		"Without '-o' only the size report is printed. With signers the compacted ESL is\n\t"
+		"written as a full replacement auth file for <varName>, signed with the current time\n");
+	usage();
+}
+
+/**
+ *@param argv , array of command line arguments
+ *@param argc, length of argv
+ *@param args, struct that will be filled with data from argv
+ *@return success or errno
+ */
+static int parseArgs(int argc, char *argv[], struct compactArguments *args)
+{
+	int rc = SUCCESS;
+
+	args->signKeys = calloc(argc ? argc : 1, sizeof(*args->signKeys));
+	args->signCerts = calloc(argc ? argc : 1, sizeof(*args->signCerts));
+	if (!args->signKeys || !args->signCerts) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (int i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "--usage")) {
+			usage();
+			args->helpFlag = 1;
+			goto out;
+		}
+		else if (!strcmp(argv[i], "--help")) {
+			help();
+			args->helpFlag = 1;
+			goto out;
+		}
+		if (argv[i][0] != '-' || strlen(argv[i]) != 2) {
+			prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		switch (argv[i][1]) {
+			case 'v':
+				verbose = PR_DEBUG;
+				break;
+			case 'p':
+			case 'e':
+			case 'n':
+			case 'o':
+			case 'k':
+			case 'c':
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '%s', see usage...\n", argv[i]);
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				if (argv[i - 1][1] == 'p')
+					args->pathToSecVars = argv[i];
+				else if (argv[i - 1][1] == 'e')
+					args->eslFile = argv[i];
+				else if (argv[i - 1][1] == 'n')
+					args->varName = argv[i];
+				else if (argv[i - 1][1] == 'o')
+					args->outFile = argv[i];
+				else if (argv[i - 1][1] == 'k')
+					args->signKeys[args->signKeyCount++] = argv[i];
+				else
+					args->signCerts[args->signCertCount++] = argv[i];
+				break;
+			default:
+				prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+				rc = ARG_PARSE_FAIL;
+				goto out;
+		}
+	}
+
+out:
+	if (rc) {
+		prlog(PR_ERR, "Failed during argument parsing\n");
+		usage();
+	}
+
+	return rc;
+}
+
+/*
+ *finds the output list for a signature list, hash lists of the same type and signature
+ *size share one unless they carry a signature header. Certificate lists are never
+ *shared, firmware and verify only read the first certificate of a list
+ *@return index of the group or groupCount if a new group is needed
+ */
+static size_t findGroup(const struct compactResult *res, const EFI_SIGNATURE_LIST *list)
+{
+	size_t i;
+
+	if (list->SignatureHeaderSize || uuid_equals(&list->SignatureType, &EFI_CERT_X509_GUID))
+		return res->groupCount;
+	for (i = 0; i < res->groupCount; i++) {
+		if (!res->groups[i].header.SignatureHeaderSize
+			&& res->groups[i].header.SignatureSize == list->SignatureSize
+			&& !memcmp(&res->groups[i].header.SignatureType, &list->SignatureType, sizeof(uuid_t)))
+			break;
+	}
+
+	return i;
+}
+
+struct collectState {
+	struct compactResult *res;
+	size_t group, entryCap, groupCap;
+};
+
+static int collectSignature(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data)
+{
+	struct collectState *state = data;
+	struct compactResult *res = state->res;
+	void *tmp;
+
+	if (!sig) {
+		res->listCount++;
+		state->group = findGroup(res, list);
+		if (state->group < res->groupCount)
+			return SUCCESS;
+		if (res->groupCount == state->groupCap) {
+			state->groupCap = state->groupCap * 2 + 8;
+			tmp = realloc(res->groups, state->groupCap * sizeof(*res->groups));
+			if (!tmp)
+				goto alloc_fail;
+			res->groups = tmp;
+		}
+		res->groups[state->group].header = *list;
+		res->groups[state->group].listData = listData;
+		res->groups[state->group].kept = 0;
+		res->groupCount++;
+		return SUCCESS;
+	}
+	if (res->entryCount == state->entryCap) {
+		state->entryCap = state->entryCap * 2 + 64;
+		tmp = realloc(res->entries, state->entryCap * sizeof(*res->entries));
+		if (!tmp)
+			goto alloc_fail;
+		res->entries = tmp;
+	}
+	res->entries[res->entryCount].sig = sig;
+	res->entries[res->entryCount].group = state->group;
+	res->entries[res->entryCount].seq = res->entryCount;
+	res->entries[res->entryCount].duplicate = 0;
+	res->entryCount++;
+
+	return SUCCESS;
+alloc_fail:
+	prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+
+	return ALLOC_FAIL;
+}
+
+/**
+ *splits ESL's into their signatures and assigns each to an output list
+ *@param res, filled with entries and groups
+ *@param esl, buffer of ESL's
+ *@param size, length of esl
+ *@return SUCCESS or ESL_FAIL if the ESL's are malformed
+ */
+static int collectEntries(struct compactResult *res, const unsigned char *esl, size_t size)
+{
+	int rc;
+	struct collectState state = { .res = res, .group = 0, .entryCap = 0, .groupCap = 0 };
+
+	rc = walkESL(esl, size, collectSignature, &state);
+	if (rc)
+		return rc;
+	prlog(PR_INFO, "Found %zd signatures in %zd signature lists\n", res->entryCount, res->listCount);
+
+	return SUCCESS;
+}
+
+static const struct compactResult *sortResult;
+
+/*
+ *orders entries by type, size and data without the owner so duplicates are next
+ *to each other, ties keep input order so the first one is kept
+ */
+static int compareEntries(const void *a, const void *b)
+{
+	const struct compactEntry *x = *(const struct compactEntry * const *)a, *y = *(const struct compactEntry * const *)b;
+	const EFI_SIGNATURE_LIST *gx = &sortResult->groups[x->group].header, *gy = &sortResult->groups[y->group].header;
+	int cmp;
+
+	if (gx->SignatureSize != gy->SignatureSize)
+		return gx->SignatureSize < gy->SignatureSize ? -1 : 1;
+	cmp = memcmp(&gx->SignatureType, &gy->SignatureType, sizeof(uuid_t));
+	if (!cmp)
+		cmp = memcmp(x->sig + SIG_OWNER_SIZE, y->sig + SIG_OWNER_SIZE, gx->SignatureSize - SIG_OWNER_SIZE);
+	if (cmp)
+		return cmp;
+
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/**
+ *flags every signature whose type and data already appeared earlier in the input
+ *@param res, collected entries
+ */
+static void markDuplicates(struct compactResult *res)
+{
+	struct compactEntry **sorted;
+	size_t i;
+
+	for (i = 0; i < res->groupCount; i++)
+		res->groups[i].kept = 0;
+	if (!res->entryCount)
+		return;
+	sorted = malloc(res->entryCount * sizeof(*sorted));
+	if (!sorted) {
+		// compaction still works, only nothing is deduplicated
+		prlog(PR_WARNING, "WARNING: failed to allocate memory, duplicates are kept\n");
+		for (i = 0; i < res->entryCount; i++)
+			res->groups[res->entries[i].group].kept++;
+		return;
+	}
+	for (i = 0; i < res->entryCount; i++)
+		sorted[i] = &res->entries[i];
+	sortResult = res;
+	qsort(sorted, res->entryCount, sizeof(*sorted), compareEntries);
+	for (i = 1; i < res->entryCount; i++) {
+		const EFI_SIGNATURE_LIST *prev = &res->groups[sorted[i - 1]->group].header;
+		const EFI_SIGNATURE_LIST *cur = &res->groups[sorted[i]->group].header;
+
+		if (prev->SignatureSize == cur->SignatureSize
+			&& !memcmp(&prev->SignatureType, &cur->SignatureType, sizeof(uuid_t))
+			&& !memcmp(sorted[i - 1]->sig + SIG_OWNER_SIZE, sorted[i]->sig + SIG_OWNER_SIZE, cur->SignatureSize - SIG_OWNER_SIZE)) {
+			sorted[i]->duplicate = 1;
+			res->duplicates++;
+			if (memcmp(sorted[i - 1]->sig, sorted[i]->sig, SIG_OWNER_SIZE))
+				prlog(PR_INFO, "Signature %zd duplicates signature %zd with a different owner, first owner is kept\n", sorted[i]->seq, sorted[i - 1]->seq);
+		}
+	}
+	for (i = 0; i < res->entryCount; i++) {
+		if (!res->entries[i].duplicate)
+			res->groups[res->entries[i].group].kept++;
+	}
+	free(sorted);
+}
+
+/**
+ *writes one signature list per group with the remaining signatures in input order
+ *@param res, entries with duplicates marked
+ *@param out, the compacted ESL's, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outSize, length of out
+ *@return SUCCESS or ALLOC_FAIL
+ */
+static int buildCompactESL(const struct compactResult *res, unsigned char **out, size_t *outSize)
+{
+	EFI_SIGNATURE_LIST list;
+	size_t size = 0, offset = 0, g, i;
+
+	for (g = 0; g < res->groupCount; g++) {
+		if (res->groups[g].kept)
+			size += sizeof(list) + res->groups[g].header.SignatureHeaderSize
+				+ res->groups[g].kept * res->groups[g].header.SignatureSize;
+	}
+	// never hand out a zero length allocation
+	*out = malloc(size + 1);
+	if (!*out) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (g = 0; g < res->groupCount; g++) {
+		if (!res->groups[g].kept)
+			continue;
+		list = res->groups[g].header;
+		list.SignatureListSize = sizeof(list) + list.SignatureHeaderSize + res->groups[g].kept * list.SignatureSize;
+		memcpy(*out + offset, &list, sizeof(list));
+		offset += sizeof(list);
+		// a list with a signature header is never shared, so its header is the only one
+		memcpy(*out + offset, res->groups[g].listData + sizeof(list), list.SignatureHeaderSize);
+		offset += list.SignatureHeaderSize;
+		for (i = 0; i < res->entryCount; i++) {
+			if (res->entries[i].group != g || res->entries[i].duplicate)
+				continue;
+			memcpy(*out + offset, res->entries[i].sig, list.SignatureSize);
+			offset += list.SignatureSize;
+		}
+	}
+	*outSize = offset;
+
+	return SUCCESS;
+}
+
+static void freeResult(struct compactResult *res)
+{
+	if (res->entries)
+		free(res->entries);
+	if (res->groups)
+		free(res->groups);
+	memset(res, 0, sizeof(*res));
+}
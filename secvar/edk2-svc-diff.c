@@ -0,0 +1,419 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <mbedtls/md.h> // for certificate keys
+#include "backends/include/backends.h"
+#include "secvar/include/edk2-svc.h"// import last!!
+
+// longest digest kept as is, longer data (certificates) is keyed by its SHA256
+#define DIFF_MAX_KEY 64
+#define DIFF_HASHED_KEY 32
+#define DIFF_VAR_COUNT 4
+
+/*
+ *where one side of the diff comes from, a variable path or an ESL file
+ */
+struct diffSource {
+	const char *path, *eslFile;
+};
+
+struct diffArguments {
+	int helpFlag, sourceCount, varCount;
+	const char *vars[DIFF_VAR_COUNT];
+	struct diffSource sources[2];
+};
+
+/*
+ *one entry of either side, equal entries of both sides are stored once
+ */
+struct diffEntry {
+	uuid_t type;
+	unsigned char key[DIFF_MAX_KEY];
+	size_t keyLen;
+	// bit 0 set if in the old side, bit 1 if in the new side
+	int sides;
+};
+
+/*
+ *entries in the order they were first seen plus an open addressing index into them
+ */
+struct diffSet {
+	struct diffEntry *entries;
+	size_t count, capacity;
+	size_t *index;
+	size_t indexMask, hashed;
+	int side;
+};
+
+static void usage();
+static void help();
+static int parseArgs(int argc, char *argv[], struct diffArguments *args);
+static int getSourceData(const struct diffSource *src, const char *var, char **data, size_t *size);
+static int diffVariable(const struct diffArguments *args, const char *var, int *differs);
+static int addSignature(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data);
+static void printEntry(char mark, const struct diffEntry *e);
+static void freeSet(struct diffSet *set);
+
+/*
+ *called from main()
+ *compares the entries of two keystores or ESL files per variable
+ *@param argc, number of argument
+ *@param arv, array of params
+ *@return SUCCESS if both sides could be compared, err number otherwise
+ */
+int performDiffCommand(int argc, char* argv[])
+{
+	int rc, differs = 0, eslOnly;
+	struct diffArguments args;
+
+	memset(&args, 0, sizeof(args));
+	rc = parseArgs(argc, argv, &args);
+	if (rc || args.helpFlag)
+		goto out;
+
+	if (args.sourceCount != 2) {
+		prlog(PR_ERR, "ERROR: Two keystores are needed, give two of '-p <path>' or '-e <eslFile>'\n");
+		usage();
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	eslOnly = args.sources[0].eslFile && args.sources[1].eslFile;
+	// an ESL file holds a single variable, which one must be given to compare it to a path
+	if (!eslOnly && (args.sources[0].eslFile || args.sources[1].eslFile) && args.varCount != 1) {
+		prlog(PR_ERR, "ERROR: Comparing an ESL file to a path needs exactly one '-n <varName>'\n");
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (eslOnly && args.varCount > 1) {
+		prlog(PR_ERR, "ERROR: ESL files hold a single variable, give at most one '-n <varName>'\n");
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (!args.varCount) {
+		if (eslOnly)
+			args.vars[args.varCount++] = "ESL";
+		else {
+			for (int i = 0; i < DIFF_VAR_COUNT; i++)
+				args.vars[args.varCount++] = variables[i];
+		}
+	}
+
+	for (int i = 0; i < args.varCount; i++) {
+		rc = diffVariable(&args, args.vars[i], &differs);
+		if (rc)
+			goto out;
+	}
+	printf("%d of %d variables differ\n", differs, args.varCount);
+
+out:
+	if (!args.helpFlag)
+		printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
+
+	return rc;
+}
+
+static void usage()
+{
+	printf("USAGE:\n\t $ secvarctl diff [OPTIONS] {-p <path> | -e <eslFile>} {-p <path> | -e <eslFile>}"
+		"\n\tOPTIONS:"
+		"\n\t\t--help/--usage"
+		"\n\t\t-v\t\tverbose, also print the unchanged entries"
+		"\n\t\t-p <path>\tone side is the variables in <path>, see 'read -p'"
+		"\n\t\t-e <eslFile>\tone side is the ESL's in <eslFile>"
+		"\n\t\t-n <varName>\tonly compare <varName>, can be given several times,"
+		"\n\t\t\t\tdefault is {'PK','KEK','db','dbx'}\n");
+}
+
+static void help()
+{
+	printf("HELP:\n\t"
+		"The purpose of this command is to compare two keystores entry by entry, for\n\t"
+		"example two hosts or one host before and after an update. The first source is\n\t"
+		"the old side and the second the new side. Every signature is keyed by its type\n\t"
+		"and its digest, certificates by the SHA256 of the certificate, so the order,\n\t"
+		"the list layout and the owner GUID of the entries do not matter. A variable\n\t"
+		"that does not exist in a path is compared as one without entries.\n\t"
+		"Added entries are printed with '+', removed entries with '-'.\n");
+	usage();
+}
+
+/**
+ *@param argv , array of command line arguments
+ *@param argc, length of argv
+ *@param args, struct that will be filled with data from argv
+ *@return success or errno
+ */
+static int parseArgs(int argc, char *argv[], struct diffArguments *args)
+{
+	int rc = SUCCESS;
+
+	for (int i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "--usage")) {
+			usage();
+			args->helpFlag = 1;
+			goto out;
+		}
+		else if (!strcmp(argv[i], "--help")) {
+			help();
+			args->helpFlag = 1;
+			goto out;
+		}
+		if (argv[i][0] != '-' || strlen(argv[i]) != 2) {
+			prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		switch (argv[i][1]) {
+			case 'v':
+				verbose = PR_DEBUG;
+				break;
+			case 'p':
+			case 'e':
+			case 'n':
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '%s', see usage...\n", argv[i]);
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				if (argv[i - 1][1] == 'n') {
+					if (isVariable(argv[i]) || !strcmp(argv[i], "TS") || args->varCount == DIFF_VAR_COUNT) {
+						prlog(PR_ERR, "ERROR: %s is not a variable that can be compared\n", argv[i]);
+						rc = ARG_PARSE_FAIL;
+						goto out;
+					}
+					args->vars[args->varCount++] = argv[i];
+					break;
+				}
+				if (args->sourceCount == 2) {
+					prlog(PR_ERR, "ERROR: More than two keystores given: %s\n", argv[i]);
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				if (argv[i - 1][1] == 'p')
+					args->sources[args->sourceCount++].path = argv[i];
+				else
+					args->sources[args->sourceCount++].eslFile = argv[i];
+				break;
+			default:
+				prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+				rc = ARG_PARSE_FAIL;
+				goto out;
+		}
+	}
+
+out:
+	if (rc) {
+		prlog(PR_ERR, "Failed during argument parsing\n");
+		usage();
+	}
+
+	return rc;
+}
+
+/**
+ *@param src, path or ESL file
+ *@param var, variable to read from a path
+ *@param data, filled with allocated ESL data, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *set to NULL if the variable does not exist in the path
+ *@param size, filled with length of data, 0 for a variable that does not exist
+ *@return SUCCESS or error number
+ */
+static int getSourceData(const struct diffSource *src, const char *var, char **data, size_t *size)
+{
+	if (src->eslFile) {
+		*data = getDataFromFile(src->eslFile, size);
+		if (!*data) {
+			prlog(PR_ERR, "ERROR: Could not read ESL's from %s\n", src->eslFile);
+			return INVALID_FILE;
+		}
+		return SUCCESS;
+	}
+	// a variable that was never enrolled (no dbx yet) compares as an empty one
+	if (secvarctl_backend->hasSecVar && !secvarctl_backend->hasSecVar(src->path, var)) {
+		prlog(PR_INFO, "%s does not exist in %s, it has no entries\n", var, src->path);
+		*data = NULL;
+		*size = 0;
+		return SUCCESS;
+	}
+
+	return getSecVarData(src->path, var, data, size);
+}
+
+static size_t entryHash(const uuid_t *type, const unsigned char *key, size_t keyLen)
+{
+	uint64_t h, word = 0;
+
+	// digests are already uniformly distributed, the first bytes mixed with the type are enough
+	memcpy(&h, type, sizeof(h));
+	memcpy(&word, key, keyLen < sizeof(word) ? keyLen : sizeof(word));
+	h = (h ^ word ^ keyLen) * 0x9e3779b97f4a7c15ULL;
+
+	return (size_t)(h ^ (h >> 29));
+}
+
+static int growSet(struct diffSet *set)
+{
+	size_t capacity = set->capacity * 2 + 64, slots = 1, slot;
+	struct diffEntry *entries;
+	size_t *index;
+
+	// keep the index a power of two and at most half full
+	while (slots < capacity * 2)
+		slots <<= 1;
+	entries = realloc(set->entries, capacity * sizeof(*entries));
+	if (!entries)
+		return ALLOC_FAIL;
+	set->entries = entries;
+	// slots hold entry number + 1, 0 is empty
+	index = calloc(slots, sizeof(*index));
+	if (!index)
+		return ALLOC_FAIL;
+	for (size_t i = 0; i < set->count; i++) {
+		slot = entryHash(&entries[i].type, entries[i].key, entries[i].keyLen) & (slots - 1);
+		while (index[slot])
+			slot = (slot + 1) & (slots - 1);
+		index[slot] = i + 1;
+	}
+	if (set->index)
+		free(set->index);
+	set->index = index;
+	set->indexMask = slots - 1;
+	set->capacity = capacity;
+
+	return SUCCESS;
+}
+
+/**
+ *walk callback, adds one signature of the current side to the set
+ *@return SUCCESS or error number
+ */
+static int addSignature(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data)
+{
+	struct diffSet *set = data;
+	unsigned char key[DIFF_MAX_KEY];
+	size_t keyLen, slot, dataLen;
+	struct diffEntry *e;
+
+	if (!sig)
+		return SUCCESS;
+	sig += sizeof(uuid_t);
+	dataLen = list->SignatureSize - sizeof(uuid_t);
+	if (!memcmp(&list->SignatureType, &EFI_CERT_X509_GUID, sizeof(uuid_t)) || dataLen > DIFF_MAX_KEY) {
+		if (cryptoHash(MBEDTLS_MD_SHA256, sig, dataLen, key)) {
+			prlog(PR_ERR, "ERROR: Failed to hash signature\n");
+			return HASH_FAIL;
+		}
+		keyLen = DIFF_HASHED_KEY;
+		set->hashed++;
+	}
+	else {
+		memcpy(key, sig, dataLen);
+		keyLen = dataLen;
+	}
+
+	if (set->count == set->capacity && growSet(set)) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	slot = entryHash(&list->SignatureType, key, keyLen) & set->indexMask;
+	for (; set->index[slot]; slot = (slot + 1) & set->indexMask) {
+		e = &set->entries[set->index[slot] - 1];
+		if (e->keyLen == keyLen && !memcmp(e->key, key, keyLen) && !memcmp(&e->type, &list->SignatureType, sizeof(uuid_t))) {
+			e->sides |= set->side;
+			return SUCCESS;
+		}
+	}
+	e = &set->entries[set->count];
+	e->type = list->SignatureType;
+	memcpy(e->key, key, keyLen);
+	e->keyLen = keyLen;
+	e->sides = set->side;
+	set->index[slot] = ++set->count;
+
+	return SUCCESS;
+}
+
+/**
+ *compares one variable of both sides and prints the changes
+ *@param args, parsed arguments
+ *@param var, variable name, used for both sides
+ *@param differs, incremented if the variable changed
+ *@return SUCCESS or error number
+ */
+static int diffVariable(const struct diffArguments *args, const char *var, int *differs)
+{
+	int rc = SUCCESS;
+	char *data = NULL;
+	size_t size, added = 0, removed = 0, unchanged = 0;
+	struct diffSet set;
+
+	memset(&set, 0, sizeof(set));
+	for (int s = 0; s < 2; s++) {
+		rc = getSourceData(&args->sources[s], var, &data, &size);
+		if (rc)
+			goto out;
+		set.side = 1 << s;
+		rc = walkESL((unsigned char *)data, size, addSignature, &set);
+		free(data);
+		data = NULL;
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not parse %s of %s\n", var,
+			      args->sources[s].eslFile ? args->sources[s].eslFile : args->sources[s].path);
+			goto out;
+		}
+	}
+
+	for (size_t i = 0; i < set.count; i++) {
+		if (set.entries[i].sides == 3)
+			unchanged++;
+		else if (set.entries[i].sides == 1)
+			removed++;
+		else
+			added++;
+	}
+	printf("%s: %zd added, %zd removed, %zd unchanged\n", var, added, removed, unchanged);
+	// removed entries come first in old order, then added ones in new order
+	for (size_t i = 0; i < set.count; i++) {
+		if (set.entries[i].sides == 1)
+			printEntry('-', &set.entries[i]);
+	}
+	for (size_t i = 0; i < set.count; i++) {
+		if (set.entries[i].sides == 2)
+			printEntry('+', &set.entries[i]);
+	}
+	if (verbose >= PR_DEBUG) {
+		for (size_t i = 0; i < set.count; i++) {
+			if (set.entries[i].sides == 3)
+				printEntry(' ', &set.entries[i]);
+		}
+	}
+	if (added || removed)
+		(*differs)++;
+	prlog(PR_INFO, "%zd entries of %s were keyed by their SHA256\n", set.hashed, var);
+
+out:
+	freeSet(&set);
+
+	return rc;
+}
+
+static void printEntry(char mark, const struct diffEntry *e)
+{
+	printf("\t%c %s ", mark, getSigType(e->type));
+	for (size_t i = 0; i < e->keyLen; i++)
+		printf("%02x", e->key[i]);
+	printf("\n");
+}
+
+static void freeSet(struct diffSet *set)
+{
+	if (set->entries)
+		free(set->entries);
+	if (set->index)
+		free(set->index);
+	memset(set, 0, sizeof(*set));
+}
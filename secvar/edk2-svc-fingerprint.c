@@ -0,0 +1,465 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <mbedtls/md.h>
+#include "backends/include/backends.h"
+#include "secvar/include/edk2-svc.h"// import last!!
+
+#define FP_HASH_SIZE 32
+#define FP_VAR_COUNT 4
+// longest hex digest a proof can be asked for, SHA512
+#define FP_MAX_DIGEST 64
+
+// domain separation, a leaf can never be mistaken for an inner node
+#define FP_LEAF_PREFIX 0x00
+#define FP_NODE_PREFIX 0x01
+
+typedef unsigned char fpHash[FP_HASH_SIZE];
+
+struct fingerprintArguments {
+	int helpFlag;
+	const char *pathToSecVars, *proofVar, *proofEntry;
+};
+
+/*
+ *canonical leaves of one variable, sorted and without duplicates
+ */
+struct fpLeaves {
+	fpHash *hashes;
+	size_t count, capacity;
+};
+
+/*
+ *one step from a node up to the root, the sibling is hashed on the left or right
+ */
+struct fpStep {
+	fpHash sibling;
+	char side;
+};
+
+static void usage();
+static void help();
+static int parseArgs(int argc, char *argv[], struct fingerprintArguments *args);
+static int hashNode(unsigned char prefix, const unsigned char *a, size_t aLen, const unsigned char *b, size_t bLen, unsigned char *out);
+static int addLeaf(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data);
+static int getLeaves(const char *path, const char *varName, struct fpLeaves *leaves);
+static int merkleRoot(fpHash *nodes, size_t count, size_t target, struct fpStep *steps, size_t *stepCount, unsigned char *root);
+static int findEntry(const struct fpLeaves *leaves, const char *entry, size_t *target);
+static void printHash(const unsigned char *hash);
+
+/*
+ *called from main()
+ *computes a Merkle root over the entries of PK, KEK, db and dbx and optionally an inclusion proof
+ *@param argc, number of argument
+ *@param arv, array of params
+ *@return SUCCESS or err number
+ */
+int performFingerprintCommand(int argc, char* argv[])
+{
+	int rc, proofIdx = -1;
+	size_t target = SIZE_MAX, stepCount = 0, varSteps = 0;
+	struct fpLeaves leaves[FP_VAR_COUNT];
+	struct fpStep *steps = NULL;
+	fpHash subroots[FP_VAR_COUNT], shownRoots[FP_VAR_COUNT], root;
+	struct fingerprintArguments args = {
+		.helpFlag = 0, .pathToSecVars = NULL, .proofVar = NULL, .proofEntry = NULL
+	};
+
+	memset(leaves, 0, sizeof(leaves));
+	rc = parseArgs(argc, argv, &args);
+	if (rc || args.helpFlag)
+		goto out;
+
+	for (int i = 0; i < FP_VAR_COUNT; i++) {
+		rc = getLeaves(args.pathToSecVars, variables[i], &leaves[i]);
+		if (rc)
+			goto out;
+		if (args.proofVar && !strcmp(args.proofVar, variables[i]))
+			proofIdx = i;
+	}
+
+	if (proofIdx >= 0) {
+		rc = findEntry(&leaves[proofIdx], args.proofEntry, &target);
+		if (rc)
+			goto out;
+		// a tree of n leaves is never deeper than n levels, plus two levels of variables
+		steps = calloc(leaves[proofIdx].count + FP_VAR_COUNT, sizeof(*steps));
+		if (!steps) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		printf("Proof for %s entry %s:\n\tleaf ", args.proofVar, args.proofEntry);
+		printHash(leaves[proofIdx].hashes[target]);
+		printf("\n");
+	}
+
+	for (int i = 0; i < FP_VAR_COUNT; i++) {
+		// merkleRoot reduces the leaves in place, they are not needed afterwards
+		rc = merkleRoot(leaves[i].hashes, leaves[i].count, i == proofIdx ? target : SIZE_MAX,
+				steps, &stepCount, subroots[i]);
+		if (rc)
+			goto out;
+		memcpy(shownRoots[i], subroots[i], FP_HASH_SIZE);
+	}
+	varSteps = stepCount;
+	rc = merkleRoot(subroots, FP_VAR_COUNT, proofIdx >= 0 ? (size_t)proofIdx : SIZE_MAX, steps, &stepCount, root);
+	if (rc)
+		goto out;
+
+	if (proofIdx >= 0) {
+		for (size_t i = 0; i < stepCount; i++) {
+			// the variable root sits between the entry steps and the keystore steps
+			if (i == varSteps) {
+				printf("\t%s ", args.proofVar);
+				printHash(shownRoots[proofIdx]);
+				printf("\n");
+			}
+			printf("\t%c ", steps[i].side);
+			printHash(steps[i].sibling);
+			printf("\n");
+		}
+		printf("\troot ");
+		printHash(root);
+		printf("\n");
+	}
+	printf("Keystore root: ");
+	printHash(root);
+	printf("\n");
+	for (int i = 0; i < FP_VAR_COUNT; i++) {
+		printf("\t%s: ", variables[i]);
+		printHash(shownRoots[i]);
+		printf(" (%zd entries)\n", leaves[i].count);
+	}
+
+out:
+	for (int i = 0; i < FP_VAR_COUNT; i++) {
+		if (leaves[i].hashes)
+			free(leaves[i].hashes);
+	}
+	if (steps)
+		free(steps);
+	if (!args.helpFlag)
+		printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
+
+	return rc;
+}
+
+static void usage()
+{
+	printf("USAGE:\n\t $ secvarctl fingerprint [OPTIONS]"
+		"\n\tOPTIONS:"
+		"\n\t\t--help/--usage"
+		"\n\t\t-v\t\tverbose, print process info"
+		"\n\t\t-p <path>\tvariables are in path, default is the backend's variable path"
+		"\n\t\t-x <varName> <entry>\tprint the inclusion proof of an entry of <varName>,"
+		"\n\t\t\t\t<entry> is a hex digest or an x509 certificate file\n");
+}
+
+static void help()
+{
+	printf("HELP:\n\t"
+		"The purpose of this command is to fingerprint a keystore so many hosts can be\n\t"
+		"compared by a single 32 byte root. Every signature is a leaf, the SHA256 of\n\t"
+		"0x00 | signature type GUID | signature data, the owner GUID and the list layout\n\t"
+		"are left out. The leaves of a variable are sorted, duplicates removed, and\n\t"
+		"hashed pairwise as SHA256 of 0x01 | left | right up to the variable root, an\n\t"
+		"odd node is carried up as is and an empty variable has the SHA256 of nothing as\n\t"
+		"its root. The keystore root is built the same way from the PK, KEK, db and dbx\n\t"
+		"roots in that order. When roots differ, only the variable roots that differ\n\t"
+		"need a closer look.\n\t"
+		"An inclusion proof prints the leaf and one line per level, 'L <hash>' if the\n\t"
+		"sibling is hashed on the left, 'R <hash>' if on the right, ending in the root.\n");
+	usage();
+}
+
+/**
+ *@param argv , array of command line arguments
+ *@param argc, length of argv
+ *@param args, struct that will be filled with data from argv
+ *@return success or errno
+ */
+static int parseArgs(int argc, char *argv[], struct fingerprintArguments *args)
+{
+	int rc = SUCCESS;
+
+	for (int i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "--usage")) {
+			usage();
+			args->helpFlag = 1;
+			goto out;
+		}
+		else if (!strcmp(argv[i], "--help")) {
+			help();
+			args->helpFlag = 1;
+			goto out;
+		}
+		else if (!strcmp(argv[i], "-v"))
+			verbose = PR_DEBUG;
+		else if (!strcmp(argv[i], "-p")) {
+			if (i + 1 >= argc || argv[i + 1][0] == '-') {
+				prlog(PR_ERR, "ERROR: Incorrect value for '-p', see usage...\n");
+				rc = ARG_PARSE_FAIL;
+				goto out;
+			}
+			args->pathToSecVars = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-x")) {
+			if (i + 2 >= argc || args->proofVar) {
+				prlog(PR_ERR, "ERROR: '-x' needs a variable and an entry and can be given once, see usage...\n");
+				rc = ARG_PARSE_FAIL;
+				goto out;
+			}
+			if (isVariable(argv[i + 1]) || !strcmp(argv[i + 1], "TS")) {
+				prlog(PR_ERR, "ERROR: %s is not a variable with entries\n", argv[i + 1]);
+				rc = ARG_PARSE_FAIL;
+				goto out;
+			}
+			args->proofVar = argv[++i];
+			args->proofEntry = argv[++i];
+		}
+		else {
+			prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+	}
+
+out:
+	if (rc) {
+		prlog(PR_ERR, "Failed during argument parsing\n");
+		usage();
+	}
+
+	return rc;
+}
+
+/**
+ *SHA256 of prefix | a | b
+ *@return SUCCESS or HASH_FAIL
+ */
+static int hashNode(unsigned char prefix, const unsigned char *a, size_t aLen, const unsigned char *b, size_t bLen, unsigned char *out)
+{
+	int rc;
+	struct cryptoHashCtx *ctx;
+
+	rc = cryptoHashInit(&ctx, MBEDTLS_MD_SHA256);
+	if (rc)
+		return rc;
+	rc = cryptoHashUpdate(ctx, &prefix, 1);
+	if (!rc)
+		rc = cryptoHashUpdate(ctx, a, aLen);
+	if (!rc)
+		rc = cryptoHashUpdate(ctx, b, bLen);
+	if (!rc)
+		rc = cryptoHashFinish(ctx, out);
+	cryptoHashFree(ctx);
+	if (rc)
+		prlog(PR_ERR, "ERROR: Failed to hash Merkle node\n");
+
+	return rc;
+}
+
+/**
+ *walk callback, hashes one signature into a canonical leaf
+ *@return SUCCESS or error number
+ */
+static int addLeaf(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data)
+{
+	struct fpLeaves *leaves = data;
+	fpHash *grown;
+
+	if (!sig)
+		return SUCCESS;
+	if (leaves->count == leaves->capacity) {
+		leaves->capacity = leaves->capacity * 2 + 16;
+		grown = realloc(leaves->hashes, leaves->capacity * sizeof(*grown));
+		if (!grown) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			return ALLOC_FAIL;
+		}
+		leaves->hashes = grown;
+	}
+
+	return hashNode(FP_LEAF_PREFIX, (const unsigned char *)&list->SignatureType, sizeof(uuid_t),
+			sig + sizeof(uuid_t), list->SignatureSize - sizeof(uuid_t), leaves->hashes[leaves->count++]);
+}
+
+static int compareHashes(const void *a, const void *b)
+{
+	return memcmp(a, b, FP_HASH_SIZE);
+}
+
+/**
+ *reads a variable and fills leaves with its sorted, unique leaf hashes
+ *@param path, path to variables
+ *@param varName, variable to read
+ *@param leaves, empty leaves to fill
+ *@return SUCCESS or error number
+ */
+static int getLeaves(const char *path, const char *varName, struct fpLeaves *leaves)
+{
+	int rc;
+	char *data = NULL;
+	size_t size, unique = 0;
+
+	rc = getSecVarData(path, varName, &data, &size);
+	if (rc)
+		return rc;
+	rc = walkESL((unsigned char *)data, size, addLeaf, leaves);
+	free(data);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Could not parse the ESL's of %s\n", varName);
+		return rc;
+	}
+	qsort(leaves->hashes, leaves->count, FP_HASH_SIZE, compareHashes);
+	for (size_t i = 0; i < leaves->count; i++) {
+		if (unique && !memcmp(leaves->hashes[unique - 1], leaves->hashes[i], FP_HASH_SIZE))
+			continue;
+		memmove(leaves->hashes[unique++], leaves->hashes[i], FP_HASH_SIZE);
+	}
+	prlog(PR_INFO, "%s has %zd unique entries of %zd\n", varName, unique, leaves->count);
+	leaves->count = unique;
+
+	return SUCCESS;
+}
+
+/**
+ *reduces nodes to their Merkle root, nodes is overwritten
+ *@param nodes, bottom level of the tree
+ *@param count, number of nodes, 0 gives the SHA256 of nothing
+ *@param target, index of the node to prove or SIZE_MAX for none
+ *@param steps, proof steps are appended here if target is given
+ *@param stepCount, number of steps in steps, updated
+ *@param root, filled with the root
+ *@return SUCCESS or HASH_FAIL
+ */
+static int merkleRoot(fpHash *nodes, size_t count, size_t target, struct fpStep *steps, size_t *stepCount, unsigned char *root)
+{
+	int rc;
+	size_t next;
+
+	if (!count) {
+		if (cryptoHash(MBEDTLS_MD_SHA256, NULL, 0, root)) {
+			prlog(PR_ERR, "ERROR: Failed to hash empty Merkle tree\n");
+			return HASH_FAIL;
+		}
+		return SUCCESS;
+	}
+
+	while (count > 1) {
+		if (target != SIZE_MAX && (target ^ 1) < count) {
+			memcpy(steps[*stepCount].sibling, nodes[target ^ 1], FP_HASH_SIZE);
+			steps[*stepCount].side = target & 1 ? 'L' : 'R';
+			(*stepCount)++;
+		}
+		for (next = 0; next * 2 + 1 < count; next++) {
+			rc = hashNode(FP_NODE_PREFIX, nodes[next * 2], FP_HASH_SIZE, nodes[next * 2 + 1], FP_HASH_SIZE, nodes[next]);
+			if (rc)
+				return rc;
+		}
+		// an odd node is carried up unchanged
+		if (count & 1)
+			memmove(nodes[next++], nodes[count - 1], FP_HASH_SIZE);
+		count = next;
+		if (target != SIZE_MAX)
+			target /= 2;
+	}
+	memcpy(root, nodes[0], FP_HASH_SIZE);
+
+	return SUCCESS;
+}
+
+/**
+ *decodes a hex digest, bytes may be separated by '/' or ':'
+ *@param hex, string to decode
+ *@param out, buffer of FP_MAX_DIGEST bytes
+ *@return number of bytes decoded or -1 if hex is not a digest
+ */
+static int decodeHex(const char *hex, unsigned char *out)
+{
+	int len = 0;
+	unsigned int byte;
+
+	while (*hex) {
+		if (*hex == '/' || *hex == ':') {
+			hex++;
+			continue;
+		}
+		if (!isxdigit((unsigned char)hex[0]) || !isxdigit((unsigned char)hex[1]) || len >= FP_MAX_DIGEST)
+			return -1;
+		if (sscanf(hex, "%2x", &byte) != 1)
+			return -1;
+		out[len++] = byte;
+		hex += 2;
+	}
+
+	return len;
+}
+
+/**
+ *finds the leaf of an entry, a hex digest is tried as every hash type of its length,
+ *anything else is read as an x509 certificate file
+ *@param leaves, sorted leaves of the variable
+ *@param entry, hex digest or certificate file
+ *@param target, filled with the index of the leaf
+ *@return SUCCESS or error number if entry is not in the variable
+ */
+static int findEntry(const struct fpLeaves *leaves, const char *entry, size_t *target)
+{
+	int rc = SUCCESS, len;
+	unsigned char digest[FP_MAX_DIGEST], *certBuf = NULL;
+	size_t certSize;
+	fpHash leaf, *found;
+	mbedtls_x509_crt cert;
+
+	mbedtls_x509_crt_init(&cert);
+	len = decodeHex(entry, digest);
+	for (int i = 0; len > 0 && i < ARRAY_SIZE(hash_functions); i++) {
+		if (hash_functions[i].size != len)
+			continue;
+		rc = hashNode(FP_LEAF_PREFIX, (const unsigned char *)hash_functions[i].guid, sizeof(uuid_t), digest, len, leaf);
+		if (rc)
+			goto out;
+		found = bsearch(leaf, leaves->hashes, leaves->count, FP_HASH_SIZE, compareHashes);
+		if (found) {
+			*target = found - leaves->hashes;
+			goto out;
+		}
+	}
+	if (len <= 0) {
+		certBuf = (unsigned char *)getDataFromFile(entry, &certSize);
+		if (!certBuf || parseX509(&cert, certBuf, certSize)) {
+			prlog(PR_ERR, "ERROR: %s is neither a hex digest nor an x509 certificate file\n", entry);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		rc = hashNode(FP_LEAF_PREFIX, (const unsigned char *)&EFI_CERT_X509_GUID, sizeof(uuid_t), cert.raw.p, cert.raw.len, leaf);
+		if (rc)
+			goto out;
+		found = bsearch(leaf, leaves->hashes, leaves->count, FP_HASH_SIZE, compareHashes);
+		if (found) {
+			*target = found - leaves->hashes;
+			goto out;
+		}
+	}
+	prlog(PR_ERR, "ERROR: %s is not an entry of the variable\n", entry);
+	rc = ESL_FAIL;
+
+out:
+	if (certBuf)
+		free(certBuf);
+	mbedtls_x509_crt_free(&cert);
+
+	return rc;
+}
+
+static void printHash(const unsigned char *hash)
+{
+	for (int i = 0; i < FP_HASH_SIZE; i++)
+		printf("%02x", hash[i]);
+}
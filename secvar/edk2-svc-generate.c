@@ -13,16 +13,21 @@
 #include "external/libstb-secvar/include/libstb-secvar.h"
 #include "backends/include/backends.h"
 
+// an update line has at most 6 fields before its signatures
+#define MANIFEST_MAX_FIELDS 64
 
 
 struct Arguments {
     //the alreadySignedFlag is to determine if signKeys stores a private key file(0) or signed data (1)
-	int helpFlag, inpValid, signKeyCount, signCertCount, alreadySignedFlag;
-	const char *inFile, *outFile, 
-	**signCerts, **signKeys,
+	int helpFlag, inpValid, signKeyCount, signCertCount, alreadySignedFlag, append, threads, inFileCount, updateVarCount;
+	const char *inFile, *outFile, *baseFile, *cacheFile,
+	**inFiles, **signCerts, **signKeys, **updateVars,
 	*inForm, *outForm, *varName, *hashAlg;
 	char **currentVars;
 	struct efi_time *time;
+	// signatures already in memory, used instead of the signKeys files if set
+	const unsigned char **signatures;
+	size_t *signatureSizes;
 }; 
 static int parseArgs(int argc, char *argv[], struct Arguments *args);
 
@@ -39,10 +44,19 @@ static int getOutputData (const unsigned char *buff, size_t size, struct Argumen
 static int authToESL(const unsigned char *in, size_t inSize, unsigned char **out, size_t *outSize);
 static int toHashForSecVarSigning(const unsigned char* ESL, size_t ESL_size, struct Arguments *args, unsigned char** outBuff, size_t* outBuffSize);
 static int getPreHashForSecVar(unsigned char **outData, size_t *outSize, const unsigned char *ESL, size_t ESL_size, struct Arguments *args);
+static int getAppendDelta(const unsigned char *esl, size_t size, const char *baseFile, unsigned char **outBuff, size_t *outBuffSize);
+static int parseTimestamp(const char *date, const char *clock, struct efi_time *ts);
+static int generateFromManifest(struct Arguments *args);
+static int generateManifestEntry(struct Arguments *args, char **fields, int count, char **digests, size_t *digestsSize);
+static int getManifestSignature(const char *field, unsigned char **sig, size_t *sigSize);
+static int mergeSigners(struct Arguments *args);
+static int bundleUpdates(struct Arguments *args);
 static void usage()
 {
 	printf("USAGE:\n\t"
 		"$ secvarctl generate <inputFormat>:<outputFormat> [OPTIONS] -i <inputFile> -o <outputFile>\n"
+		"\t'-i -' reads the input from stdin and '-o -' writes the output to stdout, everything\n"
+		"\telse is then printed to stderr so generate can be piped into validate and write\n"
 		"OPTIONS:\n\t-v\t\tverbose, give process progress\n"
 		"\t-n <varName>\tname of secure boot variable, used when generating an Auth file\n\t" 
 		"\t\talso when an ESL or Auth file contains hashed data use '-n dbx'\n\t"
@@ -50,7 +64,8 @@ static void usage()
 		"\t-h <hashAlg>\thash function, use when '[h]ash' is input/output format\n\t"
 		"\t\tcurrently accepted for <hashAlg>:\n\t"
 		"\t\t\t{'SHA256', 'SHA224', 'SHA1', 'SHA384', 'SHA512'}\n"
-		"\t-k <keyFile>\tprivate RSA key (PEM), used when signing data for PKCS7/Auth files\n"
+		"\t-k <keyFile>\tprivate RSA key (PEM), used when signing data for PKCS7/Auth files\n"		"\t\t\tor 'pkcs11:object=<label>?module-path=<module>&pin-value=<PIN>' for a key\n"
+		"\t\t\ton a PKCS#11 token, if built with PKCS11\n"
 		"\t\t\tmust have a corresponding '-c <crtFile>'\n\t"
 		"\t\tyou can also use multiple signers by declaring several '-k <> -c <>' pairs\n"
         "\t-s <sigFile>\traw signed data, alternative to using private keys when generating\n" 
@@ -64,21 +79,46 @@ static void usage()
 		"\t\tcreates a custom timestamp used when generating an auth or PKCS7 file,\n\t"
 		"\t\tif not given then current time is used\n"
 		"\t-f\t\tforce, does not do prevalidation on the input file, assumes format is correct\n"
+		"\t-a\t\tappend, sign the auth/PKCS7 as an EFI_VARIABLE_APPEND_WRITE so the\n"
+		"\t\t\tnew ESL is added to the variable instead of replacing it\n"
+		"\t--base <eslFile>\twith '-a', leave out every signature already in <eslFile>,\n"
+		"\t\t\tthe current contents of the variable, so only new entries are signed\n"
+		"\t-j <threads>\tnumber of threads that check the certificates of a bundle or ESL,\n"
+		"\t\t\tdefault is number of online CPUs\n"
+		"\t--cache <file>\tremember certificates that passed validation in <file> and\n"
+		"\t\t\tdo not parse them again in later runs, see 'verify --cache'\n"
 		"\treset\t\tgenerates a valid variable reset file\n"
 		"\t\t\treplaces <inputFormat>:<outputFormat>\n"
 		"\t\t\tthis file is just an auth file with an empty ESL.\n"
 		"\t\t\trequired arguments are output file, signer crt/key pair and variable name.\n"
 		"\t\t\tno input file required.\n"
 		"\t\t\tuse this flag to delete a variable\n"
+		"\tmerge\t\tcombines the signers of several Auth or PKCS7 files into one\n"
+		"\t\t\treplaces <inputFormat>:<outputFormat>, give every file with its own '-i'.\n"
+		"\t\t\tthe files must hold the same data and timestamp and every signer must\n"
+		"\t\t\thave signed the same digest, nothing is signed again\n"
+		"\tbundle\t\tpacks several Auth files into one update bundle for verify,\n"
+		"\t\t\twrite and validate '-b', replaces <inputFormat>:<outputFormat>.\n"
+		"\t\t\tthe updates are given as '-u <varName> <authFile> ...' in the order\n"
+		"\t\t\tthey are applied, with '-a' all of them are marked as appends\n"
 		"Accepted <inputFormat>:"
 		"\n\t[h]ash\tA file containing only hashed data\n\t"
 		"\tuse -h <hashAlg> to specifify the function used (default SHA256)\n"
-		"\t[c]ert\tAn x509 certificate (PEM format)\n"
+		"\t[c]ert\tAn x509 certificate (PEM format), a PEM bundle of several certificates\n"
+		"\t\tor a directory of .crt/.der/.pem/.cer files, several certificates are\n"
+		"\t\tdeduplicated and packed into one ESL\n"
 		"\t[e]sl\tAn EFI Signature List, must specify if dbx update w '-n dbx'\n"
 		"\t[p]kcs7\tA PKCS7 file containing signed data only used as input type when generating a hash\n"
 		"\t[a]uth\tA signed authenticated file containing a PKCS7 and the new data\n"
 		"\t\tused as input type when output type is hash or esl'\n"
-		"\t[f]ile\tAny file type, Warning: no format validation will be done\n\n"
+		"\t[f]ile\tAny file type, Warning: no format validation will be done\n"
+		"\t[m]anifest\tA list of updates, one '<varName> <y-m-d> <h:m:s> <eslFile> <authFile> [append]'\n"
+		"\t\tper line, only used with the output types [x] and [a]. With 'm:x' the presigned\n"
+		"\t\tdigests of every update are written to <outputFile>, each as its line followed by\n"
+		"\t\tthe digest in hex. With 'm:a' every line also ends with one raw signature per\n"
+		"\t\t'-c <crtFile>', in hex in place of the digest or as a file, and its Auth file\n"
+		"\t\tis written to <authFile>, no '-o' is needed.\n"
+		"\t\tWith '-k <keyFile> -c <crtFile>' pairs instead, 'm:a' signs every update itself\n\n"
 		"Accepted <outputFormat>:\n"
 		"\t[h]ash\tA file containing only hashed data\n\t"
 		"\tuse -h <hashAlg> to specifify the function to use (default SHA256)\n"
@@ -105,6 +145,8 @@ static void help()
 		"\t\t'secvarctl generate f:e -i <file> -o <file> -h SHA512'\n" 
 		"\tto create an ESL from an x509 certificate:\n"
 		"\t\t'secvarctl generate c:e -i <file> -o <file>'\n"
+		"\tto create one ESL from a CA bundle or a directory of certificates:\n"
+		"\t\t'secvarctl generate c:e -n db -i <bundleFileOrDirectory> -o <file>'\n"
 		"\tto create a signed auth file from an ESL, the resulting file is a valid key update file:\n"
 		"\t\t'secvarctl generate e:a -k <file> -c <file> -n <varName> -i <file> -o <file>'\n"
 		"\tto create a signed auth file from an x509, the resulting file is a valid key update file:\n"
@@ -115,10 +157,23 @@ static void help()
 		"\t\t'secvarctl generate a:e -i <file> -o <file>'\n"
 		"\tto create a signed auth file for a key reset, the resulting file is a valid key reset file:\n"
 		"\t\t'secvarctl generate reset -k <file> -c <file> -n <varName> -o <file>'\n"
+		"\tto combine auth files that signers made separately with the same '-t <timestamp>':\n"
+		"\t\t'secvarctl generate merge -i <file> -i <file> -o <file>'\n"
+		"\tto pack a keystore rotation into one file for 'verify -b' and 'write -b':\n"
+		"\t\t'secvarctl generate bundle -u PK <file> KEK <file> db <file> dbx <file> -o <file>'\n"
         "\tto create an auth file, using an external signing framework:\n"
         "\t\t'secvarctl generate c:x -n <varName> -t <y-m-d h:m:s> -i <file> -o <file>'\n"
         "\t\tthen user gets the output file signed into raw signature in <sigFile>\n"
-        "\t\t'secvarctl c:a -n <sameName> -t <sameTimestamp> -s <sigFile> -c <crtfile> -i <file> -o <file>\n");
+        "\t\t'secvarctl c:a -n <sameName> -t <sameTimestamp> -s <sigFile> -c <crtfile> -i <file> -o <file>\n"
+		"\tto get the digests of many updates signed externally at once:\n"
+		"\t\t'secvarctl generate m:x -i <manifest> -o <digestManifest>'\n"
+		"\t\tthen user signs every digest and replaces it with the signature in hex or its <sigFile>\n"
+		"\t\t'secvarctl generate m:a -c <crtFile> -i <signatureManifest>'\n"
+		"\tto sign with a private key on a PKCS#11 token (HSM):\n"
+		"\t\t'secvarctl generate e:a -k \"pkcs11:token=<label>;object=<keyLabel>?module-path=<module.so>\" -c <file> -n <varName> -i <file> -o <file>'\n"
+		"\t\tthe PIN is given with 'pin-value=<PIN>' or SECVARCTL_PKCS11_PIN\n"
+		"\tto create a dbx append update with only the hashes the current dbx does not have:\n"
+		"\t\t'secvarctl generate e:a -a --base <currentDbxEsl> -k <file> -c <file> -n dbx -i <file> -o <file>'\n");
 
 	usage();
 }
@@ -139,14 +194,16 @@ int performGenerateCommand(int argc,char* argv[])
 	unsigned char *buff = NULL, *outBuff = NULL;
 	struct Arguments args = {	
 		.helpFlag = 0, .inpValid = 0, .signKeyCount = 0, .signCertCount = 0, .alreadySignedFlag = 2,
-		.inFile = NULL, .outFile = NULL,  
-		.signCerts = NULL, .signKeys = NULL, .inForm = NULL, .outForm = NULL, .varName = NULL, 
+		.append = 0, .threads = 0, .inFileCount = 0, .updateVarCount = 0, .inFile = NULL, .outFile = NULL, .baseFile = NULL,
+		.cacheFile = NULL, .inFiles = NULL, .updateVars = NULL, .signCerts = NULL, .signKeys = NULL, .inForm = NULL, .outForm = NULL, .varName = NULL, 
 		.hashAlg = NULL, .time = NULL
 	};
+	int bundle = 0;
 
 	rc = parseArgs(argc, argv, &args);
 	if (rc || args.helpFlag)
 		goto out;
+	eslThreads = args.threads;
 	
 	if (args.varName && isVariable(args.varName)) {
 		prlog(PR_ERR, "ERROR: %s is not a valid variable name\n", args.varName);
@@ -160,6 +217,19 @@ int performGenerateCommand(int argc,char* argv[])
 		rc = ARG_PARSE_FAIL;
 		goto out;
 	}
+	if (!strcmp(args.inForm, "merge")) {
+		rc = mergeSigners(&args);
+		goto out;
+	}
+	if (!strcmp(args.inForm, "bundle")) {
+		rc = bundleUpdates(&args);
+		goto out;
+	}
+	// a manifest names the files of every update itself
+	if (args.inForm[0] == 'm') {
+		rc = generateFromManifest(&args);
+		goto out;
+	}
 	//output file must be defined
 	if (args.outFile == NULL) {
 		prlog(PR_ERR, "ERROR: No output file given, see usage below...\n");
@@ -175,6 +245,17 @@ int performGenerateCommand(int argc,char* argv[])
 		rc = ARG_PARSE_FAIL;
 		goto out;
 	}
+	// an empty append does nothing and the base is only meaningful for appends
+	if (args.append && args.inForm[0] == 'r') {
+		prlog(PR_ERR, "ERROR: A reset file cannot be an append, remove '-a'\n");
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (args.baseFile && !args.append) {
+		prlog(PR_ERR, "ERROR: '--base' can only be used with '-a'\n");
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
 	// if signing each signer needs a certificate
 	if (args.signCertCount != args.signKeyCount) {
 		if (args.alreadySignedFlag == 1)
@@ -185,10 +266,31 @@ int performGenerateCommand(int argc,char* argv[])
 		goto out;
 	}
 	prlog(PR_INFO, "Input file is %s of type %s , output file is %s of type %s\n", args.inFile, args.inForm, args.outFile, args.outForm);
+	if (args.cacheFile) {
+		rc = openVerifyCache(args.cacheFile);
+		if (rc)
+			goto out;
+	}
 	
 	//if reset key than don't look for a input file
 	if (args.inForm[0] == 'r') 
 		size = 0;
+	// many certificates are packed into one ESL and continue as an ESL input
+	// stdin can only be read once, so it is taken as a single certificate
+	else if (args.inForm[0] == 'c' && !isStdioFile(args.inFile) && isCertBundle(args.inFile)) {
+		if (!strchr("eapx", args.outForm[0])) {
+			prlog(PR_ERR, "ERROR: Several certificates can only be generated into an ESL, Auth, PKCS7 or presigned hash\n");
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		rc = certBundleToESL(args.inFile, args.varName, args.threads, args.inpValid, &buff, &size);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not generate ESL from certificates in %s\n", args.inFile);
+			goto out;
+		}
+		args.inForm = "esl";
+		bundle = 1;
+	}
 	else {
 		// get data from input file
 		buff = (unsigned char *)getDataFromFile(args.inFile, &size);
@@ -206,7 +308,13 @@ int performGenerateCommand(int argc,char* argv[])
 	if (rc) 
 		goto out;
 	// now we can try to generate the desired output format
-	rc = getOutputData(buff, size, &args, hashFunction, &outBuff, &outBuffSize);
+	if (bundle && args.outForm[0] == 'e') {
+		outBuff = buff;
+		outBuffSize = size;
+		buff = NULL;
+	}
+	else
+		rc = getOutputData(buff, size, &args, hashFunction, &outBuff, &outBuffSize);
 	if (rc) {
 		prlog(PR_ERR, "Failed to generate into output format: %s\n", args.outForm);
 		goto out;
@@ -220,10 +328,17 @@ int performGenerateCommand(int argc,char* argv[])
 	}
 
 out:
+	// only certificates that passed are cached, so save them either way
+	if (args.cacheFile && isVerifyCacheOpen() && closeVerifyCache() && !rc)
+		prlog(PR_WARNING, "WARNING: verification cache %s was not updated\n", args.cacheFile);
 	if (buff) 
 		free(buff);
 	if (outBuff) 
 		free(outBuff);
+	if (args.inFiles)
+		free(args.inFiles);
+	if (args.updateVars)
+		free(args.updateVars);
 	if (args.signKeys) 
 		free(args.signKeys);
 	if (args.signCerts) 
@@ -238,6 +353,526 @@ out:
 	return rc;
 }
 
+/*
+ *signs an ESL into an auth file for a variable with the current time, for commands
+ *that compute new variable contents themselves
+ *@param esl, new ESL data
+ *@param size, length of esl
+ *@param varName, variable the auth is for
+ *@param signKeys, private key files, one per signer
+ *@param signCerts, certificate files, one per signer
+ *@param signerCount, number of signers
+ *@param append, 1 to sign it as an append write
+ *@param outBuff, the resulting auth file, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outBuffSize, the length of outBuff
+ *@return SUCCESS or err number
+ */
+int generateAuthFromESL(const unsigned char *esl, size_t size, const char *varName, const char **signKeys,
+			const char **signCerts, int signerCount, int append, unsigned char **outBuff, size_t *outBuffSize)
+{
+	int rc;
+	struct efi_time time;
+	struct Arguments args = {
+		.signKeyCount = signerCount, .signCertCount = signerCount, .alreadySignedFlag = 0, .append = append,
+		.signCerts = signCerts, .signKeys = signKeys, .varName = varName, .time = &time
+	};
+
+	if (!signerCount) {
+		prlog(PR_ERR, "ERROR: No signers given for %s auth file\n", varName);
+		return ARG_PARSE_FAIL;
+	}
+	rc = getTimestamp(&time);
+	if (rc)
+		return rc;
+
+	return toAuth(esl, size, &args, MBEDTLS_MD_SHA256, outBuff, outBuffSize);
+}
+
+/*
+ *handles the [m]anifest input format, every line of the manifest is one update:
+ *	<varName> <y-m-d> <h:m:s> <eslFile> <authFile> [append] [<signature>...]
+ *for m:x the presigned digest of every update is written to args->outFile, as the
+ *update's line followed by the digest in hex, so one external signing round covers
+ *all of them. For m:a every update is assembled into its <authFile> from the raw
+ *signatures that end its line, in hex where m:x put the digest or as <sigFile> paths,
+ *one per '-c <crtFile>' and in the same order, or
+ *signed with the '-k <keyFile>' keys if the lines have no signatures
+ *@param args, struct containing command line info, inFile is the manifest
+ *@return SUCCESS or err number
+ */
+static int generateFromManifest(struct Arguments *args)
+{
+	char *data = NULL, *tmp, *line, *next, *save, *field, *fields[MANIFEST_MAX_FIELDS], *digests = NULL;
+	size_t size = 0, lineNum = 0, digestsSize = 0, entries = 0;
+	int rc = SUCCESS, count;
+
+	if (args->outForm[0] != 'x' && args->outForm[0] != 'a') {
+		prlog(PR_ERR, "ERROR: A manifest can only be generated into presigned digests [x] or Auth files [a]\n");
+		return ARG_PARSE_FAIL;
+	}
+	// every update brings its own variable, timestamp, attributes and signatures
+	if (args->varName || args->time || args->append || args->baseFile || args->alreadySignedFlag == 1) {
+		prlog(PR_ERR, "ERROR: '-n', '-t', '-a', '--base' and '-s' are given per line in a manifest\n");
+		return ARG_PARSE_FAIL;
+	}
+	if (args->signKeyCount && (args->outForm[0] == 'x' || args->signKeyCount != args->signCertCount)) {
+		prlog(PR_ERR, "ERROR: Every '-k <keyFile>' needs a '-c <crtFile>' and keys only sign Auth files\n");
+		return ARG_PARSE_FAIL;
+	}
+	if (args->outForm[0] == 'x' && !args->outFile) {
+		prlog(PR_ERR, "ERROR: No output file given for the digest manifest, see usage below...\n");
+		usage();
+		return ARG_PARSE_FAIL;
+	}
+	if (args->outForm[0] == 'a' && !args->signCertCount) {
+		prlog(PR_ERR, "ERROR: No signer certificates given, use '-c <crtFile>' for every signature of an update\n");
+		return ARG_PARSE_FAIL;
+	}
+	if (!args->inFile || isFile(args->inFile)) {
+		prlog(PR_ERR, "ERROR: Input File is invalid, see usage below...\n");
+		usage();
+		return ARG_PARSE_FAIL;
+	}
+	data = getDataFromFile(args->inFile, &size);
+	if (!data)
+		return INVALID_FILE;
+	// the auth files of all lines are synced together at the end
+	outputBatchStart();
+	// terminate the text so lines can be split with the str functions
+	tmp = realloc(data, size + 1);
+	if (!tmp) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	data = tmp;
+	data[size] = '\0';
+
+	for (line = data; *line; line = next) {
+		lineNum++;
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+		count = 0;
+		for (field = strtok_r(line, " \t\r", &save); field && count < MANIFEST_MAX_FIELDS; field = strtok_r(NULL, " \t\r", &save))
+			fields[count++] = field;
+		// skip empty lines and comments
+		if (!count || fields[0][0] == '#')
+			continue;
+		if (field) {
+			prlog(PR_ERR, "ERROR: Line %zd of %s has more than %d fields\n", lineNum, args->inFile, MANIFEST_MAX_FIELDS);
+			rc = INVALID_FILE;
+			goto out;
+		}
+		rc = generateManifestEntry(args, fields, count, &digests, &digestsSize);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not generate line %zd of %s\n", lineNum, args->inFile);
+			goto out;
+		}
+		entries++;
+	}
+	if (!entries) {
+		prlog(PR_ERR, "ERROR: No updates found in %s\n", args->inFile);
+		rc = INVALID_FILE;
+		goto out;
+	}
+	if (args->outForm[0] == 'x') {
+		prlog(PR_INFO, "Writing %zd presigned digests to %s\n", entries, args->outFile);
+		rc = createFile(args->outFile, digests, digestsSize);
+		if (rc)
+			prlog(PR_ERR, "ERROR: Could not write new data to output file %s\n", args->outFile);
+	}
+	else
+		prlog(PR_INFO, "Generated %zd Auth files\n", entries);
+
+out:
+	if (outputBatchFinish() && !rc)
+		rc = FILE_WRITE_FAIL;
+	if (data)
+		free(data);
+	if (digests)
+		free(digests);
+
+	return rc;
+}
+
+/*
+ *generates one update of a manifest, see generateFromManifest
+ *@param args, struct containing command line info
+ *@param fields, the whitespace separated fields of the update's line
+ *@param count, number of fields
+ *@param digests, the digest manifest that the line is added to for m:x, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param digestsSize, length of digests
+ *@return SUCCESS or err number
+ */
+static int generateManifestEntry(struct Arguments *args, char **fields, int count, char **digests, size_t *digestsSize)
+{
+	int rc, append, sigCount;
+	size_t eslSize = 0, outBuffSize = 0, lineSize, *sigSizes = NULL;
+	unsigned char *esl = NULL, *outBuff = NULL, **sigs = NULL;
+	char *tmp, *ptr;
+	struct efi_time time;
+	struct Arguments entryArgs = {
+		.signCertCount = args->signCertCount, .alreadySignedFlag = 1,
+		.signCerts = args->signCerts, .varName = fields[0], .time = &time
+	};
+
+	if (count < 5) {
+		prlog(PR_ERR, "ERROR: Expected '<varName> <y-m-d> <h:m:s> <eslFile> <authFile> [append] [<signature>...]'\n");
+		return INVALID_FILE;
+	}
+	if (isVariable(fields[0]) || !strcmp(fields[0], "TS")) {
+		prlog(PR_ERR, "ERROR: %s is not a valid variable name\n", fields[0]);
+		return INVALID_VAR_NAME;
+	}
+	rc = parseTimestamp(fields[1], fields[2], &time);
+	if (rc)
+		return rc;
+	append = count > 5 && !strcmp(fields[5], "append");
+	entryArgs.append = append;
+	sigCount = count - 5 - append;
+	if (args->outForm[0] == 'x' && sigCount) {
+		prlog(PR_ERR, "ERROR: Unexpected field '%s', an update to get the digest of has no signatures\n", fields[5 + append]);
+		return INVALID_FILE;
+	}
+	if (args->outForm[0] == 'a' && !args->signKeyCount && sigCount != args->signCertCount) {
+		prlog(PR_ERR, "ERROR: Number of certificates does not equal number of signature files, %d != %d\n", args->signCertCount, sigCount);
+		return INVALID_FILE;
+	}
+	// with keys every update is signed here, the key sessions are kept for the whole manifest
+	if (args->signKeyCount) {
+		if (sigCount) {
+			prlog(PR_ERR, "ERROR: Unexpected field '%s', updates are signed with '-k'\n", fields[5 + append]);
+			return INVALID_FILE;
+		}
+		entryArgs.alreadySignedFlag = 0;
+		entryArgs.signKeys = args->signKeys;
+		entryArgs.signKeyCount = args->signKeyCount;
+	}
+	else if (sigCount) {
+		entryArgs.signKeys = (const char **)fields + 5 + append;
+		entryArgs.signKeyCount = sigCount;
+		sigs = calloc(sigCount, sizeof(*sigs));
+		sigSizes = calloc(sigCount, sizeof(*sigSizes));
+		if (!sigs || !sigSizes) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		for (int i = 0; i < sigCount; i++) {
+			rc = getManifestSignature(fields[5 + append + i], &sigs[i], &sigSizes[i]);
+			if (rc)
+				goto out;
+		}
+		entryArgs.signatures = (const unsigned char **)sigs;
+		entryArgs.signatureSizes = sigSizes;
+	}
+
+	esl = (unsigned char *)getDataFromFile(fields[3], &eslSize);
+	if (!esl) {
+		prlog(PR_ERR, "ERROR: Could not find data in file %s\n", fields[3]);
+		rc = INVALID_FILE;
+		goto out;
+	}
+	// if data is known to be valid than do not validate
+	if (!args->inpValid) {
+		rc = validateESL(esl, eslSize, fields[0]);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not validate ESL %s\n", fields[3]);
+			goto out;
+		}
+	}
+
+	if (args->outForm[0] == 'x') {
+		rc = toHashForSecVarSigning(esl, eslSize, &entryArgs, &outBuff, &outBuffSize);
+		if (rc)
+			goto out;
+		// the line is echoed without its signatures, then the digest
+		lineSize = outBuffSize * 2 + 2;
+		for (int i = 0; i < 5 + append; i++)
+			lineSize += strlen(fields[i]) + 1;
+		tmp = realloc(*digests, *digestsSize + lineSize + 1);
+		if (!tmp) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		*digests = tmp;
+		ptr = *digests + *digestsSize;
+		for (int i = 0; i < 5 + append; i++)
+			ptr += sprintf(ptr, "%s ", fields[i]);
+		for (size_t i = 0; i < outBuffSize; i++)
+			ptr += sprintf(ptr, "%02x", outBuff[i]);
+		ptr += sprintf(ptr, "\n");
+		*digestsSize = ptr - *digests;
+	}
+	else {
+		rc = toAuth(esl, eslSize, &entryArgs, MBEDTLS_MD_SHA256, &outBuff, &outBuffSize);
+		if (rc)
+			goto out;
+		prlog(PR_INFO, "Writing %zd bytes to %s\n", outBuffSize, fields[4]);
+		rc = createFile(fields[4], (char *)outBuff, outBuffSize);
+		if (rc)
+			prlog(PR_ERR, "ERROR: Could not write new data to output file %s\n", fields[4]);
+	}
+
+out:
+	for (int i = 0; sigs && i < sigCount; i++) {
+		if (sigs[i])
+			free(sigs[i]);
+	}
+	if (sigs)
+		free(sigs);
+	if (sigSizes)
+		free(sigSizes);
+	if (esl)
+		free(esl);
+	if (outBuff)
+		free(outBuff);
+
+	return rc;
+}
+
+/*
+ *reads one signature of a manifest line, written in hex where 'm:x' put the digest
+ *so the signing response can be pasted in, or the path to a raw signature file
+ *@param field, hex signature or file, an existing file of that name wins
+ *@param sig, the raw signature, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param sigSize, length of sig
+ *@return SUCCESS or INVALID_FILE
+ */
+static int getManifestSignature(const char *field, unsigned char **sig, size_t *sigSize)
+{
+	size_t len = strlen(field);
+	unsigned int byte;
+
+	if (isFile(field) && len && len % 2 == 0 && strspn(field, "0123456789abcdefABCDEF") == len) {
+		*sigSize = len / 2;
+		*sig = malloc(*sigSize);
+		if (!*sig) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			return ALLOC_FAIL;
+		}
+		for (size_t i = 0; i < *sigSize; i++) {
+			sscanf(field + i * 2, "%2x", &byte);
+			(*sig)[i] = byte;
+		}
+		return SUCCESS;
+	}
+	*sig = (unsigned char *)getDataFromFile(field, sigSize);
+	if (!*sig) {
+		prlog(PR_ERR, "ERROR: %s is neither a hex signature nor a signature file\n", field);
+		return INVALID_FILE;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *combines the signers of several Auth or PKCS7 files into one file of the same type, for
+ *multi-signer updates whose signers each ran their own 'generate' with the same '-t'.
+ *Auth files must have the same timestamp and ESL, the result keeps them with the merged PKCS7
+ *@param args, struct containing command line info, inFiles are the files to merge
+ *@return SUCCESS or err number
+ */
+static int mergeSigners(struct Arguments *args)
+{
+	int rc = SUCCESS, isAuth;
+	unsigned char **data = NULL, *pkcs7 = NULL, *outBuff = NULL;
+	const unsigned char **pkcs7s = NULL;
+	size_t *sizes = NULL, *pkcs7Sizes = NULL, pkcs7Size = 0, outBuffSize, headerSize, eslSize = 0;
+	const struct efi_variable_authentication_2 *auth, *first = NULL;
+	const uuid_t pkcs7Guid = EFI_CERT_TYPE_PKCS7_GUID;
+
+	if (args->signKeyCount || args->signCertCount || args->varName || args->time || args->append || args->baseFile) {
+		prlog(PR_ERR, "ERROR: Merging only combines existing signers, remove '-k', '-s', '-c', '-n', '-t', '-a' and '--base'\n");
+		return ARG_PARSE_FAIL;
+	}
+	if (args->inFileCount < 2 || !args->outFile) {
+		prlog(PR_ERR, "ERROR: Give every file to merge with '-i <file>', at least two, and '-o <file>'\n");
+		usage();
+		return ARG_PARSE_FAIL;
+	}
+	data = calloc(args->inFileCount, sizeof(*data));
+	sizes = calloc(args->inFileCount, sizeof(*sizes));
+	pkcs7s = calloc(args->inFileCount, sizeof(*pkcs7s));
+	pkcs7Sizes = calloc(args->inFileCount, sizeof(*pkcs7Sizes));
+	if (!data || !sizes || !pkcs7s || !pkcs7Sizes) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	headerSize = sizeof(auth->timestamp) + sizeof(auth->auth_info.hdr) + sizeof(auth->auth_info.cert_type);
+	for (int i = 0; i < args->inFileCount; i++) {
+		if (isFile(args->inFiles[i])) {
+			prlog(PR_ERR, "ERROR: Input File %s is invalid\n", args->inFiles[i]);
+			rc = INVALID_FILE;
+			goto out;
+		}
+		data[i] = (unsigned char *)getDataFromFile(args->inFiles[i], &sizes[i]);
+		if (!data[i]) {
+			prlog(PR_ERR, "ERROR: Could not find data in file %s\n", args->inFiles[i]);
+			rc = INVALID_FILE;
+			goto out;
+		}
+		// an auth is told apart by its header, anything else has to be a PKCS7
+		auth = (const struct efi_variable_authentication_2 *)data[i];
+		isAuth = sizes[i] > headerSize && !memcmp(&auth->auth_info.cert_type, &pkcs7Guid, sizeof(pkcs7Guid))
+			 && auth->auth_info.hdr.dw_length > headerSize - sizeof(auth->timestamp)
+			 && auth->auth_info.hdr.dw_length <= sizes[i] - sizeof(auth->timestamp);
+		if (i && isAuth != !!first) {
+			prlog(PR_ERR, "ERROR: Cannot merge Auth and PKCS7 files together, %s is not like %s\n", args->inFiles[i], args->inFiles[0]);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		if (!isAuth) {
+			pkcs7s[i] = data[i];
+			pkcs7Sizes[i] = sizes[i];
+			continue;
+		}
+		pkcs7s[i] = data[i] + headerSize;
+		pkcs7Sizes[i] = get_pkcs7_len(auth);
+		if (!first) {
+			first = auth;
+			eslSize = sizes[i] - sizeof(auth->timestamp) - auth->auth_info.hdr.dw_length;
+		}
+		else if (memcmp(&auth->timestamp, &first->timestamp, sizeof(auth->timestamp))) {
+			prlog(PR_ERR, "ERROR: %s has another timestamp than %s, sign with the same '-t'\n", args->inFiles[i], args->inFiles[0]);
+			rc = AUTH_FAIL;
+			goto out;
+		}
+		else if (sizes[i] - sizeof(auth->timestamp) - auth->auth_info.hdr.dw_length != eslSize
+			 || memcmp(data[i] + sizes[i] - eslSize, data[0] + sizes[0] - eslSize, eslSize)) {
+			prlog(PR_ERR, "ERROR: %s has another ESL than %s\n", args->inFiles[i], args->inFiles[0]);
+			rc = AUTH_FAIL;
+			goto out;
+		}
+	}
+	rc = merge_pkcs7(&pkcs7, &pkcs7Size, pkcs7s, pkcs7Sizes, args->inFileCount);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Could not merge the signers of the input files\n");
+		goto out;
+	}
+	if (first) {
+		// the header of the first auth, with the length of the merged PKCS7
+		outBuffSize = headerSize + pkcs7Size + eslSize;
+		outBuff = malloc(outBuffSize);
+		if (!outBuff) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		memcpy(outBuff, first, headerSize);
+		((struct efi_variable_authentication_2 *)outBuff)->auth_info.hdr.dw_length = headerSize - sizeof(first->timestamp) + pkcs7Size;
+		memcpy(outBuff + headerSize, pkcs7, pkcs7Size);
+		memcpy(outBuff + headerSize + pkcs7Size, data[0] + sizes[0] - eslSize, eslSize);
+	}
+	else {
+		outBuff = pkcs7;
+		outBuffSize = pkcs7Size;
+		pkcs7 = NULL;
+	}
+	prlog(PR_INFO, "Writing %zd bytes to %s\n", outBuffSize, args->outFile);
+	rc = createFile(args->outFile, (char *)outBuff, outBuffSize);
+	if (rc)
+		prlog(PR_ERR, "ERROR: Could not write new data to output file %s\n", args->outFile);
+
+out:
+	for (int i = 0; data && i < args->inFileCount; i++) {
+		if (data[i])
+			free(data[i]);
+	}
+	if (data)
+		free(data);
+	if (sizes)
+		free(sizes);
+	if (pkcs7s)
+		free(pkcs7s);
+	if (pkcs7Sizes)
+		free(pkcs7Sizes);
+	if (pkcs7)
+		free(pkcs7);
+	if (outBuff)
+		free(outBuff);
+
+	return rc;
+}
+
+/*
+ *packs the auth files of several updates into one update bundle, see openUpdateBundle
+ *@param args, struct containing command line info, updateVars are the <varName> <authFile> pairs
+ *@return SUCCESS or err number
+ */
+static int bundleUpdates(struct Arguments *args)
+{
+	int rc = SUCCESS, count;
+	unsigned char **data = NULL;
+	const char **vars = NULL;
+	size_t *sizes = NULL;
+	uint32_t *flags = NULL;
+
+	if (args->signKeyCount || args->signCertCount || args->varName || args->time || args->baseFile || args->inFileCount) {
+		prlog(PR_ERR, "ERROR: Bundling only packs existing Auth files, remove '-k', '-s', '-c', '-n', '-t', '-i' and '--base'\n");
+		return ARG_PARSE_FAIL;
+	}
+	if (!args->updateVarCount || args->updateVarCount % 2 || !args->outFile) {
+		prlog(PR_ERR, "ERROR: Give the updates with '-u <varName> <authFile> ...' and '-o <file>'\n");
+		usage();
+		return ARG_PARSE_FAIL;
+	}
+	count = args->updateVarCount / 2;
+	data = calloc(count, sizeof(*data));
+	vars = calloc(count, sizeof(*vars));
+	sizes = calloc(count, sizeof(*sizes));
+	flags = calloc(count, sizeof(*flags));
+	if (!data || !vars || !sizes || !flags) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	for (int i = 0; i < count; i++) {
+		vars[i] = args->updateVars[2 * i];
+		if (isVariable(vars[i]) || !strcmp(vars[i], "TS")) {
+			prlog(PR_ERR, "ERROR: %s is not a variable that can be updated\n", vars[i]);
+			rc = INVALID_VAR_NAME;
+			goto out;
+		}
+		data[i] = (unsigned char *)getDataFromFile(args->updateVars[2 * i + 1], &sizes[i]);
+		if (!data[i]) {
+			prlog(PR_ERR, "ERROR: Could not find data in file %s\n", args->updateVars[2 * i + 1]);
+			rc = INVALID_FILE;
+			goto out;
+		}
+		if (!args->inpValid) {
+			rc = validateAuth(data[i], sizes[i], vars[i]);
+			if (rc) {
+				prlog(PR_ERR, "ERROR: %s is not a valid Auth file for %s\n", args->updateVars[2 * i + 1], vars[i]);
+				goto out;
+			}
+		}
+		flags[i] = args->append ? UPDATE_BUNDLE_APPEND : 0;
+	}
+	rc = createUpdateBundle(args->outFile, vars, (const unsigned char **)data, sizes, flags, count);
+
+out:
+	for (int i = 0; data && i < count; i++) {
+		if (data[i])
+			free(data[i]);
+	}
+	if (data)
+		free(data);
+	if (vars)
+		free(vars);
+	if (sizes)
+		free(sizes);
+	if (flags)
+		free(flags);
+
+	return rc;
+}
+
 /**
  *@param argv , array of command line arguments
  *@param argc, length of argv
@@ -246,6 +881,7 @@ out:
  */
 static int parseArgs( int argc, char *argv[], struct Arguments *args) {
 	int rc = SUCCESS;
+	const char **inFiles;
 	for (int i = 0; i < argc; i++) {
 		if (argv[i][0] == '-') {
 			if (!strcmp(argv[i], "--usage")) {
@@ -265,6 +901,36 @@ static int parseArgs( int argc, char *argv[], struct Arguments *args) {
 			//  set input is valid flag
 			else if (!strcmp(argv[i], "-f"))
 				args->inpValid = 1;	
+			// sign as an append write
+			else if (!strcmp(argv[i], "-a"))
+				args->append = 1;
+			else if (!strcmp(argv[i], "-j")) {
+				if (i + 1 >= argc || argv[i + 1][0] == '-' || atoi(argv[i + 1]) <= 0) {
+					prlog(PR_ERR, "ERROR: Incorrect value for '-j', use '-j <threads>', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				args->threads = atoi(argv[i]);
+			}
+			else if (!strcmp(argv[i], "--cache")) {
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '--cache', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				args->cacheFile = argv[i];
+			}
+			else if (!strcmp(argv[i], "--base")) {
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '--base', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				args->baseFile = argv[i];
+			}
 			// set private key signer	
 			else if (!strcmp(argv[i], "-k")) {
                  //if already storing signed data, then don't allow for private keys
@@ -321,7 +987,8 @@ static int parseArgs( int argc, char *argv[], struct Arguments *args) {
 			}
 			// set input file
 			else if (!strcmp(argv[i], "-i")) {
-				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+				// "-" reads the input from stdin
+				if (i + 1 >= argc || (argv[i + 1][0] == '-' && !isStdioFile(argv[i + 1]))) {
 					prlog(PR_ERR, "ERROR: Incorrect flag '-i', see usage...\n");
 					rc = ARG_PARSE_FAIL;
 					goto out;
@@ -329,11 +996,48 @@ static int parseArgs( int argc, char *argv[], struct Arguments *args) {
 				else {
 					i++;
 					args->inFile = argv[i];
+					// merge takes several, the other operations use the last one
+					inFiles = realloc(args->inFiles, (args->inFileCount + 1) * sizeof(char*));
+					if (!inFiles) {
+						prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+						rc = ALLOC_FAIL;
+						goto out;
+					}
+					args->inFiles = inFiles;
+					args->inFiles[args->inFileCount++] = argv[i];
 				}
 			}
+			// set the <varName> <authFile> pairs of a bundle
+			else if (!strcmp(argv[i], "-u")) {
+				if (args->updateVars) {
+					prlog(PR_ERR, "ERROR: Update variables defined twice, see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				while (i < argc && argv[i][0] != '-') {
+					args->updateVarCount++;
+					i++;
+				}
+				if (!args->updateVarCount) {
+					prlog(PR_ERR, "ERROR: Incorrect flag '-u', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				args->updateVars = malloc(args->updateVarCount * sizeof(char*));
+				if (!args->updateVars) {
+					prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+					rc = ALLOC_FAIL;
+					goto out;
+				}
+				memcpy(args->updateVars, &argv[i - args->updateVarCount], args->updateVarCount * sizeof(char*));
+				// to iterate back to the -" " arg
+				i--;
+			}
 			// set output file 
 			else if (!strcmp(argv[i], "-o")) {
-				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+				// "-" writes the output to stdout
+				if (i + 1 >= argc || (argv[i + 1][0] == '-' && !isStdioFile(argv[i + 1]))) {
 					prlog(PR_ERR, "ERROR: Incorrect flag '-o', see usage...\n");
 					rc = ARG_PARSE_FAIL;
 					goto out;
@@ -382,20 +1086,10 @@ static int parseArgs( int argc, char *argv[], struct Arguments *args) {
 						rc = ALLOC_FAIL;
 						goto out;
 					}
-					// make sure timestamp is correct format
-					if (sscanf(argv[i++],"%hd-%hhd-%hhd", &args->time->year, &args->time->month, &args->time->day) != 3
-						|| sscanf(argv[i], "%hhd:%hhd:%hhd", &args->time->hour, &args->time->minute, &args->time->second) != 3) {
-						prlog(PR_ERR, "ERROR: Could not parse given timestamp, make sure it is in format 'y-m-d h:m:s'\n ");
-						rc = ARG_PARSE_FAIL;
+					rc = parseTimestamp(argv[i], argv[i + 1], args->time);
+					i++;
+					if (rc)
 						goto out;
-					}		
-					else {
-						rc = validateTime(args->time);
-						// todo: refactor the two ways time can be set (and validateTime called) into 1 path
-						if (secvarctl_backend->quirks & QUIRK_TIME_MINUS_1900)
-							args->time->year -= 1900;
-						if (rc) goto out;
-					}
 				}
 			}
 				
@@ -406,6 +1100,15 @@ static int parseArgs( int argc, char *argv[], struct Arguments *args) {
 			args->inFile = "empty";
 			args->outForm = "auth";
 		}
+		// merging keeps the format of its inputs
+		else if (!strcmp(argv[i], "merge")) {
+			args->inForm = "merge";
+			args->outForm = "merge";
+		}
+		else if (!strcmp(argv[i], "bundle")) {
+			args->inForm = "bundle";
+			args->outForm = "bundle";
+		}
 		// else set input and output formats
 		else {
 				args->inForm = strtok(argv[i], ":");
@@ -494,7 +1197,7 @@ static int generateAuthOrPKCS7(const unsigned char* buff, size_t size, struct Ar
 {
 	int rc;
 	size_t intermediateBuffSize, inpSize = size; 
-	unsigned char *intermediateBuff = NULL, **inpPtr;
+	unsigned char *intermediateBuff = NULL, *deltaBuff = NULL, **inpPtr;
 	inpPtr = (unsigned char **)&buff;
 	
 	switch (args->inForm[0]) {
@@ -540,6 +1243,13 @@ static int generateAuthOrPKCS7(const unsigned char* buff, size_t size, struct Ar
 		prlog(PR_ERR, "Failed to validate input format\n");
 		goto out;
 	}
+	// for an append, only sign what the variable does not have yet
+	if (args->baseFile) {
+		rc = getAppendDelta(*inpPtr, inpSize, args->baseFile, &deltaBuff, &inpSize);
+		if (rc)
+			goto out;
+		inpPtr = &deltaBuff;
+	}
 	
 	if (args->outForm[0] == 'a')
 		rc = toAuth(*inpPtr, inpSize, args, hashFunct->mbedtls_funct, outBuff, outBuffSize);
@@ -555,9 +1265,47 @@ static int generateAuthOrPKCS7(const unsigned char* buff, size_t size, struct Ar
 out: 
 	if (intermediateBuff) 
 		free(intermediateBuff);
+	if (deltaBuff)
+		free(deltaBuff);
 	return rc;
 }
 
+/*
+ *removes the signatures of an ESL that are already in the current contents of
+ *the variable, so an append update only carries the new entries
+ *@param esl, new ESL data
+ *@param size, length of esl
+ *@param baseFile, file with the current ESL's of the variable
+ *@param outBuff, the remaining ESL data, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outBuffSize, the length of outBuff
+ *@return SUCCESS or err number
+ */
+static int getAppendDelta(const unsigned char *esl, size_t size, const char *baseFile, unsigned char **outBuff, size_t *outBuffSize)
+{
+	int rc;
+	unsigned char *base = NULL;
+	size_t baseSize;
+
+	base = (unsigned char *)getDataFromFile(baseFile, &baseSize);
+	if (!base) {
+		prlog(PR_ERR, "ERROR: Could not read base ESL's from %s\n", baseFile);
+		return INVALID_FILE;
+	}
+	rc = removeESLSignatures(esl, size, base, baseSize, outBuff, outBuffSize);
+	free(base);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Could not compare ESL's with %s\n", baseFile);
+		return rc;
+	}
+	if (!*outBuffSize) {
+		prlog(PR_ERR, "ERROR: Every entry is already in %s, nothing to append\n", baseFile);
+		return ESL_FAIL;
+	}
+	prlog(PR_INFO, "Appending %zd of %zd bytes of ESL data not found in %s\n", *outBuffSize, size, baseFile);
+
+	return SUCCESS;
+}
+
 /*
  *does prevalidation on input info, then given all the input information it should generate an esl file and its size and return a SUCCESS or negative number (ERROR)
  *@param buff, data to be added to ESL, it must be of the same type as specified by inform
@@ -874,6 +1622,31 @@ static int getTimestamp(struct efi_time *ts) {
 	return rc;
 }
 
+/*
+ *parses a timestamp given as 'y-m-d' 'h:m:s' and validates it
+ *@param date, the 'y-m-d' part
+ *@param clock, the 'h:m:s' part
+ *@param ts, the outputted time
+ *@return SUCCESS or errno if the timestamp is not of that format or incorrect
+ */
+static int parseTimestamp(const char *date, const char *clock, struct efi_time *ts)
+{
+	int rc;
+
+	// make sure timestamp is correct format
+	if (sscanf(date, "%hd-%hhd-%hhd", &ts->year, &ts->month, &ts->day) != 3
+		|| sscanf(clock, "%hhd:%hhd:%hhd", &ts->hour, &ts->minute, &ts->second) != 3) {
+		prlog(PR_ERR, "ERROR: Could not parse given timestamp, make sure it is in format 'y-m-d h:m:s'\n ");
+		return ARG_PARSE_FAIL;
+	}
+	rc = validateTime(ts);
+	// todo: refactor the two ways time can be set (and validateTime called) into 1 path
+	if (secvarctl_backend->quirks & QUIRK_TIME_MINUS_1900)
+		ts->year -= 1900;
+
+	return rc;
+}
+
 /*
  *generates presigned hashed data, this accepts an ESL and all metadata, it performs a SHA hash
  *@param ESL, ESL data buffer
@@ -949,7 +1722,7 @@ static int getPreHashForSecVar(unsigned char **outData, size_t *outSize, const u
     unsigned char *ptr = NULL;
     char *wkey = NULL;
     size_t varlen;
-    le32 attr = cpu_to_le32(secvarctl_backend->default_attributes);
+    le32 attr = cpu_to_le32(secvarctl_backend->default_attributes | (args->append ? EFI_VARIABLE_APPEND_WRITE : 0));
     uuid_t guid;
 
     if (!args->varName) {
@@ -1026,7 +1799,11 @@ static int toPKCS7ForSecVar(const unsigned char* newData, size_t dataSize, struc
         goto out;
     }
 	// get pkcs7 and size, if we are already given ths signatures then call appropriate funciton
-	if (args->alreadySignedFlag){
+	if (args->alreadySignedFlag && args->signatures) {
+		prlog(PR_INFO, "Generating PKCS7 with already signed data\n");
+		rc = to_pkcs7_signatures((unsigned char **)outBuff, outBuffSize, actualData, totalSize, args->signCerts, args->signatures, args->signatureSizes, args->signKeyCount, MBEDTLS_MD_SHA256);
+	}
+	else if (args->alreadySignedFlag){
         prlog(PR_INFO, "Generating PKCS7 with already signed data\n");
         rc = to_pkcs7_already_signed_data((unsigned char **)outBuff, outBuffSize, actualData, totalSize, args->signCerts, args->signKeys, args->signKeyCount, MBEDTLS_MD_SHA256);
     }
@@ -0,0 +1,600 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <mbedtls/md.h> // for hashing candidate files
+#include "backends/include/backends.h"
+#include "secvar/include/edk2-svc.h"// import last!!
+
+#define HASH_FUNCTION_COUNT ARRAY_SIZE(hash_functions)
+#define LOOKUP_READ_CHUNK (64 * 1024)
+#define LOOKUP_MAX_DIGEST 64
+// bloom filter sizing, about 0.3% false positives
+#define BLOOM_BITS_PER_ENTRY 16
+#define BLOOM_PROBES 4
+
+struct lookupQuery {
+	int isHash;
+	const char *value;
+};
+
+struct lookupArguments {
+	int helpFlag, bloom, queryCount;
+	const char *pathToSecVars, *eslFile, *listFile;
+	struct lookupQuery *queries;
+};
+
+/*
+ *every dbx digest of one hash type, sorted so membership is a binary search
+ */
+struct dbxPartition {
+	const struct hash_funct *hash;
+	unsigned char *digests;
+	size_t count, capacity;
+	// optional bloom filter, bloomMask + 1 bits
+	uint64_t *bloom;
+	uint64_t bloomMask;
+};
+
+struct dbxIndex {
+	struct dbxPartition parts[HASH_FUNCTION_COUNT];
+	size_t entries, skipped, queries, revoked;
+};
+
+static void usage();
+static void help();
+static int parseArgs(int argc, char *argv[], struct lookupArguments *args);
+static int getDBX(const struct lookupArguments *args, char **data, size_t *size);
+static int buildIndex(struct dbxIndex *idx, const unsigned char *esl, size_t size, int bloom);
+static void freeIndex(struct dbxIndex *idx);
+static int indexContains(const struct dbxPartition *part, const unsigned char *digest);
+static int lookupHash(struct dbxIndex *idx, const char *hex);
+static int lookupFile(struct dbxIndex *idx, const char *file);
+static int lookupList(struct dbxIndex *idx, const char *listFile);
+
+/*
+ *called from main()
+ *checks whether binaries or digests are revoked by the current dbx
+ *@param argc, number of argument
+ *@param arv, array of params
+ *@return SUCCESS if every query could be checked, err number otherwise
+ */
+int performLookupCommand(int argc, char* argv[])
+{
+	int rc, failed = 0;
+	char *dbx = NULL;
+	size_t dbxSize = 0;
+	clock_t start;
+	double seconds;
+	struct dbxIndex idx;
+	struct lookupArguments args = {
+		.helpFlag = 0, .bloom = 0, .queryCount = 0,
+		.pathToSecVars = NULL, .eslFile = NULL, .listFile = NULL, .queries = NULL
+	};
+
+	memset(&idx, 0, sizeof(idx));
+
+	rc = parseArgs(argc, argv, &args);
+	if (rc || args.helpFlag)
+		goto out;
+
+	if (!args.queryCount && !args.listFile) {
+		prlog(PR_ERR, "ERROR: No files or hashes to look up\n");
+		usage();
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+
+	rc = getDBX(&args, &dbx, &dbxSize);
+	if (rc)
+		goto out;
+	rc = buildIndex(&idx, (unsigned char *)dbx, dbxSize, args.bloom);
+	if (rc)
+		goto out;
+	if (!idx.entries)
+		prlog(PR_WARNING, "WARNING: dbx does not contain any hashes, nothing is revoked\n");
+
+	start = clock();
+	for (int i = 0; i < args.queryCount; i++) {
+		if (args.queries[i].isHash)
+			rc = lookupHash(&idx, args.queries[i].value);
+		else
+			rc = lookupFile(&idx, args.queries[i].value);
+		if (rc)
+			failed++;
+	}
+	if (args.listFile && lookupList(&idx, args.listFile))
+		failed++;
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("Checked %zd queries against %zd dbx hashes: %zd revoked\n", idx.queries, idx.entries, idx.revoked);
+	if (seconds > 0)
+		prlog(PR_NOTICE, "Lookups took %.3f seconds, %.0f queries per second\n", seconds, idx.queries / seconds);
+	rc = failed ? INVALID_FILE : SUCCESS;
+
+out:
+	freeIndex(&idx);
+	if (dbx)
+		free(dbx);
+	if (args.queries)
+		free(args.queries);
+
+	return rc;
+}
+
+static void usage()
+{
+	printf("USAGE:\n\t $ secvarctl lookup [OPTIONS] {-f <file> | -h <hash>}..."
+		"\n\tOPTIONS:"
+		"\n\t\t--help/--usage"
+		"\n\t\t-v\t\tverbose, print process info"
+		"\n\t\t-p <path>\tlooks for dbx in path, default is " );
+	printf("%s", secvarctl_backend ? secvarctl_backend->default_secvar_path : "the backend's var path");
+	printf("\n\t\t-e <eslFile>\tuse the ESL's in <eslFile> as dbx instead"
+		"\n\t\t-f <file>\thash <file> and look up its digest"
+		"\n\t\t-h <hash>\tlook up a hex encoded digest"
+		"\n\t\t-l <listFile>\tlook up every line of <listFile>, each a file or a hex digest"
+		"\n\t\t-b\t\tbuild a bloom filter to answer most negative queries faster\n");
+}
+
+static void help()
+{
+	printf("HELP:\n\t"
+		"The purpose of this command is to find out if binaries or digests are revoked\n\t"
+		"by the dbx. The dbx is read once and its hashes are indexed by hash type, then\n\t"
+		"every file is hashed with each hash type present in the dbx and every digest is\n\t"
+		"checked against the entries of the same length. One line is printed per query.\n\t"
+		"Digests may separate bytes with '/' or ':', so the output of 'read' can be used.\n\t"
+		"NOTE: files are hashed as a whole, no signature or image format is parsed\n");
+	usage();
+}
+
+/**
+ *@param argv , array of command line arguments
+ *@param argc, length of argv
+ *@param args, struct that will be filled with data from argv
+ *@return success or errno
+ */
+static int parseArgs(int argc, char *argv[], struct lookupArguments *args)
+{
+	int rc = SUCCESS;
+
+	args->queries = calloc(argc ? argc : 1, sizeof(*args->queries));
+	if (!args->queries) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (int i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "--usage")) {
+			usage();
+			args->helpFlag = 1;
+			goto out;
+		}
+		else if (!strcmp(argv[i], "--help")) {
+			help();
+			args->helpFlag = 1;
+			goto out;
+		}
+		if (argv[i][0] != '-' || strlen(argv[i]) != 2) {
+			prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		switch (argv[i][1]) {
+			case 'v':
+				verbose = PR_DEBUG;
+				break;
+			case 'b':
+				args->bloom = 1;
+				break;
+			case 'p':
+			case 'e':
+			case 'f':
+			case 'h':
+			case 'l':
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '%s', see usage...\n", argv[i]);
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				if (argv[i - 1][1] == 'p')
+					args->pathToSecVars = argv[i];
+				else if (argv[i - 1][1] == 'e')
+					args->eslFile = argv[i];
+				else if (argv[i - 1][1] == 'l')
+					args->listFile = argv[i];
+				else {
+					args->queries[args->queryCount].isHash = argv[i - 1][1] == 'h';
+					args->queries[args->queryCount++].value = argv[i];
+				}
+				break;
+			default:
+				prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+				rc = ARG_PARSE_FAIL;
+				goto out;
+		}
+	}
+
+out:
+	if (rc) {
+		prlog(PR_ERR, "Failed during argument parsing\n");
+		usage();
+	}
+
+	return rc;
+}
+
+/**
+ *reads the dbx from an ESL file or from the variables of the current backend
+ *@param args, parsed arguments
+ *@param data, filled with allocated dbx data
+ *@param size, filled with length of data
+ *@return SUCCESS or error number
+ */
+static int getDBX(const struct lookupArguments *args, char **data, size_t *size)
+{
+	if (args->eslFile) {
+		*data = getDataFromFile(args->eslFile, size);
+		if (!*data) {
+			prlog(PR_ERR, "ERROR: Could not read dbx from %s\n", args->eslFile);
+			return INVALID_FILE;
+		}
+		return SUCCESS;
+	}
+
+	return getSecVarData(args->pathToSecVars, "dbx", data, size);
+}
+
+static size_t sortSize;
+
+static int compareDigests(const void *a, const void *b)
+{
+	return memcmp(a, b, sortSize);
+}
+
+static uint64_t bloomWord(const unsigned char *digest, int word)
+{
+	uint64_t ret;
+
+	// digests are uniformly distributed already, so their bytes can be used as hashes
+	memcpy(&ret, digest + word * sizeof(ret), sizeof(ret));
+
+	return ret;
+}
+
+/**
+ *sorts the digests of a partition, drops duplicates and builds its bloom filter
+ *@param part, partition with all digests added
+ *@param bloom, 1 to build a bloom filter
+ *@return SUCCESS or ALLOC_FAIL
+ */
+static int finishPartition(struct dbxPartition *part, int bloom)
+{
+	size_t size = part->hash->size, kept = 0, bits = 64;
+	uint64_t h1, h2;
+
+	sortSize = size;
+	qsort(part->digests, part->count, size, compareDigests);
+	for (size_t i = 0; i < part->count; i++) {
+		if (kept && !memcmp(part->digests + (kept - 1) * size, part->digests + i * size, size))
+			continue;
+		memmove(part->digests + kept * size, part->digests + i * size, size);
+		kept++;
+	}
+	part->count = kept;
+
+	if (!bloom)
+		return SUCCESS;
+	while (bits < part->count * BLOOM_BITS_PER_ENTRY)
+		bits <<= 1;
+	part->bloom = calloc(bits / 64, sizeof(uint64_t));
+	if (!part->bloom) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	part->bloomMask = bits - 1;
+	for (size_t i = 0; i < part->count; i++) {
+		h1 = bloomWord(part->digests + i * size, 0);
+		h2 = bloomWord(part->digests + i * size, 1) | 1;
+		for (int k = 0; k < BLOOM_PROBES; k++, h1 += h2)
+			part->bloom[(h1 & part->bloomMask) / 64] |= 1ULL << (h1 % 64);
+	}
+
+	return SUCCESS;
+}
+
+/**
+ *indexes every hash in a buffer of appended ESL's by hash type in one pass,
+ *certificates and unknown signature types are skipped
+ *@param idx, index to fill, free with freeIndex
+ *@param esl, buffer of ESL's
+ *@param size, length of esl
+ *@param bloom, 1 to build bloom filters
+ *@return SUCCESS or error number
+ */
+static int buildIndex(struct dbxIndex *idx, const unsigned char *esl, size_t size, int bloom)
+{
+	int rc;
+	size_t offset = 0, dataSize, count, hashSize;
+	const unsigned char *sig;
+	EFI_SIGNATURE_LIST *sigList;
+	struct dbxPartition *part;
+	unsigned char *tmp;
+
+	for (int i = 0; i < HASH_FUNCTION_COUNT; i++)
+		idx->parts[i].hash = &hash_functions[i];
+
+	while (size - offset >= sizeof(EFI_SIGNATURE_LIST)) {
+		sigList = (EFI_SIGNATURE_LIST *)(esl + offset);
+		if (sigList->SignatureListSize > size - offset || !sigList->SignatureSize
+			|| sigList->SignatureListSize < sizeof(EFI_SIGNATURE_LIST) + sigList->SignatureHeaderSize) {
+			prlog(PR_ERR, "ERROR: dbx ESL at offset %zd is malformed\n", offset);
+			return ESL_FAIL;
+		}
+		dataSize = sigList->SignatureListSize - sizeof(EFI_SIGNATURE_LIST) - sigList->SignatureHeaderSize;
+		count = dataSize / sigList->SignatureSize;
+		sig = esl + offset + sizeof(EFI_SIGNATURE_LIST) + sigList->SignatureHeaderSize;
+		offset += sigList->SignatureListSize;
+
+		part = NULL;
+		for (int i = 0; i < HASH_FUNCTION_COUNT; i++) {
+			if (uuid_equals(&sigList->SignatureType, hash_functions[i].guid))
+				part = &idx->parts[i];
+		}
+		hashSize = part ? part->hash->size : 0;
+		// every signature is an owner guid followed by the data
+		if (!part || sigList->SignatureSize != sizeof(uuid_t) + hashSize) {
+			prlog(PR_INFO, "Skipping %zd dbx entries of type %s\n", count, getSigType(sigList->SignatureType));
+			idx->skipped += count;
+			continue;
+		}
+		if (part->count + count > part->capacity) {
+			tmp = realloc(part->digests, (part->count + count) * hashSize);
+			if (!tmp) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				return ALLOC_FAIL;
+			}
+			part->digests = tmp;
+			part->capacity = part->count + count;
+		}
+		for (size_t i = 0; i < count; i++, sig += sigList->SignatureSize)
+			memcpy(part->digests + (part->count++) * hashSize, sig + sizeof(uuid_t), hashSize);
+	}
+	if (offset != size)
+		prlog(PR_WARNING, "WARNING: %zd bytes at the end of dbx are not an ESL, ignoring them\n", size - offset);
+
+	for (int i = 0; i < HASH_FUNCTION_COUNT; i++) {
+		if (!idx->parts[i].count)
+			continue;
+		rc = finishPartition(&idx->parts[i], bloom);
+		if (rc)
+			return rc;
+		prlog(PR_NOTICE, "Indexed %zd unique %s dbx hashes\n", idx->parts[i].count, hash_functions[i].name);
+		idx->entries += idx->parts[i].count;
+	}
+
+	return SUCCESS;
+}
+
+static void freeIndex(struct dbxIndex *idx)
+{
+	for (int i = 0; i < HASH_FUNCTION_COUNT; i++) {
+		if (idx->parts[i].digests)
+			free(idx->parts[i].digests);
+		if (idx->parts[i].bloom)
+			free(idx->parts[i].bloom);
+	}
+	memset(idx, 0, sizeof(*idx));
+}
+
+/**
+ *@param part, finished partition
+ *@param digest, digest of part->hash->size bytes
+ *@return 1 if digest is in the partition, 0 otherwise
+ */
+static int indexContains(const struct dbxPartition *part, const unsigned char *digest)
+{
+	size_t low = 0, high = part->count, mid, size = part->hash->size;
+	uint64_t h1, h2;
+	int cmp;
+
+	if (!part->count)
+		return 0;
+	if (part->bloom) {
+		h1 = bloomWord(digest, 0);
+		h2 = bloomWord(digest, 1) | 1;
+		for (int k = 0; k < BLOOM_PROBES; k++, h1 += h2) {
+			if (!(part->bloom[(h1 & part->bloomMask) / 64] & (1ULL << (h1 % 64))))
+				return 0;
+		}
+	}
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		cmp = memcmp(digest, part->digests + mid * size, size);
+		if (!cmp)
+			return 1;
+		if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	return 0;
+}
+
+static void printResult(struct dbxIndex *idx, const char *query, const struct hash_funct *revokedBy)
+{
+	idx->queries++;
+	if (revokedBy) {
+		idx->revoked++;
+		printf("%s: REVOKED (%s)\n", query, revokedBy->name);
+	}
+	else
+		printf("%s: not revoked\n", query);
+}
+
+/**
+ *decodes a hex digest, bytes may be separated by '/' or ':'
+ *@param hex, string to decode
+ *@param out, buffer of LOOKUP_MAX_DIGEST bytes
+ *@return number of bytes decoded or -1 if hex is not a digest
+ */
+static int decodeHex(const char *hex, unsigned char *out)
+{
+	int len = 0;
+	unsigned int byte;
+
+	while (*hex) {
+		if (*hex == '/' || *hex == ':') {
+			hex++;
+			continue;
+		}
+		if (!isxdigit((unsigned char)hex[0]) || !isxdigit((unsigned char)hex[1]) || len >= LOOKUP_MAX_DIGEST)
+			return -1;
+		if (sscanf(hex, "%2x", &byte) != 1)
+			return -1;
+		out[len++] = byte;
+		hex += 2;
+	}
+
+	return len;
+}
+
+/**
+ *looks up a hex encoded digest, the hash type is taken from its length
+ *@param idx, dbx index
+ *@param hex, digest
+ *@return SUCCESS or ARG_PARSE_FAIL if hex is not a digest
+ */
+static int lookupHash(struct dbxIndex *idx, const char *hex)
+{
+	unsigned char digest[LOOKUP_MAX_DIGEST];
+	int len;
+
+	len = decodeHex(hex, digest);
+	for (int i = 0; len > 0 && i < HASH_FUNCTION_COUNT; i++) {
+		if (hash_functions[i].size != len)
+			continue;
+		printResult(idx, hex, indexContains(&idx->parts[i], digest) ? &hash_functions[i] : NULL);
+		return SUCCESS;
+	}
+	prlog(PR_ERR, "ERROR: %s is not a SHA1, SHA224, SHA256, SHA384 or SHA512 digest\n", hex);
+
+	return ARG_PARSE_FAIL;
+}
+
+/**
+ *hashes a file in chunks with every hash type the dbx has entries for and
+ *looks up each digest
+ *@param idx, dbx index
+ *@param file, path to file
+ *@return SUCCESS or error number
+ */
+static int lookupFile(struct dbxIndex *idx, const char *file)
+{
+	int rc = SUCCESS;
+	FILE *fp;
+	size_t len;
+	unsigned char *buf = NULL, digest[LOOKUP_MAX_DIGEST];
+	const struct hash_funct *revokedBy = NULL;
+	struct cryptoHashCtx *ctx[HASH_FUNCTION_COUNT] = { NULL };
+
+	fp = fopen(file, "rb");
+	if (!fp) {
+		prlog(PR_ERR, "ERROR: Could not open %s: %s\n", file, strerror(errno));
+		return INVALID_FILE;
+	}
+	buf = malloc(LOOKUP_READ_CHUNK);
+	if (!buf) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	for (int i = 0; i < HASH_FUNCTION_COUNT; i++) {
+		if (idx->parts[i].count && cryptoHashInit(&ctx[i], hash_functions[i].mbedtls_funct)) {
+			rc = HASH_FAIL;
+			goto out;
+		}
+	}
+	while ((len = fread(buf, 1, LOOKUP_READ_CHUNK, fp)) > 0) {
+		for (int i = 0; i < HASH_FUNCTION_COUNT; i++) {
+			if (idx->parts[i].count && cryptoHashUpdate(ctx[i], buf, len)) {
+				rc = HASH_FAIL;
+				goto out;
+			}
+		}
+	}
+	if (ferror(fp)) {
+		prlog(PR_ERR, "ERROR: Could not read %s\n", file);
+		rc = INVALID_FILE;
+		goto out;
+	}
+	for (int i = 0; i < HASH_FUNCTION_COUNT && !revokedBy; i++) {
+		if (!idx->parts[i].count)
+			continue;
+		if (cryptoHashFinish(ctx[i], digest)) {
+			rc = HASH_FAIL;
+			goto out;
+		}
+		if (indexContains(&idx->parts[i], digest))
+			revokedBy = &hash_functions[i];
+	}
+	printResult(idx, file, revokedBy);
+
+out:
+	if (rc == HASH_FAIL)
+		prlog(PR_ERR, "ERROR: Failed to hash %s\n", file);
+	for (int i = 0; i < HASH_FUNCTION_COUNT; i++)
+		cryptoHashFree(ctx[i]);
+	if (buf)
+		free(buf);
+	fclose(fp);
+
+	return rc;
+}
+
+/**
+ *looks up every line of a file, lines naming an existing file are hashed,
+ *other lines are treated as hex digests. Empty lines and lines starting with '#' are skipped
+ *@param idx, dbx index
+ *@param listFile, path to list
+ *@return SUCCESS if every line could be looked up, error number otherwise
+ */
+static int lookupList(struct dbxIndex *idx, const char *listFile)
+{
+	int rc = SUCCESS;
+	FILE *fp;
+	char *line = NULL, *start;
+	size_t lineSize = 0;
+	ssize_t len;
+
+	fp = fopen(listFile, "r");
+	if (!fp) {
+		prlog(PR_ERR, "ERROR: Could not open %s: %s\n", listFile, strerror(errno));
+		return INVALID_FILE;
+	}
+	while ((len = getline(&line, &lineSize, fp)) >= 0) {
+		while (len > 0 && isspace((unsigned char)line[len - 1]))
+			line[--len] = '\0';
+		for (start = line; isspace((unsigned char)*start); start++)
+			;
+		if (!*start || *start == '#')
+			continue;
+		if (!isFile(start)) {
+			if (lookupFile(idx, start))
+				rc = INVALID_FILE;
+		}
+		else if (lookupHash(idx, start))
+			rc = INVALID_FILE;
+	}
+	if (line)
+		free(line);
+	fclose(fp);
+
+	return rc;
+}
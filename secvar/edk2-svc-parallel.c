@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h> // for sysconf
+#include <pthread.h>
+#include "secvar/include/edk2-svc.h"// import last!!
+
+#define ESL_MAX_THREADS 256
+// fewer signature lists than this are not worth starting threads for
+#define ESL_PARALLEL_MIN 4
+
+// number of threads that process the signature lists of one variable, 0 for the number of online CPUs
+int eslThreads;
+
+struct eslJobContext {
+	struct eslJob *jobs;
+	size_t count, next, failed;
+	eslJobFunc func;
+	void *data;
+	pthread_mutex_t lock;
+};
+
+static void *eslWorker(void *arg);
+
+/**
+ *finds where the signature lists of ESL data start by only reading the list headers,
+ *nothing is validated so the last job may hold a list that is broken or too short,
+ *whatever processes the jobs reports that like it would in a serial walk
+ *@param esl, ESL data, could be appended ESL's
+ *@param size, length of esl
+ *@param jobs, filled with one job per signature list, NOTE: REMEMBER TO freeESLJobs
+ *@param count, filled with the number of jobs
+ *@return SUCCESS or ALLOC_FAIL
+ */
+int splitESL(const unsigned char *esl, size_t size, struct eslJob **jobs, size_t *count)
+{
+	size_t offset = 0, allocated = 0, listSize;
+	struct eslJob *tmp;
+
+	*jobs = NULL;
+	*count = 0;
+	while (offset < size) {
+		if (*count == allocated) {
+			tmp = realloc(*jobs, sizeof(*tmp) * (allocated * 2 + 16));
+			if (!tmp) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				freeESLJobs(*jobs, *count);
+				*jobs = NULL;
+				*count = 0;
+				return ALLOC_FAIL;
+			}
+			*jobs = tmp;
+			allocated = allocated * 2 + 16;
+		}
+		memset(&(*jobs)[*count], 0, sizeof(**jobs));
+		(*jobs)[*count].esl = esl + offset;
+		(*jobs)[*count].remaining = size - offset;
+		(*count)++;
+		if (size - offset < sizeof(EFI_SIGNATURE_LIST))
+			break;
+		listSize = ((const EFI_SIGNATURE_LIST *)(esl + offset))->SignatureListSize;
+		// a walk would stop here, after processing this list
+		if (listSize == 0 || listSize > size - offset)
+			break;
+		offset += listSize;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ *runs func on every job, on eslThreads workers if there are enough jobs,
+ *func sees the job's place in the variable so results can be stored by index,
+ *everything func prints is held in job->output, print it with capturePrint in
+ *job order to get the output of a serial walk. Like a serial walk nothing after
+ *the first failing job is needed, jobs past it may not be run
+ *@param jobs, from splitESL
+ *@param count, number of jobs
+ *@param func, processes one signature list, returns SUCCESS or an error number
+ *@param data, passed to func
+ */
+void runESLJobs(struct eslJob *jobs, size_t count, eslJobFunc func, void *data)
+{
+	struct eslJobContext ctx;
+	pthread_t *workers = NULL;
+	int threads = eslThreads, created = 0;
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > ESL_MAX_THREADS)
+		threads = ESL_MAX_THREADS;
+	if (threads > count)
+		threads = count;
+	// small variables are walked here, printing as they go
+	if (threads <= 1 || count < ESL_PARALLEL_MIN) {
+		for (size_t i = 0; i < count; i++) {
+			jobs[i].rc = func(&jobs[i], i, data);
+			if (jobs[i].rc)
+				break;
+		}
+		return;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.jobs = jobs;
+	ctx.count = count;
+	ctx.failed = count;
+	ctx.func = func;
+	ctx.data = data;
+	pthread_mutex_init(&ctx.lock, NULL);
+	workers = malloc(sizeof(*workers) * threads);
+	for (; workers && created < threads; created++) {
+		if (pthread_create(&workers[created], NULL, eslWorker, &ctx)) {
+			prlog(PR_WARNING, "WARNING: Could only start %d of %d worker threads\n", created, threads);
+			break;
+		}
+	}
+	// if no workers could be started then do the work here
+	if (!created)
+		eslWorker(&ctx);
+	for (int i = 0; i < created; i++)
+		pthread_join(workers[i], NULL);
+	if (workers)
+		free(workers);
+	pthread_mutex_destroy(&ctx.lock);
+}
+
+/*
+ *worker thread, takes jobs in order until there are none left or every
+ *remaining job comes after one that failed
+ *@param arg, pointer to the shared job context
+ */
+static void *eslWorker(void *arg)
+{
+	struct eslJobContext *ctx = arg;
+	struct eslJob *job;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&ctx->lock);
+		i = ctx->next++;
+		if (i > ctx->failed)
+			i = ctx->count;
+		pthread_mutex_unlock(&ctx->lock);
+		if (i >= ctx->count)
+			break;
+		job = &ctx->jobs[i];
+		captureStart();
+		job->rc = ctx->func(job, i, ctx->data);
+		job->output = captureStop();
+		if (job->rc) {
+			pthread_mutex_lock(&ctx->lock);
+			if (i < ctx->failed)
+				ctx->failed = i;
+			pthread_mutex_unlock(&ctx->lock);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ *frees jobs and any output that was not printed
+ *@param jobs, from splitESL
+ *@param count, number of jobs
+ */
+void freeESLJobs(struct eslJob *jobs, size_t count)
+{
+	if (!jobs)
+		return;
+	for (size_t i = 0; i < count; i++)
+		captureFree(jobs[i].output);
+	free(jobs);
+}
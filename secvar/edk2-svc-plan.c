@@ -0,0 +1,532 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef NO_CRYPTO
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h> // for mkdir
+#include <mbedtls/x509_crt.h> // for signer certificates
+#include "backends/include/backends.h"
+#include "secvar/include/edk2-svc.h"// import last!!
+
+// the variables a plan can change, in the order they are preferred to be updated in
+#define PLAN_VAR_COUNT 4
+static const char *planOrder[PLAN_VAR_COUNT] = { "dbx", "db", "KEK", "PK" };
+
+struct planSigner {
+	const char *keyFile, *certFile;
+	mbedtls_x509_crt cert;
+};
+
+struct planArguments {
+	int helpFlag, signKeyCount, signCertCount;
+	const char *pathToSecVars, *outDir;
+	const char *desiredFiles[PLAN_VAR_COUNT];
+	const char **signKeys, **signCerts;
+};
+
+/*
+ *one variable of the keystore, current is what the update is planned against
+ */
+struct planVar {
+	const char *name;
+	unsigned char *current, *desired, *delta;
+	size_t currentSize, desiredSize, deltaSize;
+	// change is 1 if an update is needed, append 1 if it only adds delta
+	int change, append, removals, scheduled;
+	struct planSigner *signer;
+	char *authFile;
+	size_t authSize;
+};
+
+static void usage();
+static void help();
+static int parseArgs(int argc, char *argv[], struct planArguments *args);
+static int planVariable(struct planVar *var, int appendOnly);
+static int scheduleUpdates(struct planVar *vars, struct planSigner *signers, int signerCount, struct planVar **order, int *updateCount);
+static int writeUpdates(struct planVar **order, int updateCount, const char *outDir);
+static int dryRun(struct planVar **order, int updateCount, const char *path);
+
+/*
+ *called from main()
+ *plans and signs the updates that take the current variables to the desired ones
+ *@param argc, number of argument
+ *@param arv, array of params
+ *@return SUCCESS or err number
+ */
+int performPlanCommand(int argc, char* argv[])
+{
+	int rc, signerCount = 0, updateCount = 0, appendOnly;
+	size_t written = 0, replaced = 0, certSize = 0;
+	unsigned char *certBuf = NULL;
+	struct planVar vars[PLAN_VAR_COUNT], *order[PLAN_VAR_COUNT];
+	struct planSigner *signers = NULL;
+	struct planArguments args = {
+		.helpFlag = 0, .signKeyCount = 0, .signCertCount = 0,
+		.pathToSecVars = NULL, .outDir = NULL, .signKeys = NULL, .signCerts = NULL
+	};
+
+	memset(vars, 0, sizeof(vars));
+	memset(args.desiredFiles, 0, sizeof(args.desiredFiles));
+	rc = parseArgs(argc, argv, &args);
+	if (rc || args.helpFlag)
+		goto out;
+
+	if (!args.outDir) {
+		prlog(PR_ERR, "ERROR: No output directory given, use '-o <outDir>'\n");
+		usage();
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (!args.signKeyCount || args.signCertCount != args.signKeyCount) {
+		prlog(PR_ERR, "ERROR: Every signer needs a '-k <keyFile>' and '-c <crtFile>', %d != %d\n", args.signKeyCount, args.signCertCount);
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (!args.pathToSecVars)
+		args.pathToSecVars = secvarctl_backend->default_secvar_path;
+	// backends that sign every write as an append can never remove an entry
+	appendOnly = (secvarctl_backend->default_attributes & EFI_VARIABLE_APPEND_WRITE) != 0;
+
+	signers = calloc(args.signKeyCount, sizeof(*signers));
+	if (!signers) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	for (; signerCount < args.signKeyCount; signerCount++) {
+		signers[signerCount].keyFile = args.signKeys[signerCount];
+		signers[signerCount].certFile = args.signCerts[signerCount];
+		mbedtls_x509_crt_init(&signers[signerCount].cert);
+		certBuf = (unsigned char *)getDataFromFile(args.signCerts[signerCount], &certSize);
+		if (!certBuf || parseX509(&signers[signerCount].cert, certBuf, certSize)) {
+			prlog(PR_ERR, "ERROR: Could not parse certificate %s\n", args.signCerts[signerCount]);
+			signerCount++;
+			rc = CERT_FAIL;
+			goto out;
+		}
+		free(certBuf);
+		certBuf = NULL;
+	}
+
+	for (int i = 0; i < PLAN_VAR_COUNT; i++) {
+		vars[i].name = planOrder[i];
+		rc = getSecVarData(args.pathToSecVars, vars[i].name, (char **)&vars[i].current, &vars[i].currentSize);
+		if (rc)
+			goto out;
+		if (!args.desiredFiles[i])
+			continue;
+		vars[i].desired = (unsigned char *)getDataFromFile(args.desiredFiles[i], &vars[i].desiredSize);
+		if (!vars[i].desired) {
+			prlog(PR_ERR, "ERROR: Could not read desired %s from %s\n", vars[i].name, args.desiredFiles[i]);
+			rc = INVALID_FILE;
+			goto out;
+		}
+		rc = validateESL(vars[i].desired, vars[i].desiredSize, vars[i].name);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Desired %s in %s is not a valid ESL\n", vars[i].name, args.desiredFiles[i]);
+			goto out;
+		}
+		rc = planVariable(&vars[i], appendOnly);
+		if (rc)
+			goto out;
+	}
+
+	rc = scheduleUpdates(vars, signers, signerCount, order, &updateCount);
+	if (rc)
+		goto out;
+	if (!updateCount) {
+		printf("Current variables in %s already match, nothing to do\n", args.pathToSecVars);
+		goto out;
+	}
+	rc = writeUpdates(order, updateCount, args.outDir);
+	if (rc)
+		goto out;
+
+	for (int i = 0; i < updateCount; i++) {
+		printf("%d: %s %s, %zd ESL bytes", i + 1, order[i]->name, order[i]->append ? "append" : "replace",
+		       order[i]->append ? order[i]->deltaSize : order[i]->desiredSize);
+		if (order[i]->append)
+			printf(" (replace would be %zd)", order[i]->desiredSize);
+		printf(", signed by %s -> %s\n", order[i]->signer->certFile, order[i]->authFile);
+		written += order[i]->authSize;
+		replaced += order[i]->desiredSize;
+	}
+	printf("%d updates, %zd bytes of auth files, %zd ESL bytes if every variable was replaced\n", updateCount, written, replaced);
+
+	rc = dryRun(order, updateCount, args.pathToSecVars);
+
+out:
+	for (int i = 0; i < PLAN_VAR_COUNT; i++) {
+		if (vars[i].current)
+			free(vars[i].current);
+		if (vars[i].desired)
+			free(vars[i].desired);
+		if (vars[i].delta)
+			free(vars[i].delta);
+		if (vars[i].authFile)
+			free(vars[i].authFile);
+	}
+	for (int i = 0; i < signerCount; i++)
+		mbedtls_x509_crt_free(&signers[i].cert);
+	if (signers)
+		free(signers);
+	if (certBuf)
+		free(certBuf);
+	if (args.signKeys)
+		free(args.signKeys);
+	if (args.signCerts)
+		free(args.signCerts);
+	if (!args.helpFlag)
+		printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
+
+	return rc;
+}
+
+static void usage()
+{
+	printf("USAGE:\n\t $ secvarctl plan [OPTIONS] -d <varName> <eslFile>... -k <keyFile> -c <crtFile>... -o <outDir>"
+		"\n\tOPTIONS:"
+		"\n\t\t--help/--usage"
+		"\n\t\t-v\t\tverbose, print process info"
+		"\n\t\t-p <path>\tcurrent variables are in path, default is ");
+	printf("%s", secvarctl_backend ? secvarctl_backend->default_secvar_path : "the backend's var path");
+	printf("\n\t\t-d <varName> <eslFile>\tdesired contents of <varName>, one of {'PK','KEK','db','dbx'},"
+		"\n\t\t\t\tvariables that are not given are left as they are"
+		"\n\t\t-k <keyFile>\tprivate RSA key (PEM) of a signer, must have a corresponding '-c <crtFile>'"
+		"\n\t\t-c <crtFile>\tx509 certificate of a signer, give every key that may be needed"
+		"\n\t\t-o <outDir>\tdirectory the numbered auth files are written to\n");
+}
+
+static void help()
+{
+	printf("HELP:\n\t"
+		"The purpose of this command is to reconcile a keystore with its desired state.\n\t"
+		"Each desired variable is compared to the current one. If entries are only added\n\t"
+		"and the variable is not the PK, an append update with just the new entries is\n\t"
+		"signed, otherwise the whole desired ESL replaces the variable. The updates are\n\t"
+		"ordered so every one is signed by a key that has authority over its variable at\n\t"
+		"that point (PK over all, KEK over db and dbx), preferring dbx, db, KEK and then PK\n\t"
+		"so old authorities sign before they are replaced. The auth files are written as\n\t"
+		"<outDir>/<number>_<varName>.auth and all of them are then run through 'verify' as\n\t"
+		"a dry run, nothing is written to the variables. Submit them in order.\n");
+	usage();
+}
+
+/**
+ *@param argv , array of command line arguments
+ *@param argc, length of argv
+ *@param args, struct that will be filled with data from argv
+ *@return success or errno
+ */
+static int parseArgs(int argc, char *argv[], struct planArguments *args)
+{
+	int rc = SUCCESS, v;
+
+	args->signKeys = calloc(argc ? argc : 1, sizeof(*args->signKeys));
+	args->signCerts = calloc(argc ? argc : 1, sizeof(*args->signCerts));
+	if (!args->signKeys || !args->signCerts) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (int i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "--usage")) {
+			usage();
+			args->helpFlag = 1;
+			goto out;
+		}
+		else if (!strcmp(argv[i], "--help")) {
+			help();
+			args->helpFlag = 1;
+			goto out;
+		}
+		if (argv[i][0] != '-' || strlen(argv[i]) != 2) {
+			prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		switch (argv[i][1]) {
+			case 'v':
+				verbose = PR_DEBUG;
+				break;
+			case 'd':
+				if (i + 2 >= argc || argv[i + 2][0] == '-') {
+					prlog(PR_ERR, "ERROR: '-d' needs a variable name and an ESL file, see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				for (v = 0; v < PLAN_VAR_COUNT && strcmp(argv[i + 1], planOrder[v]); v++)
+					;
+				if (v == PLAN_VAR_COUNT || args->desiredFiles[v]) {
+					prlog(PR_ERR, "ERROR: %s is not a variable or was already given\n", argv[i + 1]);
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				args->desiredFiles[v] = argv[i + 2];
+				i += 2;
+				break;
+			case 'p':
+			case 'o':
+			case 'k':
+			case 'c':
+				if (i + 1 >= argc || argv[i + 1][0] == '-') {
+					prlog(PR_ERR, "ERROR: Incorrect value for '%s', see usage...\n", argv[i]);
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				if (argv[i - 1][1] == 'p')
+					args->pathToSecVars = argv[i];
+				else if (argv[i - 1][1] == 'o')
+					args->outDir = argv[i];
+				else if (argv[i - 1][1] == 'k')
+					args->signKeys[args->signKeyCount++] = argv[i];
+				else
+					args->signCerts[args->signCertCount++] = argv[i];
+				break;
+			default:
+				prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
+				rc = ARG_PARSE_FAIL;
+				goto out;
+		}
+	}
+
+out:
+	if (rc) {
+		prlog(PR_ERR, "Failed during argument parsing\n");
+		usage();
+	}
+
+	return rc;
+}
+
+/**
+ *decides between no update, an append of the new entries or a replacement
+ *@param var, variable with current and desired data
+ *@param appendOnly, 1 if the backend signs every update as an append
+ *@return SUCCESS or error number
+ */
+static int planVariable(struct planVar *var, int appendOnly)
+{
+	int rc;
+	unsigned char *removed = NULL;
+	size_t removedSize;
+
+	rc = removeESLSignatures(var->desired, var->desiredSize, var->current, var->currentSize, &var->delta, &var->deltaSize);
+	if (!rc)
+		rc = removeESLSignatures(var->current, var->currentSize, var->desired, var->desiredSize, &removed, &removedSize);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Could not compare the current and desired %s\n", var->name);
+		return rc;
+	}
+	if (removed)
+		free(removed);
+	var->removals = removedSize != 0;
+	var->change = var->deltaSize || var->removals;
+	// an append only pays off if it is smaller, it always is unless nothing is kept
+	var->append = var->change && !var->removals && strcmp(var->name, "PK") && var->deltaSize < var->desiredSize;
+	if (appendOnly && var->change && !var->append) {
+		prlog(PR_ERR, "ERROR: %s backend only appends, entries of %s can not be %s\n", secvarctl_backend->name,
+		      var->name, var->removals ? "removed" : "replaced");
+		return ARG_PARSE_FAIL;
+	}
+	prlog(PR_INFO, "%s: %zd new bytes of ESL, %s\n", var->name, var->deltaSize,
+	      var->removals ? "has removals" : "no removals");
+
+	return SUCCESS;
+}
+
+struct certSearch {
+	const mbedtls_x509_crt *cert;
+};
+
+static int matchCert(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data)
+{
+	const mbedtls_x509_crt *cert = ((struct certSearch *)data)->cert;
+
+	return sig && !memcmp(&list->SignatureType, &EFI_CERT_X509_GUID, sizeof(uuid_t))
+		&& list->SignatureSize - sizeof(uuid_t) == cert->raw.len
+		&& !memcmp(sig + sizeof(uuid_t), cert->raw.p, cert->raw.len);
+}
+
+/**
+ *@param state, contents every variable will have when the update is submitted
+ *@param var, name of variable to update
+ *@param signer, candidate signer
+ *@return 1 if the signer's certificate is in one of the authorities of var
+ */
+static int hasAuthority(unsigned char **state, size_t *stateSize, const char *var, const struct planSigner *signer)
+{
+	// same rules as get_key_authority() in edk2-compat-process.c
+	const char *authorities[2] = { "PK", strcmp(var, "db") && strcmp(var, "dbx") ? NULL : "KEK" };
+	struct certSearch search = { .cert = &signer->cert };
+	int a, v;
+
+	for (a = 0; a < 2; a++) {
+		if (!authorities[a])
+			continue;
+		for (v = 0; strcmp(planOrder[v], authorities[a]); v++)
+			;
+		if (walkESL(state[v], stateSize[v], matchCert, &search) == 1)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ *orders the needed updates so every one has an authorized signer, simulating the
+ *variables after each one
+ *@param vars, planned variables
+ *@param signers, available signers
+ *@param signerCount, number of signers
+ *@param order, filled with the updates in submission order
+ *@param updateCount, filled with number of updates
+ *@return SUCCESS or AUTH_FAIL if some update can not be signed
+ */
+static int scheduleUpdates(struct planVar *vars, struct planSigner *signers, int signerCount, struct planVar **order, int *updateCount)
+{
+	unsigned char *state[PLAN_VAR_COUNT], *grown[PLAN_VAR_COUNT] = { NULL };
+	size_t stateSize[PLAN_VAR_COUNT];
+	int pending = 0, setupMode, i, s, rc = SUCCESS;
+
+	for (i = 0; i < PLAN_VAR_COUNT; i++) {
+		state[i] = vars[i].current;
+		stateSize[i] = vars[i].currentSize;
+		pending += vars[i].change;
+	}
+	// the verify emulation decides on setup mode once, before the first update
+	setupMode = vars[PLAN_VAR_COUNT - 1].currentSize == 0;
+	*updateCount = 0;
+	while (pending) {
+		for (i = 0; i < PLAN_VAR_COUNT; i++) {
+			if (!vars[i].change || vars[i].scheduled)
+				continue;
+			for (s = 0; s < signerCount; s++) {
+				if (setupMode || hasAuthority(state, stateSize, vars[i].name, &signers[s]))
+					break;
+			}
+			if (s < signerCount)
+				break;
+		}
+		if (i == PLAN_VAR_COUNT) {
+			for (i = 0; i < PLAN_VAR_COUNT; i++) {
+				if (vars[i].change && !vars[i].scheduled)
+					prlog(PR_ERR, "ERROR: No signer has authority over %s, give a key of %s\n", vars[i].name,
+					      strcmp(vars[i].name, "db") && strcmp(vars[i].name, "dbx") ? "the PK" : "the KEK or PK");
+			}
+			rc = AUTH_FAIL;
+			goto out;
+		}
+		vars[i].scheduled = 1;
+		vars[i].signer = &signers[s];
+		order[(*updateCount)++] = &vars[i];
+		pending--;
+		if (!vars[i].append) {
+			state[i] = vars[i].desired;
+			stateSize[i] = vars[i].desiredSize;
+			continue;
+		}
+		// after an append the variable holds the old entries and the new ones
+		grown[i] = malloc(stateSize[i] + vars[i].deltaSize + 1);
+		if (!grown[i]) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		memcpy(grown[i], state[i], stateSize[i]);
+		memcpy(grown[i] + stateSize[i], vars[i].delta, vars[i].deltaSize);
+		state[i] = grown[i];
+		stateSize[i] += vars[i].deltaSize;
+	}
+
+out:
+	for (i = 0; i < PLAN_VAR_COUNT; i++) {
+		if (grown[i])
+			free(grown[i]);
+	}
+
+	return rc;
+}
+
+/**
+ *signs every update and writes it to <outDir>/<number>_<varName>.auth
+ *@param order, updates in submission order
+ *@param updateCount, number of updates
+ *@param outDir, output directory, created if missing
+ *@return SUCCESS or error number
+ */
+static int writeUpdates(struct planVar **order, int updateCount, const char *outDir)
+{
+	int rc = SUCCESS;
+	unsigned char *auth = NULL;
+	struct planVar *var;
+
+	if (mkdir(outDir, 0755) && errno != EEXIST) {
+		prlog(PR_ERR, "ERROR: Could not create %s: %s\n", outDir, strerror(errno));
+		return INVALID_FILE;
+	}
+	// the updates are synced together once all are signed
+	outputBatchStart();
+	for (int i = 0; i < updateCount; i++) {
+		var = order[i];
+		var->authFile = malloc(strlen(outDir) + strlen(var->name) + 16);
+		if (!var->authFile) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			break;
+		}
+		sprintf(var->authFile, "%s/%d_%s.auth", outDir, i + 1, var->name);
+		rc = generateAuthFromESL(var->append ? var->delta : var->desired, var->append ? var->deltaSize : var->desiredSize,
+					 var->name, &var->signer->keyFile, &var->signer->certFile, 1, var->append,
+					 &auth, &var->authSize);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Failed to sign the update for %s\n", var->name);
+			break;
+		}
+		rc = createFile(var->authFile, (char *)auth, var->authSize);
+		free(auth);
+		auth = NULL;
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not write %s\n", var->authFile);
+			break;
+		}
+	}
+	if (outputBatchFinish() && !rc)
+		rc = FILE_WRITE_FAIL;
+
+	return rc;
+}
+
+/**
+ *checks the written updates against the current variables with the backend's
+ *verify, nothing is written to the variables
+ *@param order, updates in submission order
+ *@param updateCount, number of updates
+ *@param path, path to current variables
+ *@return SUCCESS or error number
+ */
+static int dryRun(struct planVar **order, int updateCount, const char *path)
+{
+	int rc, appendFlags[PLAN_VAR_COUNT];
+	const char *updateVars[PLAN_VAR_COUNT * 2];
+
+	if (!secvarctl_backend->verify) {
+		prlog(PR_WARNING, "WARNING: %s backend can not verify updates, dry run skipped\n", secvarctl_backend->name);
+		return SUCCESS;
+	}
+	for (int i = 0; i < updateCount; i++) {
+		updateVars[i * 2] = order[i]->name;
+		updateVars[i * 2 + 1] = order[i]->authFile;
+		appendFlags[i] = order[i]->append;
+	}
+	rc = secvarctl_backend->verify(NULL, 0, updateVars, updateCount * 2, path, 0, appendFlags, NULL);
+	if (rc)
+		prlog(PR_ERR, "ERROR: The planned updates failed the dry run against %s\n", path);
+	else
+		printf("Dry run: every update verified against %s\n", path);
+
+	return rc;
+}
+#endif
@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h> // bundles are read from a mapping
+#include "external/skiboot/include/endian.h"
+#include "secvar/include/edk2-svc.h"// import last!!
+
+/*
+ *An update bundle carries the auth files of several variable updates, e.g. a
+ *whole PK, KEK, db and dbx rotation, in one file that is read with one mapping.
+ *File format, all numbers little endian:
+ *	header	UPDATE_BUNDLE_MAGIC, le32 version, le32 count
+ *	index	count entries of: char name[8], le32 flags, le32 reserved, le64 offset, le64 size
+ *	data	the auths, in index order and without gaps or overlaps
+ *Entries are applied in index order, flags may hold UPDATE_BUNDLE_APPEND.
+ */
+#define UPDATE_BUNDLE_MAGIC "SVBUNDLE"
+#define UPDATE_BUNDLE_VERSION 1
+#define UPDATE_BUNDLE_HEADER_SIZE 16
+#define UPDATE_BUNDLE_ENTRY_SIZE 32
+
+struct bundleHeader {
+	char magic[8];
+	le32 version;
+	le32 count;
+};
+
+struct bundleIndexEntry {
+	char name[UPDATE_BUNDLE_NAME_SIZE];
+	le32 flags;
+	le32 reserved;
+	le64 offset;
+	le64 size;
+};
+
+/**
+ *maps a bundle file and checks its index, NOTE: REMEMBER TO closeUpdateBundle
+ *the auths themselves are not validated, entries only point into the mapping
+ *@param bundle, filled with the mapping and one entry per update
+ *@param file, path to the bundle
+ *@return SUCCESS or INVALID_FILE if the file is not a well formed bundle
+ */
+int openUpdateBundle(struct updateBundle *bundle, const char *file)
+{
+	int fd, rc = INVALID_FILE;
+	struct stat fileInfo;
+	const struct bundleHeader *header;
+	const struct bundleIndexEntry *index;
+	uint64_t offset, size, end;
+	uint32_t count;
+
+	memset(bundle, 0, sizeof(*bundle));
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		prlog(PR_ERR, "ERROR: Opening %s failed: %s\n", file, strerror(errno));
+		return INVALID_FILE;
+	}
+	if (fstat(fd, &fileInfo) < 0 || !S_ISREG(fileInfo.st_mode)) {
+		prlog(PR_ERR, "ERROR: %s is not a regular file\n", file);
+		close(fd);
+		return INVALID_FILE;
+	}
+	if (fileInfo.st_size < UPDATE_BUNDLE_HEADER_SIZE) {
+		prlog(PR_ERR, "ERROR: %s is too small to be an update bundle\n", file);
+		close(fd);
+		return INVALID_FILE;
+	}
+	bundle->mapSize = fileInfo.st_size;
+	bundle->map = mmap(NULL, bundle->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (bundle->map == MAP_FAILED) {
+		prlog(PR_ERR, "ERROR: Mapping %s failed: %s\n", file, strerror(errno));
+		bundle->map = NULL;
+		return INVALID_FILE;
+	}
+
+	header = bundle->map;
+	count = le32_to_cpu(header->count);
+	if (memcmp(header->magic, UPDATE_BUNDLE_MAGIC, sizeof(header->magic))) {
+		prlog(PR_ERR, "ERROR: %s is not an update bundle\n", file);
+		goto out;
+	}
+	if (le32_to_cpu(header->version) != UPDATE_BUNDLE_VERSION) {
+		prlog(PR_ERR, "ERROR: %s is an update bundle of unknown version %u\n", file, le32_to_cpu(header->version));
+		goto out;
+	}
+	if (!count || count > UPDATE_BUNDLE_MAX_ENTRIES
+	    || (bundle->mapSize - UPDATE_BUNDLE_HEADER_SIZE) / UPDATE_BUNDLE_ENTRY_SIZE < count) {
+		prlog(PR_ERR, "ERROR: Update bundle %s has an invalid entry count %u\n", file, count);
+		goto out;
+	}
+	bundle->entries = calloc(count, sizeof(*bundle->entries));
+	if (!bundle->entries) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+
+	index = (const struct bundleIndexEntry *)((const unsigned char *)bundle->map + UPDATE_BUNDLE_HEADER_SIZE);
+	end = UPDATE_BUNDLE_HEADER_SIZE + (uint64_t)count * UPDATE_BUNDLE_ENTRY_SIZE;
+	for (uint32_t i = 0; i < count; i++) {
+		offset = le64_to_cpu(index[i].offset);
+		size = le64_to_cpu(index[i].size);
+		if (!memchr(index[i].name, '\0', sizeof(index[i].name)) || isVariable(index[i].name)) {
+			prlog(PR_ERR, "ERROR: Entry %u of update bundle %s has no valid variable name\n", i, file);
+			goto out;
+		}
+		if (le32_to_cpu(index[i].flags) & ~UPDATE_BUNDLE_APPEND) {
+			prlog(PR_ERR, "ERROR: Entry %u of update bundle %s has unknown flags %#x\n", i, file, le32_to_cpu(index[i].flags));
+			goto out;
+		}
+		// every auth follows the one before it and lies in the file
+		if (offset != end || !size || size > bundle->mapSize - offset) {
+			prlog(PR_ERR, "ERROR: Entry %u (%s) of update bundle %s is out of bounds\n", i, index[i].name, file);
+			goto out;
+		}
+		memcpy(bundle->entries[i].name, index[i].name, sizeof(index[i].name));
+		bundle->entries[i].flags = le32_to_cpu(index[i].flags);
+		bundle->entries[i].data = (const unsigned char *)bundle->map + offset;
+		bundle->entries[i].size = size;
+		end = offset + size;
+	}
+	if (end != bundle->mapSize) {
+		prlog(PR_ERR, "ERROR: Update bundle %s has %zd bytes of trailing data\n", file, bundle->mapSize - (size_t)end);
+		goto out;
+	}
+	bundle->count = count;
+	prlog(PR_INFO, "Update bundle %s holds %d updates in %zd bytes\n", file, bundle->count, bundle->mapSize);
+	rc = SUCCESS;
+
+out:
+	if (rc)
+		closeUpdateBundle(bundle);
+
+	return rc;
+}
+
+/**
+ *unmaps a bundle from openUpdateBundle, its entries are invalid afterwards
+ *@param bundle, bundle to close, may be closed already
+ */
+void closeUpdateBundle(struct updateBundle *bundle)
+{
+	if (bundle->map)
+		munmap(bundle->map, bundle->mapSize);
+	if (bundle->entries)
+		free(bundle->entries);
+	memset(bundle, 0, sizeof(*bundle));
+}
+
+/**
+ *writes a new bundle file holding the given auths in order
+ *@param file, path of the bundle to create
+ *@param vars, variable name of every auth
+ *@param auths, auth data of every update
+ *@param sizes, length of every auth
+ *@param flags, UPDATE_BUNDLE_APPEND or 0 for every update
+ *@param count, number of updates
+ *@return SUCCESS or err number
+ */
+int createUpdateBundle(const char *file, const char **vars, const unsigned char **auths, const size_t *sizes,
+		       const uint32_t *flags, int count)
+{
+	int rc;
+	unsigned char *buff;
+	size_t size, offset;
+	struct bundleHeader *header;
+	struct bundleIndexEntry *index;
+
+	if (count <= 0 || count > UPDATE_BUNDLE_MAX_ENTRIES) {
+		prlog(PR_ERR, "ERROR: An update bundle holds 1 to %d updates, not %d\n", UPDATE_BUNDLE_MAX_ENTRIES, count);
+		return ARG_PARSE_FAIL;
+	}
+	size = UPDATE_BUNDLE_HEADER_SIZE + (size_t)count * UPDATE_BUNDLE_ENTRY_SIZE;
+	for (int i = 0; i < count; i++) {
+		if (strlen(vars[i]) >= UPDATE_BUNDLE_NAME_SIZE || !sizes[i]) {
+			prlog(PR_ERR, "ERROR: Cannot add update %d (%s) to a bundle\n", i, vars[i]);
+			return ARG_PARSE_FAIL;
+		}
+		size += sizes[i];
+	}
+	buff = calloc(1, size);
+	if (!buff) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	header = (struct bundleHeader *)buff;
+	memcpy(header->magic, UPDATE_BUNDLE_MAGIC, sizeof(header->magic));
+	header->version = cpu_to_le32(UPDATE_BUNDLE_VERSION);
+	header->count = cpu_to_le32(count);
+	index = (struct bundleIndexEntry *)(buff + UPDATE_BUNDLE_HEADER_SIZE);
+	offset = UPDATE_BUNDLE_HEADER_SIZE + (size_t)count * UPDATE_BUNDLE_ENTRY_SIZE;
+	for (int i = 0; i < count; i++) {
+		strcpy(index[i].name, vars[i]);
+		index[i].flags = cpu_to_le32(flags ? flags[i] : 0);
+		index[i].offset = cpu_to_le64(offset);
+		index[i].size = cpu_to_le64(sizes[i]);
+		memcpy(buff + offset, auths[i], sizes[i]);
+		offset += sizes[i];
+	}
+	prlog(PR_INFO, "Writing update bundle of %d updates, %zd bytes, to %s\n", count, size, file);
+	rc = createFile(file, (char *)buff, size);
+	if (rc)
+		prlog(PR_ERR, "ERROR: Could not write update bundle %s\n", file);
+	free(buff);
+
+	return rc;
+}
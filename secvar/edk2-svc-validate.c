@@ -19,7 +19,15 @@ static void usage();
 static void help();
 static bool validate_hash(uuid_t type, size_t size);
 static int parseArgs(int argc, char *argv[], struct Arguments *args);
-static int validateSingularESL(size_t* bytesRead, const unsigned char* esl, size_t eslvarsize, const char *varName);
+static int parseSingularESL(struct eslEntry *entry, size_t* bytesRead, const unsigned char* esl, size_t eslvarsize, const char *varName);
+static int checkX509(mbedtls_x509_crt *x509, const char *varName);
+static int parseESLJob(struct eslJob *job, size_t index, void *data);
+static int validateUpdateBundle(const char *file);
+
+struct parseESLJobData {
+	struct eslEntry *entries;
+	const char *key;
+};
 
 
 
@@ -27,7 +35,8 @@ enum fileTypes{
 	AUTH = 'a',
 	PKCS7 = 'p',
 	ESL = 'e',
-	CERT = 'c'
+	CERT = 'c',
+	BUNDLE = 'b'
 };
 
 /*
@@ -57,6 +66,11 @@ int performValidation(int argc, char* argv[])
 		rc = ARG_PARSE_FAIL;
 		goto out;
 	}
+	// a bundle is validated from its mapping, entry by entry
+	if (args.inForm == BUNDLE) {
+		rc = validateUpdateBundle(args.inFile);
+		goto out;
+	}
 
 	buff = (unsigned char *)getDataFromFile(args.inFile, &size);
 	if (!buff) {
@@ -91,8 +105,35 @@ out:
 	return rc;
 }
 
+/*
+ *validates every auth of an update bundle for its variable
+ *@param file, path to the bundle
+ *@return SUCCESS or the error of the first update that fails
+ */
+static int validateUpdateBundle(const char *file)
+{
+	int rc;
+	struct updateBundle bundle;
+
+	rc = openUpdateBundle(&bundle, file);
+	if (rc)
+		return rc;
+	for (int i = 0; i < bundle.count; i++) {
+		prlog(PR_INFO, "----VALIDATING UPDATE %d FOR %s----\n", i, bundle.entries[i].name);
+		rc = validateAuth(bundle.entries[i].data, bundle.entries[i].size, bundle.entries[i].name);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: update %d for %s in %s is invalid\n", i, bundle.entries[i].name, file);
+			break;
+		}
+	}
+	closeUpdateBundle(&bundle);
+
+	return rc;
+}
+
 static void usage() {
 	printf("USAGE:\n\t $ secvarctl validate [OPTIONS] <file>"
+		"\n\t<file> is '-' to validate data from stdin, bundles must be regular files"
 		"\n\tOPTIONS:"
 		"\n\t\t--help/--usage"
 		"\n\t\t-v\t\tverbose, print process info"
@@ -100,6 +141,10 @@ static void usage() {
 		"\t\t\tNOTE: user still needs to specify file type"
 		"\n\t\t-p\t\tfile is a PKCS7\n\t\t-e\t\tfile is an ESL\n\t\t-a\t\tfile is an auth"
 		"\n\t\t-c\t\tfile is a x509 cert (DER or PEM format)"
+		"\n\t\t-b\t\tfile is an update bundle, every auth in it is validated\n\t"
+		"\t\t\tfor the variable it is named for"
+		"\n\t\t-j <threads>\tnumber of threads that parse the signature lists of an ESL,\n\t"
+		"\t\t\tdefault is number of online CPUs, output is the same for any number"
 		"\n\t\t-a\t\tfile is a signed authenticated file containg a PKCS7 and appended ESL\n\t"
 		"\t\t\tDEFAULT\n");
 }
@@ -121,7 +166,8 @@ static void help() {
 static int parseArgs( int argc, char *argv[], struct Arguments *args) {
 	int rc = SUCCESS;
 	for (int i = 0; i < argc; i++) {
-		if (argv[i][0] != '-') {
+		// "-" validates data from stdin
+		if (argv[i][0] != '-' || isStdioFile(argv[i])) {
 			args->inFile = argv[i];
 			continue;
 		}
@@ -156,6 +202,19 @@ static int parseArgs( int argc, char *argv[], struct Arguments *args) {
 			case 'c':
 				args->inForm = CERT;
 				break;
+			case 'b':
+				args->inForm = BUNDLE;
+				break;
+		// number of threads that parse the signature lists of an ESL
+			case 'j':
+				if (i + 1 >= argc || argv[i + 1][0] == '-' || atoi(argv[i + 1]) <= 0) {
+					prlog(PR_ERR, "ERROR: Incorrect value for '-j', use '-j <threads>', see usage...\n");
+					rc = ARG_PARSE_FAIL;
+					goto out;
+				}
+				i++;
+				eslThreads = atoi(argv[i]);
+				break;
 			default:
 				prlog(PR_ERR, "ERROR: Unknown argument: %s\n", argv[i]);
 				rc = ARG_PARSE_FAIL;
@@ -182,10 +241,33 @@ out:
  *@return whatever is returned from validateESl
  */
 int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key) 
+{
+	int rc;
+	struct parsedAuth auth;
+
+	rc = parseAuth(&auth, authBuf, buflen, key, 1);
+	freeParsedAuth(&auth);
+
+	return rc;
+}
+
+/**
+ *validates auth data like validateAuth but keeps what was parsed so that later steps
+ *do not have to parse the same data again, all views point into authBuf
+ *@param auth, filled with the parsed auth, must be freed with freeParsedAuth even on failure
+ *@param authBuf pointer to auth file data, must outlive auth
+ *@param buflen length of buflen
+ *@param key, variable name {"db","dbx","KEK", "PK"} b/c dbx is a different format
+ *@param checkCerts, see parsePKCS7
+ *@return SUCCESS or error number, same as validateAuth
+ */
+int parseAuth(struct parsedAuth *auth, const unsigned char *authBuf, size_t buflen, const char *key, int checkCerts)
 {
 	int rc;
 	size_t authSize, pkcs7_size;
-	const struct efi_variable_authentication_2 *auth = (struct efi_variable_authentication_2 *)authBuf;
+	const struct efi_variable_authentication_2 *desc = (struct efi_variable_authentication_2 *)authBuf;
+
+	memset(auth, 0, sizeof(*auth));
 	prlog(PR_INFO, "VALIDATING AUTH FILE:\n");
 
 	if (!authBuf) {
@@ -199,7 +281,7 @@ int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key)
 	}
 
 	// total size of auth and pkcs7 data (appended ESL not included)
-	authSize = auth->auth_info.hdr.dw_length + sizeof(auth->timestamp);
+	authSize = desc->auth_info.hdr.dw_length + sizeof(desc->timestamp);
 	// if expected length is greater than the actual length or not a valid size, return fail
 	if ((ssize_t)authSize <= 0 || authSize > buflen) { 
 		prlog(PR_ERR,"ERROR: Invalid auth size, expected %zd found %zd\n", authSize, buflen);
@@ -208,16 +290,16 @@ int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key)
 
 	if (verbose >= PR_INFO) {
 		prlog(PR_INFO,"\tGuid code is : ");			
-		printGuidSig(&auth->auth_info.cert_type);
+		printGuidSig(&desc->auth_info.cert_type);
 	}
 	// make sure guid is PKCS7
-	if (strcmp(getSigType(auth->auth_info.cert_type), "PKCS7") != 0) {
+	if (strcmp(getSigType(desc->auth_info.cert_type), "PKCS7") != 0) {
 		prlog(PR_ERR,"ERROR: Auth file does not contain PKCS7 guid\n");
 		return AUTH_FAIL;
 	}
 	prlog(PR_INFO, "\tType: PKCS7\n");
 
-	pkcs7_size = get_pkcs7_len(auth);
+	pkcs7_size = get_pkcs7_len(desc);
 	// ensure pkcs7 size is valid length
 	if ((ssize_t)pkcs7_size <= 0 || pkcs7_size > authSize) { 
 		prlog(PR_ERR,"ERROR: Invalid pkcs7 size %zd\n", pkcs7_size);
@@ -228,10 +310,14 @@ int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key)
 
 	if( verbose >= PR_INFO){
 		prlog(PR_INFO, "\tTimestamp: ");
-		printTimestamp(auth->timestamp);
+		printTimestamp(desc->timestamp);
 	}
+	auth->buf = authBuf;
+	auth->size = buflen;
+	auth->authSize = authSize;
+	auth->desc = desc;
 	// validate pkcs7
-	rc = validatePKCS7(auth->auth_info.cert_data, pkcs7_size);
+	rc = parsePKCS7(&auth->pkcs7, desc->auth_info.cert_data, pkcs7_size, checkCerts);
 	if (rc) {
 		prlog(PR_ERR,"ERROR: PKCS7 FAILED\n");
 		return rc;
@@ -243,7 +329,7 @@ int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key)
 		prlog(PR_WARNING, "WARNING: appended ESL is empty, (valid key reset file)...\n");
 	}
 	else {
-		rc = validateESL(authBuf + authSize, buflen - authSize, key);
+		rc = parseESL(&auth->esl, authBuf + authSize, buflen - authSize, key);
 		if (rc) {
 			prlog(PR_ERR,"ERROR: ESL FAILED\n");
 			return rc;
@@ -253,6 +339,20 @@ int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key)
 	return rc;	
 }
 
+/**
+ *frees everything parseAuth allocated, the viewed buffer is not touched
+ *@param auth, struct filled by parseAuth
+ */
+void freeParsedAuth(struct parsedAuth *auth)
+{
+	if (auth->pkcs7) {
+		mbedtls_pkcs7_free(auth->pkcs7);
+		free(auth->pkcs7);
+	}
+	freeParsedESL(&auth->esl);
+	memset(auth, 0, sizeof(*auth));
+}
+
 // inspired by secvar/backend/edk2-compat-process.c by Nayna Jain
 /**
  *returns only size of auth->auth_info.hdr.cert_data
@@ -281,33 +381,61 @@ int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key)
  */
 int validatePKCS7(const unsigned char *cert_data, size_t len) 
 {
-	mbedtls_x509_crt *pkcs7cert = NULL;
+	int rc;
 	mbedtls_pkcs7 *pkcs7 = NULL;
+
+	rc = parsePKCS7(&pkcs7, cert_data, len, 1);
+	if (pkcs7) {
+		mbedtls_pkcs7_free(pkcs7);
+		free(pkcs7);
+	}
+
+	return rc;
+}
+
+/**
+ *validates a pkcs7 like validatePKCS7 and returns the parsed structure
+ *@param pkcs7, set to the allocated and parsed pkcs7 on success, NULL otherwise
+ *@param cert_data pkcs7 DER data
+ *@param len length of cert_data
+ *@param checkCerts, if 0 the embedded signing certificates are not decoded or checked, verification
+ *only needs the signer infos and uses the certificates of the keystore
+ *@return PKCS7_FAIL if something goes wrong, SUCCESS if everything is correct
+ */
+int parsePKCS7(mbedtls_pkcs7 **pkcs7, const unsigned char *cert_data, size_t len, int checkCerts)
+{
+	mbedtls_x509_crt *pkcs7cert = NULL;
 	int rc;
 
 	prlog(PR_INFO, "VALIDATING PKCS7:\n");
-	pkcs7 = malloc(sizeof(struct mbedtls_pkcs7));
-	if (!pkcs7){
+	*pkcs7 = malloc(sizeof(struct mbedtls_pkcs7));
+	if (!*pkcs7){
 		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
 		return ALLOC_FAIL;
 	}
-	mbedtls_pkcs7_init(pkcs7);
-	rc = mbedtls_pkcs7_parse_der(cert_data, len, pkcs7);
+	mbedtls_pkcs7_init(*pkcs7);
+	rc = mbedtls_pkcs7_parse_der_ext(cert_data, len, *pkcs7, MBEDTLS_PKCS7_PARSE_LAZY_CERTS);
 	if (rc != MBEDTLS_PKCS7_SIGNED_DATA) {	// if pkcs7 parsing fails, then try new signed data format 
 			prlog(PR_ERR, "ERROR: parsing pkcs7 failed mbedtls error #%04x\n", rc);
 			goto out;	
 	}
 	// make sure digest alg is sha246
-	if (memcmp(pkcs7->signed_data.digest_alg_identifiers.p, MBEDTLS_OID_DIGEST_ALG_SHA256, strlen(MBEDTLS_OID_DIGEST_ALG_SHA256) )!= 0) {
+	if (memcmp((*pkcs7)->signed_data.digest_alg_identifiers.p, MBEDTLS_OID_DIGEST_ALG_SHA256, strlen(MBEDTLS_OID_DIGEST_ALG_SHA256) )!= 0) {
 		prlog(PR_ERR, "ERROR: PKCS7 data is not signed with SHA256\n");
 		goto out;
 	}
 	prlog(PR_INFO, "\tDigest Alg: SHA256\n");
-	// print info on all siging certificates
-	pkcs7cert = &pkcs7->signed_data.certs;
+	if (!checkCerts)
+		return SUCCESS;
+	// print info on all siging certificates, they are decoded on first use and checked in place
+	rc = mbedtls_pkcs7_get_certificates(*pkcs7, &pkcs7cert);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: failed to parse signing certificates of pkcs7 mbedtls error #%04x\n", rc);
+		goto out;
+	}
 	do {
 		prlog(PR_INFO, "VALIDATING SIGNING CERTIFIATE:\n");
-		rc = validateCert(pkcs7cert->raw.p, pkcs7cert->raw.len, NULL);
+		rc = checkX509(pkcs7cert, NULL);
 		if (rc) {
 			prlog(PR_ERR,"ERROR: failure to parse x509 signing certificate\n");
 			goto out;
@@ -316,14 +444,13 @@ int validatePKCS7(const unsigned char *cert_data, size_t len)
 		pkcs7cert = pkcs7cert->next;
 	}
 	while (pkcs7cert);
-	mbedtls_pkcs7_free(pkcs7);
-	free(pkcs7);
+
 	return SUCCESS;
 
 out:
-	mbedtls_pkcs7_free(pkcs7);
-	free(pkcs7);
-	pkcs7 = NULL;
+	mbedtls_pkcs7_free(*pkcs7);
+	free(*pkcs7);
+	*pkcs7 = NULL;
 	
 	return PKCS7_FAIL;
 }
@@ -339,51 +466,116 @@ out:
  */ 
 int validateESL(const unsigned char *eslBuf, size_t buflen, const char *key) 
 {
-	ssize_t eslvarsize = buflen;
-	size_t  eslsize = 0;
-	int count = 0, offset = 0, rc;
+	int rc;
+	struct parsedESL esl;
+
+	rc = parseESL(&esl, eslBuf, buflen, key);
+	freeParsedESL(&esl);
+
+	return rc;
+}
+
+/**
+ *validates ESL data like validateESL and keeps a view of every valid ESL with its parsed certificate
+ *@param esl, filled with the parsed ESLs, must be freed with freeParsedESL even on failure
+ *@param eslBuf pointer to ESL all ESL data, could be appended ESL's, must outlive esl
+ *@param buflen length of eslBuf
+ *@param key, variable name {"db","dbx","KEK", "PK"} b/c dbx is a different format
+ *@return SUCCESS or error number, same as validateESL
+ */
+int parseESL(struct parsedESL *esl, const unsigned char *eslBuf, size_t buflen, const char *key)
+{
+	struct eslJob *jobs;
+	struct parseESLJobData data;
+	size_t count, i;
+	int rc;
+
+	memset(esl, 0, sizeof(*esl));
 	prlog(PR_INFO, "VALIDATING ESL:\n");
-	while (eslvarsize > 0) {
-		rc = validateSingularESL(&eslsize, eslBuf + offset, eslvarsize, key);
+	rc = splitESL(eslBuf, buflen, &jobs, &count);
+	if (rc)
+		return rc;
+	esl->entries = calloc(count ? count : 1, sizeof(*esl->entries));
+	if (!esl->entries) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	data.entries = esl->entries;
+	data.key = key;
+	runESLJobs(jobs, count, parseESLJob, &data);
+	// results come back in the order of the variable, as if it was walked one list after another
+	for (i = 0; i < count; i++) {
+		capturePrint(jobs[i].output);
+		jobs[i].output = NULL;
 		// verify current esl to ensure it is a valid sigList, if 1 is returned break or error
-		if (rc) { 
-			prlog(PR_ERR, "ERROR: Sig List #%d is not structured correctly\n", count);
+		if (jobs[i].rc) {
+			prlog(PR_ERR, "ERROR: Sig List #%d is not structured correctly\n", esl->count);
 			// if there is one good esl just leave the loop
-			if (count) break;	
-			else return rc;
+			if (esl->count)
+				break;
+			rc = jobs[i].rc;
+			goto out;
 		}
-		
-		count++;	
-		 // we read all eslsize bytes so iterate to next esl	
-		offset += eslsize;
-		// size left of total file
-		eslvarsize -= eslsize;	
-	}
-	prlog(PR_INFO, "\tFound %d ESL's\n\n", count);
-	if (!count) 
-		return ESL_FAIL;
+		esl->count++;
+	}
+	prlog(PR_INFO, "\tFound %d ESL's\n\n", esl->count);
+	if (!esl->count)
+		rc = ESL_FAIL;
 
-	return SUCCESS;
+out:
+	// drop what the workers parsed after the first broken list
+	for (i = esl->count; esl->entries && i < count; i++) {
+		certCacheRelease(esl->entries[i].x509);
+		esl->entries[i].x509 = NULL;
+	}
+	freeESLJobs(jobs, count);
+
+	return rc;
+}
+
+/*
+ *runESLJobs callback for parseESL, fills the entry of the job's signature list
+ */
+static int parseESLJob(struct eslJob *job, size_t index, void *data)
+{
+	struct parseESLJobData *p = data;
+
+	return parseSingularESL(&p->entries[index], &job->bytesRead, job->esl, job->remaining, p->key);
+}
+
+/**
+ *frees the certificates parseESL parsed, the viewed buffer is not touched
+ *@param esl, struct filled by parseESL
+ */
+void freeParsedESL(struct parsedESL *esl)
+{
+	for (int i = 0; i < esl->count; i++)
+		certCacheRelease(esl->entries[i].x509);
+	if (esl->entries)
+		free(esl->entries);
+	memset(esl, 0, sizeof(*esl));
 }
 
 /*
  *checks fields of the struct to ensure that the buffer was correctly into a sig list
  *for now, only checks that sizes of field are valid
+ *@param entry will be filled with views of the sig list and its data and the parsed certificate
  *@param bytesRead will be filled with the number of bytes read during this function (eslsize)
  *@param esl, pointer to start of esl
  *@param eslvarsize, remaining size of eslbuf
  *@param varName, variable name {"db","dbx","KEK", "PK"} b/c dbx is a different format
  *@return SUCCESS if cetificate and header info is valid, errno otherwise
  */
-static int validateSingularESL(size_t* bytesRead, const unsigned char* esl, size_t eslvarsize, const char *varName) 
+static int parseSingularESL(struct eslEntry *entry, size_t* bytesRead, const unsigned char* esl, size_t eslvarsize, const char *varName) 
 {
-	ssize_t cert_size;
+	size_t cert_size, cert_offset;
 	int rc;
 	size_t eslsize;
-	unsigned char *cert = NULL;
 	EFI_SIGNATURE_LIST *sigList;
 	
 	*bytesRead = 0;
+	memset(entry, 0, sizeof(*entry));
 	// verify struct to ensure it is a valid sigList, if 1 is returned break
 	if (eslvarsize < sizeof(EFI_SIGNATURE_LIST)) { 
 		prlog(PR_ERR, "ERROR: ESL has %zd bytes and is smaller than an ESL (%zd bytes), remaining data not parsed\n", eslvarsize, sizeof(EFI_SIGNATURE_LIST));
@@ -428,12 +620,16 @@ static int validateSingularESL(size_t* bytesRead, const unsigned char* esl, size
 		prlog(PR_ERR, "ERROR: Sig list is not X509 format\n");
 		return ESL_FAIL;
 	}
-	// get certificate
-	cert_size = get_esl_cert((const char *)esl, sigList, (char **)&cert); // puts sig data in cert
-	if (cert_size <= 0) {
+	// get view of certificate, same layout as get_esl_cert but without the copy
+	cert_offset = sizeof(EFI_SIGNATURE_LIST) + sigList->SignatureHeaderSize + sizeof(uuid_t);
+	if (sigList->SignatureSize <= sizeof(uuid_t) || cert_offset + sigList->SignatureSize - sizeof(uuid_t) > eslsize) {
 		prlog(PR_ERR, "\tERROR: Signature Size was too small, no data \n");
 		return ESL_FAIL;
 	}
+	cert_size = sigList->SignatureSize - sizeof(uuid_t);
+	entry->list = sigList;
+	entry->data = esl + cert_offset;
+	entry->size = cert_size;
 	// if dbx, make sure it is 32 bytes if SHA256, 64 for SHA512 etc, and skip x509 validation
 	if (varName && !strcmp(varName, "dbx")) {
 		if ( !validate_hash(sigList->SignatureType, cert_size)){
@@ -444,13 +640,20 @@ static int validateSingularESL(size_t* bytesRead, const unsigned char* esl, size
 
 		if (verbose >= PR_INFO) {
 			prlog(PR_INFO, "\tHash: ");
-			printHex(cert, cert_size);
+			printHex((unsigned char *)entry->data, cert_size);
 		}
 	}
 	else {
-		rc = validateCert(cert, cert_size, varName);
+		entry->x509 = certCacheGet(entry->data, cert_size);
+		if (!entry->x509)
+			rc = CERT_FAIL;
+		else
+			rc = checkX509(entry->x509, varName);
+		if (rc) {
+			certCacheRelease(entry->x509);
+			entry->x509 = NULL;
+		}
 	}
-	free(cert);
 	*bytesRead = eslsize;
 
 	return rc;
@@ -478,53 +681,68 @@ static bool validate_hash(uuid_t type, size_t size)
  */
 int validateCert(const unsigned char *certBuf, size_t buflen, const char *varName) 
 {
-	char *x509_info = NULL;
 	mbedtls_x509_crt *x509;
-	int rc;
+	unsigned char digest[VERIFY_CACHE_KEY_SIZE];
+	int rc, cacheable;
 
 	if (buflen == 0) {
 		prlog(PR_ERR, "ERROR: Length %zd is invalid\n", buflen);
 		return CERT_FAIL;
 	}
-	x509 = malloc(sizeof(*x509));
-	if (!x509){
-		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-		return ALLOC_FAIL;
-	}
-	rc = parseX509(x509, certBuf, buflen);
-	if (rc) {
-		rc = CERT_FAIL;
-		goto out;
+	// with a verification cache open, certificates that passed before are not parsed again
+	cacheable = isVerifyCacheOpen() && !getValidateCacheKey("validateCert", varName ? varName : "(null)",
+							       certBuf, buflen, digest);
+	if (cacheable && !verifyCacheLookup(digest)) {
+		prlog(PR_INFO, "validateCert found in verification cache\n");
+		return SUCCESS;
 	}
+	x509 = certCacheGet(certBuf, buflen);
+	if (!x509)
+		return CERT_FAIL;
+	rc = checkX509(x509, varName);
+	certCacheRelease(x509);
+	if (!rc && cacheable)
+		verifyCacheStore(digest);
+
+	return rc;
+}
+
+/**
+ *verifies the fields of an already parsed x509 certificate
+ *@param x509 parsed certificate
+ *@param varName,  variable name {"db","dbx","KEK", "PK"} b/c db allows for any RSA len, if NULL expect RSA-2048
+ *@return CERT_FAIL if certificate had incorrect data
+ *@return SUCCESS if certificate is valid
+ */
+static int checkX509(mbedtls_x509_crt *x509, const char *varName)
+{
+	char *x509_info = NULL;
+	int rc = SUCCESS;
+
 	// check raw cert data has data
 	if (x509->raw.len <= 0) {	
 		prlog(PR_ERR, "ERROR: X509 has no data\n");
-		rc = CERT_FAIL;
-		goto out;
+		return CERT_FAIL;
 	}
 	// check raw certificate body has data type defined
 	if (x509->tbs.len <= 0) { 
 		prlog(PR_ERR,"ERROR: X509 certificate has no data\n");
-		rc = CERT_FAIL;
-		goto out;
+		return CERT_FAIL;
 	}
 	// check if version is something other than 1,2,3
 	if (x509->version < 1 || x509->version > 3) { 
 		prlog(PR_ERR,"ERROR: X509 version %d is not valid\n", x509->version );
-		rc = CERT_FAIL;
-		goto out;
+		return CERT_FAIL;
 	}
 	// if public key type is not in range of asn1 pk type enum
 	if ((int)(x509->pk.pk_info->type) < 0 || x509->pk.pk_info->type > 6 ) { 
 		prlog(PR_ERR,"ERROR: public key type not supported\n");
-		rc = CERT_FAIL;
-		goto out;
+		return CERT_FAIL;
 	}
 	// if sig doesnt have data
 	if (x509->sig.len <= 0) { 
 		prlog(PR_ERR, "ERROR: X509 has no signature data\n");
-		rc = CERT_FAIL;
-		goto out;
+		return CERT_FAIL;
 	}
 	
 	//if x509 for db then signature can be RSA 4096 or other (since it won't be signing anything else)
@@ -537,31 +755,23 @@ int validateCert(const unsigned char *certBuf, size_t buflen, const char *varNam
 			x509_info = malloc(CERT_BUFFER_SIZE);
 			if (!x509_info){
 				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-				rc = CERT_FAIL;
-				goto out;
+				return CERT_FAIL;
 			}
 			rc = mbedtls_x509_sig_alg_gets(x509_info, CERT_BUFFER_SIZE, &x509->sig_oid,
                        x509->sig_pk, x509->sig_md, x509->sig_opts );
 			prlog(PR_ERR,"ERROR: Wanted Cert with RSA 2048 and SHA-256. Discovered %s with key size %d and signature length %zd\n", x509_info, (int)mbedtls_pk_get_bitlen( &x509->pk ), x509->sig.len);
 			free(x509_info);
-			goto out;
+			return CERT_FAIL;
 		}
 	}
 	
 	// This part is to print out certificate info
 	if (verbose >= PR_INFO) {
 		rc = printCertInfo(x509);
-		if (rc) {
-			rc = CERT_FAIL;
-			goto out;
-		}
+		if (rc)
+			return CERT_FAIL;
 	}
 
-out:
-	mbedtls_x509_crt_free(x509);
-	if (x509) 
-		free(x509);
-
 	return rc;
 }
 
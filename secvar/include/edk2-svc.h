@@ -4,6 +4,8 @@
 #define EDK2_SVC_SECVAR_H
 #include <stdint.h> //for uint_16 stuff like that
 #include <mbedtls/x509_crt.h> // for printCertInfo
+#include <mbedtls/md.h> // for hash types
+#include "crypto/include/crypto.h" // for hashing, also verification cache keys
 #include "external/skiboot/include/secvar.h" //for secvar struct
 #include "err.h"
 #include "prlog.h"
@@ -14,6 +16,7 @@
 #define variables  (char* []){ "PK", "KEK", "db", "dbx", "TS" }
 #define ARRAY_SIZE(a) (sizeof (a) / sizeof ((a)[0]))
 #define uuid_equals(a,b) (!memcmp(a, b, UUID_SIZE))
+#define VERIFY_CACHE_KEY_SIZE 32
 
 // array holding different hash function information
 static const struct hash_funct {
@@ -29,10 +32,47 @@ static const struct hash_funct {
     { .name = "SHA512", .size = 64, .mbedtls_funct = MBEDTLS_MD_SHA512, .guid = &EFI_CERT_SHA512_GUID },
 };
 
+/*
+ *one valid ESL inside a buffer, list and data are views into that buffer
+ */
+struct eslEntry {
+	const EFI_SIGNATURE_LIST *list;
+	const unsigned char *data; // signature data after the owner guid
+	size_t size;
+	mbedtls_x509_crt *x509; // parsed certificate, NULL for hashes
+};
+
+struct parsedESL {
+	struct eslEntry *entries;
+	int count;
+};
+
+/*
+ *an auth file validated and parsed once, desc is a view into buf and the
+ *appended ESL starts at buf + authSize
+ */
+struct parsedAuth {
+	const unsigned char *buf;
+	size_t size, authSize;
+	const struct efi_variable_authentication_2 *desc;
+	mbedtls_pkcs7 *pkcs7;
+	struct parsedESL esl;
+};
+
 int performValidation(int argc, char* argv[]); 
 int performGenerateCommand(int argc, char* argv[]);
+int performAuditCommand(int argc, char* argv[]);
+int performLookupCommand(int argc, char* argv[]);
+int performCompactCommand(int argc, char* argv[]);
+int performDiffCommand(int argc, char* argv[]);
+int generateAuthFromESL(const unsigned char *esl, size_t size, const char *varName, const char **signKeys,
+			const char **signCerts, int signerCount, int append, unsigned char **outBuff, size_t *outBuffSize);
+int performPlanCommand(int argc, char* argv[]);
+int performFingerprintCommand(int argc, char* argv[]);
+int performCatalogCommand(int argc, char* argv[]);
 
 int printReadable(const char *c , size_t size, const char * key);
+int printSummary(const char *c, size_t size, const char *key, size_t maxSize, size_t *entries);
 
 
 int printCertInfo(mbedtls_x509_crt *x509);
@@ -45,6 +85,10 @@ ssize_t get_esl_cert( const char *c,EFI_SIGNATURE_LIST *list ,char **cert);
 size_t get_pkcs7_len(const struct efi_variable_authentication_2 *auth);
 int parseX509(mbedtls_x509_crt *x509, const unsigned char *certBuf, size_t buflen);
 const char* getSigType(const uuid_t);
+typedef int (*eslWalkCallback)(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data);
+int walkESL(const unsigned char *esl, size_t size, eslWalkCallback callback, void *data);
+int removeESLSignatures(const unsigned char *esl, size_t eslSize, const unsigned char *base, size_t baseSize, unsigned char **out, size_t *outSize);
+int getSecVarData(const char *path, const char *varName, char **data, size_t *size);
 
 int isVariable(const char *var);
 
@@ -52,8 +96,79 @@ int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key);
 int validateESL(const unsigned char *eslBuf, size_t buflen, const char *key);
 int validateCert(const unsigned char *authBuf, size_t buflen, const char *varName);
 int validatePKCS7(const unsigned char *cert_data, size_t len);
+int parseAuth(struct parsedAuth *auth, const unsigned char *authBuf, size_t buflen, const char *key, int checkCerts);
+void freeParsedAuth(struct parsedAuth *auth);
+int parseESL(struct parsedESL *esl, const unsigned char *eslBuf, size_t buflen, const char *key);
+void freeParsedESL(struct parsedESL *esl);
+int parsePKCS7(mbedtls_pkcs7 **pkcs7, const unsigned char *cert_data, size_t len, int checkCerts);
 int validateTS(const unsigned char *data, size_t size);
 int validateTime(struct efi_time *time);
 
+int openVerifyCache(const char *file);
+int closeVerifyCache(void);
+int isVerifyCacheOpen(void);
+int verifyCacheKeyStart(struct cryptoHashCtx **ctx, const char *tag);
+int verifyCacheKeyAdd(struct cryptoHashCtx *ctx, const void *data, size_t len);
+int verifyCacheKeyFinish(struct cryptoHashCtx *ctx, unsigned char *key);
+int verifyCacheLookup(const unsigned char *key);
+void verifyCacheStore(const unsigned char *key);
+int getValidateCacheKey(const char *tag, const char *key, const unsigned char *data, size_t size, unsigned char *digest);
+int cachedValidate(const char *tag, const char *key, const unsigned char *data, size_t size,
+		   int (*validate)(const unsigned char *, size_t, const char *));
+
+/*
+ *one signature list of a variable for runESLJobs, output holds what was printed
+ *while it was processed on a worker thread
+ */
+struct eslJob {
+	const unsigned char *esl; // start of the signature list
+	size_t remaining; // bytes from esl to the end of the variable
+	size_t bytesRead;
+	int rc;
+	struct outputCapture *output;
+};
+
+typedef int (*eslJobFunc)(struct eslJob *job, size_t index, void *data);
+extern int eslThreads;
+int splitESL(const unsigned char *esl, size_t size, struct eslJob **jobs, size_t *count);
+void runESLJobs(struct eslJob *jobs, size_t count, eslJobFunc func, void *data);
+void freeESLJobs(struct eslJob *jobs, size_t count);
+
+mbedtls_x509_crt *certCacheGet(const unsigned char *cert, size_t size);
+mbedtls_x509_crt *certCacheFind(const unsigned char *cert, size_t size);
+void certCacheRelease(mbedtls_x509_crt *x509);
+void certCacheFlush(void);
+
+int isCertBundle(const char *path);
+int certBundleToESL(const char *path, const char *varName, int threads, int skipValidation,
+		    unsigned char **out, size_t *outSize);
+
+#define UPDATE_BUNDLE_NAME_SIZE 8
+#define UPDATE_BUNDLE_MAX_ENTRIES 64
+// the entry was signed as an EFI_VARIABLE_APPEND_WRITE
+#define UPDATE_BUNDLE_APPEND 0x1
+
+/*
+ *one auth of an update bundle, data is a view into the mapping of the bundle
+ */
+struct updateBundleEntry {
+	char name[UPDATE_BUNDLE_NAME_SIZE];
+	uint32_t flags;
+	const unsigned char *data;
+	size_t size;
+};
+
+struct updateBundle {
+	void *map;
+	size_t mapSize;
+	int count;
+	struct updateBundleEntry *entries;
+};
+
+int openUpdateBundle(struct updateBundle *bundle, const char *file);
+void closeUpdateBundle(struct updateBundle *bundle);
+int createUpdateBundle(const char *file, const char **vars, const unsigned char **auths, const size_t *sizes,
+		       const uint32_t *flags, int count);
+
 
 #endif
@@ -1,10 +1,13 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include "backends/include/backends.h"
 #include "secvar/include/edk2-svc.h"
 
 #define CERT_BUFFER_SIZE 2048
 
+static int printSingularESL(struct eslJob *job, size_t index, void *data);
+
 /*
  *prints human readable data in of ESL buffer
  *@param c , buffer containing ESL data
@@ -14,91 +17,207 @@
  */
 int printReadable(const char *c, size_t size, const char *key) 
 {
-	ssize_t eslvarsize = size, cert_size;
-	size_t  eslsize = 0;
-	int count = 0, offset = 0, rc;
+	struct eslJob *jobs;
+	size_t jobCount, i;
+	int count = 0, rc;
+
+	rc = splitESL((const unsigned char *)c, size, &jobs, &jobCount);
+	if (rc)
+		return rc;
+	// lists are parsed on worker threads, their output is printed here in order
+	runESLJobs(jobs, jobCount, printSingularESL, (void *)key);
+	for (i = 0; i < jobCount; i++) {
+		capturePrint(jobs[i].output);
+		jobs[i].output = NULL;
+		if (jobs[i].rc == ALLOC_FAIL) {
+			freeESLJobs(jobs, jobCount);
+			return ALLOC_FAIL;
+		}
+		if (jobs[i].rc)
+			break;
+		count++;
+	}
+	freeESLJobs(jobs, jobCount);
+	prout("\tFound %d ESL's\n\n", count);
+
+	if (!count)
+		return ESL_FAIL;
+
+	return SUCCESS;
+}
+
+/*
+ *runESLJobs callback for printReadable, prints one signature list and its data
+ *@param data, variable name {"db","dbx","KEK", "PK"} b/c dbx is a different format
+ *@return SUCCESS or error number, printReadable stops at the first error
+ */
+static int printSingularESL(struct eslJob *job, size_t index, void *data)
+{
+	const char *key = data;
+	const char *c = (const char *)job->esl;
+	ssize_t eslvarsize = job->remaining, cert_size;
 	unsigned char *cert = NULL;
 	EFI_SIGNATURE_LIST *sigList;
 	mbedtls_x509_crt *x509 = NULL;
+	int rc = ESL_FAIL;
 
-	while (eslvarsize > 0) {
-		if (eslvarsize < sizeof(EFI_SIGNATURE_LIST)) { 
-			prlog(PR_ERR, "ERROR: ESL has %zd bytes and is smaller than an ESL (%zd bytes), remaining data not parsed\n", eslvarsize, sizeof(EFI_SIGNATURE_LIST));
-			break;
+	if (eslvarsize < sizeof(EFI_SIGNATURE_LIST)) { 
+		prlog(PR_ERR, "ERROR: ESL has %zd bytes and is smaller than an ESL (%zd bytes), remaining data not parsed\n", eslvarsize, sizeof(EFI_SIGNATURE_LIST));
+		return ESL_FAIL;
+	}
+	// Get sig list
+	sigList = get_esl_signature_list(c, eslvarsize);
+	// check size info is logical 
+	if (sigList->SignatureListSize > 0) {
+		if ((sigList->SignatureSize <= 0 && sigList->SignatureHeaderSize <= 0) 
+			|| sigList->SignatureListSize < sigList->SignatureHeaderSize + sigList->SignatureSize) {
+			/*printf("Sig List : %d , sig Header: %d, sig Size: %d\n",list.SignatureListSize,list.SignatureHeaderSize,list.SignatureSize);*/
+			prlog(PR_ERR,"ERROR: Sig List is not structured correctly, defined size and actual sizes are mismatched\n");
+			return ESL_FAIL;
+		}	
+	}
+	if (sigList->SignatureListSize  > eslvarsize || sigList->SignatureHeaderSize > eslvarsize || sigList->SignatureSize > eslvarsize) {
+		prlog(PR_ERR, "ERROR: Expected Sig List Size %d + Header size %d + Signature Size is %d larger than actual size %zd\n", sigList->SignatureListSize, sigList->SignatureHeaderSize, sigList->SignatureSize, eslvarsize);
+		return ESL_FAIL;
+	}
+	printESLInfo(sigList);
+	// puts sig data in cert
+	cert_size = get_esl_cert(c, sigList, (char **)&cert); 
+	if (cert_size <= 0) {
+		prlog(PR_ERR, "\tERROR: Signature Size was too small, no data \n");
+		goto out;
+	}
+	if (key && !strcmp(key, "dbx")) {
+		prout("\tHash: ");
+		printHex(cert, cert_size);
+	}
+	else {
+		x509 = certCacheGet(cert, (size_t) cert_size);
+		if (!x509) {
+			rc = CERT_FAIL;
+			goto out;
 		}
-		// Get sig list
-		sigList = get_esl_signature_list(c + offset, eslvarsize);
-		// check size info is logical 
-		if (sigList->SignatureListSize > 0) {
-			if ((sigList->SignatureSize <= 0 && sigList->SignatureHeaderSize <= 0) 
-				|| sigList->SignatureListSize < sigList->SignatureHeaderSize + sigList->SignatureSize) {
-				/*printf("Sig List : %d , sig Header: %d, sig Size: %d\n",list.SignatureListSize,list.SignatureHeaderSize,list.SignatureSize);*/
-				prlog(PR_ERR,"ERROR: Sig List is not structured correctly, defined size and actual sizes are mismatched\n");
-				break;
-			}	
+		rc = printCertInfo(x509);
+		if (rc)
+			goto out;
+	}
+	job->bytesRead = sigList->SignatureListSize;
+	rc = SUCCESS;
+
+out:
+	certCacheRelease(x509);
+	if (cert) 
+		free(cert);
+
+	return rc;
+}
+
+/*
+ *number of signatures of one type in a variable
+ */
+struct sigTypeCount {
+	uuid_t type;
+	size_t count;
+};
+
+/**
+ *prints the size, hash and entry counts of a variable by only reading the headers of its
+ *signature lists, nothing is decoded so it stays fast on large variables
+ *@param c , buffer containing ESL data, or timestamps if key is "TS"
+ *@param size , length of buffer
+ *@param key, variable name {"db","dbx","KEK", "PK", "TS"} or NULL for an ESL file
+ *@param maxSize, largest size the variable can have, 0 if not known
+ *@param entries, the number of signatures found is added to it
+ *@return SUCCESS or error number if the lists or timestamps are malformed
+ */
+int printSummary(const char *c, size_t size, const char *key, size_t maxSize, size_t *entries)
+{
+	EFI_SIGNATURE_LIST list;
+	struct sigTypeCount *types = NULL, *tmp;
+	unsigned char hash[32];
+	size_t offset = 0, lists = 0, sigs = 0, typeCount = 0, i, n;
+	int rc = SUCCESS;
+
+	if (maxSize)
+		printf("\tSize: %zd bytes, %zd bytes free\n", size, maxSize > size ? maxSize - size : 0);
+	else
+		printf("\tSize: %zd bytes\n", size);
+	rc = cryptoHash(MBEDTLS_MD_SHA256, (const unsigned char *)c, size, hash);
+	if (rc)
+		return rc;
+	printf("\tSHA256: ");
+	for (i = 0; i < sizeof(hash); i++)
+		printf("%02x", hash[i]);
+	printf("\n");
+
+	if (key && !strcmp(key, "TS")) {
+		// one timestamp for every variable besides the TS variable
+		if (size != sizeof(struct efi_time) * (ARRAY_SIZE(variables) - 1)) {
+			prlog(PR_ERR, "ERROR: TS variable does not contain data on all the variables, expected %zd bytes of data, found %zd\n",
+			      sizeof(struct efi_time) * (ARRAY_SIZE(variables) - 1), size);
+			return INVALID_TIMESTAMP;
 		}
-		if (sigList->SignatureListSize  > eslvarsize || sigList->SignatureHeaderSize > eslvarsize || sigList->SignatureSize > eslvarsize) {
-			prlog(PR_ERR, "ERROR: Expected Sig List Size %d + Header size %d + Signature Size is %d larger than actual size %zd\n", sigList->SignatureListSize, sigList->SignatureHeaderSize, sigList->SignatureSize, eslvarsize);
+		for (i = 0; i < ARRAY_SIZE(variables) - 1; i++) {
+			printf("\t%s timestamp: ", variables[i]);
+			printTimestamp(((const struct efi_time *)c)[i]);
+		}
+		return SUCCESS;
+	}
+
+	while (offset < size) {
+		if (size - offset < sizeof(list)) {
+			prlog(PR_ERR, "ERROR: ESL has %zd bytes and is smaller than an ESL (%zd bytes), remaining data not counted\n", size - offset, sizeof(list));
+			rc = ESL_FAIL;
 			break;
 		}
-		eslsize = sigList->SignatureListSize;
-		printESLInfo(sigList);
-		// puts sig data in cert
-		cert_size = get_esl_cert(c + offset, sigList, (char **)&cert); 
-		if (cert_size <= 0) {
-			prlog(PR_ERR, "\tERROR: Signature Size was too small, no data \n");
+		memcpy(&list, c + offset, sizeof(list));
+		if (list.SignatureSize == 0 || list.SignatureListSize > size - offset
+			|| list.SignatureListSize < sizeof(list) + list.SignatureHeaderSize
+			|| (list.SignatureListSize - sizeof(list) - list.SignatureHeaderSize) % list.SignatureSize) {
+			prlog(PR_ERR, "ERROR: Sig List at byte %zd is not structured correctly, remaining data not counted\n", offset);
+			rc = ESL_FAIL;
 			break;
 		}
-		if (key && !strcmp(key, "dbx")) {
-			printf("\tHash: ");
-			printHex(cert, cert_size);
+		n = (list.SignatureListSize - sizeof(list) - list.SignatureHeaderSize) / list.SignatureSize;
+		for (i = 0; i < typeCount; i++) {
+			if (uuid_equals(&types[i].type, &list.SignatureType))
+				break;
 		}
-		else {
-			x509 = malloc(sizeof(*x509));
-			if (!x509) {
+		if (i == typeCount) {
+			tmp = realloc(types, sizeof(*types) * (typeCount + 1));
+			if (!tmp) {
 				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-				return ALLOC_FAIL;
+				rc = ALLOC_FAIL;
+				goto out;
 			}
-			rc = parseX509(x509, cert, (size_t) cert_size);
-			if (rc)
-				break;
-			rc = printCertInfo(x509);
-			if (rc)
-				break;
-			free(cert);
-			cert = NULL;
-			mbedtls_x509_crt_free(x509);
-			free(x509);
-			x509 = NULL;
+			types = tmp;
+			memcpy(&types[typeCount].type, &list.SignatureType, sizeof(uuid_t));
+			types[typeCount++].count = 0;
 		}
-		
-		count++;	
-		 // we read all eslsize bytes so iterate to next esl	
-		offset += eslsize;
-		// size left of total file
-		eslvarsize -= eslsize;	
-	}
-	printf("\tFound %d ESL's\n\n", count);
-	if (x509) {
-		mbedtls_x509_crt_free(x509);
-		free(x509);
+		types[i].count += n;
+		sigs += n;
+		lists++;
+		offset += list.SignatureListSize;
 	}
-	if (cert) 
-		free(cert);
+	printf("\tEntries: %zd in %zd ESL's\n", sigs, lists);
+	for (i = 0; i < typeCount; i++)
+		printf("\t\t%s: %zd\n", getSigType(types[i].type), types[i].count);
+	*entries += sigs;
 
-	if (!count)
-		return ESL_FAIL;
+out:
+	if (types)
+		free(types);
 
-	return SUCCESS;
+	return rc;
 }
 
 //prints info on ESL, nothing on ESL data
 void printESLInfo(EFI_SIGNATURE_LIST *sigList) 
 {
-	printf("\tESL SIG LIST SIZE: %d\n", sigList->SignatureListSize);
-	printf("\tGUID is : ");
+	prout("\tESL SIG LIST SIZE: %d\n", sigList->SignatureListSize);
+	prout("\tGUID is : ");
 	printGuidSig(&sigList->SignatureType);
-	printf("\tSignature type is: %s\n", getSigType(sigList->SignatureType));
+	prout("\tSignature type is: %s\n", getSigType(sigList->SignatureType));
 }
 
 //prints info on x509
@@ -118,7 +237,7 @@ int printCertInfo(mbedtls_x509_crt *x509)
 		prlog(PR_ERR, "\tERROR: Failed to get cert info, wrote %d bytes when getting info\n", failures);
 		return CERT_FAIL;
 	}
-	printf("\tFOUND %d bytes of certificate info:\n %s", failures, x509_info);
+	prout("\tFOUND %d bytes of certificate info:\n %s", failures, x509_info);
 	free(x509_info);
 
 	return SUCCESS;
@@ -175,8 +294,8 @@ void printGuidSig(const void *sig)
 {
 	const unsigned char *p = sig;
 	for (int i = 0; i < 16; i++)
-		printf("%02hhx", p[i]);
-	printf("\n");
+		prout("%02hhx", p[i]);
+	prout("\n");
 }
 
 /**
@@ -212,3 +331,290 @@ int isVariable(const char * var)
 
 	return INVALID_VAR_NAME;
 }
+
+/*
+ *walks every signature of a buffer of ESL's, the lists are checked to be well formed
+ *before any of their signatures is handed out
+ *@param esl, buffer of ESL's
+ *@param size, length of esl
+ *@param callback, called with sig NULL at the start of every list and then once for
+ *each signature (owner GUID followed by data, list->SignatureSize bytes), listData
+ *points to the list in esl, a non zero return stops the walk
+ *@param data, passed through to callback
+ *@return SUCCESS, ESL_FAIL if the ESL's are malformed or the return of callback
+ */
+int walkESL(const unsigned char *esl, size_t size, eslWalkCallback callback, void *data)
+{
+	EFI_SIGNATURE_LIST list;
+	size_t offset = 0, pos;
+	int rc;
+
+	while (offset < size) {
+		if (size - offset < sizeof(list)) {
+			prlog(PR_ERR, "ERROR: ESL has %zd bytes and is smaller than an ESL (%zd bytes)\n", size - offset, sizeof(list));
+			return ESL_FAIL;
+		}
+		memcpy(&list, esl + offset, sizeof(list));
+		if (list.SignatureSize <= sizeof(uuid_t) || list.SignatureListSize > size - offset
+			|| list.SignatureListSize < sizeof(list) + list.SignatureHeaderSize
+			|| (list.SignatureListSize - sizeof(list) - list.SignatureHeaderSize) % list.SignatureSize) {
+			prlog(PR_ERR, "ERROR: Sig List is not structured correctly, defined size and actual sizes are mismatched\n");
+			return ESL_FAIL;
+		}
+		rc = callback(&list, esl + offset, NULL, data);
+		if (rc)
+			return rc;
+		for (pos = sizeof(list) + list.SignatureHeaderSize; pos < list.SignatureListSize; pos += list.SignatureSize) {
+			rc = callback(&list, esl + offset, esl + offset + pos, data);
+			if (rc)
+				return rc;
+		}
+		offset += list.SignatureListSize;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *one signature of the base ESL's, sig points into base
+ */
+struct indexedSignature {
+	uuid_t type;
+	const unsigned char *sig;
+	size_t sigSize;
+};
+
+/*
+ *the signatures of the base ESL's plus an open addressing index into them
+ */
+struct signatureIndex {
+	struct indexedSignature *entries;
+	size_t count, capacity;
+	// slots hold entry number + 1, 0 is empty
+	size_t *slots, slotMask;
+};
+
+struct signatureFilter {
+	struct signatureIndex index;
+	size_t written, listStart, listKept;
+	unsigned char *out;
+};
+
+static size_t signatureHash(const uuid_t *type, const unsigned char *sig, size_t sigSize)
+{
+	const unsigned char *bytes = (const unsigned char *)type;
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	// FNV-1a, the owner GUID is part of sig and often the same for every entry
+	for (size_t i = 0; i < sizeof(uuid_t); i++)
+		h = (h ^ bytes[i]) * 0x100000001b3ULL;
+	for (size_t i = 0; i < sigSize; i++)
+		h = (h ^ sig[i]) * 0x100000001b3ULL;
+
+	return (size_t)(h ^ (h >> 32));
+}
+
+static int countSignature(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data)
+{
+	if (sig)
+		(*(size_t *)data)++;
+
+	return SUCCESS;
+}
+
+static int indexSignature(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data)
+{
+	struct signatureIndex *index = data;
+	struct indexedSignature *e;
+	size_t slot;
+
+	if (!sig || index->count == index->capacity)
+		return SUCCESS;
+	e = &index->entries[index->count];
+	e->type = list->SignatureType;
+	e->sig = sig;
+	e->sigSize = list->SignatureSize;
+	slot = signatureHash(&e->type, sig, e->sigSize) & index->slotMask;
+	while (index->slots[slot])
+		slot = (slot + 1) & index->slotMask;
+	index->slots[slot] = ++index->count;
+
+	return SUCCESS;
+}
+
+/*
+ *indexes every signature of base so each lookup is one hash instead of a walk of base
+ *@param index, filled with the table, free with freeSignatureIndex
+ *@param base, buffer of ESL's
+ *@param baseSize, length of base
+ *@return SUCCESS or ALLOC_FAIL
+ */
+static int buildSignatureIndex(struct signatureIndex *index, const unsigned char *base, size_t baseSize)
+{
+	size_t count = 0, slots = 1;
+
+	memset(index, 0, sizeof(*index));
+	// a malformed base can not be searched beyond the error, those entries have nothing in common with the update
+	walkESL(base, baseSize, countSignature, &count);
+	if (!count)
+		return SUCCESS;
+	// keep the table a power of two and at most half full
+	while (slots < count * 2)
+		slots <<= 1;
+	index->entries = malloc(count * sizeof(*index->entries));
+	index->slots = calloc(slots, sizeof(*index->slots));
+	if (!index->entries || !index->slots) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	index->capacity = count;
+	index->slotMask = slots - 1;
+	walkESL(base, baseSize, indexSignature, index);
+
+	return SUCCESS;
+}
+
+/*
+ *@param type, signature type of the list sig is in
+ *@param sig, one signature entry, owner and data
+ *@param sigSize, length of sig
+ *@return 1 if one of the lists in the index of the same type has the entry, 0 otherwise
+ */
+static int indexHasSignature(const struct signatureIndex *index, const uuid_t *type, const unsigned char *sig, size_t sigSize)
+{
+	const struct indexedSignature *e;
+	size_t slot;
+
+	if (!index->count)
+		return 0;
+	slot = signatureHash(type, sig, sigSize) & index->slotMask;
+	for (; index->slots[slot]; slot = (slot + 1) & index->slotMask) {
+		e = &index->entries[index->slots[slot] - 1];
+		if (e->sigSize == sigSize && !memcmp(&e->type, type, sizeof(uuid_t)) && !memcmp(e->sig, sig, sigSize))
+			return 1;
+	}
+
+	return 0;
+}
+
+static void freeSignatureIndex(struct signatureIndex *index)
+{
+	if (index->entries)
+		free(index->entries);
+	if (index->slots)
+		free(index->slots);
+	memset(index, 0, sizeof(*index));
+}
+
+static int filterSignature(const EFI_SIGNATURE_LIST *list, const unsigned char *listData, const unsigned char *sig, void *data)
+{
+	struct signatureFilter *filter = data;
+	EFI_SIGNATURE_LIST copy;
+	size_t headerSize = sizeof(copy) + list->SignatureHeaderSize;
+
+	if (!sig) {
+		// drop the previous list if none of its signatures were new
+		if (!filter->listKept)
+			filter->written = filter->listStart;
+		filter->listStart = filter->written;
+		filter->listKept = 0;
+		memcpy(filter->out + filter->written, listData, headerSize);
+		filter->written += headerSize;
+		return SUCCESS;
+	}
+	if (indexHasSignature(&filter->index, &list->SignatureType, sig, list->SignatureSize))
+		return SUCCESS;
+	memcpy(filter->out + filter->written, sig, list->SignatureSize);
+	filter->written += list->SignatureSize;
+	filter->listKept++;
+	copy = *list;
+	copy.SignatureListSize = filter->written - filter->listStart;
+	memcpy(filter->out + filter->listStart, &copy, sizeof(copy));
+
+	return SUCCESS;
+}
+
+/*
+ *copies the ESL's in esl without the signatures that are already in base, lists
+ *that have no new signatures left are dropped
+ *@param esl, buffer of ESL's
+ *@param eslSize, length of esl
+ *@param base, buffer of ESL's to compare against, usually the current variable
+ *@param baseSize, length of base
+ *@param out, newly allocated ESL's, NULL if nothing is left, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outSize, length of out
+ *@return SUCCESS or error number if failure
+ */
+int removeESLSignatures(const unsigned char *esl, size_t eslSize, const unsigned char *base, size_t baseSize, unsigned char **out, size_t *outSize)
+{
+	struct signatureFilter filter = { .written = 0, .listStart = 0, .listKept = 0 };
+	int rc;
+
+	*out = NULL;
+	*outSize = 0;
+	if (!eslSize)
+		return SUCCESS;
+	// the result is never larger than the input
+	filter.out = malloc(eslSize);
+	if (!filter.out) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	rc = buildSignatureIndex(&filter.index, base, baseSize);
+	if (!rc)
+		rc = walkESL(esl, eslSize, filterSignature, &filter);
+	freeSignatureIndex(&filter.index);
+	if (rc) {
+		free(filter.out);
+		return rc;
+	}
+	// the last list is only dropped here, the walk ends without another list start
+	if (!filter.listKept)
+		filter.written = filter.listStart;
+	if (!filter.written) {
+		free(filter.out);
+		return SUCCESS;
+	}
+	*out = filter.out;
+	*outSize = filter.written;
+
+	return SUCCESS;
+}
+
+/*
+ *reads the data of a variable through the current backend
+ *@param path, path to variables, NULL for the backend's default path
+ *@param varName, variable to read
+ *@param data, filled with a copy of the data, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param size, filled with length of data
+ *@return SUCCESS or error number if failure
+ */
+int getSecVarData(const char *path, const char *varName, char **data, size_t *size)
+{
+	int rc;
+	struct secvar *var = NULL;
+
+	if (!path)
+		path = secvarctl_backend->default_secvar_path;
+	if (!secvarctl_backend->readSecVar) {
+		prlog(PR_ERR, "ERROR: %s backend can not read variables, use '-e <eslFile>'\n", secvarctl_backend->name);
+		return INVALID_FILE;
+	}
+	rc = secvarctl_backend->readSecVar(&var, path, varName);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Could not read %s from %s\n", varName, path);
+		return rc;
+	}
+	*size = var->data_size;
+	// never hand out a zero length allocation
+	*data = malloc(var->data_size + 1);
+	if (!*data) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		dealloc_secvar(var);
+		return ALLOC_FAIL;
+	}
+	memcpy(*data, var->data, var->data_size);
+	dealloc_secvar(var);
+
+	return SUCCESS;
+}
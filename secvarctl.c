@@ -10,6 +10,7 @@
 #include <unistd.h>
 
 #include "backends/include/backends.h"
+#include "crypto/include/crypto.h"
 
 int verbose = PR_WARNING;
 static void getBackend();
@@ -17,11 +18,18 @@ static void getBackend();
 static struct command generic_commands[] = {
 #ifndef NO_CRYPTO
 	{ .name = "generate", .func = performGenerateCommand },
+	{ .name = "plan", .func = performPlanCommand },
 #endif
 	{ .name = "validate", .func = performValidation },
 	{ .name = "read", .func = readCommand },
 	{ .name = "write", .func = performWriteCommand },
 	{ .name = "verify", .func = performVerificationCommand },
+	{ .name = "audit", .func = performAuditCommand },
+	{ .name = "lookup", .func = performLookupCommand },
+	{ .name = "compact", .func = performCompactCommand },
+	{ .name = "diff", .func = performDiffCommand },
+	{ .name = "fingerprint", .func = performFingerprintCommand },
+	{ .name = "catalog", .func = performCatalogCommand },
 };
 
 void usage() 
@@ -37,9 +45,23 @@ void usage()
 		"use 'secvarctl validate --usage/help' for more information\n\t"
 		"verify\t\tcompares proposed variable to the current variables,\n\t\t\t"
 		"use 'secvarctl verify --usage/help' for more information\n"
+		"\taudit\t\tsummarizes the keystores of many hosts,\n\t\t\t"
+		"use 'secvarctl audit --usage/help' for more information\n"
+		"\tlookup\t\tchecks if files or hashes are revoked by the dbx,\n\t\t\t"
+		"use 'secvarctl lookup --usage/help' for more information\n"
+		"\tcompact\t\tremoves duplicates from an ESL or variable and packs its lists,\n\t\t\t"
+		"use 'secvarctl compact --usage/help' for more information\n"
+		"\tdiff\t\tshows the entries added and removed between two keystores,\n\t\t\t"
+		"use 'secvarctl diff --usage/help' for more information\n"
+		"\tfingerprint\tprints a Merkle root of the keystore and inclusion proofs,\n\t\t\t"
+		"use 'secvarctl fingerprint --usage/help' for more information\n"
+		"\tcatalog\t\tindexes a directory of auth files and picks the newest updates,\n\t\t\t"
+		"use 'secvarctl catalog --usage/help' for more information\n"
 #ifndef NO_CRYPTO
 		"\tgenerate\tcreates relevant files for secure variable management,\n\t\t\t"
 		"use 'secvarctl generate --usage/help' for more information\n"
+		"\tplan\t\tsigns the updates that take the variables to a desired state,\n\t\t\t"
+		"use 'secvarctl plan --usage/help' for more information\n"
 #endif
 		);
 }
@@ -51,11 +73,19 @@ void help()
        "read - print out information on their current secure vaiables\n\t\t"
        "write - update the given variable's key value, committed upon reboot\n\t\t"
        "validate  -  checks format requirements are met for the given file type\n\t\t"
-       "verify - checks that the given files are correctly signed by the current variables\n"
+       "verify - checks that the given files are correctly signed by the current variables\n\t\t"
+       "audit - validates and summarizes a directory of host keystores\n\t\t"
+       "lookup - checks if files or hashes are revoked by the dbx\n\t\t"
+       "compact - removes duplicate signatures and packs signature lists to save space\n\t\t"
+       "diff - compares the entries of two keystores or ESL files\n\t\t"
+       "fingerprint - prints a Merkle root of the keystore for cheap comparison of many hosts\n\t\t"
+       "catalog - indexes auth files without crypto so the right update is found quickly\n"
 #ifndef NO_CRYPTO
        "\t\tgenerate - create files that are relevant to the secure variable management process\n"
+       "\t\tplan - reconcile the variables with a desired state using the fewest bytes of updates\n"
 #endif
        );
+	printf("\tHashing, signing and verification use %s\n", cryptoLibName);
 	usage();
 
 }
@@ -95,6 +125,16 @@ int main(int argc, char *argv[])
 	argv++;
 	argc--;
 
+	// with '-o -' stdout carries the output data, so print everything else to stderr from here on
+	for (i = 0; i + 1 < argc; i++) {
+		if (!strcmp(argv[i], "-o") && isStdioFile(argv[i + 1])) {
+			rc = reserveStdout();
+			if (rc)
+				return rc;
+			break;
+		}
+	}
+
 	// if backend is not edk2-compat print continuing despite some funtionality not working 
 	getBackend();
 	if (!secvarctl_backend) { 
@@ -117,6 +157,10 @@ out:
 		prlog(PR_ERR, "ERROR:Unknown command %s\n", subcommand);
 		usage();
 	}
+	certCacheFlush();
+#ifdef PKCS11
+	cryptoTokenClose();
+#endif
 	
 	return rc;
 }
@@ -8,11 +8,15 @@ import sys
 import time
 import unittest
 import filecmp
+import shutil
 
 MEM_ERR = 101
 SECTOOLS="../secvarctl-cov"
 GEN = [SECTOOLS, "generate", "-v"]
 OUTDIR = "./generatedTestData/"
+#SoftHSM stands in for a hardware token when testing PKCS#11 signing
+SOFTHSM = next((m for m in ["/usr/lib/softhsm/libsofthsm2.so", "/usr/lib/x86_64-linux-gnu/softhsm/libsofthsm2.so",
+	"/usr/lib64/pkcs11/libsofthsm2.so", "/usr/local/lib/softhsm/libsofthsm2.so"] if os.path.exists(m)), None)
 
 # fTOh = [#[generateCommand], resultofGenerateCommand, [validatation Command], result
 # [["-h", "SHA512", "-i", ]]
@@ -67,6 +71,7 @@ badSignedCommands = [
 [["e:a", "-i", "./testdata/db_by_PK.esl", "-o", OUTDIR+"foo.auth", "-c", "./testdata/goldenKeys/PK/PK.key", "-k", "./testdata/goldenKeys/PK/PK.key", "-n", "db"], False], #key given for crt
 [["e:a", "-i", "./testdata/db_by_PK.esl", "-o", OUTDIR+"foo.auth", "-c", "./testdata/goldenKeys/PK/PK.crt", "-k", "./testdata/goldenKeys/PK/PK.crt", "-n", "db"], False], #cert given for key
 [["e:a", "-i", "./testdata/db_by_PK.esl", "-o", OUTDIR+"foo.auth", "-c", "./testdata/goldenKeys/PK/foo.crt", "-k", "./testdata/goldenKeys/PK/PK.crt", "-n", "db"], False], #cert is not a file
+[["e:a", "-i", "./testdata/db_by_PK.esl", "-o", OUTDIR+"foo.auth", "-c", "./testdata/goldenKeys/PK/PK.crt", "-k", "pkcs11:object=PK?module-path=./foo.so", "-n", "db"], False], #PKCS#11 module does not exist
 
 [["e:a", "-i", "./testdata/db_by_PK.esl", "-o", OUTDIR+"foo.auth", "-c", "./testdata/goldenKeys/PK/data", "-k", "./testdata/goldenKeys/PK/PK.crt", "-n", "db"], False], #cert is nnot PEM
 [["e:a", "-i", "./testdata/db_by_PK.esl", "-o", OUTDIR+"foo.auth", "-c", "./testdata/goldenKeys/PK/PK.crt", "-k", "./testdata/goldenKeys/PK/data", "-n", "db"], False], #key is not PEM
@@ -174,6 +179,50 @@ class Test(unittest.TestCase):
 				self.assertEqual( compareFiles(eslMade, eslDesired), True) #make sure the generated file is byte for byte the same as the one we know is correct
 			for i in badESLcommands:
 				self.assertEqual( getCmdResult(cmd + i[0], out, self), i[1]) 
+	def test_genBundle(self):
+		out = "genBundleLog.txt"
+		cmd = GEN
+		certs = ["./testdata/goldenKeys/" + k + "/" + k + ".crt" for k in ["PK", "KEK", "db"]]
+		bundleDir = OUTDIR + "bundleDir"
+		command(["mkdir", "-p", bundleDir], out)
+		command(["sh", "-c", "cat " + " ".join(certs + certs[:1]) + " > " + OUTDIR + "bundle.pem"], out) #PK is in there twice
+		command(["sh", "-c", "cat " + " ".join(reversed(certs)) + " > " + OUTDIR + "reversed.pem"], out)
+		for c in certs:
+			command(["cp", c, bundleDir], out)
+		command(["cp", "./testdata/goldenKeys/KEK/KEK.der", bundleDir + "/KEKcopy.der"], out) #DER duplicate
+		command(["cp", "./testdata/goldenKeys/PK/PK.key", bundleDir], out) #not a certificate file name, ignored
+		self.assertEqual( getCmdResult(cmd + ["c:e", "-n", "KEK", "-i", OUTDIR + "bundle.pem", "-o", OUTDIR + "bundle.esl"], out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS ,"validate", "-e", OUTDIR + "bundle.esl"], out, self), True)
+		#every certificate is its own signature list, laid out like the ESL of that certificate alone
+		with open(OUTDIR + "bundle.esl", "rb") as f:
+			bundleESL = f.read()
+		for c in certs:
+			self.assertEqual( getCmdResult(cmd + ["c:e", "-i", c, "-o", OUTDIR + "single.esl"], out, self), True)
+			with open(OUTDIR + "single.esl", "rb") as f:
+				self.assertIn(f.read(), bundleESL)
+		self.assertEqual( len(bundleESL), 3 * os.path.getsize(OUTDIR + "single.esl")) #the golden certificates are all the same size
+		#so the last certificate of the KEK can sign too
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-c", "PK", "./testdata/goldenKeys/PK/data", "KEK", OUTDIR + "bundle.esl", "-u", "db", "./testdata/bad_db_by_db.auth"], out, self), True)
+		for inp, threads in [[OUTDIR + "bundle.pem", "1"], [OUTDIR + "bundle.pem", "8"], [OUTDIR + "reversed.pem", "3"], [bundleDir, "2"]]:
+			self.assertEqual( getCmdResult(cmd + ["c:e", "-j", threads, "-n", "KEK", "-i", inp, "-o", OUTDIR + "bundle2.esl"], out, self), True)
+			self.assertEqual( compareFiles(OUTDIR + "bundle.esl", OUTDIR + "bundle2.esl"), True) #same set of certificates, same ESL
+		self.assertEqual( getCmdResult(cmd + ["c:a", "-n", "db", "-i", bundleDir, "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-o", OUTDIR + "bundle.auth"], out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS ,"validate", OUTDIR + "bundle.auth"], out, self), True)
+		self.assertEqual( getCmdResult(cmd + ["c:h", "-i", OUTDIR + "bundle.pem", "-o", OUTDIR + "bundle.hash"], out, self), False) #a bundle has no single hash
+		#certificates that passed are remembered in the cache, the result is the same
+		cache = OUTDIR + "bundle.cache"
+		for i in range(2):
+			self.assertEqual( getCmdResult(cmd + ["c:e", "-v", "--cache", cache, "-n", "KEK", "-i", bundleDir, "-o", OUTDIR + "bundle2.esl"], out, self), True)
+			self.assertEqual( compareFiles(OUTDIR + "bundle.esl", OUTDIR + "bundle2.esl"), True)
+		with open(out) as f:
+			self.assertIn("validateCert found in verification cache", f.read())
+		self.assertEqual( getCmdResult(cmd + ["c:e", "-n", "KEK", "-i", bundleDir, "-o", OUTDIR + "bundle2.esl", "--cache"], out, self), False)
+		command(["cp", "./testdata/brokenFiles/rsa4096.crt", bundleDir], out)
+		self.assertEqual( getCmdResult(cmd + ["c:e", "-n", "KEK", "-i", bundleDir, "-o", OUTDIR + "bundle2.esl"], out, self), False) #KEK certificates must be RSA 2048
+		self.assertEqual( getCmdResult(cmd + ["c:e", "--cache", cache, "-n", "KEK", "-i", bundleDir, "-o", OUTDIR + "bundle2.esl"], out, self), False) #failures are not cached
+		self.assertEqual( getCmdResult(cmd + ["c:e", "-f", "-n", "KEK", "-i", bundleDir, "-o", OUTDIR + "bundle2.esl"], out, self), True) #unless validation is skipped
+		self.assertEqual( getCmdResult(cmd + ["c:e", "-j", "0", "-i", bundleDir, "-o", OUTDIR + "bundle2.esl"], out, self), False) #bad thread count
+		command(["rm", "-rf", bundleDir, OUTDIR + "bundle.pem", OUTDIR + "reversed.pem", OUTDIR + "bundle.esl", OUTDIR + "bundle2.esl", OUTDIR + "bundle.auth", OUTDIR + "single.esl", cache], out)
 	def test_genSignedFilesGen(self):
 		out = "genSignedFilesLog.txt"
 		auths = [] #array of[filename, key being updated, key signing]
@@ -355,6 +404,203 @@ class Test(unittest.TestCase):
 		#two files should be eqaul
 		self.assertEqual(compareFiles(expectedOutput, actualOutput), True)
 		
+	def test_genManifest(self):
+		out = "genManifestLog.txt"
+		sigCrt = "./testdata/goldenKeys/KEK/KEK.crt"
+		sigKey = "./testdata/goldenKeys/KEK/KEK.key"
+		manifest = OUTDIR + "updates.manifest"
+		digestManifest = OUTDIR + "updates.digests"
+		sigManifest = OUTDIR + "updates.sigs"
+		hexManifest = OUTDIR + "updates.hexsigs"
+		updates = [ #varName, timestamp, ESL, append
+			["db", "2020-1-1 1:1:1", "./testdata/db_by_KEK.esl", ""],
+			["db", "2020-1-1 1:1:2", "./testdata/db_by_PK.esl", "append"],
+			["dbx", "2020-1-1 1:1:3", "./testdata/dbx_by_KEK.esl", ""],
+		]
+		with open(manifest, "w") as f:
+			f.write("# updates signed by the KEK\n\n")
+			for i, u in enumerate(updates):
+				f.write(" ".join([u[0], u[1], u[2], OUTDIR + "manifest_" + str(i) + ".auth", u[3]]) + "\n")
+		#generate expected files one at a time
+		for i, u in enumerate(updates):
+			cmd = GEN + ["e:a", "-n", u[0], "-k", sigKey, "-c", sigCrt, "-i", u[2], "-o", OUTDIR + "exp_manifest_" + str(i) + ".auth", "-t"] + u[1].split()
+			if u[3]:
+				cmd += ["-a"]
+			self.assertEqual(getCmdResult(cmd, out, self), True)
+		#per update options and signatures do not belong with a manifest
+		self.assertEqual(getCmdResult(GEN + ["m:x", "-n", "db", "-i", manifest, "-o", digestManifest], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["m:x", "-i", manifest], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["m:e", "-i", manifest, "-o", digestManifest], out, self), False)
+		#one run gets every digest
+		self.assertEqual(getCmdResult(GEN + ["m:x", "-i", manifest, "-o", digestManifest], out, self), True)
+		with open(digestManifest) as f:
+			lines = [l.split() for l in f.read().splitlines()]
+		self.assertEqual(len(lines), len(updates))
+		#sign every digest externally
+		sigLines = []
+		hexLines = []
+		for i, l in enumerate(lines):
+			digestWHeader = OUTDIR + "manifest_" + str(i) + ".bin"
+			genSig = OUTDIR + "manifest_" + str(i) + ".sig"
+			with open(digestWHeader, "wb") as f:
+				f.write(bytes.fromhex("3031300D060960864801650304020105000420" + l[-1]))
+			command(["openssl", "rsautl", "-in", digestWHeader, "-sign", "-inkey", sigKey, "-pkcs", "-out", genSig])
+			sigLines.append(" ".join(l[:-1] + [genSig]))
+			with open(genSig, "rb") as f:
+				hexLines.append(" ".join(l[:-1] + [f.read().hex()]))
+		with open(sigManifest, "w") as f:
+			f.write("\n".join(sigLines) + "\n")
+		with open(hexManifest, "w") as f:
+			f.write("\n".join(hexLines) + "\n")
+		#every signature needs its certificate
+		self.assertEqual(getCmdResult(GEN + ["m:a", "-i", sigManifest], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["m:a", "-c", sigCrt, "-c", sigCrt, "-i", sigManifest], out, self), False)
+		#one run assembles every auth
+		self.assertEqual(getCmdResult(GEN + ["m:a", "-c", sigCrt, "-i", sigManifest], out, self), True)
+		for i in range(len(updates)):
+			self.assertEqual(compareFiles(OUTDIR + "exp_manifest_" + str(i) + ".auth", OUTDIR + "manifest_" + str(i) + ".auth"), True)
+		#signatures pasted in as hex where the digests were work the same
+		command(["rm"] + [OUTDIR + "manifest_" + str(i) + ".auth" for i in range(len(updates))])
+		self.assertEqual(getCmdResult(GEN + ["m:a", "-c", sigCrt, "-i", hexManifest], out, self), True)
+		for i in range(len(updates)):
+			self.assertEqual(compareFiles(OUTDIR + "exp_manifest_" + str(i) + ".auth", OUTDIR + "manifest_" + str(i) + ".auth"), True)
+		with open(hexManifest, "w") as f:
+			f.write(hexLines[0][:-1] + "\n")
+		self.assertEqual(getCmdResult(GEN + ["m:a", "-c", sigCrt, "-i", hexManifest], out, self), False)
+		#or signs every update with keys, lines then have no signatures
+		command(["rm"] + [OUTDIR + "manifest_" + str(i) + ".auth" for i in range(len(updates))])
+		self.assertEqual(getCmdResult(GEN + ["m:a", "-k", sigKey, "-c", sigCrt, "-i", sigManifest], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["m:x", "-k", sigKey, "-c", sigCrt, "-i", manifest, "-o", digestManifest], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["m:a", "-k", sigKey, "-c", sigCrt, "-i", manifest], out, self), True)
+		for i in range(len(updates)):
+			self.assertEqual(compareFiles(OUTDIR + "exp_manifest_" + str(i) + ".auth", OUTDIR + "manifest_" + str(i) + ".auth"), True)
+		#replaced files keep their permissions and no temporary file is left behind
+		os.chmod(OUTDIR + "manifest_0.auth", 0o600)
+		self.assertEqual(getCmdResult(GEN + ["m:a", "-k", sigKey, "-c", sigCrt, "-i", manifest], out, self), True)
+		self.assertEqual(os.stat(OUTDIR + "manifest_0.auth").st_mode & 0o777, 0o600)
+		self.assertEqual([f for f in os.listdir(OUTDIR) if f.startswith("manifest_") and ".auth." in f], [])
+		#outputs that are not regular files are written in place
+		self.assertEqual(getCmdResult(GEN + ["m:x", "-i", manifest, "-o", "/dev/null"], out, self), True)
+		self.assertEqual(getCmdResult(GEN + ["m:x", "-i", manifest, "-o", OUTDIR + "noSuchDir/updates.digests"], out, self), False)
+		#a symlink stays a link and the file it points to is replaced, next to it
+		linkDir = OUTDIR + "linked/"
+		command(["rm", "-rf", linkDir, OUTDIR + "link.digests"])
+		os.mkdir(linkDir)
+		command(["cp", OUTDIR + "manifest_0.auth", linkDir + "manifest_0.auth"])
+		os.symlink("linked/updates.digests", OUTDIR + "link.digests")
+		self.assertEqual(getCmdResult(GEN + ["m:x", "-i", manifest, "-o", OUTDIR + "link.digests"], out, self), True)
+		self.assertEqual(os.path.islink(OUTDIR + "link.digests"), True)
+		self.assertEqual(compareFiles(digestManifest, linkDir + "updates.digests"), True)
+		os.remove(OUTDIR + "manifest_0.auth")
+		os.symlink("linked/manifest_0.auth", OUTDIR + "manifest_0.auth")
+		self.assertEqual(getCmdResult(GEN + ["m:a", "-c", sigCrt, "-i", sigManifest], out, self), True)
+		self.assertEqual(os.path.islink(OUTDIR + "manifest_0.auth"), True)
+		self.assertEqual(compareFiles(OUTDIR + "exp_manifest_0.auth", linkDir + "manifest_0.auth"), True)
+		self.assertEqual([f for f in os.listdir(OUTDIR) if f.startswith("manifest_") and ".auth." in f], [])
+		command(["rm", "-rf", linkDir, OUTDIR + "link.digests", OUTDIR + "manifest_0.auth"])
+
+	def test_genMerge(self):
+		out = "genMergeLog.txt"
+		esl = "./testdata/db_by_KEK.esl"
+		timestamp = ["-t", "2030-1-1", "1:1:1"]
+		signers = ["KEK", "PK"]
+		for form in ["a", "p"]:
+			#every signer signs on its own with the same timestamp
+			parts = []
+			for s in signers:
+				parts.append(OUTDIR + "merge_" + s + "." + form)
+				self.assertEqual(getCmdResult(GEN + ["e:" + form, "-n", "db", "-k", "./testdata/goldenKeys/" + s + "/" + s + ".key", "-c", "./testdata/goldenKeys/" + s + "/" + s + ".crt", "-i", esl, "-o", parts[-1]] + timestamp, out, self), True)
+			#signers of one run are written last to first
+			expected = OUTDIR + "merge_exp." + form
+			cmd = GEN + ["e:" + form, "-n", "db", "-i", esl, "-o", expected] + timestamp
+			for s in reversed(signers):
+				cmd += ["-k", "./testdata/goldenKeys/" + s + "/" + s + ".key", "-c", "./testdata/goldenKeys/" + s + "/" + s + ".crt"]
+			self.assertEqual(getCmdResult(cmd, out, self), True)
+			merged = OUTDIR + "merged." + form
+			self.assertEqual(getCmdResult(GEN + ["merge", "-i", parts[0], "-i", parts[1], "-o", merged], out, self), True)
+			self.assertEqual(compareFiles(expected, merged), True)
+			#a signer that is given twice is kept once
+			self.assertEqual(getCmdResult(GEN + ["merge", "-i", parts[0], "-i", expected, "-o", merged], out, self), True)
+			self.assertEqual(compareFiles(expected, merged), True)
+		self.assertEqual(getCmdResult([SECTOOLS, "verify", "-p", "./testdata/goldenKeys/", "-u", "db", OUTDIR + "merged.a"], out, self), True)
+		#another timestamp or variable is another digest
+		other = OUTDIR + "merge_other.a"
+		self.assertEqual(getCmdResult(GEN + ["e:a", "-n", "db", "-k", "./testdata/goldenKeys/PK/PK.key", "-c", "./testdata/goldenKeys/PK/PK.crt", "-i", esl, "-o", other, "-t", "2030-1-1", "1:1:2"], out, self), True)
+		self.assertEqual(getCmdResult(GEN + ["merge", "-i", OUTDIR + "merge_KEK.a", "-i", other, "-o", OUTDIR + "foo.auth"], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["e:a", "-n", "KEK", "-k", "./testdata/goldenKeys/PK/PK.key", "-c", "./testdata/goldenKeys/PK/PK.crt", "-i", esl, "-o", other] + timestamp, out, self), True)
+		self.assertEqual(getCmdResult(GEN + ["merge", "-i", OUTDIR + "merge_KEK.a", "-i", other, "-o", OUTDIR + "foo.auth"], out, self), False)
+		#auths and PKCS7s do not mix, one file has nothing to merge with
+		self.assertEqual(getCmdResult(GEN + ["merge", "-i", OUTDIR + "merge_KEK.a", "-i", OUTDIR + "merge_PK.p", "-o", OUTDIR + "foo.auth"], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["merge", "-i", OUTDIR + "merge_KEK.a", "-o", OUTDIR + "foo.auth"], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["merge", "-i", OUTDIR + "merge_KEK.a", "-i", OUTDIR + "merge_PK.a", "-n", "db", "-o", OUTDIR + "foo.auth"], out, self), False)
+
+	def test_genStdio(self):
+		out = "genStdioLog.txt"
+		esl = "./testdata/db_by_KEK.esl"
+		signer = ["-n", "db", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-t", "2030-1-1", "1:1:1"]
+		expected = OUTDIR + "stdio_exp.auth"
+		self.assertEqual(getCmdResult(GEN + ["e:a", "-i", esl, "-o", expected] + signer, out, self), True)
+		#the data alone goes to stdout, everything printed goes to stderr
+		with open(esl, "rb") as f, open(out, "w") as log:
+			gen = subprocess.run(GEN + ["e:a", "-i", "-", "-o", "-"] + signer, stdin=f, stdout=subprocess.PIPE, stderr=log)
+		self.assertEqual(gen.returncode, 0)
+		with open(expected, "rb") as f:
+			self.assertEqual(gen.stdout, f.read())
+		#generate | validate and generate | write without a file on disk
+		with open(out, "w") as log:
+			self.assertEqual(subprocess.run([SECTOOLS, "validate", "-"], input=gen.stdout, stdout=log, stderr=log).returncode, 0)
+			self.assertNotEqual(subprocess.run([SECTOOLS, "validate", "-"], input=gen.stdout[:-1], stdout=log, stderr=log).returncode, 0)
+			self.assertNotEqual(subprocess.run([SECTOOLS, "validate", "-b", "-"], input=gen.stdout, stdout=log, stderr=log).returncode, 0)
+		env = OUTDIR + "stdioEnv/"
+		command(["cp", "-a", "./testdata/goldenKeys/.", env], out)
+		with open(out, "w") as log:
+			self.assertEqual(subprocess.run([SECTOOLS, "write", "-p", env, "db", "-"], input=gen.stdout, stdout=log, stderr=log).returncode, 0)
+		self.assertEqual(compareFiles(expected, env + "db/update"), True)
+		#read -f and validate -e take an ESL from stdin
+		for cmd in [["read", "-f", "-"], ["validate", "-e", "-"]]:
+			with open(esl, "rb") as f, open(out, "w") as log:
+				self.assertEqual(subprocess.run([SECTOOLS] + cmd, stdin=f, stdout=log, stderr=log).returncode, 0)
+		#'-' still needs to be a value, not a missing one
+		self.assertEqual(getCmdResult([SECTOOLS, "read", "-f"], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["e:a", "-i", esl, "-o"] + signer, out, self), False)
+
+	@unittest.skipUnless(SOFTHSM and shutil.which("softhsm2-util"), "SoftHSM is not installed")
+	def test_genPKCS11(self):
+		out = "genPKCS11Log.txt"
+		timestamp = ["-t", "2020-1-1","1:1:1"]
+		inpCrt = "./testdata/db_by_KEK.crt"
+		sigCrt = "./testdata/goldenKeys/KEK/KEK.crt"
+		sigKey = "./testdata/goldenKeys/KEK/KEK.key"
+		tokenDir = os.path.abspath(OUTDIR + "softhsm")
+		pk8Key = OUTDIR + "KEK.pk8"
+		expectedOutput = OUTDIR + "exp_pkcs11_db_by_KEK.auth"
+		actualOutput = OUTDIR + "pkcs11_db_by_KEK.auth"
+		uri = "pkcs11:token=secvar;object=KEK?module-path=" + SOFTHSM + "&pin-value=1234"
+		#SoftHSM keeps its tokens in a directory of its own
+		command(["rm", "-rf", tokenDir])
+		os.mkdir(tokenDir)
+		with open(tokenDir + ".conf", "w") as f:
+			f.write("directories.tokendir = " + tokenDir + "\n")
+		os.environ["SOFTHSM2_CONF"] = tokenDir + ".conf"
+		command(["softhsm2-util", "--init-token", "--free", "--label", "secvar", "--pin", "1234", "--so-pin", "4321"], out)
+		command(["openssl", "pkcs8", "-topk8", "-nocrypt", "-in", sigKey, "-out", pk8Key])
+		self.assertEqual(command(["softhsm2-util", "--import", pk8Key, "--token", "secvar", "--label", "KEK", "--id", "01", "--pin", "1234"], out), 0)
+		self.assertEqual(getCmdResult(GEN + ["c:a", "-n", "db", "-k", sigKey, "-c", sigCrt, "-i", inpCrt, "-o", expectedOutput] + timestamp, out, self), True)
+		result = getCmdResult(GEN + ["c:a", "-n", "db", "-k", uri, "-c", sigCrt, "-i", inpCrt, "-o", actualOutput] + timestamp, out, self)
+		with open(out) as f:
+			if "built without PKCS11" in f.read():
+				self.skipTest("secvarctl is built without PKCS11")
+		self.assertEqual(result, True)
+		#RSA PKCS#1 v1.5 signatures are deterministic, the token signs like the key file
+		self.assertEqual(compareFiles(expectedOutput, actualOutput), True)
+		#both signers use the one session of the key
+		self.assertEqual(getCmdResult(GEN + ["c:a", "-n", "db", "-k", uri, "-c", sigCrt, "-k", uri, "-c", sigCrt, "-i", inpCrt, "-o", actualOutput] + timestamp, out, self), True)
+		#wrong PIN, key label and certificate
+		self.assertEqual(getCmdResult(GEN + ["c:a", "-n", "db", "-k", uri.replace("1234", "0000"), "-c", sigCrt, "-i", inpCrt, "-o", actualOutput], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["c:a", "-n", "db", "-k", uri.replace("KEK", "PK"), "-c", sigCrt, "-i", inpCrt, "-o", actualOutput], out, self), False)
+		self.assertEqual(getCmdResult(GEN + ["c:a", "-n", "db", "-k", uri, "-c", "./testdata/goldenKeys/PK/PK.crt", "-i", inpCrt, "-o", actualOutput], out, self), False)
+		command(["rm", "-rf", tokenDir, tokenDir + ".conf"])
+
 	def test_genHash(self):
 		out = "genHashLog.txt"
 		inpDir = "./testdata/"
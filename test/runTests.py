@@ -40,6 +40,8 @@ readCommands=[
 	[["--usage"], True],[["--help"], True], #usage and help
 	[["-f", "./testenv/db/data", "-r"], True],#print raw data from file
 	[["-p", "./testenv/", "-r"], True], #print raw data from current vars
+	[["-p", "./testenv/", "--summary"], True], [["-p", "./testenv/", "--summary", "dbx"], True], #headers only
+	[["-f", "./testdata/db_by_PK.esl", "--summary"], True],
 
 	[["-p", "."], False],#bad path
 	[["-f", "./testdata/db_by_PK.auth"], False],#given authfile instead of esl
@@ -47,6 +49,8 @@ readCommands=[
 	[["-f"], False],#only -f no file
 	[["-f","-p","-f"], False], #idek but should fail
 	[["-f", "foo"], False], #fake file should fail
+	[["-p", "./testenv/", "--summary", "-r"], False], #summary has no raw output
+	[["-f", "./testdata/db_by_PK.auth", "--summary"], False], #not an esl
 
 
 ]
@@ -74,6 +78,7 @@ verifyCommands=[
 [["-c", "PK","./testenv/PK/data", "./testenv/KEK/data", "KEK", "-u", "db","./testdata/db_by_PK.auth"], False],#current vars bad format 
 [["-c", "PK", "KEK", "./testenv/PK/data", "./testenv/KEK/data", "-u", "db","./testdata/db_by_PK.auth"], False],#current vars bad format 
 [["-c", "PK", "./testenv/PK/data", "KEK", "-u", "db","./testdata/db_by_PK.auth"], False],#current vars bad format 
+[["-p", "./testenv/", "--cache", "-u", "db","./testdata/db_by_PK.auth"], False],#no cache file given
 
 
 
@@ -102,6 +107,84 @@ validateCommands=[
 [["-p"], False],#no pkcs7
 [["-p","./testdata/db_by_PK.auth"], False],#give auth as pkcs7
 ]
+auditCommands=[
+[["--usage"], True],[["--help"], True],
+[["./testfleet/"], True], #audit all hosts
+[["-j", "1", "./testfleet/"], True], #audit all hosts with one worker
+[["-v", "-j", "64", "./testfleet/"], True], #more workers than hosts
+[[], False], #no root directory
+[["-j", "./testfleet/"], False], #no thread count
+[["-j", "0", "./testfleet/"], False], #bad thread count
+[["./testfleetfoo/"], False], #nonexistent root directory
+]
+lookupCommands=[
+[["--usage"], True],[["--help"], True],
+[["-p", "./testenv/", "-h", "cce580028ea1d4f6dbee469d3fd1d145a41b89e5819fc12bd9622256f2752645"], True], #hash in dbx
+[["-b", "-p", "./testenv/", "-h", "/cc/e5/80/02/8e/a1/d4/f6/db/ee/46/9d/3f/d1/d1/45/a4/1b/89/e5/81/9f/c1/2b/d9/62/22/56/f2/75/26/45"], True], #hash as printed by read
+[["-p", "./testenv/", "-f", "./testdata/db_by_PK.crt"], True], #file not in dbx
+[["-e", "./testdata/dbx_by_PK.esl", "-f", "./testdata/db_by_PK.crt", "-h", "00"*64], True], #dbx from esl file
+[["-p", "./testenv/"], False], #nothing to look up
+[["-p", "./testenv/", "-h", "abcd"], False], #not a digest
+[["-p", "./testenv/", "-f", "thisDontExist.efi"], False], #nonexistent file
+[["-e", "thisDontExist.esl", "-h", "00"*32], False], #nonexistent dbx
+[["-p", "./testenv/", "-f"], False], #no file given
+]
+compactCommands=[
+[["--usage"], True],[["--help"], True],
+[["-p", "./testenv/", "-n", "dbx"], True], #report only
+[["-e", "./testdata/dbx_by_PK.esl", "-o", "compact.esl"], True], #compact esl file
+[["-p", "./testenv/", "-n", "db", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-o", "compact.auth"], True], #signed replacement
+[[], False], #nothing to compact
+[["-e", "./testdata/dbx_by_PK.esl", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-o", "compact.auth"], False], #signing needs a variable name
+[["-n", "db", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-o", "compact.auth"], False], #key without certificate
+[["-e", "./testdata/brokenFiles/1db_by_PK.auth"], False], #not an esl
+[["-e", "thisDontExist.esl"], False], #nonexistent file
+[["-n", "foo"], False], #bad variable name
+]
+diffCommands=[
+[["--usage"], True],[["--help"], True],
+[["-p", "./testenv/", "-p", "./testenv/"], True], #same keystore
+[["-v", "-e", "./testdata/db_by_PK.esl", "-e", "./testdata/db_by_KEK.esl"], True], #two esl files
+[["-n", "db", "-e", "./testdata/db_by_PK.esl", "-p", "./testenv/"], True], #esl file against a variable
+[["-p", "./testenv/"], False], #only one side
+[["-p", "./testenv/", "-p", "./testenv/", "-e", "./testdata/db_by_PK.esl"], False], #three sides
+[["-e", "./testdata/db_by_PK.esl", "-p", "./testenv/"], False], #esl file against path without variable
+[["-n", "TS", "-p", "./testenv/", "-p", "./testenv/"], False], #TS has no entries
+[["-e", "./testdata/db_by_PK.auth", "-e", "./testdata/db_by_PK.esl"], False], #not an esl
+[["-e", "thisDontExist.esl", "-e", "./testdata/db_by_PK.esl"], False], #nonexistent file
+]
+planCommands=[
+[["--usage"], True],[["--help"], True],
+[["-p", "./testenv/", "-d", "db", "./testenv/db/data", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-o", "planOut"], True], #already in desired state
+[["-p", "./testenv/", "-d", "KEK", "./testdata/KEK_by_PK.esl", "-k", "./testdata/goldenKeys/PK/PK.key", "-c", "./testdata/goldenKeys/PK/PK.crt", "-o", "planOut"], True], #replace KEK signed by PK
+[["-p", "./testenv/", "-d", "KEK", "./testdata/KEK_by_PK.esl", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-o", "planOut"], False], #KEK has no authority over KEK
+[["-p", "./testenv/", "-d", "db", "./testdata/db_by_PK.auth", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-o", "planOut"], False], #desired file is not an esl
+[["-p", "./testenv/", "-d", "TS", "./testdata/db_by_PK.esl", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-o", "planOut"], False], #TS can not be planned
+[["-p", "./testenv/", "-d", "db", "./testdata/db_by_PK.esl", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-o", "planOut"], False], #key without cert
+[["-p", "./testenv/", "-d", "db", "./testdata/db_by_PK.esl", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt"], False], #no output directory
+]
+catalogCommands=[
+[["--usage"], True],[["--help"], True],
+[["./testdata", "-o", "catalog.idx"], True], #skips files that are not auths of a known variable
+[["-i", "catalog.idx"], True],
+[["-i", "catalog.idx", "-n", "db", "-s", "./testdata/goldenKeys/KEK/KEK.crt"], True],
+[["-i", "catalog.idx", "-n", "TS"], False], #TS is never updated
+[["-i", "catalog.idx", "-n", "PK", "-s", "./testdata/goldenKeys/db/db.crt"], False], #no PK update signed by db
+[["./testdata", "-i", "catalog.idx"], False], #directory only when building
+[["./testdata"], False], #no index file
+[["-i", "./testdata/db_by_PK.auth"], False], #not an index
+[["./thisDontExist", "-o", "catalog.idx"], False],
+]
+fingerprintCommands=[
+[["--usage"], True],[["--help"], True],
+[["-p", "./testenv/"], True],
+[["-v", "-p", "./testenv/", "-x", "db", "./testdata/goldenKeys/db/db.crt"], True], #proof for a certificate
+[["-p", "./testenv/", "-x", "dbx", "cce580028ea1d4f6dbee469d3fd1d145a41b89e5819fc12bd9622256f2752645"], True], #proof for a hash
+[["-p", "./testenv/", "-x", "db", "./testdata/goldenKeys/KEK/KEK.crt"], False], #not in the db
+[["-p", "./testenv/", "-x", "TS", "00"], False], #TS has no entries
+[["-p", "./testenv/", "-x", "dbx", "notAHash"], False], #neither a digest nor a file
+[["-p", "./thisDontExist/"], False], #no variables
+]
 toeslCommands=[
 [["-i", "-o", "out.esl"], False],#no input file
 [["-i", "./testdata/db_by_PK.auth", "-o"], False],#no output file
@@ -189,6 +272,13 @@ def setupArrays():
 			brokenAuths.append("./testdata/brokenFiles/"+file)
 		elif file.endswith(".pkcs7"):
 			brokenPkcs7s.append("./testdata/brokenFiles/"+file)
+def setupTestFleet(hosts):
+	out="log.txt"
+	command(["rm", "-rf", "testfleet"], out)
+	for host in hosts:
+		for var in ["PK", "KEK", "db", "dbx"]:
+			command(["mkdir", "-p", "testfleet/"+host+"/"+var], out)
+			command(["cp", "./testdata/"+var+"_by_PK.esl", "testfleet/"+host+"/"+var+"/data"], out)
 def compareFiles(a,b):
 		if filecmp.cmp(a,b):
 			return True
@@ -224,6 +314,52 @@ class Test(unittest.TestCase):
 			self.assertEqual( getCmdResult(cmd+[ "-p", "testenv/","-u",fileInfo[1],file],out, self), False)#verify all bad auths are not signed correctly
 		for i in verifyCommands:
 			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		command(["rm", "-f", "verify.cache"], out)
+		for fileInfo in goodAuths:
+			file="./testdata/"+fileInfo[0]
+			for j in range(2): #second run is answered from the cache
+				self.assertEqual( getCmdResult(cmd+[ "--cache", "verify.cache", "-p", "testenv/","-u",fileInfo[1],file],out, self), True)
+		for fileInfo in badAuths:
+			file="./testdata/"+fileInfo[0]
+			self.assertEqual( getCmdResult(cmd+[ "--cache", "verify.cache", "-p", "testenv/","-u",fileInfo[1],file],out, self), False)#failures are never cached
+		command(["rm", "-f", "verify.cache"], out)
+		for fileInfo in goodAuths:
+			file="./testdata/"+fileInfo[0]
+			self.assertEqual( getCmdResult(cmd+[ "-j", "4", "-p", "testenv/","-u",fileInfo[1],file],out, self), True)#signer/certificate pairs checked on threads
+		for fileInfo in badAuths:
+			file="./testdata/"+fileInfo[0]
+			self.assertEqual( getCmdResult(cmd+[ "-j", "4", "-p", "testenv/","-u",fileInfo[1],file],out, self), False)
+		dual=[SECTOOLS, "generate", "e:a", "-n", "db", "-i", "./testdata/db_by_KEK.esl", "-k", "./testdata/goldenKeys/db/db.key", "-c", "./testdata/goldenKeys/db/db.crt"]
+		command(dual+["-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-o", "dual.auth"], out)
+		command(dual+["-k", "./testdata/goldenKeys/dbx/dbx.key", "-c", "./testdata/goldenKeys/dbx/dbx.crt", "-o", "dualBad.auth"], out)
+		for j in [[], ["-j", "2"], ["-j", "2", "-v"]]:
+			self.assertEqual( getCmdResult(cmd+j+[ "-p", "testenv/","-u", "db", "dual.auth"],out, self), True)#second signer is in the KEK
+			self.assertEqual( getCmdResult(cmd+j+[ "-p", "testenv/","-u", "db", "dualBad.auth"],out, self), False)#neither signer is in the KEK
+		self.assertEqual( getCmdResult(cmd+[ "-j", "0", "-p", "testenv/","-u", "db", "dual.auth"],out, self), False)#bad thread count
+		command(["rm", "-f", "dual.auth", "dualBad.auth"], out)
+		#the keystore does the verifying, a corrupt embedded signing certificate gives the same result at every log level
+		with open("./testdata/db_by_KEK.auth", "rb") as f:
+			auth = bytearray(f.read())
+		sha256WithRSA = bytes.fromhex("06092A864886F70D01010B")
+		auth[auth.index(sha256WithRSA) + len(sha256WithRSA) - 1] = 0x7F #unknown signature algorithm in the signer's certificate
+		with open("badCert.auth", "wb") as f:
+			f.write(auth)
+		self.assertEqual( getCmdResult([SECTOOLS, "validate", "badCert.auth"],out, self), False)
+		command(["rm", "-f", "verify.cache"], out)
+		for j in [[], ["-v"], ["--cache", "verify.cache"], ["--cache", "verify.cache", "-v"]]:
+			self.assertEqual( getCmdResult(cmd+j+[ "-p", "testenv/","-u", "db", "badCert.auth"],out, self), True)
+		command(["rm", "-f", "badCert.auth", "verify.cache"], out)
+		gen=[SECTOOLS, "generate", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-n", "dbx"]
+		command([SECTOOLS, "generate", "f:e", "-h", "SHA256", "-i", "./testdata/db_by_PK.crt", "-o", "append.esl"], out)
+		command(["sh", "-c", "cat ./testenv/dbx/data append.esl > both.esl"], out)
+		self.assertEqual( getCmdResult(gen+["e:a", "-a", "--base", "./testenv/dbx/data", "-i", "both.esl", "-o", "append.auth"],out, self), True)#only the new hash is signed
+		self.assertEqual( getCmdResult(gen+["e:a", "-a", "--base", "./testenv/dbx/data", "-i", "./testenv/dbx/data", "-o", "none.auth"],out, self), False)#nothing new to append
+		self.assertEqual( getCmdResult(gen+["reset", "-a", "-o", "none.auth"],out, self), False)#reset can not be appended
+		self.assertEqual( getCmdResult(cmd+["-a", "-p", "testenv/", "-u", "dbx", "append.auth"],out, self), True)
+		self.assertEqual( getCmdResult(cmd+["-p", "testenv/", "-u", "dbx", "append.auth"],out, self), False)#signature covers the append attribute
+		self.assertEqual( getCmdResult(cmd+["-a", "-w", "-p", "testenv/", "-u", "dbx", "append.auth"],out, self), False)#appends can not be written to update files
+		self.assertEqual( getCmdResult(cmd+["-a", "-p", "testenv/", "-u", "PK", "./testdata/PK_by_PK.auth"],out, self), False)#PK can not be appended to
+		command(["rm", "-f", "append.esl", "both.esl", "append.auth", "none.auth"], out)
 	def test_validate(self):
 		out="validatelog.txt"
 		cmd=[SECTOOLS, "validate"]
@@ -254,6 +390,34 @@ class Test(unittest.TestCase):
 			self.assertEqual( getCmdResult(cmd+["-v", "-c", i],out, self), False)
 		for i in brokenPkcs7s:
 			self.assertEqual( getCmdResult(cmd+["-v", "-p", i],out, self), False)
+	def test_parallelESL(self):
+		out="parallelESLlog.txt"
+		#ESLs with good lists, a broken list in the middle and a truncated last list
+		files={"big.esl":["db_by_PK.esl","KEK_by_PK.esl","db_by_KEK.esl","PK_by_PK.esl","db_by_PK.esl","KEK_by_PK.esl"]}
+		files["badMid.esl"]=files["big.esl"][:2]+["bad_db_by_db.esl"]+files["big.esl"][2:]
+		files["badTail.esl"]=files["big.esl"]+["brokenFiles/4db_by_PK.esl"]
+		for name in files:
+			command(["sh", "-c", "cat "+' '.join(["./testdata/"+i for i in files[name]])+" > "+name], out)
+		#output is the same for any number of threads
+		for name in files:
+			for args in [["validate","-v","-e"],["validate","-e"]]:
+				results=[]
+				for j in [[],["-j","1"],["-j","2"],["-j","8"]]:
+					result=subprocess.run([SECTOOLS]+args+j+[name], capture_output=True)
+					results.append([result.returncode, result.stdout, result.stderr])
+				for i in results[1:]:
+					self.assertEqual(results[0], i)
+		self.assertEqual( getCmdResult([SECTOOLS,"validate","-j","4","-e","big.esl"],out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS,"validate","-j","0","-e","big.esl"],out, self), False)
+		self.assertEqual( getCmdResult([SECTOOLS,"validate","-e","big.esl","-j"],out, self), False)
+		#lists are printed in the order they are in
+		whole=subprocess.run([SECTOOLS,"read","-f","big.esl"], capture_output=True).stdout.decode()
+		parts=""
+		for i in files["big.esl"]:
+			parts+=subprocess.run([SECTOOLS,"read","-f","./testdata/"+i], capture_output=True).stdout.decode()
+		strip=lambda s: [l for l in s.splitlines() if l.startswith("\t") and "Found" not in l]
+		self.assertEqual(strip(whole), strip(parts))
+		command(["rm", "-f"]+list(files), out)
 	def test_read(self):
 		out="readlog.txt"
 		cmd=[SECTOOLS, "read"]
@@ -266,6 +430,15 @@ class Test(unittest.TestCase):
 							self.assertEqual( getCmdResult(cmd+["-f", i],out, self), True) 
 			else:
 				self.assertEqual( getCmdResult(cmd+["-f", i],out, self), False) #all truncated esls should fail to print human readable info
+		#the update file is as large as a variable may get
+		command(["sh", "-c", "cat ./testdata/db_by_PK.esl ./testdata/KEK_by_PK.esl ./testdata/db_by_PK.esl > ./testenv/db/data && echo 2571 > ./testenv/db/size && truncate -s 4096 ./testenv/db/update"], out)
+		self.assertEqual( getCmdResult(cmd+["-p", "./testenv/", "--summary", "db"],out, self), True)
+		with open(out) as f:
+			log=f.read()
+		self.assertIn("Size: 2571 bytes, 1525 bytes free", log)
+		self.assertIn("Entries: 3 in 3 ESL's", log)
+		self.assertIn("TOTAL: 3 entries, 2571 bytes in 1 variables, 1525 bytes free", log)
+		setupTestEnv()
 	def test_write(self):
 		out="writelog.txt"
 		cmd=[SECTOOLS,"write"]
@@ -282,6 +455,47 @@ class Test(unittest.TestCase):
 			self.assertEqual( getCmdResult(cmd+["-p", path, "KEK",i],out, self), False)#broken auths should fail
 			self.assertEqual( getCmdResult(cmd+["-p", path ,"-f", "KEK",i],out, self), True)#if forced, they should work
 			self.assertEqual(compareFiles(i,path+"KEK/update"), True)
+	def test_updateBundle(self):
+		out="bundlelog.txt"
+		gen=[SECTOOLS, "generate", "bundle", "-o"]
+		path="./testenv/"
+		chain=[["db", "./testdata/db_by_PK.auth"], ["KEK", "./testdata/KEK_by_PK.auth"], ["PK", "./testdata/PK_by_PK.auth"]]
+		updates=[j for i in chain for j in i]
+		self.assertEqual( getCmdResult(gen+["rotation.bundle", "-u"]+updates,out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "validate", "-b", "rotation.bundle"],out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-p", path, "-b", "rotation.bundle"],out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-w", "-p", path, "-b", "rotation.bundle"],out, self), True)
+		for i in chain:
+			self.assertEqual(compareFiles(i[1], path+i[0]+"/update"), True)
+		command(["rm", "-f", path+"db/update", path+"KEK/update", path+"PK/update"], out)
+		command(["touch", path+"db/update", path+"KEK/update", path+"PK/update"], out)
+		self.assertEqual( getCmdResult([SECTOOLS, "write", "-p", path, "-b", "rotation.bundle"],out, self), True)
+		for i in chain:
+			self.assertEqual(compareFiles(i[1], path+i[0]+"/update"), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-p", path, "-b", "rotation.bundle", "-u"]+chain[0],out, self), False)#either -b or -u
+		self.assertEqual( getCmdResult([SECTOOLS, "write", "-p", path, "-b", "rotation.bundle"]+chain[0],out, self), False)
+		self.assertEqual( getCmdResult(gen+["reordered.bundle", "-u"]+updates[2:]+updates[:2],out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-p", path, "-b", "reordered.bundle"],out, self), False)#db is no longer signed by the PK
+		self.assertEqual( getCmdResult(gen+["append.bundle", "-a", "-u"]+chain[0],out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-w", "-p", path, "-b", "append.bundle"],out, self), False)#appends can not be submitted
+		self.assertEqual( getCmdResult([SECTOOLS, "write", "-p", path, "-b", "append.bundle"],out, self), False)
+		self.assertEqual( getCmdResult(gen+["broken.bundle", "-u", "KEK", brokenAuths[0]],out, self), False)#auths are validated
+		self.assertEqual( getCmdResult(gen+["broken.bundle", "-f", "-u", "db", "./testdata/db_by_PK.auth", "KEK", brokenAuths[0]],out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "validate", "-b", "broken.bundle"],out, self), False)
+		command(["cp", "./testdata/db_by_PK.auth", path+"db/update"], out)
+		self.assertEqual( getCmdResult([SECTOOLS, "write", "-p", path, "-b", "broken.bundle"],out, self), False)
+		self.assertEqual(compareFiles("./testdata/db_by_PK.auth", path+"db/update"), True)#nothing written if one update is invalid
+		self.assertEqual( getCmdResult([SECTOOLS, "write", "-f", "-p", path, "-b", "broken.bundle"],out, self), True)
+		self.assertEqual(compareFiles(brokenAuths[0], path+"KEK/update"), True)
+		self.assertEqual( getCmdResult(gen+["ts.bundle", "-u", "TS", "./testdata/db_by_PK.auth"],out, self), False)#TS can not be updated
+		self.assertEqual( getCmdResult(gen+["odd.bundle", "-u", "db"],out, self), False)
+		self.assertEqual( getCmdResult(gen+["odd.bundle", "-k", "./testdata/goldenKeys/KEK/KEK.key", "-u"]+chain[0],out, self), False)#nothing is signed
+		command(["sh", "-c", "head -c 200 rotation.bundle > truncated.bundle"], out)
+		for i in ["truncated.bundle", "./testdata/db_by_PK.auth", "thisDontExist.bundle"]:
+			self.assertEqual( getCmdResult([SECTOOLS, "validate", "-b", i],out, self), False)
+			self.assertEqual( getCmdResult([SECTOOLS, "verify", "-p", path, "-b", i],out, self), False)
+			self.assertEqual( getCmdResult([SECTOOLS, "write", "-p", path, "-b", i],out, self), False)
+		command(["rm", "-f", "rotation.bundle", "reordered.bundle", "append.bundle", "broken.bundle", "truncated.bundle"], out)
 	def test_authtoesl(self):
 		out="authtoesllog.txt"
 		cmd=[SECTOOLS,"generate", "a:e"]
@@ -304,6 +518,132 @@ class Test(unittest.TestCase):
 			postUpdate="testGenerated.esl" 
 			self.assertEqual( getCmdResult(cmd+["-i", i, "-o", postUpdate],out, self), False) #all broken auths should fail to have correct esl
 			self.assertEqual( getCmdResult(["rm",postUpdate],out, self), False) #removal of output file should fail since it was never made
+	def test_audit(self):
+		out="auditlog.txt"
+		cmd=[SECTOOLS,"audit"]
+		setupTestFleet(["host"+str(i) for i in range(8)])
+		for i in auditCommands:
+			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		command(["rm", "testfleet/host3/PK/data"], out)
+		self.assertEqual( getCmdResult(cmd+["./testfleet/"],out, self), True) #host without PK is in setup mode
+		command(["cp", brokenESLs[0], "testfleet/host5/db/data"], out)
+		self.assertEqual( getCmdResult(cmd+["./testfleet/"],out, self), False) #host with broken db is invalid
+		command(["rm", "-rf", "testfleet"], out)
+	def test_lookup(self):
+		out="lookuplog.txt"
+		cmd=[SECTOOLS,"lookup"]
+		for i in lookupCommands:
+			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		command([SECTOOLS, "generate", "f:e", "-h", "SHA512", "-i", "./testdata/db_by_PK.crt", "-o", "lookup.esl"], out)
+		self.assertEqual( getCmdResult(cmd+["-b", "-e", "lookup.esl", "-f", "./testdata/db_by_PK.crt"],out, self), True)
+		with open(out) as f:
+			self.assertIn("REVOKED (SHA512)", f.read()) #hash of file was added to dbx
+		command(["rm", "lookup.esl"], out)
+	def test_compact(self):
+		out="compactlog.txt"
+		cmd=[SECTOOLS,"compact"]
+		for i in compactCommands:
+			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		command(["sh", "-c", "cat ./testenv/dbx/data ./testdata/dbx_by_PK.esl ./testenv/dbx/data ./testdata/dbx_by_KEK.esl > dup.esl"], out)
+		self.assertEqual( getCmdResult(cmd+["-e", "dup.esl", "-o", "compact.esl"],out, self), True)
+		with open(out) as f:
+			log = f.read()
+		self.assertIn("(1 duplicates removed)", log)
+		self.assertIn("Signature lists: 4 -> 1", log)
+		self.assertEqual( getCmdResult([SECTOOLS, "validate", "-x", "-e", "compact.esl"],out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-p", "./testenv/", "-u", "db", "compact.auth"],out, self), True)
+		#certificates of the same size keep their own lists, so the second one can still sign
+		command(["sh", "-c", SECTOOLS + " generate c:e -i ./testdata/goldenKeys/db/db.crt -o dbCert.esl && cat ./testenv/KEK/data dbCert.esl > twoKEK.esl"], out)
+		self.assertEqual( getCmdResult(cmd+["-e", "twoKEK.esl", "-o", "compact.esl"],out, self), True)
+		with open(out) as f:
+			self.assertIn("Signature lists: 2 -> 2", f.read())
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-c", "PK", "./testenv/PK/data", "KEK", "compact.esl", "-u", "db", "./testdata/bad_db_by_db.auth"],out, self), True)
+		command(["rm", "-f", "dup.esl", "compact.esl", "compact.auth", "dbCert.esl", "twoKEK.esl"], out)
+	def test_diff(self):
+		out="difflog.txt"
+		cmd=[SECTOOLS,"diff"]
+		for i in diffCommands:
+			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		command(["sh", "-c", "cat ./testenv/dbx/data ./testdata/dbx_by_PK.esl ./testenv/dbx/data > dup.esl"], out)
+		self.assertEqual( getCmdResult(cmd+["-n", "dbx", "-p", "./testenv/", "-e", "dup.esl"],out, self), True)
+		with open(out) as f:
+			self.assertIn("dbx: 1 added, 0 removed, 1 unchanged", f.read()) #duplicates and list layout do not matter
+		self.assertEqual( getCmdResult(cmd+["-e", "dup.esl", "-e", "./testdata/dbx_by_PK.esl"],out, self), True)
+		with open(out) as f:
+			self.assertIn("ESL: 0 added, 1 removed, 1 unchanged", f.read())
+		#a variable that was never enrolled has no entries, it is not a failure
+		command(["rm", "-rf", "noDbx"], out)
+		command(["cp", "-r", "./testenv/", "noDbx"], out)
+		command(["rm", "-r", "noDbx/dbx"], out)
+		self.assertEqual( getCmdResult(cmd+["-p", "noDbx/", "-p", "./testenv/"],out, self), True)
+		with open(out) as f:
+			log = f.read()
+		self.assertIn("dbx: 1 added, 0 removed, 0 unchanged", log)
+		self.assertIn("db: 0 added, 0 removed, 1 unchanged", log)
+		self.assertEqual( getCmdResult(cmd+["-n", "dbx", "-p", "./testenv/", "-p", "noDbx/"],out, self), True)
+		with open(out) as f:
+			self.assertIn("dbx: 0 added, 1 removed, 0 unchanged", f.read())
+		command(["chmod", "000", "noDbx/KEK/data"], out)
+		if not os.access("noDbx/KEK/data", os.R_OK): #root can still read it
+			self.assertEqual( getCmdResult(cmd+["-n", "KEK", "-p", "noDbx/", "-p", "./testenv/"],out, self), False) #unreadable is not missing
+		command(["rm", "-rf", "dup.esl", "noDbx"], out)
+	def test_plan(self):
+		out="planlog.txt"
+		cmd=[SECTOOLS,"plan"]
+		for i in planCommands:
+			command(["rm", "-rf", "planOut"], out)
+			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		command(["sh", "-c", "cat ./testenv/db/data ./testdata/db_by_KEK.esl > desired_db.esl"], out)
+		command(["rm", "-rf", "planOut"], out)
+		signers=["-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-k", "./testdata/goldenKeys/PK/PK.key", "-c", "./testdata/goldenKeys/PK/PK.crt"]
+		self.assertEqual( getCmdResult(cmd+["-p", "./testenv/", "-d", "db", "desired_db.esl", "-d", "KEK", "./testdata/KEK_by_PK.esl", "-o", "planOut"]+signers,out, self), True)
+		with open(out) as f:
+			log=f.read()
+		self.assertIn("1: db append", log) #db is signed by the old KEK before it is replaced
+		self.assertIn("2: KEK replace", log)
+		self.assertIn("Dry run: every update verified", log)
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-a", "-p", "./testenv/", "-u", "db", "planOut/1_db.auth"],out, self), True)
+		command(["rm", "-rf", "planOut", "desired_db.esl"], out)
+	def test_catalog(self):
+		out="cataloglog.txt"
+		cmd=[SECTOOLS,"catalog"]
+		for i in catalogCommands:
+			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		#the newest update is picked unless it does not verify against the current variables
+		command(["mkdir", "-p", "catalogRepo/db"], out)
+		command(["cp", "./testdata/db_by_PK.auth", "./testdata/db_by_KEK.auth", "./testdata/bad_db_by_db.auth", "catalogRepo/db/"], out)
+		command(["cp", "./testdata/dbx_by_KEK.auth", "catalogRepo/"], out)
+		self.assertEqual( getCmdResult(cmd+["catalogRepo", "-o", "catalog.idx"],out, self), True)
+		self.assertEqual( getCmdResult(cmd+["-i", "catalog.idx", "-n", "db"],out, self), True)
+		with open(out) as f:
+			self.assertIn("db: 2020-10-16T15:08:12 catalogRepo/db/bad_db_by_db.auth", f.read())
+		self.assertEqual( getCmdResult(cmd+["-i", "catalog.idx", "-p", "./testenv/"],out, self), True)
+		with open(out) as f:
+			log=f.read()
+		self.assertIn("db: 2020-10-16T15:08:08 catalogRepo/db/db_by_KEK.auth", log)
+		self.assertIn("dbx: 2020-10-16T15:08:15 catalogRepo/dbx_by_KEK.auth", log)
+		self.assertIn("PK: no applicable update", log)
+		#only the signer given is picked
+		self.assertEqual( getCmdResult(cmd+["-i", "catalog.idx", "-n", "db", "-s", "./testdata/goldenKeys/PK/PK.crt"],out, self), True)
+		with open(out) as f:
+			self.assertIn("db: 2020-10-16T15:08:07 catalogRepo/db/db_by_PK.auth", f.read())
+		command(["rm", "-rf", "catalogRepo", "catalog.idx"], out)
+	def test_fingerprint(self):
+		out="fingerprintlog.txt"
+		cmd=[SECTOOLS,"fingerprint"]
+		for i in fingerprintCommands:
+			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		self.assertEqual( getCmdResult(cmd+["-p", "./testenv/"],out, self), True)
+		with open(out) as f:
+			before=[l for l in f.read().splitlines() if "root" in l or ":" in l and "entries" in l]
+		#duplicated entries and the list layout do not change the fingerprint
+		command(["sh", "-c", "cat ./testenv/dbx/data ./testenv/dbx/data > dup.esl && cp dup.esl ./testenv/dbx/data && printf %d `wc -c < dup.esl` > ./testenv/dbx/size"], out)
+		self.assertEqual( getCmdResult(cmd+["-p", "./testenv/"],out, self), True)
+		with open(out) as f:
+			after=[l for l in f.read().splitlines() if "root" in l or ":" in l and "entries" in l]
+		self.assertEqual(before, after)
+		command(["rm", "-f", "dup.esl"], out)
+		setupTestEnv()
 	def test_badenv(self):
 		out="badEnvLog.txt"
 		for i in badEnvCommands: